@@ -4,6 +4,11 @@ import qt
 import slicer
 import numpy as np
 import logging
+import json
+import shutil
+import struct
+import time
+import zlib
 from slicer.ScriptedLoadableModule import ScriptedLoadableModule, ScriptedLoadableModuleWidget, ScriptedLoadableModuleLogic, ScriptedLoadableModuleTest
 
 # PinholeCameraCalibration
@@ -12,7 +17,7 @@ class PinholeCameraCalibration(ScriptedLoadableModule):
     ScriptedLoadableModule.__init__(self, parent)
     self.parent.title = "PinholeCamera Calibration"
     self.parent.categories = ["Computer Vision"]
-    self.parent.dependencies = ["PinholeCameras", "PointToLineRegistration", "Annotations"]
+    self.parent.dependencies = ["PinholeCameras", "Annotations"]
     self.parent.contributors = ["Adam Rankin (Robarts Research Institute)"]
     self.parent.helpText = """This module utilizes OpenCV camera calibration functions to perform intrinsic calibration and calibration to an external tracker using a tracked, calibrated stylus. """ + self.getDefaultModuleDocumentationLink()
     self.parent.acknowledgementText = """This module was developed with support from the Natural Sciences and Engineering Research Council of Canada, the Canadian Foundation for Innovation, and the Virtual Augmentation and Simulation for Surgery and Therapy laboratory, Western University."""
@@ -95,6 +100,7 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
       logging.warning("Aruco python interface not available.")
 
     self.logic = PinholeCameraCalibrationLogic()
+    self.camerasLogic = slicer.modules.pinholecameras.logic()
     self.markupsLogic = slicer.modules.markups.logic()
 
     self.canSelectFiducials = True
@@ -131,6 +137,9 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     # Observer tags
     self.stylusTipTransformObserverTag = None
     self.pointModifiedObserverTag = None
+    # (object, tag) of the observations of the camera node and its storage node, to follow where the camera is saved
+    self.videoCameraStorageObservations = []
+    self.calibrationObservationsAddedObserverTag = None
 
     # Inputs
     self.imageSelector = None
@@ -156,6 +165,9 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
 
     # Intrinsics
     self.capIntrinsicButton = None
+    self.liveCaptureButton = None
+    self.liveCaptureTimer = None
+    self.liveCalibrationError = None
     self.intrinsicCheckerboardButton = None
     self.intrinsicCircleGridButton = None
     self.intrinsicArucoButton = None
@@ -172,6 +184,18 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     self.arucoDictComboBox = None
     self.arucoDictContainer = None
     self.calibrateButton = None
+    self.resolveButton = None
+    self.analyzeResidualsButton = None
+    self.viewResidualsTableNode = None
+    self.residualHistogramTableNode = None
+
+    # Tracker latency
+    self.latencyVideoSequenceSelector = None
+    self.latencyTransformSequenceSelector = None
+    self.maximumLatencySpinBox = None
+    self.estimateLatencyButton = None
+    self.latencyResultLabel = None
+    self.latencyTimer = None
 
     self.columnsSpinBox = None
     self.rowsSpinBox = None
@@ -235,6 +259,7 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
 
       # Intrinsic calibration members
       self.capIntrinsicButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_CaptureIntrinsic")
+      self.liveCaptureButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_LiveCapture")
       self.resetButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_Reset")
       self.intrinsicCheckerboardButton = PinholeCameraCalibrationWidget.get(self.widget, "radioButton_IntrinsicCheckerboard")
       self.intrinsicCircleGridButton = PinholeCameraCalibrationWidget.get(self.widget, "radioButton_IntrinsicCircleGrid")
@@ -260,6 +285,15 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
       self.charucoSquareSizeSpinBox = PinholeCameraCalibrationWidget.get(self.widget, "doubleSpinBox_charucoSquareSize")
       self.charucoMarkerSizeSpinBox = PinholeCameraCalibrationWidget.get(self.widget, "doubleSpinBox_charucoMarkerSize")
       self.calibrateButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_Calibrate")
+      self.resolveButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_Resolve")
+      self.analyzeResidualsButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_AnalyzeResiduals")
+
+      # Tracker latency members
+      self.latencyVideoSequenceSelector = PinholeCameraCalibrationWidget.get(self.widget, "comboBox_LatencyVideoSequence")
+      self.latencyTransformSequenceSelector = PinholeCameraCalibrationWidget.get(self.widget, "comboBox_LatencyTransformSequence")
+      self.maximumLatencySpinBox = PinholeCameraCalibrationWidget.get(self.widget, "doubleSpinBox_MaximumLatency")
+      self.estimateLatencyButton = PinholeCameraCalibrationWidget.get(self.widget, "pushButton_EstimateLatency")
+      self.latencyResultLabel = PinholeCameraCalibrationWidget.get(self.widget, "label_LatencyResult")
 
       # Results
       self.labelResult = PinholeCameraCalibrationWidget.get(self.widget, "label_ResultValue")
@@ -273,13 +307,17 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
       self.videoCameraIntrinWidget.setMRMLScene(slicer.mrmlScene)
       self.imageSelector.setMRMLScene(slicer.mrmlScene)
       self.stylusTipTransformSelector.setMRMLScene(slicer.mrmlScene)
+      self.latencyVideoSequenceSelector.setMRMLScene(slicer.mrmlScene)
+      self.latencyTransformSequenceSelector.setMRMLScene(slicer.mrmlScene)
 
       # Inputs
+      self.videoCameraSelector.connect("currentNodeChanged(vtkMRMLNode*)", self.onVideoCameraSelected)
       self.imageSelector.connect("currentNodeChanged(vtkMRMLNode*)", self.onImageSelected)
       self.stylusTipTransformSelector.connect("currentNodeChanged(vtkMRMLNode*)", self.onStylusTipTransformSelected)
 
       # Connections
       self.capIntrinsicButton.connect('clicked(bool)', self.onIntrinsicCapture)
+      self.liveCaptureButton.connect('toggled(bool)', self.onLiveCaptureToggled)
       self.resetButton.connect('clicked(bool)', self.onReset)
       self.intrinsicCheckerboardButton.connect('clicked(bool)', self.onIntrinsicModeChanged)
       self.intrinsicCircleGridButton.connect('clicked(bool)', self.onIntrinsicModeChanged)
@@ -294,6 +332,15 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
       self.captureCountSpinBox.connect('valueChanged(int)', self.onCaptureCountChanged)
       self.arucoDictComboBox.connect('currentIndexChanged(int)', self.onArucoDictChanged)
       self.calibrateButton.connect('clicked(bool)', self.onCalibrateButtonClicked)
+      self.liveCaptureTimer = qt.QTimer()
+      self.liveCaptureTimer.setInterval(100)
+      self.liveCaptureTimer.connect('timeout()', self.onLiveCaptureTimeout)
+      self.resolveButton.connect('clicked(bool)', self.onResolveButtonClicked)
+      self.analyzeResidualsButton.connect('clicked(bool)', self.onAnalyzeResidualsButtonClicked)
+      self.estimateLatencyButton.connect('clicked(bool)', self.onEstimateLatency)
+      self.latencyTimer = qt.QTimer()
+      self.latencyTimer.setInterval(200)
+      self.latencyTimer.connect('timeout()', self.onLatencyTimeout)
 
       self.manualButton.connect('clicked(bool)', self.onManualButton)
       self.semiAutoButton.connect('clicked(bool)', self.onSemiAutoButton)
@@ -329,14 +376,20 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
       self.onIntrinsicModeChanged()
 
       # Refresh Apply button state
+      self.onVideoCameraSelected()
       self.updateUI()
       self.onProcessingModeChanged()
 
   def cleanup(self):
+    self.liveCaptureButton.checked = False
+    self.latencyTimer.stop()
+    self.camerasLogic.StopTrackerLatencyEstimation()
     self.onReset()
     self.onResetPtL()
 
     self.capIntrinsicButton.disconnect('clicked(bool)', self.onIntrinsicCapture)
+    self.liveCaptureButton.disconnect('toggled(bool)', self.onLiveCaptureToggled)
+    self.liveCaptureTimer.disconnect('timeout()', self.onLiveCaptureTimeout)
     self.intrinsicCheckerboardButton.disconnect('clicked(bool)', self.onIntrinsicModeChanged)
     self.intrinsicCircleGridButton.disconnect('clicked(bool)', self.onIntrinsicModeChanged)
     self.intrinsicArucoButton.disconnect('clicked(bool)', self.onIntrinsicModeChanged)
@@ -350,7 +403,13 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     self.captureCountSpinBox.disconnect('valueChanged(int)', self.onCaptureCountChanged)
     self.arucoDictComboBox.disconnect('currentIndexChanged(int)', self.onArucoDictChanged)
     self.calibrateButton.disconnect('clicked(bool)', self.onCalibrateButtonClicked)
+    self.resolveButton.disconnect('clicked(bool)', self.onResolveButtonClicked)
+    self.analyzeResidualsButton.disconnect('clicked(bool)', self.onAnalyzeResidualsButtonClicked)
+    self.estimateLatencyButton.disconnect('clicked(bool)', self.onEstimateLatency)
+    self.latencyTimer.disconnect('timeout()', self.onLatencyTimeout)
 
+    self.videoCameraSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.onVideoCameraSelected)
+    self.removeVideoCameraStorageObservations()
     self.imageSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.onImageSelected)
     self.stylusTipTransformSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.updateUI)
 
@@ -372,6 +431,8 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
 
   def onReset(self):
     self.logic.resetIntrinsic()
+    self.camerasLogic.ResetCalibration()
+    self.liveCalibrationError = None
     self.labelResult.text = "Reset."
     self.videoCameraIntrinWidget.GetCurrentNode().SetAndObserveIntrinsicMatrix(vtk.vtkMatrix3x3().Identity())
     self.videoCameraIntrinWidget.GetCurrentNode().SetNumberOfDistortionCoefficients(5)
@@ -441,6 +502,7 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     self.onIntrinsicModeChanged()
 
   def onIntrinsicCapture(self):
+    self.attachSessionArchive()
     vtk_im = self.imageSelector.currentNode().GetImageData()
     rows, cols, _ = vtk_im.GetDimensions()
     components = vtk_im.GetNumberOfScalarComponents()
@@ -480,6 +542,111 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     else:
       self.labelResult.text = "Failure."
 
+  def onLiveCaptureToggled(self, checked):
+    if not checked:
+      self.liveCaptureTimer.stop()
+      # Stopping processes the last results, archive them before removing the observer
+      self.camerasLogic.StopCalibrationCapture()
+      self.removeCalibrationObservationsAddedObserver()
+      self.onLiveCaptureTimeout()
+      return
+
+    if not self.setCamerasLogicPattern():
+      self.labelResult.text = "Live capture supports checkerboard and circle grid patterns only."
+      self.liveCaptureButton.checked = False
+      return
+
+    # Results are processed on each new frame too, not only on the timer, so views are archived as the logic adds them
+    self.attachSessionArchive()
+    self.removeCalibrationObservationsAddedObserver()
+    self.calibrationObservationsAddedObserverTag = self.camerasLogic.AddObserver(slicer.vtkSlicerPinholeCamerasLogic.CalibrationObservationsAddedEvent,
+                                                                                 self.onCalibrationObservationsAdded)
+    if not self.camerasLogic.StartCalibrationCapture(self.imageSelector.currentNode(), self.invertImage):
+      self.removeCalibrationObservationsAddedObserver()
+      self.labelResult.text = "Unable to start live capture."
+      self.liveCaptureButton.checked = False
+      return
+    self.liveCaptureTimer.start()
+
+  def removeCalibrationObservationsAddedObserver(self):
+    if self.calibrationObservationsAddedObserverTag is not None:
+      self.camerasLogic.RemoveObserver(self.calibrationObservationsAddedObserverTag)
+      self.calibrationObservationsAddedObserverTag = None
+
+  def onCalibrationObservationsAdded(self, caller, event):
+    imageData = self.imageSelector.currentNode().GetImageData() if self.imageSelector.currentNode() is not None else None
+    if imageData is None:
+      return
+    self.attachSessionArchive()
+    self.logic.archiveNativeObservations(self.camerasLogic, imageData.GetDimensions()[:2])
+
+  def setCamerasLogicPattern(self):
+    # Native detection handles checkerboards and circle grids only
+    if self.intrinsicCheckerboardButton.checked:
+      patternType = slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternCheckerboard
+    elif self.intrinsicCircleGridButton.checked:
+      if self.asymmetricButton.checked:
+        patternType = slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternAsymmetricCircleGrid
+      else:
+        patternType = slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternCircleGrid
+    else:
+      return False
+
+    self.camerasLogic.SetCalibrationPattern(patternType, self.rowsSpinBox.value, self.columnsSpinBox.value, self.squareSizeDoubleSpinBox.value)
+    self.camerasLogic.SetCalibrationDetectionFlags(self.logic.flags)
+    self.camerasLogic.SetCalibrationSubPixelRadius(self.logic.subPixRadius)
+    return True
+
+  def onEstimateLatency(self):
+    if self.camerasLogic.IsTrackerLatencyEstimationActive():
+      # Cancel button hit
+      self.latencyTimer.stop()
+      self.camerasLogic.StopTrackerLatencyEstimation()
+      self.latencyResultLabel.text = "Cancelled."
+      self.estimateLatencyButton.text = "Estimate"
+      return
+
+    if self.videoCameraSelector.currentNode() is None or self.latencyVideoSequenceSelector.currentNode() is None \
+       or self.latencyTransformSequenceSelector.currentNode() is None:
+      self.latencyResultLabel.text = "Select a camera, a video sequence and a tracker sequence."
+      return
+    if not self.setCamerasLogicPattern():
+      self.latencyResultLabel.text = "Latency estimation supports checkerboard and circle grid patterns only."
+      return
+
+    if not self.camerasLogic.StartTrackerLatencyEstimation(self.videoCameraSelector.currentNode(), self.latencyVideoSequenceSelector.currentNode(),
+                                                           self.latencyTransformSequenceSelector.currentNode(), self.maximumLatencySpinBox.value, self.invertImage):
+      self.latencyResultLabel.text = "Unable to start the estimation, see the error log."
+      return
+    self.latencyResultLabel.text = "Estimating..."
+    self.estimateLatencyButton.text = "Cancel"
+    self.latencyTimer.start()
+
+  def onLatencyTimeout(self):
+    if not self.camerasLogic.ProcessTrackerLatencyEstimationResult():
+      return
+    self.latencyTimer.stop()
+    self.estimateLatencyButton.text = "Estimate"
+    if self.camerasLogic.GetTrackerLatencyEstimationSucceeded():
+      self.latencyResultLabel.text = "Latency: %.1f ms (correlation %.2f, pattern in %d frames)" % (1000.0 * self.camerasLogic.GetEstimatedTrackerLatency(),
+        self.camerasLogic.GetTrackerLatencyCorrelation(), self.camerasLogic.GetNumberOfTrackerLatencyFrames())
+    else:
+      self.latencyResultLabel.text = "Failure: " + self.camerasLogic.GetTrackerLatencyEstimationError()
+
+  def onLiveCaptureTimeout(self):
+    added = self.camerasLogic.ProcessCalibrationCaptureResults()
+    self.labelPointsCollected.text = self.camerasLogic.GetNumberOfCalibrationPoints()
+    if added > 0:
+      # Poses of the new views only, the intrinsics are refined when Calibrate is clicked
+      error = self.camerasLogic.EstimateCalibrationError()
+      if error >= 0:
+        self.liveCalibrationError = error
+    self.labelResult.text = "Live: " + str(self.camerasLogic.GetNumberOfDetectedFrames()) + " detected in " + \
+      str(self.camerasLogic.GetNumberOfCapturedFrames()) + " frames, " + str(self.camerasLogic.GetNumberOfDroppedFrames()) + " dropped, " + \
+      str(self.camerasLogic.GetNumberOfCalibrationObservations()) + " kept."
+    if self.liveCalibrationError is not None:
+      self.labelResult.text += " Reprojection error: " + str(self.liveCalibrationError) + "."
+
   def onIntrinsicModeChanged(self):
     if self.intrinsicCheckerboardButton.checked:
       self.checkerboardContainer.enabled = True
@@ -536,15 +703,131 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
     self.updateUI()
 
   def onCalibrateButtonClicked(self):
+    if self.camerasLogic.GetNumberOfCalibrationObservations() > 0:
+      # Frames collected by the live capture are solved natively
+      error = self.camerasLogic.CalibratePinholeCamera(self.videoCameraIntrinWidget.GetCurrentNode())
+      if error < 0:
+        self.labelResult.text = "Calibration failed."
+        return
+      self.labelResult.text = "Calibration reprojection error: " + str(error) + "."
+      self.attachSessionArchive()
+      if self.logic.sessionArchiveStarted:
+        self.labelResult.text += " Observations saved to " + os.path.basename(self.logic.sessionArchiveFileName) + "."
+      return
+
     done, error, mtx, dist = self.logic.calibratePinholeCamera()
     if done:
-      self.videoCameraIntrinWidget.GetCurrentNode().SetAndObserveIntrinsicMatrix(mtx)
-      self.videoCameraIntrinWidget.GetCurrentNode().SetNumberOfDistortionCoefficients(dist.GetNumberOfValues())
-      for i in range(0, dist.GetNumberOfValues()):
-        self.videoCameraIntrinWidget.GetCurrentNode().SetDistortionCoefficientValue(i, dist.GetValue(i))
-      self.videoCameraIntrinWidget.GetCurrentNode().SetReprojectionError(error)
+      self.applyCalibration(error, mtx, dist)
       self.labelResult.text = "Calibration reprojection error: " + str(error) + "."
 
+      # Frames were archived as they were captured, the archive moves next to the camera file once there is one
+      self.attachSessionArchive()
+      if self.logic.sessionArchiveStarted:
+        self.labelResult.text += " Observations saved to " + os.path.basename(self.logic.sessionArchiveFileName) + "."
+
+  def onResolveButtonClicked(self):
+    archiveFileName = self.getObservationArchiveFileName()
+    if archiveFileName is None or not os.path.isfile(archiveFileName):
+      # Archive of the current session, not yet attached to a camera file
+      archiveFileName = self.logic.sessionArchiveFileName if self.logic.sessionArchiveStarted else None
+    if archiveFileName is None or not os.path.isfile(archiveFileName):
+      archiveFileName = qt.QFileDialog.getOpenFileName(self.widget, "Open observation archive", "", "Observation archive (*" + PinholeCameraCalibrationLogic.ARCHIVE_EXTENSION + ")")
+      if not archiveFileName:
+        return
+
+    result = self.logic.recalibrateFromObservations(archiveFileName)
+    if not result:
+      self.labelResult.text = "Unable to calibrate from " + os.path.basename(archiveFileName) + "."
+      return
+
+    done, error, mtx, dist = result
+    self.applyCalibration(error, mtx, dist)
+    self.labelResult.text = "Re-solved from " + str(self.logic.countIntrinsics()) + " saved frames, reprojection error: " + str(error) + "."
+
+  def onAnalyzeResidualsButtonClicked(self):
+    node = self.videoCameraIntrinWidget.GetCurrentNode()
+    analysis = slicer.vtkPinholeCameraResidualAnalysis()
+    solverErrors = None
+    if self.camerasLogic.GetNumberOfCalibrationObservations() > 0:
+      done = self.camerasLogic.AnalyzeCalibrationResiduals(analysis)
+    else:
+      done = node is not None and self.logic.analyzeResiduals(analysis, node)
+      solverErrors = self.logic.perViewErrors
+    if not done:
+      self.labelResult.text = "Calibrate first to analyze the residuals."
+      return
+
+    self.viewResidualsTableNode = self.updateResidualsTableNode(self.viewResidualsTableNode, "CalibrationViewResiduals", analysis.GetViewTable())
+    if solverErrors is not None and len(solverErrors) == analysis.GetNumberOfViews():
+      # Errors reported by the solver, they differ from RMSError if the camera node keeps fewer distortion coefficients
+      solverErrorColumn = vtk.util.numpy_support.numpy_to_vtk(np.asarray(solverErrors, np.float64), deep=True)
+      solverErrorColumn.SetName("SolverRMSError")
+      self.viewResidualsTableNode.GetTable().AddColumn(solverErrorColumn)
+    self.residualHistogramTableNode = self.updateResidualsTableNode(self.residualHistogramTableNode, "CalibrationResidualHistogram", analysis.GetHistogramTable())
+    slicer.app.applicationLogic().GetSelectionNode().SetActiveTableID(self.viewResidualsTableNode.GetID())
+    slicer.app.applicationLogic().PropagateTableSelection()
+
+    views = vtk.vtkIntArray()
+    analysis.GetViewsSortedByError(views)
+    viewErrors = analysis.GetViewTable().GetColumnByName("RMSError")
+    worstViews = [views.GetValue(i) for i in range(min(5, views.GetNumberOfValues()))]
+    self.labelResult.text = "RMS error " + "%.3f" % analysis.GetRMSError() + " px over " + str(analysis.GetNumberOfViews()) + " views, worst views: " + \
+      ", ".join(str(view) + " (" + "%.3f" % viewErrors.GetValue(view) + " px)" for view in worstViews) + "."
+
+  def updateResidualsTableNode(self, tableNode, name, table):
+    if tableNode is None or slicer.mrmlScene.GetNodeByID(tableNode.GetID()) is None:
+      tableNode = slicer.vtkMRMLTableNode()
+      tableNode.SetName(slicer.mrmlScene.GenerateUniqueName(name))
+      slicer.mrmlScene.AddNode(tableNode)
+    copy = vtk.vtkTable()
+    copy.DeepCopy(table)
+    tableNode.SetAndObserveTable(copy)
+    return tableNode
+
+  def applyCalibration(self, error, mtx, dist):
+    node = self.videoCameraIntrinWidget.GetCurrentNode()
+    wasModifying = node.StartModify()
+    node.SetAndObserveIntrinsicMatrix(mtx)
+    node.SetDistortionCoefficientValues(dist)
+    node.SetReprojectionError(error)
+    node.EndModify(wasModifying)
+
+  def getObservationArchiveFileName(self):
+    node = self.videoCameraIntrinWidget.GetCurrentNode()
+    if node is None or node.GetStorageNode() is None or not node.GetStorageNode().GetFileName():
+      return None
+    return PinholeCameraCalibrationLogic.observationArchiveFileName(node.GetStorageNode().GetFileName())
+
+  def attachSessionArchive(self):
+    # Until the camera has a file, the session archive stays where the logic started it
+    archiveFileName = self.getObservationArchiveFileName()
+    if archiveFileName is not None:
+      self.logic.setSessionArchiveFileName(archiveFileName)
+
+  def removeVideoCameraStorageObservations(self):
+    for observed, tag in self.videoCameraStorageObservations:
+      observed.RemoveObserver(tag)
+    self.videoCameraStorageObservations = []
+
+  def onVideoCameraSelected(self, node=None):
+    # Saving the camera the first time adds its storage node, saving it elsewhere changes the storage node file name
+    self.removeVideoCameraStorageObservations()
+    node = self.videoCameraIntrinWidget.GetCurrentNode()
+    if node is not None:
+      for event in (slicer.vtkMRMLNode.ReferenceAddedEvent, slicer.vtkMRMLNode.ReferenceModifiedEvent):
+        self.videoCameraStorageObservations.append((node, node.AddObserver(event, self.onVideoCameraStorageModified)))
+      if node.GetStorageNode() is not None:
+        storageNode = node.GetStorageNode()
+        self.videoCameraStorageObservations.append((storageNode, storageNode.AddObserver(vtk.vtkCommand.ModifiedEvent, self.onVideoCameraStorageModified)))
+    self.attachSessionArchive()
+
+  def onVideoCameraStorageModified(self, caller, event):
+    if caller.IsA('vtkMRMLStorageNode'):
+      self.attachSessionArchive()
+    else:
+      # The storage node may have been replaced, observe the new one
+      self.onVideoCameraSelected()
+
   @vtk.calldata_type(vtk.VTK_OBJECT)
   def onStylusTipTransformModified(self, caller, event):
     mat = vtk.vtkMatrix4x4()
@@ -685,20 +968,14 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
             logging.debug("x: " + str(combination[0]))
             logging.debug("origin: " + str(combination[1]))
             logging.debug("dir: " + str(combination[2]))
+          logging.debug("residuals: " + str(self.logic.getResidualsMarkerToSensor()))
 
-          trans = vtk.vtkTransform()
-          trans.PostMultiply()
-          trans.Identity()
-          trans.Concatenate(self.stylusTipToPinholeCamera)
-          trans.Concatenate(videoCameraToImage)
-
-          posePosition = trans.GetPosition()
-
-          xPrime = posePosition[0] / posePosition[2]
-          yPrime = posePosition[1] / posePosition[2]
-
-          u = (mtx[0, 0] * xPrime) + mtx[0, 2]
-          v = (mtx[1, 1] * yPrime) + mtx[1, 2]
+          # Project the stylus tip (in camera marker coordinates) through the newly registered camera
+          tipPoints = vtk.vtkPoints()
+          tipPoints.InsertNextPoint(tip_cam)
+          pixels = vtk.vtkDoubleArray()
+          self.videoCameraSelector.currentNode().ProjectPoints(tipPoints, None, pixels)
+          u, v = pixels.GetTuple2(0)
 
           logging.debug("undistorted point: " + str(undistPoint[0, 0, 0]) + "," + str(undistPoint[0, 0, 1]))
           logging.debug("u,v: " + str(u) + "," + str(v))
@@ -719,7 +996,7 @@ class PinholeCameraCalibrationWidget(ScriptedLoadableModuleWidget):
 
       string = "Registration complete. Error: " + str(self.logic.getErrorMarkerToSensor())
     else:
-      string = "Registration failed."
+      string = "Registration failed (" + self.logic.getStatusMarkerToSensor() + ")."
 
     return result, markerToSensor, string
 
@@ -757,28 +1034,49 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
 
     self.flags = 0
     self.imageSize = (0,0)
+    self.objPatternType = ''
     self.objPatternRows = 0
     self.objPatternColumns = 0
     self.objSize = 0
+    self.objParam2 = 0
+    self.arucoDictName = ''
     self.subPixRadius = 5
     self.objPattern = None
     self.terminationCriteria = (cv2.TERM_CRITERIA_EPS + cv2.TERM_CRITERIA_MAX_ITER, 30, 0.1)
 
-    self.pointToLineRegistrationLogic = slicer.vtkSlicerPointToLineRegistrationLogic()
-    self.pointToLineRegistrationLogic.SetLandmarkRegistrationModeToRigidBody()
+    # Last calibration, the starting point of the next one
+    self.cameraMatrix = None
+    self.distCoeffs = None
+    # Board poses and RMS reprojection error of each view of the last calibration
+    self.rotationVectors = None
+    self.translationVectors = None
+    self.perViewErrors = None
+    self.calibrationCriteria = (cv2.TERM_CRITERIA_EPS + cv2.TERM_CRITERIA_COUNT, 100, 1e-6)
+
+    # Keeps running sums of the point/line pairs, and starts each solve from the last marker to sensor transform
+    self.pointToLineRegistration = slicer.vtkPinholeCameraPointToLineRegistration()
+
+    # Observation archive of the capture session, each detected frame is appended to it as it is captured
+    self.sessionArchiveFileName = None
+    self.sessionArchiveStarted = False
 
   def setTerminationCriteria(self, criteria):
     self.terminationCriteria = criteria
 
   def calculateObjectPattern(self, rows, columns, type, param1, param2):
+    self.objPatternType = type
     self.objPatternRows = rows
     self.objPatternColumns = columns
     self.objSize = param1
+    self.objParam2 = param2
     pattern_size = (self.objPatternColumns, self.objPatternRows)
     self.objPattern = np.zeros((np.prod(pattern_size), 3), np.float32)
     self.objPattern[:, :2] = np.indices(pattern_size).T.reshape(-1, 2)
     self.objPattern *= param1
     self.createBoard(type, param1, param2)
+    # Frames of another pattern go to a new archive
+    self.sessionArchiveFileName = None
+    self.sessionArchiveStarted = False
 
   def createBoard(self, type, param1_mm, param2_mm):
     if self.arucoDict is not None:
@@ -809,6 +1107,13 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
     self.arucoCount = []
     self.charucoCorners = []
     self.charucoIDs = []
+    self.cameraMatrix = None
+    self.distCoeffs = None
+    self.rotationVectors = None
+    self.translationVectors = None
+    self.perViewErrors = None
+    self.sessionArchiveFileName = None
+    self.sessionArchiveStarted = False
 
   def setFlags(self, flags):
     self.flags = flags
@@ -831,6 +1136,7 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
       self.objectPoints.append(self.objPattern)
       corners2 = cv2.cornerSubPix(gray, corners, (self.subPixRadius, self.subPixRadius), (-1, -1), self.terminationCriteria)
       self.imagePoints.append(corners.reshape(-1,2))
+      self.archivePoints(self.objPattern, corners)
 
     return ret
 
@@ -849,13 +1155,15 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
     if ret:
       self.objectPoints.append(self.objPattern)
       self.imagePoints.append(centers)
+      self.archivePoints(self.objPattern, centers)
       string = "Success (" + str(self.logic.countIntrinsics()) + ")"
       done, result, error, mtx, dist = self.logic.calibratePinholeCamera()
       if done:
-        self.videoCameraIntrinWidget.GetCurrentNode().SetAndObserveIntrinsicMatrix(mtx)
-        self.videoCameraIntrinWidget.GetCurrentNode().SetNumberOfDistortionCoefficients(dist.GetNumberOfValues())
-        for i in range(0, dist.GetNumberOfValues()):
-          self.videoCameraIntrinWidget.GetCurrentNode().SetDistortionCoefficientValue(i, dist.GetValue(i))
+        node = self.videoCameraIntrinWidget.GetCurrentNode()
+        wasModifying = node.StartModify()
+        node.SetAndObserveIntrinsicMatrix(mtx)
+        node.SetDistortionCoefficientValues(dist)
+        node.EndModify(wasModifying)
         string += ". Calibration reprojection error: " + str(error)
       self.labelResult.text = string
     else:
@@ -918,11 +1226,31 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
       if res[1] is not None and res[2] is not None and len(res[1]) > 3:
         self.charucoCorners.append(res[1])
         self.charucoIDs.append(res[2])
+        self.archiveCharuco(res[1], res[2])
     return (res is not None)
 
+  def getInitialIntrinsics(self):
+    # Refine the previous solution when there is one, it is close to the optimum after adding a few views
+    if self.cameraMatrix is not None:
+      return self.cameraMatrix.copy(), self.distCoeffs.copy(), cv2.CALIB_USE_INTRINSIC_GUESS
+    cameraMatrixInit = np.array([[2000., 0., self.imageSize[0] / 2.],
+                                 [0., 2000., self.imageSize[1] / 2.],
+                                 [0., 0., 1.]])
+    return cameraMatrixInit, np.zeros((5, 1)), 0
+
   def calibratePinholeCamera(self):
     if len(self.imagePoints) > 0:
-      ret, mtx, dist, rvecs, tvecs = cv2.calibrateCamera(self.objectPoints, self.imagePoints, self.imageSize, None, None)
+      cameraMatrixInit, distCoeffsInit, flags = self.getInitialIntrinsics()
+      if flags == 0:
+        cameraMatrixInit = None
+        distCoeffsInit = None
+      ret, mtx, dist, rvecs, tvecs = cv2.calibrateCamera(self.objectPoints, self.imagePoints, self.imageSize, cameraMatrixInit, distCoeffsInit,
+                                                         flags=flags, criteria=self.calibrationCriteria)
+      self.cameraMatrix = mtx
+      self.distCoeffs = dist
+      self.rotationVectors = rvecs
+      self.translationVectors = tvecs
+      self.perViewErrors = None
       mat = vtk.vtkMatrix3x3()
       for i in range(0, 3):
         for j in range(0, 3):
@@ -933,11 +1261,7 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
 
       return True, ret, mat, pts
     if len(self.arucoCorners) > 0:
-      cameraMatrixInit = np.array([[2000., 0., self.imageSize[0] / 2.],
-                                   [0., 2000., self.imageSize[1] / 2.],
-                                   [0., 0., 1.]])
-
-      distCoeffsInit = np.zeros((5, 1))
+      cameraMatrixInit, distCoeffsInit, _ = self.getInitialIntrinsics()
       flags = (cv2.CALIB_USE_INTRINSIC_GUESS + cv2.CALIB_RATIONAL_MODEL)
       ret, mtx, dist, rvecs, tvecs = aruco.calibrateCameraCharucoExtended(charucoCorners=self.arucoCorners,
             charucoIds=self.arucoIDs,
@@ -946,7 +1270,11 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
             cameraMatrix=cameraMatrixInit,
             distCoeffs=distCoeffsInit,
             flags=flags,
-            criteria=(cv2.TERM_CRITERIA_EPS & cv2.TERM_CRITERIA_COUNT, 10000, 1e-9))
+            criteria=self.calibrationCriteria)
+      # Residuals of these views are not analyzed, their corners are not matched to board points
+      self.rotationVectors = None
+      self.translationVectors = None
+      self.perViewErrors = None
 
       mat = vtk.vtkMatrix3x3()
       for i in range(0, 3):
@@ -958,11 +1286,7 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
 
       return True, ret, mat, pts
     if len(self.charucoCorners) > 0:
-      cameraMatrixInit = np.array([[2000., 0., self.imageSize[0] / 2.],
-                                   [0., 2000., self.imageSize[1] / 2.],
-                                   [0., 0., 1.]])
-
-      distCoeffsInit = np.zeros((5, 1))
+      cameraMatrixInit, distCoeffsInit, _ = self.getInitialIntrinsics()
       flags = (cv2.CALIB_USE_INTRINSIC_GUESS + cv2.CALIB_RATIONAL_MODEL)
       (ret, camera_matrix, distortion_coefficients0,
        rotation_vectors, translation_vectors,
@@ -975,7 +1299,12 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
         cameraMatrix=cameraMatrixInit,
         distCoeffs=distCoeffsInit,
         flags=flags,
-        criteria=(cv2.TERM_CRITERIA_EPS & cv2.TERM_CRITERIA_COUNT, 10000, 1e-9))
+        criteria=self.calibrationCriteria)
+      self.cameraMatrix = camera_matrix
+      self.distCoeffs = distortion_coefficients0
+      self.rotationVectors = rotation_vectors
+      self.translationVectors = translation_vectors
+      self.perViewErrors = perViewErrors.flatten()
 
       mat = vtk.vtkMatrix3x3()
       for i in range(0, 3):
@@ -988,35 +1317,754 @@ class PinholeCameraCalibrationLogic(ScriptedLoadableModuleLogic):
       return True, ret, mat, pts
     return False
 
+  def analyzeResiduals(self, analysis, cameraNode):
+    """Compute the reprojection residuals of the views of the last calibration with the parameters of cameraNode.
+    analysis is a vtkPinholeCameraResidualAnalysis, its views are replaced. Return False if there is nothing to analyze.
+    """
+    if self.rotationVectors is None or not analysis.SetCamera(cameraNode):
+      return False
+    if len(self.imagePoints) > 0:
+      objectPoints = self.objectPoints
+      imagePoints = self.imagePoints
+    elif len(self.charucoCorners) > 0:
+      boardCorners = np.asarray(self.arucoBoard.chessboardCorners)
+      objectPoints = [boardCorners[ids.flatten()] for ids in self.charucoIDs]
+      imagePoints = self.charucoCorners
+    else:
+      return False
+
+    analysis.RemoveAllViews()
+    analysis.SetImageSize(self.imageSize[0], self.imageSize[1])
+    for viewObjectPoints, viewImagePoints, rvec, tvec in zip(objectPoints, imagePoints, self.rotationVectors, self.translationVectors):
+      points = vtk.vtkPoints()
+      points.SetData(vtk.util.numpy_support.numpy_to_vtk(np.reshape(viewObjectPoints, (-1, 3)).astype(np.float64), deep=True))
+      pixels = vtk.util.numpy_support.numpy_to_vtk(np.reshape(viewImagePoints, (-1, 2)).astype(np.float64), deep=True)
+      rotation, _ = cv2.Rodrigues(rvec)
+      translation = np.ravel(tvec)
+      patternToCamera = vtk.vtkMatrix4x4()
+      for i in range(0, 3):
+        for j in range(0, 3):
+          patternToCamera.SetElement(i, j, rotation[i, j])
+        patternToCamera.SetElement(i, 3, translation[i])
+      analysis.AddView(points, pixels, patternToCamera)
+    return analysis.Update()
+
   def countIntrinsics(self):
     return max(len(self.imagePoints), len(self.arucoCorners), len(self.charucoCorners))
 
   def addPointLinePair(self, point, lineOrigin, lineDirection):
-    self.pointToLineRegistrationLogic.AddPointAndLine(point, lineOrigin, lineDirection)
+    self.pointToLineRegistration.AddPointAndLine(np.ravel(point).tolist(), np.ravel(lineOrigin).tolist(), np.ravel(lineDirection).tolist())
 
   def calculateMarkerToSensor(self):
-    mat = self.pointToLineRegistrationLogic.CalculateRegistration()
-    eye = vtk.vtkMatrix4x4()
-    eye.Identity()
-    for i in range(0, 4):
-      for j in range(0, 4):
-        if mat.GetElement(i,j) != eye.GetElement(i,j):
-          return True, mat
-    return False, mat
+    result = self.pointToLineRegistration.Update()
+    if not result:
+      logging.warning("Marker to sensor registration did not converge: " + self.getStatusMarkerToSensor())
+    # Callers observe the returned matrix, give them their own copy
+    mat = vtk.vtkMatrix4x4()
+    mat.DeepCopy(self.pointToLineRegistration.GetTransform())
+    return result, mat
 
   def resetMarkerToSensor(self):
-    self.pointToLineRegistrationLogic.Reset()
+    self.pointToLineRegistration.Reset()
 
   def countMarkerToSensor(self):
-    return self.pointToLineRegistrationLogic.GetCount()
+    return self.pointToLineRegistration.GetNumberOfPairs()
 
   def getErrorMarkerToSensor(self):
-    return self.pointToLineRegistrationLogic.GetError()
+    return self.pointToLineRegistration.GetError()
+
+  def getStatusMarkerToSensor(self):
+    return slicer.vtkPinholeCameraPointToLineRegistration.GetStatusAsString(self.pointToLineRegistration.GetStatus())
+
+  def getResidualsMarkerToSensor(self):
+    residuals = vtk.vtkDoubleArray()
+    self.pointToLineRegistration.GetResiduals(residuals)
+    return [residuals.GetValue(i) for i in range(residuals.GetNumberOfTuples())]
 
   def changeArucoDict(self, newDictName):
     for attr in dir(cv2.aruco):
       if attr.find(newDictName) != -1 and isinstance(getattr(cv2.aruco, attr), int):
         self.arucoDict = cv2.aruco.getPredefinedDictionary(getattr(cv2.aruco, attr))
+        self.arucoDictName = newDictName
+
+  # Observation archive
+  #  Detected corners are kept in a chunked binary file next to the camera file so that the calibration can be
+  #  solved again (e.g. with other flags) without capturing and detecting every frame again.
+  #  A capture session appends one chunk per detected frame, so an interrupted session keeps its frames. Until the
+  #  camera has a file the archive is written to the temporary directory, it is moved next to the camera file later.
+  #  Layout, little endian: magic "PHCO", uint32 version, then chunks of (4 byte tag, uint32 payload size,
+  #  uint32 CRC-32 of the payload, payload). Readers skip chunks with unknown tags.
+  #   HEAD: pattern type, rows, columns, pattern parameters, image size and aruco dictionary name
+  #   PNTS: one frame of object points (float32 x,y,z) and image points (float32 x,y)
+  #   CHAR: one frame of charuco corners (float32 x,y) and ids (int32)
+  ARCHIVE_MAGIC = b'PHCO'
+  ARCHIVE_VERSION = 1
+  ARCHIVE_EXTENSION = '.pco'
+  ARCHIVE_CHUNK_HEADER = struct.Struct('<4sII')
+  ARCHIVE_HEAD = struct.Struct('<16sIIddII32s')
+
+  @staticmethod
+  def observationArchiveFileName(cameraFileName):
+    base, ext = os.path.splitext(cameraFileName)
+    if os.path.splitext(base)[1].lower() == '.rig':
+      base = os.path.splitext(base)[0]
+    return base + PinholeCameraCalibrationLogic.ARCHIVE_EXTENSION
+
+  @staticmethod
+  def defaultSessionArchiveFileName():
+    return os.path.join(slicer.app.temporaryPath, 'PinholeCameraCalibration-' + time.strftime('%Y%m%d-%H%M%S') +
+                        PinholeCameraCalibrationLogic.ARCHIVE_EXTENSION)
+
+  @staticmethod
+  def writeArchiveChunk(file, tag, payload):
+    file.write(PinholeCameraCalibrationLogic.ARCHIVE_CHUNK_HEADER.pack(tag, len(payload), zlib.crc32(payload) & 0xffffffff))
+    file.write(payload)
+
+  def writeArchiveHeader(self, file):
+    file.write(self.ARCHIVE_MAGIC + struct.pack('<I', self.ARCHIVE_VERSION))
+    head = self.ARCHIVE_HEAD.pack(self.objPatternType.encode('utf-8')[:16], self.objPatternRows, self.objPatternColumns,
+                                  self.objSize, self.objParam2, int(self.imageSize[0]), int(self.imageSize[1]),
+                                  self.arucoDictName.encode('utf-8')[:32])
+    self.writeArchiveChunk(file, b'HEAD', head)
+
+  @staticmethod
+  def pointsChunk(objectPoints, imagePoints):
+    objectPoints = np.ascontiguousarray(objectPoints, dtype='<f4').reshape(-1, 3)
+    imagePoints = np.ascontiguousarray(imagePoints, dtype='<f4').reshape(-1, 2)
+    return struct.pack('<I', len(imagePoints)) + objectPoints.tobytes() + imagePoints.tobytes()
+
+  @staticmethod
+  def charucoChunk(corners, ids):
+    corners = np.ascontiguousarray(corners, dtype='<f4').reshape(-1, 2)
+    ids = np.ascontiguousarray(ids, dtype='<i4').reshape(-1)
+    return struct.pack('<I', len(ids)) + corners.tobytes() + ids.tobytes()
+
+  def setSessionArchiveFileName(self, fileName):
+    """Set where the session archive is written, an archive already started is moved there.
+    Return False if it could not be moved, it is kept where it was.
+    """
+    if fileName == self.sessionArchiveFileName:
+      return True
+    if self.sessionArchiveStarted and self.sessionArchiveFileName is not None and os.path.isfile(self.sessionArchiveFileName):
+      try:
+        shutil.move(self.sessionArchiveFileName, fileName)
+      except (IOError, OSError) as e:
+        logging.error("Unable to move observation archive " + self.sessionArchiveFileName + " to " + fileName + ": " + str(e))
+        return False
+    self.sessionArchiveFileName = fileName
+    return True
+
+  def appendObservationChunk(self, tag, payload):
+    # The first frame of a session starts a new archive, with the pattern description
+    try:
+      if not self.sessionArchiveStarted:
+        if self.sessionArchiveFileName is None:
+          self.sessionArchiveFileName = self.defaultSessionArchiveFileName()
+        with open(self.sessionArchiveFileName, 'wb') as f:
+          self.writeArchiveHeader(f)
+        self.sessionArchiveStarted = True
+      with open(self.sessionArchiveFileName, 'ab') as f:
+        self.writeArchiveChunk(f, tag, payload)
+    except IOError as e:
+      logging.error("Unable to write observation archive " + str(self.sessionArchiveFileName) + ": " + str(e))
+      return False
+    return True
+
+  def archivePoints(self, objectPoints, imagePoints):
+    return self.appendObservationChunk(b'PNTS', self.pointsChunk(objectPoints, imagePoints))
+
+  def archiveCharuco(self, corners, ids):
+    return self.appendObservationChunk(b'CHAR', self.charucoChunk(corners, ids))
+
+  def archiveNativeObservations(self, camerasLogic, imageSize):
+    """Archive the views the native logic (vtkSlicerPinholeCamerasLogic) appended or replaced last.
+    Views replaced by the keyframe selector stay in the archive. Return the number of views archived.
+    """
+    indices = vtk.vtkIntArray()
+    camerasLogic.GetLastChangedCalibrationObservations(indices)
+    if not self.sessionArchiveStarted:
+      self.imageSize = tuple(imageSize)
+    objectPoints = vtk.vtkPoints()
+    imagePoints = vtk.vtkDoubleArray()
+    archived = 0
+    for i in range(indices.GetNumberOfTuples()):
+      if not camerasLogic.GetCalibrationObservation(indices.GetValue(i), objectPoints, imagePoints):
+        continue
+      if not self.archivePoints(vtk.util.numpy_support.vtk_to_numpy(objectPoints.GetData()), vtk.util.numpy_support.vtk_to_numpy(imagePoints)):
+        break
+      archived += 1
+    return archived
+
+  def saveObservations(self, fileName):
+    if len(self.arucoCorners) > 0:
+      logging.warning("Aruco marker detections are not stored in the observation archive.")
+
+    try:
+      with open(fileName, 'wb') as f:
+        self.writeArchiveHeader(f)
+        for objectPoints, imagePoints in zip(self.objectPoints, self.imagePoints):
+          self.writeArchiveChunk(f, b'PNTS', self.pointsChunk(objectPoints, imagePoints))
+        for corners, ids in zip(self.charucoCorners, self.charucoIDs):
+          self.writeArchiveChunk(f, b'CHAR', self.charucoChunk(corners, ids))
+    except IOError as e:
+      logging.error("Unable to write observation archive " + fileName + ": " + str(e))
+      return False
+
+    return True
+
+  def loadObservations(self, fileName):
+    try:
+      with open(fileName, 'rb') as f:
+        data = f.read()
+    except IOError as e:
+      logging.error("Unable to read observation archive " + fileName + ": " + str(e))
+      return False
+
+    if len(data) < 8 or data[0:4] != self.ARCHIVE_MAGIC:
+      logging.error(fileName + " is not an observation archive.")
+      return False
+    version = struct.unpack_from('<I', data, 4)[0]
+    if version > self.ARCHIVE_VERSION:
+      logging.error("Unsupported observation archive version " + str(version) + ".")
+      return False
+
+    objectPoints = []
+    imagePoints = []
+    charucoCorners = []
+    charucoIDs = []
+    head = None
+
+    offset = 8
+    validSize = offset
+    while offset + self.ARCHIVE_CHUNK_HEADER.size <= len(data):
+      tag, size, crc = self.ARCHIVE_CHUNK_HEADER.unpack_from(data, offset)
+      offset += self.ARCHIVE_CHUNK_HEADER.size
+      payload = data[offset:offset + size]
+      offset += size
+      if len(payload) != size or (zlib.crc32(payload) & 0xffffffff) != crc:
+        # Keep the frames read so far, an interrupted write only loses its last chunk
+        logging.warning("Observation archive " + fileName + " is truncated or corrupted, ignoring the remaining frames.")
+        break
+      validSize = offset
+
+      if tag == b'HEAD':
+        head = self.ARCHIVE_HEAD.unpack(payload[:self.ARCHIVE_HEAD.size])
+      elif tag == b'PNTS':
+        count = struct.unpack_from('<I', payload)[0]
+        objectPoints.append(np.frombuffer(payload, '<f4', count * 3, 4).reshape(-1, 3).astype(np.float32))
+        imagePoints.append(np.frombuffer(payload, '<f4', count * 2, 4 + count * 12).reshape(-1, 2).astype(np.float32))
+      elif tag == b'CHAR':
+        count = struct.unpack_from('<I', payload)[0]
+        charucoCorners.append(np.frombuffer(payload, '<f4', count * 2, 4).reshape(-1, 1, 2).astype(np.float32))
+        charucoIDs.append(np.frombuffer(payload, '<i4', count, 4 + count * 8).reshape(-1, 1).astype(np.int32))
+
+    if head is None:
+      logging.error("Observation archive " + fileName + " has no pattern description.")
+      return False
+
+    patternType, rows, columns, param1, param2, width, height, dictName = head
+    dictName = dictName.rstrip(b'\0').decode('utf-8')
+    if dictName:
+      self.changeArucoDict(dictName)
+    self.calculateObjectPattern(rows, columns, patternType.rstrip(b'\0').decode('utf-8'), param1, param2)
+    self.imageSize = (width, height)
+
+    self.resetIntrinsic()
+    self.objectPoints = objectPoints
+    self.imagePoints = imagePoints
+    self.charucoCorners = charucoCorners
+    self.charucoIDs = charucoIDs
+    # Frames captured next are appended to the loaded archive, after its last complete chunk
+    try:
+      if validSize < len(data):
+        with open(fileName, 'r+b') as f:
+          f.truncate(validSize)
+      self.sessionArchiveFileName = fileName
+      self.sessionArchiveStarted = True
+    except IOError as e:
+      logging.warning("Unable to add frames to observation archive " + fileName + ", new frames start another archive: " + str(e))
+      self.sessionArchiveFileName = None
+    return True
+
+  def recalibrateFromObservations(self, fileName):
+    if not self.loadObservations(fileName):
+      return False
+    return self.calibratePinholeCamera()
+
+# SyntheticCalibrationImageGenerator
+class SyntheticCalibrationImageGenerator(object):
+  """Render views of a calibration board through a known pinhole camera with lens distortion.
+
+  The board is drawn flat into a texture. Every image pixel is undistorted once per camera, then for each view its
+  ray is intersected with the board plane to sample the texture, so the board is imaged through the exact camera
+  model. Pixels are supersampled to smooth the edges, blur and gray level noise are added last.
+  The board points (checkerboard inner corners, circle centers, aruco marker corners or charuco corners) are projected
+  with the same model, giving the true pixel location of everything a detector should find.
+  Patterns are described as in PinholeCameraCalibrationLogic.calculateObjectPattern, lengths in mm:
+   checkerboard: rows x columns inner corners, param1 = square size
+   circles, asymmetric circles: rows x columns circles, param1 = spacing (laid out as vtkSlicerPinholeCamerasLogic)
+   aruco: rows x columns markers, param1 = marker size, param2 = separation
+   charuco: rows x columns squares, param1 = square size, param2 = marker size
+  """
+  PATTERN_TYPES = ['checkerboard', 'circles', 'asymmetric circles', 'aruco', 'charuco']
+  # Texels across one square, circle spacing or marker of the board texture
+  TEXELS_PER_FEATURE = 80
+  # Reflectance of the scene around the board
+  BACKGROUND = 0.45
+
+  def __init__(self, patternType='checkerboard', rows=6, columns=9, param1=20.0, param2=0.0, arucoDictName='DICT_6X6_250',
+               imageSize=(1280, 720), cameraMatrix=None, distCoeffs=None, noise=2.0, blur=0.0, supersampling=2, seed=0):
+    global cv2
+    import cv2
+    if patternType not in self.PATTERN_TYPES:
+      raise ValueError("Unknown calibration pattern " + patternType)
+
+    self.patternType = patternType
+    self.rows = rows
+    self.columns = columns
+    self.param1 = param1
+    self.param2 = param2
+    self.imageSize = (int(imageSize[0]), int(imageSize[1]))
+    width, height = self.imageSize
+    if cameraMatrix is None:
+      # About 64 degrees of horizontal field of view, principal point a little off center
+      cameraMatrix = [[0.8 * width, 0.0, 0.51 * width - 0.5],
+                      [0.0, 0.8 * width, 0.49 * height - 0.5],
+                      [0.0, 0.0, 1.0]]
+    if distCoeffs is None:
+      distCoeffs = [-0.2, 0.08, 0.0008, -0.0005, -0.02]
+    self.cameraMatrix = np.array(cameraMatrix, np.float64).reshape(3, 3)
+    self.distCoeffs = np.array(distCoeffs, np.float64).ravel()
+    # Gray levels of black and white on the board, noise is the standard deviation of the gray level noise and blur the
+    # standard deviation in pixels of the gaussian blur
+    self.dark = 30.0
+    self.bright = 220.0
+    self.noise = noise
+    self.blur = blur
+    self.supersampling = max(1, int(supersampling))
+    self.random = np.random.RandomState(seed)
+
+    self.arucoDict = None
+    self.arucoBoard = None
+    self.createBoard(arucoDictName)
+    self.computeRays()
+    # Bounding box of the true pixels of all rendered views, (xmin, ymin, xmax, ymax)
+    self.coveredRegion = None
+
+  @staticmethod
+  def distortNormalized(x, y, distCoeffs):
+    # Distortion model of OpenCV, up to the 12 radial, tangential and thin prism coefficients
+    k = np.zeros(12)
+    coefficients = np.ravel(distCoeffs)[:12]
+    k[:len(coefficients)] = coefficients
+    r2 = x * x + y * y
+    radial = (1.0 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]))) / (1.0 + r2 * (k[5] + r2 * (k[6] + r2 * k[7])))
+    xd = x * radial + 2.0 * k[2] * x * y + k[3] * (r2 + 2.0 * x * x) + r2 * (k[8] + r2 * k[9])
+    yd = y * radial + k[2] * (r2 + 2.0 * y * y) + 2.0 * k[3] * x * y + r2 * (k[10] + r2 * k[11])
+    return xd, yd
+
+  @staticmethod
+  def projectNormalized(x, y, cameraMatrix, distCoeffs):
+    xd, yd = SyntheticCalibrationImageGenerator.distortNormalized(x, y, distCoeffs)
+    return (cameraMatrix[0, 0] * xd + cameraMatrix[0, 1] * yd + cameraMatrix[0, 2],
+            cameraMatrix[1, 1] * yd + cameraMatrix[1, 2])
+
+  @staticmethod
+  def undistortPixels(u, v, cameraMatrix, distCoeffs, iterations=20):
+    # Same fixed point iteration as cv::undistortPoints, with more iterations for strong distortion
+    k = np.zeros(12)
+    coefficients = np.ravel(distCoeffs)[:12]
+    k[:len(coefficients)] = coefficients
+    yd = (v - cameraMatrix[1, 2]) / cameraMatrix[1, 1]
+    xd = (u - cameraMatrix[0, 2] - cameraMatrix[0, 1] * yd) / cameraMatrix[0, 0]
+    x = xd.copy()
+    y = yd.copy()
+    for _ in range(iterations):
+      r2 = x * x + y * y
+      inverseRadial = (1.0 + r2 * (k[5] + r2 * (k[6] + r2 * k[7]))) / (1.0 + r2 * (k[0] + r2 * (k[1] + r2 * k[4])))
+      deltaX = 2.0 * k[2] * x * y + k[3] * (r2 + 2.0 * x * x) + r2 * (k[8] + r2 * k[9])
+      deltaY = k[2] * (r2 + 2.0 * y * y) + 2.0 * k[3] * x * y + r2 * (k[10] + r2 * k[11])
+      x = (xd - deltaX) * inverseRadial
+      y = (yd - deltaY) * inverseRadial
+    return x, y
+
+  def createBoard(self, arucoDictName):
+    if self.patternType in ('aruco', 'charuco'):
+      global aruco
+      import cv2.aruco as aruco
+      self.arucoDict = aruco.getPredefinedDictionary(getattr(aruco, arucoDictName))
+
+    if self.patternType == 'checkerboard':
+      featureSize = self.param1
+      pattern = np.indices((self.columns, self.rows)).T.reshape(-1, 2) * self.param1
+      # Squares extend one square past the inner corners
+      boardMin = -np.array([self.param1, self.param1])
+      boardMax = np.array([self.columns, self.rows]) * self.param1
+    elif self.patternType in ('circles', 'asymmetric circles'):
+      featureSize = self.param1
+      column, row = np.indices((self.columns, self.rows)).T.reshape(-1, 2).T
+      if self.patternType == 'asymmetric circles':
+        column = 2 * column + row % 2
+      pattern = np.stack([column, row], axis=1) * self.param1
+      boardMin = pattern.min(axis=0) - 0.5 * self.param1
+      boardMax = pattern.max(axis=0) + 0.5 * self.param1
+    elif self.patternType == 'aruco':
+      separation = self.param2 if self.param2 > 0 else 0.25 * self.param1
+      featureSize = self.param1
+      self.arucoBoard = aruco.GridBoard_create(self.columns, self.rows, self.param1, separation, self.arucoDict)
+      pattern = np.concatenate([np.asarray(corners, np.float64).reshape(4, 3)[:, :2] for corners in self.arucoBoard.objPoints])
+      boardMin = pattern.min(axis=0)
+      boardMax = pattern.max(axis=0)
+    else:
+      markerSize = self.param2 if self.param2 > 0 else 0.7 * self.param1
+      featureSize = self.param1
+      self.arucoBoard = aruco.CharucoBoard_create(self.columns, self.rows, self.param1, markerSize, self.arucoDict)
+      pattern = np.asarray(self.arucoBoard.chessboardCorners, np.float64).reshape(-1, 3)[:, :2]
+      boardMin = np.array([0.0, 0.0])
+      boardMax = np.array([self.columns, self.rows]) * self.param1
+
+    self.objectPoints = np.zeros((len(pattern), 3))
+    self.objectPoints[:, :2] = pattern
+
+    # White margin of one feature around the pattern, detectors need a quiet zone
+    self.texelsPerMm = self.TEXELS_PER_FEATURE / featureSize
+    self.textureOrigin = boardMin - featureSize
+    self.textureExtent = boardMax - boardMin + 2.0 * featureSize
+    textureSize = np.ceil(self.textureExtent * self.texelsPerMm).astype(int)
+    # Drawn in 8 bits, OpenCV antialiases 8 bit images only
+    self.texture = np.full((textureSize[1], textureSize[0]), 255, np.uint8)
+
+    if self.patternType == 'checkerboard':
+      for i in range(self.columns + 1):
+        for j in range(self.rows + 1):
+          if (i + j) % 2 == 0:
+            self.fillRectangle([(i - 1) * self.param1, (j - 1) * self.param1], [i * self.param1, j * self.param1])
+    elif self.patternType in ('circles', 'asymmetric circles'):
+      shift = 4
+      radius = int(round(0.3 * self.param1 * self.texelsPerMm * (1 << shift)))
+      for point in pattern:
+        center = np.round(self.boardToTexture(point) * (1 << shift)).astype(int)
+        cv2.circle(self.texture, (int(center[0]), int(center[1])), radius, 0, -1, cv2.LINE_AA, shift)
+    elif self.patternType == 'charuco':
+      # Black squares are the ones without a marker
+      markerCenters = [np.asarray(corners, np.float64).reshape(4, 3)[:, :2].mean(axis=0) for corners in self.arucoBoard.objPoints]
+      markerSquares = set((int(center[0] // self.param1), int(center[1] // self.param1)) for center in markerCenters)
+      for i in range(self.columns):
+        for j in range(self.rows):
+          if (i, j) not in markerSquares:
+            self.fillRectangle([i * self.param1, j * self.param1], [(i + 1) * self.param1, (j + 1) * self.param1])
+
+    # Board coordinates are y up when the first marker is mirrored in the texture, the board is then seen from behind
+    self.boardFlip = np.identity(3)
+    if self.arucoBoard is not None:
+      self.drawMarkers()
+      corners = np.asarray(self.arucoBoard.objPoints[0], np.float64).reshape(4, 3)
+      if np.cross(corners[1] - corners[0], corners[3] - corners[0])[2] < 0.0:
+        self.boardFlip = np.diag([1.0, -1.0, -1.0])
+    self.texture = self.texture.astype(np.float32) / 255.0
+
+  def boardToTexture(self, point):
+    # Texel coordinates of a board point, texel centers are at integer coordinates
+    return (np.asarray(point[:2], np.float64) - self.textureOrigin) * self.texelsPerMm - 0.5
+
+  def fillRectangle(self, boardMin, boardMax):
+    textureMin = np.round((np.asarray(boardMin) - self.textureOrigin) * self.texelsPerMm).astype(int)
+    textureMax = np.round((np.asarray(boardMax) - self.textureOrigin) * self.texelsPerMm).astype(int)
+    self.texture[textureMin[1]:textureMax[1], textureMin[0]:textureMax[0]] = 0
+
+  def drawMarkers(self):
+    textureSize = (self.texture.shape[1], self.texture.shape[0])
+    for markerId, corners in zip(np.ravel(self.arucoBoard.ids), self.arucoBoard.objPoints):
+      corners = np.asarray(corners, np.float64).reshape(4, 3)
+      side = int(round(np.linalg.norm(corners[1] - corners[0]) * self.texelsPerMm))
+      marker = aruco.drawMarker(self.arucoDict, int(markerId), side)
+      # Marker image corners 0, 1 and 3 go to the matching marker corners of the board
+      source = np.float32([[-0.5, -0.5], [side - 0.5, -0.5], [-0.5, side - 0.5]])
+      target = np.float32([self.boardToTexture(corners[k]) for k in (0, 1, 3)])
+      transform = cv2.getAffineTransform(source, target)
+      cv2.warpAffine(marker, transform, textureSize, dst=self.texture, flags=cv2.INTER_LINEAR, borderMode=cv2.BORDER_TRANSPARENT)
+
+  def computeRays(self):
+    # Undistorted normalized ray of every supersampled image location, computed once per camera
+    width, height = self.imageSize
+    s = self.supersampling
+    u = (np.arange(width * s, dtype=np.float64) + 0.5) / s - 0.5
+    v = (np.arange(height * s, dtype=np.float64) + 0.5) / s - 0.5
+    u, v = np.meshgrid(u, v)
+    self.rayX, self.rayY = self.undistortPixels(u, v, self.cameraMatrix, self.distCoeffs)
+    # Far out of the image the iteration may not converge, leave these locations as background
+    projectedU, projectedV = self.projectNormalized(self.rayX, self.rayY, self.cameraMatrix, self.distCoeffs)
+    self.rayValid = np.hypot(projectedU - u, projectedV - v) < 0.01
+
+  def projectBoardPoints(self, boardToCamera):
+    # True pixel of every board point, NaN behind the camera
+    cameraPoints = np.dot(self.objectPoints, boardToCamera[:3, :3].T) + boardToCamera[:3, 3]
+    with np.errstate(divide='ignore', invalid='ignore'):
+      depth = np.where(cameraPoints[:, 2] > 0.0, cameraPoints[:, 2], np.nan)
+      u, v = self.projectNormalized(cameraPoints[:, 0] / depth, cameraPoints[:, 1] / depth, self.cameraMatrix, self.distCoeffs)
+    return np.stack([u, v], axis=1)
+
+  def generatePoses(self, numberOfViews, maximumTilt=40.0, maximumRoll=20.0, coverage=(0.4, 0.75)):
+    """Board to camera 4x4 matrices with the whole board in the image, tilted up to maximumTilt degrees about the
+    board axes and covering the coverage range of the image size"""
+    width, height = self.imageSize
+    focalLength = self.cameraMatrix[0, 0]
+    boardCenter = np.append(self.textureOrigin + 0.5 * self.textureExtent, 0.0)
+    outline = np.array([[0.0, 0.0], [1.0, 0.0], [1.0, 1.0], [0.0, 1.0]]) * self.textureExtent + self.textureOrigin
+    outline = np.hstack([outline, np.zeros((4, 1))])
+    margin = 0.02 * width
+
+    def rotation(axis, degrees):
+      c = np.cos(np.radians(degrees))
+      s = np.sin(np.radians(degrees))
+      i, j = [(1, 2), (2, 0), (0, 1)][axis]
+      matrix = np.identity(3)
+      matrix[i, i] = c
+      matrix[j, j] = c
+      matrix[i, j] = -s
+      matrix[j, i] = s
+      return matrix
+
+    poses = []
+    attempts = 0
+    while len(poses) < numberOfViews and attempts < 100 * numberOfViews:
+      attempts += 1
+      tiltX, tiltY = self.random.uniform(-maximumTilt, maximumTilt, 2)
+      roll = self.random.uniform(-maximumRoll, maximumRoll)
+      fraction = self.random.uniform(coverage[0], coverage[1])
+      boardRotation = np.dot(np.dot(rotation(2, roll), np.dot(rotation(1, tiltY), rotation(0, tiltX))), self.boardFlip)
+      distance = focalLength * max(self.textureExtent[0] / width, self.textureExtent[1] / height) / fraction
+      offsetX = self.random.uniform(-0.5, 0.5) * (1.0 - fraction) * width / focalLength
+      offsetY = self.random.uniform(-0.5, 0.5) * (1.0 - fraction) * height / focalLength
+      pose = np.identity(4)
+      pose[:3, :3] = boardRotation
+      pose[:3, 3] = distance * np.array([offsetX, offsetY, 1.0]) - np.dot(boardRotation, boardCenter)
+
+      cameraOutline = np.dot(outline, boardRotation.T) + pose[:3, 3]
+      if np.any(cameraOutline[:, 2] <= 0.0):
+        continue
+      u, v = self.projectNormalized(cameraOutline[:, 0] / cameraOutline[:, 2], cameraOutline[:, 1] / cameraOutline[:, 2], self.cameraMatrix, self.distCoeffs)
+      if u.min() < margin or v.min() < margin or u.max() > width - 1 - margin or v.max() > height - 1 - margin:
+        continue
+      poses.append(pose)
+    return poses
+
+  def render(self, boardToCamera):
+    """Image of the board at a board to camera 4x4 pose (gray levels, uint8) and the true pixel of every board point"""
+    rotation = boardToCamera[:3, :3]
+    translation = boardToCamera[:3, 3]
+
+    # Intersect the rays with the board plane, then go to board coordinates
+    normal = rotation[:, 2]
+    with np.errstate(divide='ignore', invalid='ignore'):
+      depth = np.dot(normal, translation) / (normal[0] * self.rayX + normal[1] * self.rayY + normal[2])
+      dx = depth * self.rayX - translation[0]
+      dy = depth * self.rayY - translation[1]
+      dz = depth - translation[2]
+      boardX = rotation[0, 0] * dx + rotation[1, 0] * dy + rotation[2, 0] * dz
+      boardY = rotation[0, 1] * dx + rotation[1, 1] * dy + rotation[2, 1] * dz
+      outside = ~(depth > 0.0) | ~self.rayValid
+    mapX = (boardX - self.textureOrigin[0]) * self.texelsPerMm - 0.5
+    mapY = (boardY - self.textureOrigin[1]) * self.texelsPerMm - 0.5
+    mapX[outside] = -1.0e4
+    mapY[outside] = -1.0e4
+
+    image = cv2.remap(self.texture, mapX.astype(np.float32), mapY.astype(np.float32), cv2.INTER_LINEAR,
+                      borderMode=cv2.BORDER_CONSTANT, borderValue=self.BACKGROUND)
+    if self.supersampling > 1:
+      image = cv2.resize(image, self.imageSize, interpolation=cv2.INTER_AREA)
+    image = self.dark + (self.bright - self.dark) * image
+    if self.blur > 0.0:
+      image = cv2.GaussianBlur(image, (0, 0), self.blur)
+    if self.noise > 0.0:
+      image = image + self.random.normal(0.0, self.noise, image.shape)
+    image = np.clip(np.round(image), 0, 255).astype(np.uint8)
+
+    imagePoints = self.projectBoardPoints(boardToCamera)
+    region = np.concatenate([np.nanmin(imagePoints, axis=0), np.nanmax(imagePoints, axis=0)])
+    if self.coveredRegion is None:
+      self.coveredRegion = region
+    else:
+      self.coveredRegion = np.concatenate([np.minimum(self.coveredRegion[:2], region[:2]), np.maximum(self.coveredRegion[2:], region[2:])])
+    return image, imagePoints
+
+  def compareIntrinsics(self, cameraMatrix, distCoeffs):
+    """Errors of estimated intrinsics against the true ones:
+    focalLengthError: largest relative error of fx and fy, in percent
+    principalPointError: distance between the principal points, in pixels
+    modelError, maximumModelError: RMS and largest distance in pixels between the true and estimated projections of
+    the same rays, over a grid covering the region of the image seen by the rendered views. This combines the errors
+    of all parameters into how far off a projection is, where distortion coefficients alone are not comparable.
+    """
+    cameraMatrix = np.asarray(cameraMatrix, np.float64).reshape(3, 3)
+    focalLengthError = 100.0 * max(abs(cameraMatrix[0, 0] / self.cameraMatrix[0, 0] - 1.0), abs(cameraMatrix[1, 1] / self.cameraMatrix[1, 1] - 1.0))
+    principalPointError = float(np.hypot(cameraMatrix[0, 2] - self.cameraMatrix[0, 2], cameraMatrix[1, 2] - self.cameraMatrix[1, 2]))
+
+    region = self.coveredRegion
+    if region is None:
+      region = [0.0, 0.0, self.imageSize[0] - 1.0, self.imageSize[1] - 1.0]
+    u, v = np.meshgrid(np.linspace(region[0], region[2], 32), np.linspace(region[1], region[3], 24))
+    x, y = self.undistortPixels(u, v, self.cameraMatrix, self.distCoeffs)
+    estimatedU, estimatedV = self.projectNormalized(x, y, cameraMatrix, distCoeffs)
+    distances = np.hypot(estimatedU - u, estimatedV - v)
+    return {'focalLengthError': float(focalLengthError),
+            'principalPointError': principalPointError,
+            'modelError': float(np.sqrt(np.mean(distances * distances))),
+            'maximumModelError': float(np.max(distances))}
+
+# PinholeCameraCalibrationBenchmark
+class PinholeCameraCalibrationBenchmark(object):
+  """Detect and calibrate synthetic views of each pattern, to track detection and calibration speed across releases.
+
+  Checkerboards and circle grids go through the native detection and solve of the pinhole cameras logic (this clears
+  its calibration observations), aruco and charuco boards through the aruco module of OpenCV as the calibration
+  widget does. Rendering is not timed. Each result reports:
+   detectionFps: views processed per second by the detector, detectedViews out of numberOfViews
+   solveSeconds: time taken by the calibration solve
+   reprojectionError: RMS reprojection error of the solve, in pixels
+   focalLengthError, principalPointError, modelError, maximumModelError: see SyntheticCalibrationImageGenerator.compareIntrinsics
+  Only CPU is needed, so it runs headless, e.g.:
+   Slicer --no-splash --no-main-window --python-code "import PinholeCameraCalibration as m; m.PinholeCameraCalibrationBenchmark().runAll('benchmark.json'); exit()"
+  """
+  def __init__(self):
+    global cv2
+    import cv2
+    self.camerasLogic = slicer.modules.pinholecameras.logic()
+
+  @staticmethod
+  def getPatternTypes():
+    # Aruco and charuco need the contrib modules of OpenCV
+    try:
+      import cv2.aruco
+      return list(SyntheticCalibrationImageGenerator.PATTERN_TYPES)
+    except ImportError:
+      return [t for t in SyntheticCalibrationImageGenerator.PATTERN_TYPES if t not in ('aruco', 'charuco')]
+
+  def run(self, patternType, imageSize=(1280, 720), numberOfViews=20, noise=2.0, blur=0.0, seed=0):
+    generator = SyntheticCalibrationImageGenerator(patternType, imageSize=imageSize, noise=noise, blur=blur, seed=seed)
+    images = [generator.render(pose)[0] for pose in generator.generatePoses(numberOfViews)]
+
+    if patternType in ('aruco', 'charuco'):
+      detectedViews, detectionSeconds, solveSeconds, error, cameraMatrix, distCoeffs = self.calibrateAruco(generator, images)
+    else:
+      detectedViews, detectionSeconds, solveSeconds, error, cameraMatrix, distCoeffs = self.calibrateNative(generator, images)
+
+    result = {'patternType': patternType,
+              'width': generator.imageSize[0],
+              'height': generator.imageSize[1],
+              'noise': noise,
+              'blur': blur,
+              'numberOfViews': len(images),
+              'detectedViews': detectedViews,
+              'detectionFps': len(images) / detectionSeconds if detectionSeconds > 0.0 else 0.0,
+              'solveSeconds': solveSeconds,
+              'reprojectionError': error}
+    if cameraMatrix is not None:
+      result.update(generator.compareIntrinsics(cameraMatrix, distCoeffs))
+    return result
+
+  @staticmethod
+  def numpyToVTKImage(image):
+    vtkImage = vtk.vtkImageData()
+    vtkImage.SetDimensions(image.shape[1], image.shape[0], 1)
+    vtkImage.GetPointData().SetScalars(vtk.util.numpy_support.numpy_to_vtk(np.ascontiguousarray(image).ravel(), deep=True))
+    return vtkImage
+
+  def calibrateNative(self, generator, images):
+    logic = self.camerasLogic
+    patternTypes = {'checkerboard': slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternCheckerboard,
+                    'circles': slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternCircleGrid,
+                    'asymmetric circles': slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternAsymmetricCircleGrid}
+    budget = logic.GetCalibrationKeyframeBudget()
+    logic.SetCalibrationPattern(patternTypes[generator.patternType], generator.rows, generator.columns, generator.param1)
+    logic.SetCalibrationKeyframeBudget(0)
+    logic.ResetCalibration()
+
+    vtkImages = [self.numpyToVTKImage(image) for image in images]
+    start = time.perf_counter()
+    detectedViews = sum(1 for image in vtkImages if logic.AddCalibrationImage(image))
+    detectionSeconds = time.perf_counter() - start
+
+    cameraNode = slicer.vtkMRMLPinholeCameraNode()
+    start = time.perf_counter()
+    error = logic.CalibratePinholeCamera(cameraNode) if detectedViews > 0 else -1.0
+    solveSeconds = time.perf_counter() - start
+
+    logic.ResetCalibration()
+    logic.SetCalibrationKeyframeBudget(budget)
+    if error < 0.0:
+      return detectedViews, detectionSeconds, solveSeconds, None, None, None
+    cameraMatrix = [[cameraNode.GetIntrinsicMatrix().GetElement(i, j) for j in range(3)] for i in range(3)]
+    distCoeffs = [cameraNode.GetDistortionCoefficientValue(i) for i in range(cameraNode.GetNumberOfDistortionCoefficients())]
+    return detectedViews, detectionSeconds, solveSeconds, error, cameraMatrix, distCoeffs
+
+  def calibrateAruco(self, generator, images):
+    board = generator.arucoBoard
+    markerCorners = []
+    markerIds = []
+    markerCounts = []
+    charucoCorners = []
+    charucoIds = []
+    start = time.perf_counter()
+    for image in images:
+      corners, ids, _ = aruco.detectMarkers(image, generator.arucoDict)
+      if ids is None or len(ids) == 0:
+        continue
+      if generator.patternType == 'charuco':
+        count, corners, ids = aruco.interpolateCornersCharuco(corners, ids, image, board)
+        if ids is not None and count > 3:
+          charucoCorners.append(corners)
+          charucoIds.append(ids)
+      else:
+        markerCorners.extend(corners)
+        markerIds.append(ids)
+        markerCounts.append(len(ids))
+    detectionSeconds = time.perf_counter() - start
+    detectedViews = len(charucoCorners) + len(markerCounts)
+    if detectedViews < 3:
+      return detectedViews, detectionSeconds, 0.0, None, None, None
+
+    start = time.perf_counter()
+    try:
+      if generator.patternType == 'charuco':
+        error, cameraMatrix, distCoeffs, _, _ = aruco.calibrateCameraCharuco(charucoCorners, charucoIds, board, generator.imageSize, None, None)
+      else:
+        error, cameraMatrix, distCoeffs, _, _ = aruco.calibrateCameraAruco(markerCorners, np.vstack(markerIds), np.array(markerCounts),
+                                                                           board, generator.imageSize, None, None)
+    except cv2.error as e:
+      logging.error("Calibration of synthetic " + generator.patternType + " views failed: " + str(e))
+      return detectedViews, detectionSeconds, time.perf_counter() - start, None, None, None
+    solveSeconds = time.perf_counter() - start
+    return detectedViews, detectionSeconds, solveSeconds, error, cameraMatrix, np.ravel(distCoeffs)
+
+  @staticmethod
+  def formatResult(result):
+    text = "{patternType} {width}x{height} noise {noise}: {detectedViews}/{numberOfViews} views, {detectionFps:.1f} fps, solve {solveSeconds:.3f} s".format(**result)
+    if result['reprojectionError'] is not None:
+      text += ", reprojection {reprojectionError:.3f} px, focal length {focalLengthError:.3f} %, principal point {principalPointError:.2f} px, model {modelError:.3f} px (max {maximumModelError:.3f})".format(**result)
+    return text
+
+  def runAll(self, outputFileName=None, imageSizes=((640, 480), (1280, 720), (1920, 1080)), noiseLevels=(0.0, 2.0, 5.0), numberOfViews=20, blur=0.0):
+    """Run every pattern at every image size and noise level, log the results and write them to outputFileName as JSON if given"""
+    results = []
+    for patternType in self.getPatternTypes():
+      for imageSize in imageSizes:
+        for noise in noiseLevels:
+          result = self.run(patternType, imageSize, numberOfViews, noise, blur)
+          logging.info(self.formatResult(result))
+          results.append(result)
+
+    if outputFileName:
+      report = {'opencvVersion': cv2.__version__,
+                'numpyVersion': np.__version__,
+                'numberOfCPUs': os.cpu_count(),
+                'results': results}
+      try:
+        with open(outputFileName, 'w') as f:
+          json.dump(report, f, indent=2)
+      except IOError as e:
+        logging.error("Unable to write benchmark report " + outputFileName + ": " + str(e))
+    return results
 
 # PinholeCameraCalibrationTest
 class PinholeCameraCalibrationTest(ScriptedLoadableModuleTest):
@@ -1027,6 +2075,128 @@ class PinholeCameraCalibrationTest(ScriptedLoadableModuleTest):
     self.delayDisplay("Starting the test")
     self.delayDisplay('Test passed!')
 
+  def test_SyntheticCalibration(self):
+    self.delayDisplay("Calibrating synthetic views of each pattern")
+    benchmark = PinholeCameraCalibrationBenchmark()
+    for patternType in benchmark.getPatternTypes():
+      result = benchmark.run(patternType, imageSize=(640, 480), numberOfViews=12, noise=2.0)
+      logging.info(benchmark.formatResult(result))
+      self.assertGreaterEqual(result['detectedViews'], 9, patternType + " pattern found in too few views")
+      self.assertIsNotNone(result['reprojectionError'], patternType + " calibration failed")
+      self.assertLess(result['focalLengthError'], 2.0)
+      self.assertLess(result['modelError'], 1.0)
+    self.delayDisplay('Test passed!')
+
+  def test_ObservationArchive(self):
+    self.delayDisplay("Archiving frames as they are captured")
+    global cv2
+    import cv2
+    logic = PinholeCameraCalibrationLogic()
+    logic.calculateObjectPattern(6, 9, 'checkerboard', 25.0, 0)
+    logic.imageSize = (640, 480)
+    random = np.random.RandomState(0)
+    frames = [random.uniform(0.0, 480.0, (54, 2)).astype(np.float32) for i in range(4)]
+
+    # Without a camera file the session is archived in the temporary directory, one chunk per frame
+    self.assertTrue(logic.archivePoints(logic.objPattern, frames[0]))
+    sessionFileName = logic.sessionArchiveFileName
+    self.assertEqual(os.path.dirname(sessionFileName), slicer.app.temporaryPath)
+    sizeAfterFirstFrame = os.path.getsize(sessionFileName)
+    self.assertTrue(logic.archivePoints(logic.objPattern, frames[1]))
+    self.assertGreater(os.path.getsize(sessionFileName), sizeAfterFirstFrame)
+
+    # Once the camera is saved the archive moves next to it and the next frames follow
+    cameraFileName = os.path.join(slicer.app.temporaryPath, 'ObservationArchiveTestCamera.xml')
+    archiveFileName = PinholeCameraCalibrationLogic.observationArchiveFileName(cameraFileName)
+    self.assertTrue(logic.setSessionArchiveFileName(archiveFileName))
+    self.assertFalse(os.path.exists(sessionFileName))
+    self.assertTrue(logic.archivePoints(logic.objPattern, frames[2]))
+
+    loaded = PinholeCameraCalibrationLogic()
+    self.assertTrue(loaded.loadObservations(archiveFileName))
+    self.assertEqual(len(loaded.imagePoints), 3)
+    self.assertEqual(tuple(loaded.imageSize), (640, 480))
+    for loadedPoints, points in zip(loaded.imagePoints, frames):
+      self.assertTrue(np.array_equal(loadedPoints, points))
+
+    # An interrupted write loses its frame only, frames captured after loading are appended after the last good one
+    with open(archiveFileName, 'ab') as f:
+      f.write(PinholeCameraCalibrationLogic.ARCHIVE_CHUNK_HEADER.pack(b'PNTS', 1000, 0) + b'\0' * 10)
+    self.assertTrue(loaded.loadObservations(archiveFileName))
+    self.assertEqual(len(loaded.imagePoints), 3)
+    self.assertTrue(loaded.archivePoints(loaded.objPattern, frames[3]))
+    self.assertTrue(loaded.loadObservations(archiveFileName))
+    self.assertEqual(len(loaded.imagePoints), 4)
+    self.assertTrue(np.array_equal(loaded.imagePoints[3], frames[3]))
+
+    # A reset starts another session
+    loaded.resetIntrinsic()
+    self.assertIsNone(loaded.sessionArchiveFileName)
+    os.remove(archiveFileName)
+    self.delayDisplay('Test passed!')
+
+  def test_NativeObservationArchive(self):
+    self.delayDisplay("Archiving views of the native live capture")
+    global cv2
+    import cv2
+    generator = SyntheticCalibrationImageGenerator('checkerboard', imageSize=(640, 480), noise=1.0, seed=1)
+    images = [PinholeCameraCalibrationBenchmark.numpyToVTKImage(generator.render(pose)[0]) for pose in generator.generatePoses(6)]
+
+    camerasLogic = slicer.modules.pinholecameras.logic()
+    budget = camerasLogic.GetCalibrationKeyframeBudget()
+    queueSize = camerasLogic.GetCalibrationCaptureQueueSize()
+    camerasLogic.SetCalibrationPattern(slicer.vtkSlicerPinholeCamerasLogic.CalibrationPatternCheckerboard, generator.rows, generator.columns, generator.param1)
+    camerasLogic.SetCalibrationKeyframeBudget(0)
+    camerasLogic.ResetCalibration()
+    detectedViews = sum(1 for image in images if camerasLogic.AddCalibrationImage(image))
+    self.assertGreaterEqual(detectedViews, 4)
+    camerasLogic.ResetCalibration()
+
+    # As the widget does: results are processed on each new frame, views are archived when the logic adds them
+    logic = PinholeCameraCalibrationLogic()
+    logic.calculateObjectPattern(generator.rows, generator.columns, 'checkerboard', generator.param1, 0)
+    observerTag = camerasLogic.AddObserver(slicer.vtkSlicerPinholeCamerasLogic.CalibrationObservationsAddedEvent,
+                                           lambda caller, event: logic.archiveNativeObservations(caller, generator.imageSize))
+    volumeNode = slicer.mrmlScene.AddNewNodeByClass('vtkMRMLScalarVolumeNode')
+    volumeNode.SetAndObserveImageData(images[0])
+    camerasLogic.SetCalibrationCaptureQueueSize(len(images))
+    try:
+      self.assertTrue(camerasLogic.StartCalibrationCapture(volumeNode))
+      for image in images[1:]:
+        volumeNode.SetAndObserveImageData(image)
+      deadline = time.time() + 60.0
+      while camerasLogic.GetNumberOfDetectedFrames() < detectedViews and time.time() < deadline:
+        time.sleep(0.05)
+        camerasLogic.ProcessCalibrationCaptureResults()
+      camerasLogic.StopCalibrationCapture()
+    finally:
+      camerasLogic.RemoveObserver(observerTag)
+      camerasLogic.SetCalibrationCaptureQueueSize(queueSize)
+      camerasLogic.SetCalibrationKeyframeBudget(budget)
+    self.assertEqual(camerasLogic.GetNumberOfDroppedFrames(), 0)
+    self.assertEqual(camerasLogic.GetNumberOfCalibrationObservations(), detectedViews)
+
+    # Every kept view is in the archive, with the points the native solve uses
+    self.assertTrue(logic.sessionArchiveStarted)
+    loaded = PinholeCameraCalibrationLogic()
+    self.assertTrue(loaded.loadObservations(logic.sessionArchiveFileName))
+    self.assertEqual(len(loaded.imagePoints), detectedViews)
+    self.assertEqual(tuple(loaded.imageSize), generator.imageSize)
+    objectPoints = vtk.vtkPoints()
+    imagePoints = vtk.vtkDoubleArray()
+    archivedViews = [np.reshape(points, (-1, 2)) for points in loaded.imagePoints]
+    for index in range(detectedViews):
+      self.assertTrue(camerasLogic.GetCalibrationObservation(index, objectPoints, imagePoints))
+      viewImagePoints = vtk.util.numpy_support.vtk_to_numpy(imagePoints).astype(np.float32)
+      self.assertTrue(any(np.array_equal(viewImagePoints, points) for points in archivedViews))
+
+    camerasLogic.ResetCalibration()
+    os.remove(logic.sessionArchiveFileName)
+    self.delayDisplay('Test passed!')
+
   def runTest(self):
     self.setUp()
     self.test_PinholeCameraCalibration1()
+    self.test_SyntheticCalibration()
+    self.test_ObservationArchive()
+    self.test_NativeObservationArchive()
@@ -4,6 +4,7 @@ import qt
 import slicer
 import numpy as np
 import logging
+import time
 from slicer.ScriptedLoadableModule import ScriptedLoadableModule, ScriptedLoadableModuleWidget, ScriptedLoadableModuleLogic, ScriptedLoadableModuleTest
 
 # PinholeCameraRayIntersection
@@ -12,7 +13,7 @@ class PinholeCameraRayIntersection(ScriptedLoadableModule):
     ScriptedLoadableModule.__init__(self, parent)
     self.parent.title = "PinholeCamera Ray Intersection"
     self.parent.categories = ["Computer Vision"]
-    self.parent.dependencies = ["PinholeCameras", "LinesIntersection", "Annotations"]
+    self.parent.dependencies = ["PinholeCameras", "Annotations"]
     self.parent.contributors = ["Adam Rankin (Robarts Research Institute)"]
     self.parent.helpText = """This module calculates the offset between ray intersections on an object from multiple videoCamera angles. """ + self.getDefaultModuleDocumentationLink()
     self.parent.acknowledgementText = """This module was developed with support from the Natural Sciences and Engineering Research Council of Canada, the Canadian Foundation for Innovation, and the Virtual Augmentation and Simulation for Surgery and Therapy laboratory, Western University."""
@@ -118,6 +119,11 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
     self.videoCameraObserverTag = None
     self.videoCameraTransformObserverTag = None
     self.pointModifiedObserverTag = None
+    self.imageObserverTag = None
+
+    self.imageNode = None
+    # Arrival time of the latest video frame, the time at which the tracker pose is looked up on capture
+    self.frameTime = None
 
     self.videoCameraTransformNode = None
     self.videoCameraTransformStatusLabel = None
@@ -132,6 +138,7 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
     # Actions
     self.captureButton = None
     self.resetButton = None
+    self.robustCheckBox = None
     self.actionContainer = None
 
     # Results
@@ -172,6 +179,7 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
 
     self.captureButton = PinholeCameraRayIntersectionWidget.get(self.widget, "pushButton_Capture")
     self.resetButton = PinholeCameraRayIntersectionWidget.get(self.widget, "pushButton_Reset")
+    self.robustCheckBox = PinholeCameraRayIntersectionWidget.get(self.widget, "checkBox_Robust")
     self.actionContainer = PinholeCameraRayIntersectionWidget.get(self.widget, "widget_ActionContainer")
 
     self.resultsLabel = PinholeCameraRayIntersectionWidget.get(self.widget, "label_Results")
@@ -191,6 +199,7 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
     self.videoCameraTransformSelector.connect("currentNodeChanged(vtkMRMLNode*)", self.onPinholeCameraTransformSelected)
     self.captureButton.connect('clicked(bool)', self.onCapture)
     self.resetButton.connect('clicked(bool)', self.onReset)
+    self.robustCheckBox.connect('toggled(bool)', self.onRobustToggled)
 
     # Choose red slice only
     lm = slicer.app.layoutManager()
@@ -211,11 +220,14 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
     self.checkPinholeCamera()
 
   def cleanup(self):
+    self.observeImage(None)
+    self.logic.setTransformNode(None)
     self.videoCameraSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.onPinholeCameraSelected)
     self.imageSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.onImageSelected)
     self.videoCameraTransformSelector.disconnect("currentNodeChanged(vtkMRMLNode*)", self.onPinholeCameraTransformSelected)
     self.captureButton.disconnect('clicked(bool)', self.onCapture)
     self.resetButton.disconnect('clicked(bool)', self.onReset)
+    self.robustCheckBox.disconnect('toggled(bool)', self.onRobustToggled)
 
   @vtk.calldata_type(vtk.VTK_OBJECT)
   def onPinholeCameraModified(self, caller, event):
@@ -245,7 +257,21 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
 
     self.onSelect()
 
+  def observeImage(self, imageNode):
+    if self.imageNode is not None:
+      self.imageNode.RemoveObserver(self.imageObserverTag)
+      self.imageObserverTag = None
+    self.imageNode = imageNode
+    self.frameTime = None
+    if self.imageNode is not None:
+      self.imageObserverTag = self.imageNode.AddObserver(slicer.vtkMRMLVolumeNode.ImageDataModifiedEvent, self.onImageDataModified)
+
+  def onImageDataModified(self, caller, event):
+    self.frameTime = vtk.vtkTimerLog.GetUniversalTime()
+
   def onImageSelected(self):
+    self.observeImage(self.imageSelector.currentNode())
+
     # Set red slice to the copy node
     if self.imageSelector.currentNode() is not None:
       slicer.app.layoutManager().sliceWidget('Red').sliceLogic().GetSliceCompositeNode().SetBackgroundVolumeID(self.imageSelector.currentNode().GetID())
@@ -268,6 +294,19 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
     self.resultsLabel.text = "Reset."
     self.logic.reset()
 
+  def onRobustToggled(self, checked):
+    self.logic.setRobust(checked)
+    self.showResult(self.logic.getPoint())
+
+  def showResult(self, result):
+    if result is None:
+      return
+    text = "Point: " + str(result[0]) + "," + str(result[1]) + "," + str(result[2]) + ". Error: " + str(self.logic.getError())
+    rejectedRays = self.logic.getRejectedRays()
+    if len(rejectedRays) > 0:
+      text += ". Rejected rays: " + ", ".join(str(index + 1) for index in rejectedRays)
+    self.resultsLabel.text = text
+
   def onSelect(self):
     self.actionContainer.enabled = self.imageSelector.currentNode() \
                                    and self.videoCameraTransformSelector.currentNode() \
@@ -282,12 +321,16 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
       slicer.modules.annotations.logic().StopPlaceMode()
       return()
 
-    # Record tracker data at time of freeze and store
-    videoCameraToReferenceVtk = vtk.vtkMatrix4x4()
-    self.videoCameraTransformSelector.currentNode().GetMatrixTransformToParent(videoCameraToReferenceVtk)
-    self.videoCameraToReference = PinholeCameraRayIntersectionWidget.vtk4x4ToNumpy(videoCameraToReferenceVtk)
+    # Record tracker data at the time the frozen frame arrived, not at the time of the click
+    # The tracker reports the pose of a frame TrackerLatency seconds after the frame arrives
+    self.videoCameraToReference = vtk.vtkMatrix4x4()
+    frameTime = self.frameTime if self.frameTime is not None else vtk.vtkTimerLog.GetUniversalTime()
+    if self.videoCameraSelector.currentNode() is not None:
+      frameTime += self.videoCameraSelector.currentNode().GetTrackerLatency()
+    if not self.logic.getPoseAtTime(frameTime, self.videoCameraToReference):
+      self.videoCameraTransformSelector.currentNode().GetMatrixTransformToParent(self.videoCameraToReference)
 
-    if PinholeCameraRayIntersectionWidget.areSameVTK4x4(videoCameraToReferenceVtk, self.identity4x4):
+    if PinholeCameraRayIntersectionWidget.areSameVTK4x4(self.videoCameraToReference, self.identity4x4):
       self.resultsLabel.text = "Invalid transform. Please try again with sensor in view."
       return()
 
@@ -330,49 +373,32 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
       # Calculate point and line pair
       arr = [0,0,0]
       self.markupsNode.GetNthControlPointPosition(callData, arr)
-      point = np.zeros((1,1,2),dtype=np.float64)
-      point[0,0,0] = abs(arr[0])
-      point[0,0,1] = abs(arr[1])
-
-      # Get videoCamera parameters
-      mtx = PinholeCameraRayIntersectionWidget.vtk3x3ToNumpy(self.videoCameraSelector.currentNode().GetIntrinsicMatrix())
-
-      if self.videoCameraSelector.currentNode().GetNumberOfDistortionCoefficients() != 0:
-        dist = np.asarray(np.zeros((1, self.videoCameraSelector.currentNode().GetNumberOfDistortionCoefficients()), dtype=np.float64))
-        for i in range(0, self.videoCameraSelector.currentNode().GetNumberOfDistortionCoefficients()):
-          dist[0, i] = self.videoCameraSelector.currentNode().GetDistortionCoefficientValue(i)
-      else:
-        dist = np.asarray([], dtype=np.float64)
-
-      # Calculate the direction vector for the given pixel (after undistortion)
-      pixel = np.vstack((cv2.undistortPoints(point, mtx, dist, P=mtx)[0].transpose(), np.array([1.0], dtype=np.float64)))
-
-      # Get the direction based on selected pixel
-
-      ## Origin - defined in camera, typically 0,0,0
-      origin_sensor = np.asarray(np.zeros((1, 3),dtype=np.float64))
-      for i in range(0, 3):
-        origin_sensor[0, i] = self.videoCameraSelector.currentNode().GetCameraPlaneOffset().GetValue(i)
-
-      directionVec_sensor = np.vstack(((np.linalg.inv(mtx) * pixel) / np.linalg.norm(np.linalg.inv(mtx) * pixel), np.array([0.0], dtype=np.float64)))
-
-      sensorToPinholeCamera = np.linalg.inv(PinholeCameraRayIntersectionWidget.vtk4x4ToNumpy(self.videoCameraSelector.currentNode().GetMarkerToImageSensorTransform()))
+      pixels = vtk.vtkDoubleArray()
+      pixels.SetNumberOfComponents(2)
+      pixels.InsertNextTuple2(abs(arr[0]), abs(arr[1]))
 
-      sensorToReference = self.videoCameraToReference * sensorToPinholeCamera
+      # Calculate the ray through the selected pixel (after undistortion) in the reference coordinate system
+      origins = vtk.vtkDoubleArray()
+      directions = vtk.vtkDoubleArray()
+      if not self.videoCameraSelector.currentNode().ComputeRaysFromPixels(pixels, self.videoCameraToReference, origins, directions):
+        self.resultsLabel.text = "Unable to compute ray for selected pixel."
+        qt.QTimer.singleShot(10, self.removeMarkup)
+        return()
 
-      origin_ref = sensorToReference * origin_sensor
-      directionVec_ref = sensorToReference * directionVec_sensor
+      origin_ref = origins.GetTuple3(0)
+      directionVec_ref = directions.GetTuple3(0)
 
       if self.developerMode:
         logging.debug("origin_ref: " + str(origin_ref).replace('\n',''))
         logging.debug("dir_ref: " + str(directionVec_ref).replace('\n',''))
 
-      result = self.logic.addRay(origin_ref[0:-1], directionVec_ref[0:-1])
+      result = self.logic.addRay(origin_ref, directionVec_ref)
       if result is not None:
-        self.resultsLabel.text = "Point: " + str(result[0]) + "," + str(result[1]) + "," + str(result[2]) + ". Error: " + str(self.logic.getError())
+        self.showResult(result)
         if self.developerMode:
           # For ease of copy pasting multiple entries, print it to the python console
           print("Intersection|" + str(result[0]) + "," + str(result[1]) + "," + str(result[2]) + "|" + str(self.logic.getError()))
+          logging.debug("Intersection covariance: " + str(PinholeCameraRayIntersectionWidget.vtk3x3ToNumpy(self.logic.getCovariance())).replace('\n',''))
 
       # Allow markups module some time to process the new markup, but then quickly delete it
       # Avoids VTK errors in log
@@ -404,6 +430,7 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
       self.videoCameraTransformObserverTag = None
 
     self.videoCameraTransformNode = self.videoCameraTransformSelector.currentNode()
+    self.logic.setTransformNode(self.videoCameraTransformNode)
     if self.videoCameraTransformNode is not None:
       self.videoCameraTransformObserverTag = self.videoCameraTransformNode.AddObserver(slicer.vtkMRMLTransformNode.TransformModifiedEvent, self.onPinholeCameraTransformModified)
 
@@ -423,28 +450,81 @@ class PinholeCameraRayIntersectionWidget(ScriptedLoadableModuleWidget):
 # PinholeCameraRayIntersectionLogic
 class PinholeCameraRayIntersectionLogic(ScriptedLoadableModuleLogic):
   def __init__(self):
-    self.linesRegistrationLogic = slicer.vtkSlicerLinesIntersectionLogic()
+    # Keeps the least-squares normal equations only, adding a ray and solving again take constant time
+    self.rayIntersection = slicer.vtkPinholeCameraRayIntersection()
+
+    # All rays are also kept for the robust estimation, which solves from the complete set
+    self.robust = False
+    self.origins = vtk.vtkDoubleArray()
+    self.origins.SetNumberOfComponents(3)
+    self.directions = vtk.vtkDoubleArray()
+    self.directions.SetNumberOfComponents(3)
+    self.inliers = vtk.vtkIntArray()
+
+    # Timestamped history of the tracked camera pose, to look up the pose at the time a frame arrived
+    self.poseBuffer = slicer.vtkPinholeCameraPoseBuffer()
 
   def reset(self):
     # clear list of rays
-    self.linesRegistrationLogic.Reset()
+    self.rayIntersection.Reset()
+    self.origins.Reset()
+    self.directions.Reset()
+    self.inliers.Reset()
+
+  def setRobust(self, robust):
+    if robust == self.robust:
+      return
+    self.robust = robust
+    self.inliers.Reset()
+    if not robust:
+      # The robust solve kept the inliers only, accumulate all rays again
+      self.rayIntersection.Reset()
+      for i in range(self.origins.GetNumberOfTuples()):
+        self.rayIntersection.AddRay(self.origins.GetTuple3(i), self.directions.GetTuple3(i))
 
   def addRay(self, origin, direction):
-    self.linesRegistrationLogic.AddLine(origin, direction)
-    if self.linesRegistrationLogic.Count() > 2:
-      return self.linesRegistrationLogic.Update()
-    return None
+    self.origins.InsertNextTuple3(origin[0], origin[1], origin[2])
+    self.directions.InsertNextTuple3(direction[0], direction[1], direction[2])
+    if not self.robust:
+      self.rayIntersection.AddRay(origin, direction)
+    return self.getPoint()
 
   def getCount(self):
-    return self.linesRegistrationLogic.Count()
+    return self.origins.GetNumberOfTuples()
 
   def getPoint(self):
-    if self.linesRegistrationLogic.Count() > 2:
-      return self.linesRegistrationLogic.Update()
+    if self.getCount() <= 2:
+      return None
+    if self.robust:
+      solved = self.rayIntersection.UpdateRobust(self.origins, self.directions, self.inliers)
+    else:
+      solved = self.rayIntersection.Update()
+    if solved:
+      return self.rayIntersection.GetIntersection()
     return None
 
   def getError(self):
-    return self.linesRegistrationLogic.GetError()
+    return self.rayIntersection.GetError()
+
+  def getRejectedRays(self):
+    # Indices of the rays left out by the last robust estimation
+    if not self.robust:
+      return []
+    return [i for i in range(self.inliers.GetNumberOfTuples()) if self.inliers.GetValue(i) == 0]
+
+  def setTransformNode(self, transformNode):
+    # Record every pose of the tracked camera transform
+    self.poseBuffer.SetTransformNode(transformNode)
+
+  def getPoseAtTime(self, timestamp, pose):
+    # Interpolated tracker pose at a vtkTimerLog universal time, false if it is outside the recorded poses
+    return self.poseBuffer.GetPoseAtTime(timestamp, pose)
+
+  def getCovariance(self):
+    # 3x3 covariance of the last intersection point
+    covariance = vtk.vtkMatrix3x3()
+    covariance.DeepCopy(self.rayIntersection.GetCovariance())
+    return covariance
 
 # PinholeCameraRayIntersectionTest
 class PinholeCameraRayIntersectionTest(ScriptedLoadableModuleTest):
@@ -456,7 +536,75 @@ class PinholeCameraRayIntersectionTest(ScriptedLoadableModuleTest):
     """ Run as few or as many tests as needed here. """
     self.setUp()
     self.test_PinholeCameraRayIntersection1()
+    self.test_SyntheticRays()
 
   def test_PinholeCameraRayIntersection1(self):
     self.delayDisplay("Starting the test")
     self.delayDisplay('Test passed!')
+
+  @staticmethod
+  def lookAt(eye, target, random):
+    # Marker to reference pose of a camera at eye looking at target, rolled at random about its optical axis
+    zAxis = (target - eye) / np.linalg.norm(target - eye)
+    xAxis = np.cross(random.normal(size=3), zAxis)
+    xAxis /= np.linalg.norm(xAxis)
+    yAxis = np.cross(zAxis, xAxis)
+    pose = vtk.vtkMatrix4x4()
+    for i in range(0, 3):
+      pose.SetElement(i, 0, xAxis[i])
+      pose.SetElement(i, 1, yAxis[i])
+      pose.SetElement(i, 2, zAxis[i])
+      pose.SetElement(i, 3, eye[i])
+    return pose
+
+  def test_SyntheticRays(self):
+    """ Intersect the rays through noisy projections of a known point, seen by a distorted camera from many poses """
+    self.delayDisplay("Intersecting synthetic rays")
+    random = np.random.RandomState(0)
+    cameraNode = slicer.vtkMRMLPinholeCameraNode()
+    intrinsics = vtk.vtkMatrix3x3()
+    for i, value in enumerate([800.0, 0.0, 330.0, 0.0, 800.0, 235.0, 0.0, 0.0, 1.0]):
+      intrinsics.SetElement(i // 3, i % 3, value)
+    cameraNode.SetAndObserveIntrinsicMatrix(intrinsics)
+    coefficients = vtk.vtkDoubleArray()
+    for value in [-0.2, 0.08, 0.0008, -0.0005, -0.02]:
+      coefficients.InsertNextValue(value)
+    cameraNode.SetDistortionCoefficientValues(coefficients)
+
+    target = np.array([25.0, -40.0, 120.0])
+    points = vtk.vtkPoints()
+    points.InsertNextPoint(target)
+    numberOfRays = 200
+    outliers = set(range(0, numberOfRays, 10))
+    rays = []
+    for ray in range(numberOfRays):
+      direction = random.normal(size=3)
+      pose = self.lookAt(target - 200.0 * direction / np.linalg.norm(direction), target, random)
+      pixels = vtk.vtkDoubleArray()
+      cameraNode.ProjectPoints(points, pose, pixels)
+      # Half a pixel of clicking noise, outliers are clicked 40 pixels off
+      pixel = np.array(pixels.GetTuple2(0)) + random.normal(0.0, 0.5, 2)
+      if ray in outliers:
+        pixel += 40.0 * np.array([np.cos(ray), np.sin(ray)])
+      pixels.SetTuple2(0, pixel[0], pixel[1])
+      origins = vtk.vtkDoubleArray()
+      directions = vtk.vtkDoubleArray()
+      self.assertTrue(cameraNode.ComputeRaysFromPixels(pixels, pose, origins, directions))
+      rays.append((origins.GetTuple3(0), directions.GetTuple3(0)))
+
+    logic = PinholeCameraRayIntersectionLogic()
+    for robust in [False, True]:
+      logic.reset()
+      logic.setRobust(robust)
+      # Rays are added one at a time and solved after each, as they are clicked
+      start = time.perf_counter()
+      for ray, (origin, direction) in enumerate(rays):
+        if robust or ray not in outliers:
+          point = logic.addRay(origin, direction)
+      elapsed = time.perf_counter() - start
+      error = np.linalg.norm(np.array(point) - target)
+      logging.info("{0} intersection of {1} rays: {2:.0f} rays/s, error {3:.3f} mm".format("Robust" if robust else "Least-squares", logic.getCount(), logic.getCount() / elapsed, error))
+      self.assertLess(error, 0.5)
+      if robust:
+        self.assertTrue(outliers.issubset(logic.getRejectedRays()))
+    self.delayDisplay('Test passed!')
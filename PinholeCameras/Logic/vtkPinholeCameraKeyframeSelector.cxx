@@ -0,0 +1,303 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraKeyframeSelector.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraKeyframeSelector.h"
+
+// OpenCV includes
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace
+{
+  /// Descriptor distance at which a view counts as fully different from another
+  const double DIVERSITY_SCALE = 0.25;
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraKeyframeSelector::vtkPinholeCameraKeyframeSelector()
+  : Budget(40)
+  , DuplicateDistance(0.02)
+  , LastScore(0.0)
+  , CellCounts(CoverageGridSize * CoverageGridSize, 0)
+{
+  this->ImageSize[0] = 0;
+  this->ImageSize[1] = 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraKeyframeSelector::SetBudget(int budget, std::vector<int>* evicted)
+{
+  this->Budget = std::max(0, budget);
+  if (this->Budget == 0 || static_cast<int>(this->Keyframes.size()) <= this->Budget)
+  {
+    return;
+  }
+
+  // Evict one keyframe at a time, the scores of the others change with each removal
+  std::vector<int> originalIndices(this->Keyframes.size());
+  for (int i = 0; i < static_cast<int>(originalIndices.size()); ++i)
+  {
+    originalIndices[i] = i;
+  }
+  std::vector<int> removed;
+  while (static_cast<int>(this->Keyframes.size()) > this->Budget)
+  {
+    double leastScore;
+    const int leastUseful = this->FindLeastUsefulKeyframe(leastScore);
+    removed.push_back(originalIndices[leastUseful]);
+    this->AddCells(this->Keyframes[leastUseful], -1);
+    this->Keyframes.erase(this->Keyframes.begin() + leastUseful);
+    originalIndices.erase(originalIndices.begin() + leastUseful);
+  }
+
+  if (evicted != nullptr)
+  {
+    std::sort(removed.begin(), removed.end(), std::greater<int>());
+    evicted->insert(evicted->end(), removed.begin(), removed.end());
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraKeyframeSelector::GetBudget() const
+{
+  return this->Budget;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraKeyframeSelector::SetDuplicateDistance(double distance)
+{
+  this->DuplicateDistance = distance;
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraKeyframeSelector::GetDuplicateDistance() const
+{
+  return this->DuplicateDistance;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraKeyframeSelector::SetImageSize(int width, int height)
+{
+  if (width != this->ImageSize[0] || height != this->ImageSize[1])
+  {
+    // Descriptors and cells are relative to the image size
+    this->Reset();
+  }
+  this->ImageSize[0] = width;
+  this->ImageSize[1] = height;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraKeyframeSelector::AddView(const float* objectPoints, const float* imagePoints, int numberOfPoints)
+{
+  Keyframe keyframe;
+  if (!this->ComputeKeyframe(objectPoints, imagePoints, numberOfPoints, keyframe))
+  {
+    this->LastScore = 0.0;
+    return Rejected;
+  }
+
+  double minimumDistance;
+  this->LastScore = this->ComputeScore(keyframe, -1, minimumDistance);
+
+  if (this->Budget > 0 && minimumDistance < this->DuplicateDistance)
+  {
+    return Rejected;
+  }
+
+  if (this->Budget == 0 || static_cast<int>(this->Keyframes.size()) < this->Budget)
+  {
+    this->AddCells(keyframe, 1);
+    this->Keyframes.push_back(keyframe);
+    return Appended;
+  }
+
+  // Budget reached: replace the least useful keyframe if the new view is worth more
+  double leastScore;
+  const int leastUseful = this->FindLeastUsefulKeyframe(leastScore);
+  if (leastUseful < 0 || this->LastScore <= leastScore)
+  {
+    return Rejected;
+  }
+
+  this->AddCells(this->Keyframes[leastUseful], -1);
+  this->Keyframes[leastUseful] = keyframe;
+  this->AddCells(keyframe, 1);
+  return leastUseful;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraKeyframeSelector::GetNumberOfKeyframes() const
+{
+  return static_cast<int>(this->Keyframes.size());
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraKeyframeSelector::GetLastScore() const
+{
+  return this->LastScore;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraKeyframeSelector::Reset()
+{
+  this->Keyframes.clear();
+  std::fill(this->CellCounts.begin(), this->CellCounts.end(), 0);
+  this->LastScore = 0.0;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraKeyframeSelector::ComputeKeyframe(const float* objectPoints, const float* imagePoints, int numberOfPoints, Keyframe& keyframe) const
+{
+  if (objectPoints == nullptr || imagePoints == nullptr || numberOfPoints < 4 || this->ImageSize[0] <= 0 || this->ImageSize[1] <= 0)
+  {
+    return false;
+  }
+
+  const double width = this->ImageSize[0];
+  const double height = this->ImageSize[1];
+  const double imageScale = std::max(width, height);
+
+  std::vector<cv::Point2f> pixels(numberOfPoints);
+  std::vector<cv::Point2f> normalizedPixels(numberOfPoints);
+  double center[2] = { 0.0, 0.0 };
+  keyframe.Cells.clear();
+  for (int i = 0; i < numberOfPoints; ++i)
+  {
+    const float x = imagePoints[2 * i];
+    const float y = imagePoints[2 * i + 1];
+    pixels[i] = cv::Point2f(x, y);
+    normalizedPixels[i] = cv::Point2f(static_cast<float>(x / imageScale), static_cast<float>(y / imageScale));
+    center[0] += x;
+    center[1] += y;
+
+    const int column = std::min(CoverageGridSize - 1, std::max(0, static_cast<int>(x / width * CoverageGridSize)));
+    const int row = std::min(CoverageGridSize - 1, std::max(0, static_cast<int>(y / height * CoverageGridSize)));
+    keyframe.Cells.push_back(row * CoverageGridSize + column);
+  }
+  std::sort(keyframe.Cells.begin(), keyframe.Cells.end());
+  keyframe.Cells.erase(std::unique(keyframe.Cells.begin(), keyframe.Cells.end()), keyframe.Cells.end());
+
+  // Position and apparent size of the board
+  std::vector<cv::Point2f> hull;
+  cv::convexHull(pixels, hull);
+  keyframe.Descriptor[0] = center[0] / numberOfPoints / width;
+  keyframe.Descriptor[1] = center[1] / numberOfPoints / height;
+  keyframe.Descriptor[2] = std::sqrt(cv::contourArea(hull) / (width * height));
+
+  // Foreshortening: perspective terms of the homography from the board, scaled to [0, 1], to the image
+  keyframe.Descriptor[3] = 0.0;
+  keyframe.Descriptor[4] = 0.0;
+  float bounds[4] = { objectPoints[0], objectPoints[0], objectPoints[1], objectPoints[1] };
+  bool planar = true;
+  for (int i = 0; i < numberOfPoints; ++i)
+  {
+    bounds[0] = std::min(bounds[0], objectPoints[3 * i]);
+    bounds[1] = std::max(bounds[1], objectPoints[3 * i]);
+    bounds[2] = std::min(bounds[2], objectPoints[3 * i + 1]);
+    bounds[3] = std::max(bounds[3], objectPoints[3 * i + 1]);
+    planar = planar && objectPoints[3 * i + 2] == 0.f;
+  }
+  const float extent = std::max(bounds[1] - bounds[0], bounds[3] - bounds[2]);
+  if (planar && extent > 0.f)
+  {
+    std::vector<cv::Point2f> board(numberOfPoints);
+    for (int i = 0; i < numberOfPoints; ++i)
+    {
+      board[i] = cv::Point2f((objectPoints[3 * i] - bounds[0]) / extent, (objectPoints[3 * i + 1] - bounds[2]) / extent);
+    }
+    try
+    {
+      cv::Mat homography = cv::findHomography(board, normalizedPixels, 0);
+      if (!homography.empty() && std::abs(homography.at<double>(2, 2)) > std::numeric_limits<double>::epsilon())
+      {
+        const double scale = homography.at<double>(2, 2);
+        keyframe.Descriptor[3] = std::max(-1.0, std::min(1.0, homography.at<double>(2, 0) / scale));
+        keyframe.Descriptor[4] = std::max(-1.0, std::min(1.0, homography.at<double>(2, 1) / scale));
+      }
+    }
+    catch (const cv::Exception&)
+    {
+      // Degenerate point layout, the view is described by position and size only
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraKeyframeSelector::ComputeScore(const Keyframe& keyframe, int excluded, double& minimumDistance) const
+{
+  // Coverage: cells seen by few other keyframes count most
+  double coverage = 0.0;
+  for (std::vector<int>::const_iterator it = keyframe.Cells.begin(); it != keyframe.Cells.end(); ++it)
+  {
+    const int others = this->CellCounts[*it] - (excluded >= 0 ? 1 : 0);
+    coverage += 1.0 / (1.0 + others);
+  }
+  coverage = keyframe.Cells.empty() ? 0.0 : coverage / keyframe.Cells.size();
+
+  // Diversity: distance to the closest other keyframe pose
+  minimumDistance = std::numeric_limits<double>::max();
+  for (int i = 0; i < static_cast<int>(this->Keyframes.size()); ++i)
+  {
+    if (i == excluded)
+    {
+      continue;
+    }
+    double distance = 0.0;
+    for (int j = 0; j < DescriptorSize; ++j)
+    {
+      const double difference = keyframe.Descriptor[j] - this->Keyframes[i].Descriptor[j];
+      distance += difference * difference;
+    }
+    minimumDistance = std::min(minimumDistance, std::sqrt(distance));
+  }
+  const double diversity = std::min(1.0, minimumDistance / DIVERSITY_SCALE);
+
+  return 0.5 * (coverage + diversity);
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraKeyframeSelector::FindLeastUsefulKeyframe(double& leastScore) const
+{
+  int leastUseful = -1;
+  leastScore = std::numeric_limits<double>::max();
+  for (int i = 0; i < static_cast<int>(this->Keyframes.size()); ++i)
+  {
+    double distance;
+    const double score = this->ComputeScore(this->Keyframes[i], i, distance);
+    if (score < leastScore)
+    {
+      leastScore = score;
+      leastUseful = i;
+    }
+  }
+  return leastUseful;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraKeyframeSelector::AddCells(const Keyframe& keyframe, int increment)
+{
+  for (std::vector<int>::const_iterator it = keyframe.Cells.begin(); it != keyframe.Cells.end(); ++it)
+  {
+    this->CellCounts[*it] += increment;
+  }
+}
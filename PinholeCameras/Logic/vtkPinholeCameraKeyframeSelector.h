@@ -0,0 +1,96 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraKeyframeSelector.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraKeyframeSelector_h
+#define __vtkPinholeCameraKeyframeSelector_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// STL includes
+#include <vector>
+
+/// \brief Keep a bounded set of calibration views that add the most information.
+///
+/// Each view is scored on how much of the image it covers that other views do not (coverage of a coarse grid)
+/// and on how different the board pose is from the other views. The pose is described without knowing the
+/// intrinsics: board center and apparent size in the image, and the perspective foreshortening of the
+/// board-to-image homography.
+/// Near duplicates of a kept view are rejected. Once the budget is reached, a new view replaces the least useful
+/// kept view if it scores higher, so the cost of a calibration solve stays bounded however long capture runs.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraKeyframeSelector
+{
+public:
+  static const int CoverageGridSize = 8;
+  static const int DescriptorSize = 5;
+
+  enum
+  {
+    Rejected = -2,
+    Appended = -1
+  };
+
+public:
+  vtkPinholeCameraKeyframeSelector();
+
+  /// Maximum number of kept views, 0 keeps every view.
+  /// Lowering the budget below the number of kept views evicts the least useful ones, scored as when a new view
+  /// replaces a keyframe. Their indices are appended to evicted from the highest down, so that per-view arrays kept
+  /// alongside the keyframes can be erased in that order.
+  void SetBudget(int budget, std::vector<int>* evicted = nullptr);
+  int GetBudget() const;
+
+  /// Views whose pose descriptor is closer than this to a kept view are rejected
+  void SetDuplicateDistance(double distance);
+  double GetDuplicateDistance() const;
+
+  void SetImageSize(int width, int height);
+
+  /// Score a new view given its pattern points (x,y,z) and detected pixels (x,y).
+  /// Return Appended if the view is kept as a new keyframe, the index of the keyframe it replaces, or Rejected.
+  int AddView(const float* objectPoints, const float* imagePoints, int numberOfPoints);
+
+  int GetNumberOfKeyframes() const;
+
+  /// Score of the last view given to AddView, in [0, 1]
+  double GetLastScore() const;
+
+  void Reset();
+
+protected:
+  struct Keyframe
+  {
+    double              Descriptor[DescriptorSize];
+    std::vector<int>    Cells;
+  };
+
+  bool ComputeKeyframe(const float* objectPoints, const float* imagePoints, int numberOfPoints, Keyframe& keyframe) const;
+
+  /// Score a view against all kept keyframes but one (excluded, or -1 for none)
+  double ComputeScore(const Keyframe& keyframe, int excluded, double& minimumDistance) const;
+
+  /// Index of the keyframe that adds the least to the others, or -1 if there is none
+  int FindLeastUsefulKeyframe(double& leastScore) const;
+
+  void AddCells(const Keyframe& keyframe, int increment);
+
+protected:
+  int                     Budget;
+  double                  DuplicateDistance;
+  int                     ImageSize[2];
+  double                  LastScore;
+  std::vector<Keyframe>   Keyframes;
+  std::vector<int>        CellCounts;
+};
+
+#endif
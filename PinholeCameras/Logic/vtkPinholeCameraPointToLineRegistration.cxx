@@ -0,0 +1,718 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPointToLineRegistration.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraPointToLineRegistration.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  /// Size of x = (R columns, t, 1)
+  const int STATE_SIZE = 13;
+
+  /// Number of step halvings before a step that does not lower the cost is taken as converged
+  const int MAXIMUM_STEP_HALVINGS = 10;
+
+  //----------------------------------------------------------------------------
+  /// Refined rotation and centered translation
+  struct Solution
+  {
+    double  Rotation[3][3];
+    double  Translation[3];
+    double  Cost;
+    int     Status;
+    bool    InFront;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Solutions with the points in front of the line origins win over those behind, then the lower cost wins
+  bool IsBetter(const Solution& solution, const Solution& other)
+  {
+    if (solution.Status == vtkPinholeCameraPointToLineRegistration::Degenerate)
+    {
+      return false;
+    }
+    if (other.Status == vtkPinholeCameraPointToLineRegistration::Degenerate)
+    {
+      return true;
+    }
+    if (solution.InFront != other.InFront)
+    {
+      return solution.InFront;
+    }
+    return solution.Cost < other.Cost;
+  }
+
+  //----------------------------------------------------------------------------
+  /// x = (R columns, t, 1)
+  void ToState(const double rotation[3][3], const double translation[3], double x[STATE_SIZE])
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        x[3 * j + i] = rotation[i][j];
+      }
+    }
+    std::copy(translation, translation + 3, x + 9);
+    x[12] = 1.0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Closest rotation to a matrix, R = U V^T of its SVD (VTK returns rotations for U and V^T)
+  void ClosestRotation(const double matrix[3][3], double rotation[3][3])
+  {
+    double u[3][3];
+    double w[3];
+    double vt[3][3];
+    vtkMath::SingularValueDecomposition3x3(matrix, u, w, vt);
+    vtkMath::Multiply3x3(u, vt, rotation);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Rotation exp([w]x), Rodrigues' formula
+  void RotationFromVector(const double w[3], double rotation[3][3])
+  {
+    const double angle = vtkMath::Norm(w);
+    // sin(a) / a and (1 - cos(a)) / a^2, by their series for small angles
+    const double a = angle < 1e-6 ? 1.0 - angle * angle / 6.0 : std::sin(angle) / angle;
+    const double b = angle < 1e-6 ? 0.5 - angle * angle / 24.0 : (1.0 - std::cos(angle)) / (angle * angle);
+    const double skew[3][3] = { { 0.0, -w[2], w[1] }, { w[2], 0.0, -w[0] }, { -w[1], w[0], 0.0 } };
+    double skew2[3][3];
+    vtkMath::Multiply3x3(skew, skew, skew2);
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        rotation[i][j] = (i == j ? 1.0 : 0.0) + a * skew[i][j] + b * skew2[i][j];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Eigen-decomposition of the symmetric n x n matrix a (overwritten): eigenvalues in decreasing order and
+  /// eigenvectors as the columns of the row major n x n eigenvectors
+  bool ComputeEigenvectors(double* a, int n, double* eigenvalues, double* eigenvectors)
+  {
+    std::vector<double*> aRows(n);
+    std::vector<double*> eigenvectorRows(n);
+    for (int i = 0; i < n; ++i)
+    {
+      aRows[i] = a + n * i;
+      eigenvectorRows[i] = eigenvectors + n * i;
+    }
+    return vtkMath::JacobiN(aRows.data(), n, eigenvalues, eigenvectorRows.data()) != 0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Solve the symmetric system A y = b (A is overwritten), false if A is singular or has eigenvalues below
+  /// threshold times the largest one
+  bool SolveSymmetric(double* a, int n, const double* b, double threshold, double* y)
+  {
+    std::vector<double> eigenvalues(n);
+    std::vector<double> eigenvectors(n * n);
+    if (!ComputeEigenvectors(a, n, eigenvalues.data(), eigenvectors.data()) ||
+        eigenvalues[0] <= 0.0 || eigenvalues[n - 1] < threshold * eigenvalues[0])
+    {
+      return false;
+    }
+    std::fill(y, y + n, 0.0);
+    for (int k = 0; k < n; ++k)
+    {
+      double projection = 0.0;
+      for (int i = 0; i < n; ++i)
+      {
+        projection += eigenvectors[n * i + k] * b[i];
+      }
+      projection /= eigenvalues[k];
+      for (int i = 0; i < n; ++i)
+      {
+        y[i] += projection * eigenvectors[n * i + k];
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraPointToLineRegistration);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraPointToLineRegistration::vtkPinholeCameraPointToLineRegistration()
+  : HasInitialTransform(false)
+  , Status(InsufficientData)
+  , Transform(vtkMatrix4x4::New())
+  , Error(-1.0)
+  , NumberOfIterations(0)
+  , MaximumNumberOfIterations(20)
+  , ConvergenceTolerance(1e-9)
+  , ConditionThreshold(1e-10)
+{
+  this->Reset();
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraPointToLineRegistration::~vtkPinholeCameraPointToLineRegistration()
+{
+  this->Transform->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPointToLineRegistration::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfPairs: " << this->GetNumberOfPairs() << "\n";
+  os << indent << "HasInitialTransform: " << (this->HasInitialTransform ? "true" : "false") << "\n";
+  os << indent << "Status: " << GetStatusAsString(this->Status) << "\n";
+  os << indent << "Error: " << this->Error << "\n";
+  os << indent << "NumberOfIterations: " << this->NumberOfIterations << "\n";
+  os << indent << "MaximumNumberOfIterations: " << this->MaximumNumberOfIterations << "\n";
+  os << indent << "ConvergenceTolerance: " << this->ConvergenceTolerance << "\n";
+  os << indent << "ConditionThreshold: " << this->ConditionThreshold << "\n";
+  os << indent << "Transform:\n";
+  this->Transform->PrintSelf(os, indent.GetNextIndent());
+}
+
+//----------------------------------------------------------------------------
+const char* vtkPinholeCameraPointToLineRegistration::GetStatusAsString(int status)
+{
+  switch (status)
+  {
+    case Converged:
+      return "Converged";
+    case MaximumIterationsReached:
+      return "MaximumIterationsReached";
+    case InsufficientData:
+      return "InsufficientData";
+    case Degenerate:
+      return "Degenerate";
+    default:
+      return "";
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPointToLineRegistration::AddPointAndLine(const double point[3], const double lineOrigin[3], const double lineDirection[3])
+{
+  double d[3] = { lineDirection[0], lineDirection[1], lineDirection[2] };
+  if (vtkMath::Normalize(d) == 0.0)
+  {
+    vtkErrorMacro("AddPointAndLine: the line direction is null");
+    return false;
+  }
+
+  if (this->Points.empty())
+  {
+    // Coordinates relative to the first pair keep Q well conditioned with points far from the origin
+    std::copy(point, point + 3, this->PointCenter);
+    std::copy(lineOrigin, lineOrigin + 3, this->LineCenter);
+  }
+  const double p[3] = { point[0] - this->PointCenter[0], point[1] - this->PointCenter[1], point[2] - this->PointCenter[2] };
+  const double o[3] = { lineOrigin[0] - this->LineCenter[0], lineOrigin[1] - this->LineCenter[1], lineOrigin[2] - this->LineCenter[2] };
+
+  // R p + t - o = A x with A = [p0 I, p1 I, p2 I, I, -o], and with P = I - d d^T a projection, Q += (P A)^T (P A)
+  double projection[3][3];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      projection[i][j] = (i == j ? 1.0 : 0.0) - d[i] * d[j];
+    }
+  }
+  double projectedOrigin[3];
+  vtkMath::Multiply3x3(projection, o, projectedOrigin);
+  double pa[3][STATE_SIZE];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int k = 0; k < 3; ++k)
+    {
+      pa[i][k] = p[0] * projection[i][k];
+      pa[i][3 + k] = p[1] * projection[i][k];
+      pa[i][6 + k] = p[2] * projection[i][k];
+      pa[i][9 + k] = projection[i][k];
+    }
+    pa[i][12] = -projectedOrigin[i];
+  }
+  for (int a = 0; a < STATE_SIZE; ++a)
+  {
+    for (int b = a; b < STATE_SIZE; ++b)
+    {
+      const double value = pa[0][a] * pa[0][b] + pa[1][a] * pa[1][b] + pa[2][a] * pa[2][b];
+      this->NormalMatrix[a][b] += value;
+      if (b != a)
+      {
+        this->NormalMatrix[b][a] += value;
+      }
+    }
+  }
+  // d^T A x is the signed distance along the line
+  for (int k = 0; k < 3; ++k)
+  {
+    this->DepthVector[k] += p[0] * d[k];
+    this->DepthVector[3 + k] += p[1] * d[k];
+    this->DepthVector[6 + k] += p[2] * d[k];
+    this->DepthVector[9 + k] += d[k];
+  }
+  this->DepthVector[12] -= vtkMath::Dot(d, o);
+
+  this->Points.insert(this->Points.end(), point, point + 3);
+  this->LineOrigins.insert(this->LineOrigins.end(), lineOrigin, lineOrigin + 3);
+  this->LineDirections.insert(this->LineDirections.end(), d, d + 3);
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPointToLineRegistration::Reset()
+{
+  for (int i = 0; i < STATE_SIZE; ++i)
+  {
+    std::fill(this->NormalMatrix[i], this->NormalMatrix[i] + STATE_SIZE, 0.0);
+  }
+  std::fill(this->DepthVector, this->DepthVector + STATE_SIZE, 0.0);
+  std::fill(this->PointCenter, this->PointCenter + 3, 0.0);
+  std::fill(this->LineCenter, this->LineCenter + 3, 0.0);
+  this->Points.clear();
+  this->LineOrigins.clear();
+  this->LineDirections.clear();
+
+  this->Status = InsufficientData;
+  this->Error = -1.0;
+  this->NumberOfIterations = 0;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPointToLineRegistration::GetNumberOfPairs()
+{
+  return static_cast<int>(this->Points.size() / 3);
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPointToLineRegistration::SetInitialTransform(vtkMatrix4x4* transform)
+{
+  if (transform == nullptr)
+  {
+    this->HasInitialTransform = false;
+  }
+  else
+  {
+    this->Transform->DeepCopy(transform);
+    this->HasInitialTransform = true;
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraPointToLineRegistration::ComputeCost(const double rotation[3][3], const double translation[3])
+{
+  double x[STATE_SIZE];
+  ToState(rotation, translation, x);
+  double cost = 0.0;
+  for (int a = 0; a < STATE_SIZE; ++a)
+  {
+    double row = 0.0;
+    for (int b = 0; b < STATE_SIZE; ++b)
+    {
+      row += this->NormalMatrix[a][b] * x[b];
+    }
+    cost += x[a] * row;
+  }
+  return std::max(0.0, cost);
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraPointToLineRegistration::ComputeDepth(const double rotation[3][3], const double translation[3])
+{
+  double x[STATE_SIZE];
+  ToState(rotation, translation, x);
+  double depth = 0.0;
+  for (int a = 0; a < STATE_SIZE; ++a)
+  {
+    depth += this->DepthVector[a] * x[a];
+  }
+  return depth;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPointToLineRegistration::Initialize(double rotations[2][3][3], double translations[2][3])
+{
+  // With r = vec(R), the best translation for any r is t = -(K r + k), K = Q_tt^-1 Q_tr and k = Q_tt^-1 q_t.
+  // Q_tt = sum (I - d d^T) is singular only if all lines are parallel.
+  double qtt[3 * 3];
+  for (int i = 0; i < 3; ++i)
+  {
+    std::copy(this->NormalMatrix[9 + i] + 9, this->NormalMatrix[9 + i] + 12, qtt + 3 * i);
+  }
+  double k[3];
+  double kMatrix[3][9];
+  double column[3];
+  for (int c = 0; c < 10; ++c)
+  {
+    const int stateIndex = c < 9 ? c : 12;
+    const double rhs[3] = { this->NormalMatrix[9][stateIndex], this->NormalMatrix[10][stateIndex], this->NormalMatrix[11][stateIndex] };
+    double a[3 * 3];
+    std::copy(qtt, qtt + 9, a);
+    if (!SolveSymmetric(a, 3, rhs, this->ConditionThreshold, column))
+    {
+      return false;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      (c < 9 ? kMatrix[i][c] : k[i]) = column[i];
+    }
+  }
+
+  // Reduced cost r^T S r + 2 s^T r + constant, S = Q_rr - Q_rt K and s = q_r - Q_rt k.
+  // Without a constraint r = 0 minimizes it when all lines meet at one point (the camera center), so minimize it
+  // over |r|^2 = 3, the norm of any rotation: r = -(S - mu I)^-1 s with mu below the smallest eigenvalue of S.
+  double reduced[9 * 9];
+  double s[9];
+  for (int a = 0; a < 9; ++a)
+  {
+    s[a] = this->NormalMatrix[a][12];
+    for (int i = 0; i < 3; ++i)
+    {
+      s[a] -= this->NormalMatrix[a][9 + i] * k[i];
+    }
+    for (int b = 0; b < 9; ++b)
+    {
+      reduced[9 * a + b] = this->NormalMatrix[a][b];
+      for (int i = 0; i < 3; ++i)
+      {
+        reduced[9 * a + b] -= this->NormalMatrix[a][9 + i] * kMatrix[i][b];
+      }
+    }
+  }
+  double eigenvalues[9];
+  double eigenvectors[9 * 9];
+  if (!ComputeEigenvectors(reduced, 9, eigenvalues, eigenvectors))
+  {
+    return false;
+  }
+  double c[9];
+  double sNorm = 0.0;
+  for (int j = 0; j < 9; ++j)
+  {
+    c[j] = 0.0;
+    for (int i = 0; i < 9; ++i)
+    {
+      c[j] += eigenvectors[9 * i + j] * s[i];
+    }
+    sNorm += c[j] * c[j];
+  }
+  sNorm = std::sqrt(sNorm);
+
+  // |r(mu)|^2 increases with mu towards the smallest eigenvalue, and is at most 3 at its lower bound
+  const double squaredNorm = 3.0;
+  const double smallest = eigenvalues[8];
+  auto squaredNormAt = [&](double mu)
+  {
+    double sum = 0.0;
+    for (int j = 0; j < 9; ++j)
+    {
+      const double gap = eigenvalues[j] - mu;
+      sum += gap > 0.0 ? c[j] * c[j] / (gap * gap) : 0.0;
+    }
+    return sum;
+  };
+  double low = smallest - sNorm / std::sqrt(squaredNorm);
+  double high = smallest;
+  for (int iteration = 0; iteration < 100 && low < high; ++iteration)
+  {
+    const double mu = 0.5 * (low + high);
+    (squaredNormAt(mu) < squaredNorm ? low : high) = mu;
+  }
+  const double mu = low;
+  double r[9] = {};
+  double rSquaredNorm = 0.0;
+  for (int j = 0; j < 9; ++j)
+  {
+    const double gap = eigenvalues[j] - mu;
+    const double coefficient = gap > 0.0 ? -c[j] / gap : 0.0;
+    rSquaredNorm += coefficient * coefficient;
+    for (int i = 0; i < 9; ++i)
+    {
+      r[i] += coefficient * eigenvectors[9 * i + j];
+    }
+  }
+  // Missing norm (s orthogonal to the smallest eigenvector, always with concurrent lines) goes along that eigenvector
+  const double missing = std::sqrt(std::max(0.0, squaredNorm - rSquaredNorm));
+  for (int i = 0; i < 9; ++i)
+  {
+    r[i] += missing * eigenvectors[9 * i + 8];
+  }
+
+  // The eigenvector sign is arbitrary, and the closest rotations to r and -r start towards the solutions with the
+  // points in front of and behind the line origins: both are refined
+  for (int candidate = 0; candidate < 2; ++candidate)
+  {
+    const double sign = candidate == 0 ? 1.0 : -1.0;
+    double matrix[3][3];
+    for (int j = 0; j < 3; ++j)
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        matrix[i][j] = sign * r[3 * j + i];
+      }
+    }
+    ClosestRotation(matrix, rotations[candidate]);
+    for (int i = 0; i < 3; ++i)
+    {
+      translations[candidate][i] = -k[i];
+      for (int j = 0; j < 3; ++j)
+      {
+        for (int l = 0; l < 3; ++l)
+        {
+          translations[candidate][i] -= kMatrix[i][3 * j + l] * rotations[candidate][l][j];
+        }
+      }
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPointToLineRegistration::Refine(double rotation[3][3], double translation[3], double& cost, int& iterations)
+{
+  cost = this->ComputeCost(rotation, translation);
+  for (iterations = 0; iterations < this->MaximumNumberOfIterations; ++iterations)
+  {
+    // Perturb as exp([w]x) R, t + dt. Columns of J are the derivatives of x for each of (w, dt).
+    double x[STATE_SIZE];
+    ToState(rotation, translation, x);
+    double jacobian[STATE_SIZE][6] = {};
+    for (int k = 0; k < 3; ++k)
+    {
+      const double axis[3] = { k == 0 ? 1.0 : 0.0, k == 1 ? 1.0 : 0.0, k == 2 ? 1.0 : 0.0 };
+      for (int j = 0; j < 3; ++j)
+      {
+        const double column[3] = { rotation[0][j], rotation[1][j], rotation[2][j] };
+        double derivative[3];
+        vtkMath::Cross(axis, column, derivative);
+        for (int i = 0; i < 3; ++i)
+        {
+          jacobian[3 * j + i][k] = derivative[i];
+        }
+      }
+      jacobian[9 + k][3 + k] = 1.0;
+    }
+
+    // Negative gradient -J^T Q x and Gauss-Newton matrix J^T Q J, both halved
+    double qx[STATE_SIZE];
+    double qj[STATE_SIZE][6];
+    for (int a = 0; a < STATE_SIZE; ++a)
+    {
+      qx[a] = 0.0;
+      std::fill(qj[a], qj[a] + 6, 0.0);
+      for (int b = 0; b < STATE_SIZE; ++b)
+      {
+        qx[a] += this->NormalMatrix[a][b] * x[b];
+        for (int k = 0; k < 6; ++k)
+        {
+          qj[a][k] += this->NormalMatrix[a][b] * jacobian[b][k];
+        }
+      }
+    }
+    double gradient[6];
+    double hessian[6 * 6];
+    for (int k = 0; k < 6; ++k)
+    {
+      gradient[k] = 0.0;
+      for (int a = 0; a < STATE_SIZE; ++a)
+      {
+        gradient[k] -= jacobian[a][k] * qx[a];
+      }
+      for (int l = 0; l < 6; ++l)
+      {
+        hessian[6 * k + l] = 0.0;
+        for (int a = 0; a < STATE_SIZE; ++a)
+        {
+          hessian[6 * k + l] += jacobian[a][k] * qj[a][l];
+        }
+      }
+    }
+    double step[6];
+    if (!SolveSymmetric(hessian, 6, gradient, this->ConditionThreshold, step))
+    {
+      return Degenerate;
+    }
+
+    // Halve steps that do not lower the cost, which only happens far from the solution
+    bool lowered = false;
+    for (int halving = 0; halving < MAXIMUM_STEP_HALVINGS && !lowered; ++halving)
+    {
+      double stepRotation[3][3];
+      double newRotation[3][3];
+      RotationFromVector(step, stepRotation);
+      vtkMath::Multiply3x3(stepRotation, rotation, newRotation);
+      const double newTranslation[3] = { translation[0] + step[3], translation[1] + step[4], translation[2] + step[5] };
+      const double newCost = this->ComputeCost(newRotation, newTranslation);
+      if (newCost <= cost)
+      {
+        for (int i = 0; i < 3; ++i)
+        {
+          std::copy(newRotation[i], newRotation[i] + 3, rotation[i]);
+        }
+        std::copy(newTranslation, newTranslation + 3, translation);
+        cost = newCost;
+        lowered = true;
+      }
+      else
+      {
+        std::transform(step, step + 6, step, [](double value) { return 0.5 * value; });
+      }
+    }
+
+    // No lower cost along the step: the cost is at its minimum to rounding
+    if (!lowered || (vtkMath::Norm(step) <= this->ConvergenceTolerance && vtkMath::Norm(step + 3) <= this->ConvergenceTolerance))
+    {
+      ++iterations;
+      return Converged;
+    }
+  }
+  return MaximumIterationsReached;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPointToLineRegistration::Update()
+{
+  this->Error = -1.0;
+  this->NumberOfIterations = 0;
+
+  // Each pair constrains 2 of the 6 degrees of freedom
+  const int numberOfPairs = this->GetNumberOfPairs();
+  if (numberOfPairs < 3)
+  {
+    this->Status = InsufficientData;
+    this->Modified();
+    return false;
+  }
+
+  Solution best;
+  best.Status = Degenerate;
+  auto refine = [&](Solution& solution)
+  {
+    int iterations = 0;
+    solution.Status = this->Refine(solution.Rotation, solution.Translation, solution.Cost, iterations);
+    solution.InFront = this->ComputeDepth(solution.Rotation, solution.Translation) > 0.0;
+    this->NumberOfIterations += iterations;
+    if (IsBetter(solution, best))
+    {
+      best = solution;
+    }
+  };
+
+  if (this->HasInitialTransform)
+  {
+    // R p + t - o = R (p - pc) + (R pc + t - oc) - (o - oc), so the centered translation is R pc + t - oc
+    Solution previous;
+    double matrix[3][3];
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        matrix[i][j] = this->Transform->GetElement(i, j);
+      }
+    }
+    ClosestRotation(matrix, previous.Rotation);
+    vtkMath::Multiply3x3(previous.Rotation, this->PointCenter, previous.Translation);
+    for (int i = 0; i < 3; ++i)
+    {
+      previous.Translation[i] += this->Transform->GetElement(i, 3) - this->LineCenter[i];
+    }
+    refine(previous);
+  }
+
+  if (best.Status != Converged || !best.InFront)
+  {
+    Solution starts[2];
+    double rotations[2][3][3];
+    double translations[2][3];
+    if (this->Initialize(rotations, translations))
+    {
+      for (int candidate = 0; candidate < 2; ++candidate)
+      {
+        for (int i = 0; i < 3; ++i)
+        {
+          std::copy(rotations[candidate][i], rotations[candidate][i] + 3, starts[candidate].Rotation[i]);
+        }
+        std::copy(translations[candidate], translations[candidate] + 3, starts[candidate].Translation);
+        refine(starts[candidate]);
+      }
+    }
+  }
+
+  this->Status = best.Status;
+  if (best.Status == Degenerate)
+  {
+    vtkDebugMacro("Update: the points and lines do not determine the transform");
+    this->Modified();
+    return false;
+  }
+
+  // Back from centered coordinates: t = tc - R pc + oc
+  double rotatedCenter[3];
+  vtkMath::Multiply3x3(best.Rotation, this->PointCenter, rotatedCenter);
+  this->Transform->Identity();
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      this->Transform->SetElement(i, j, best.Rotation[i][j]);
+    }
+    this->Transform->SetElement(i, 3, best.Translation[i] - rotatedCenter[i] + this->LineCenter[i]);
+  }
+  this->HasInitialTransform = true;
+  this->Error = std::sqrt(best.Cost / numberOfPairs);
+  this->Modified();
+  return best.Status == Converged;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPointToLineRegistration::GetResiduals(vtkDoubleArray* residuals)
+{
+  if (residuals == nullptr)
+  {
+    vtkErrorMacro("GetResiduals: invalid output array");
+    return false;
+  }
+
+  const int numberOfPairs = this->GetNumberOfPairs();
+  residuals->SetNumberOfComponents(1);
+  residuals->SetNumberOfTuples(numberOfPairs);
+  for (int pair = 0; pair < numberOfPairs; ++pair)
+  {
+    const double* point = this->Points.data() + 3 * pair;
+    const double* origin = this->LineOrigins.data() + 3 * pair;
+    const double homogeneous[4] = { point[0], point[1], point[2], 1.0 };
+    double transformed[4];
+    this->Transform->MultiplyPoint(homogeneous, transformed);
+    const double v[3] = { transformed[0] - origin[0], transformed[1] - origin[1], transformed[2] - origin[2] };
+    double cross[3];
+    vtkMath::Cross(v, this->LineDirections.data() + 3 * pair, cross);
+    residuals->SetValue(pair, vtkMath::Norm(cross));
+  }
+  return true;
+}
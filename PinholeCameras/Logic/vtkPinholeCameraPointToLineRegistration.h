@@ -0,0 +1,148 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPointToLineRegistration.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraPointToLineRegistration_h
+#define __vtkPinholeCameraPointToLineRegistration_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STL includes
+#include <vector>
+
+class vtkDoubleArray;
+class vtkMatrix4x4;
+
+/// \brief Rigid registration of points to lines, as used to find the marker to image sensor transform of a camera.
+///
+/// Finds the rotation R and translation t minimizing the sum over all pairs of the squared distance from R p + t to
+/// the line (o, d), i.e. |(I - d d^T)(R p + t - o)|^2. The distance is linear in x = (R, t, 1), so the cost is x^T Q x
+/// for a 13x13 matrix Q accumulated as pairs are added: adding a pair and solving again take constant time however
+/// many pairs were added.
+/// Update runs Gauss-Newton on the rotation, starting from the previous result (or the transform given with
+/// SetInitialTransform). When there is none or it does not converge from there, it starts from the closest rotation to
+/// the linear least-squares solution constrained to the norm of a rotation.
+/// Line directions are expected to point from the line origin towards the points, as camera rays do: the cost does not
+/// tell a solution from its mirror with the points behind the line origins, the one with the points in front is kept.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraPointToLineRegistration : public vtkObject
+{
+public:
+  enum
+  {
+    Converged = 0,
+    MaximumIterationsReached,
+    InsufficientData,
+    Degenerate,
+    Status_Last
+  };
+
+public:
+  static vtkPinholeCameraPointToLineRegistration* New();
+  vtkTypeMacro(vtkPinholeCameraPointToLineRegistration, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Add a point and the line it should lie on, the direction does not need to be normalized.
+  /// Return false if the direction is null.
+  bool AddPointAndLine(const double point[3], const double lineOrigin[3], const double lineDirection[3]);
+
+  ///
+  /// Remove all pairs. The last transform is kept as the starting point of the next Update.
+  void Reset();
+
+  int GetNumberOfPairs();
+
+  ///
+  /// Start the next Update from this transform instead of the last result
+  void SetInitialTransform(vtkMatrix4x4* transform);
+
+  ///
+  /// Register the points to the lines added so far. Return true if the solution converged, see GetStatus otherwise.
+  /// With MaximumIterationsReached, the transform and error are those of the best iterate.
+  bool Update();
+
+  ///
+  /// Results of the last Update: status, point to line transform, RMS distance from the transformed points to their
+  /// lines (-1 if there is no solution) and number of Gauss-Newton iterations
+  vtkGetMacro(Status, int);
+  static const char* GetStatusAsString(int status);
+  vtkGetObjectMacro(Transform, vtkMatrix4x4);
+  vtkGetMacro(Error, double);
+  vtkGetMacro(NumberOfIterations, int);
+
+  ///
+  /// Distance from each transformed point to its line, in the order the pairs were added
+  bool GetResiduals(vtkDoubleArray* residuals);
+
+  ///
+  /// Largest number of Gauss-Newton iterations per Update (default 20)
+  vtkSetMacro(MaximumNumberOfIterations, int);
+  vtkGetMacro(MaximumNumberOfIterations, int);
+
+  ///
+  /// Iterations stop when the rotation step (rad) and translation step (mm) are both below this (default 1e-9)
+  vtkSetMacro(ConvergenceTolerance, double);
+  vtkGetMacro(ConvergenceTolerance, double);
+
+  ///
+  /// Smallest ratio of the smallest to the largest eigenvalue of the Gauss-Newton system for the pose to be
+  /// determined, e.g. not all points on a line (default 1e-10)
+  vtkSetMacro(ConditionThreshold, double);
+  vtkGetMacro(ConditionThreshold, double);
+
+protected:
+  vtkPinholeCameraPointToLineRegistration();
+  ~vtkPinholeCameraPointToLineRegistration();
+
+  /// Refine a rotation and (centered) translation, return the status
+  int Refine(double rotation[3][3], double translation[3], double& cost, int& iterations);
+
+  /// Closest rotations to the norm constrained linear solution and its opposite, false if they are undetermined
+  /// (all lines parallel)
+  bool Initialize(double rotations[2][3][3], double translations[2][3]);
+
+  /// Cost x^T Q x of a rotation and centered translation
+  double ComputeCost(const double rotation[3][3], const double translation[3]);
+
+  /// Sum of the signed distances of the transformed points along their lines
+  double ComputeDepth(const double rotation[3][3], const double translation[3]);
+
+  /// Normal matrix Q of x = (R columns, t, 1), with points and line origins relative to the first pair
+  double        NormalMatrix[13][13];
+  double        DepthVector[13];
+  double        PointCenter[3];
+  double        LineCenter[3];
+
+  /// Pairs as added (unit directions), kept for the residuals
+  std::vector<double> Points;
+  std::vector<double> LineOrigins;
+  std::vector<double> LineDirections;
+
+  bool          HasInitialTransform;
+  int           Status;
+  vtkMatrix4x4* Transform;
+  double        Error;
+  int           NumberOfIterations;
+  int           MaximumNumberOfIterations;
+  double        ConvergenceTolerance;
+  double        ConditionThreshold;
+
+private:
+  vtkPinholeCameraPointToLineRegistration(const vtkPinholeCameraPointToLineRegistration&); // Not implemented
+  void operator=(const vtkPinholeCameraPointToLineRegistration&); // Not implemented
+};
+
+#endif
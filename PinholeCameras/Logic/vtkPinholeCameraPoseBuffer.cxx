@@ -0,0 +1,311 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPoseBuffer.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraPoseBuffer.h"
+
+// MRML includes
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkTimerLog.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraPoseBuffer);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraPoseBuffer::vtkPinholeCameraPoseBuffer()
+  : Capacity(0)
+  , First(0)
+  , NumberOfPoses(0)
+  , TransformNode(nullptr)
+  , TransformCallback(vtkCallbackCommand::New())
+{
+  this->TransformCallback->SetClientData(this);
+  this->TransformCallback->SetCallback(vtkPinholeCameraPoseBuffer::OnTransformModified);
+  this->SetCapacity(512);
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraPoseBuffer::~vtkPinholeCameraPoseBuffer()
+{
+  this->SetTransformNode(nullptr);
+  this->TransformCallback->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Capacity: " << this->Capacity << "\n";
+  os << indent << "NumberOfPoses: " << this->NumberOfPoses << "\n";
+  if (this->NumberOfPoses > 0)
+  {
+    os << indent << "OldestTimestamp: " << this->GetOldestTimestamp() << "\n";
+    os << indent << "NewestTimestamp: " << this->GetNewestTimestamp() << "\n";
+  }
+  os << indent << "TransformNode: " << (this->TransformNode ? this->TransformNode->GetID() : "(none)") << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::SetCapacity(int capacity)
+{
+  if (capacity < 2)
+  {
+    vtkErrorMacro("SetCapacity: at least 2 poses are needed to interpolate");
+    return;
+  }
+  if (capacity == this->Capacity)
+  {
+    return;
+  }
+  this->Capacity = capacity;
+  this->Timestamps.assign(capacity, 0.0);
+  this->Rotations.assign(4 * capacity, 0.0);
+  this->Translations.assign(3 * capacity, 0.0);
+  this->Reset();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::Reset()
+{
+  this->First = 0;
+  this->NumberOfPoses = 0;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPoseBuffer::GetNumberOfPoses()
+{
+  return this->NumberOfPoses;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPoseBuffer::GetStorageIndex(int index) const
+{
+  return (this->First + index) % this->Capacity;
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraPoseBuffer::GetOldestTimestamp()
+{
+  return this->NumberOfPoses > 0 ? this->Timestamps[this->First] : 0.0;
+}
+
+//----------------------------------------------------------------------------
+double vtkPinholeCameraPoseBuffer::GetNewestTimestamp()
+{
+  return this->NumberOfPoses > 0 ? this->Timestamps[this->GetStorageIndex(this->NumberOfPoses - 1)] : 0.0;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPoseBuffer::AddPose(vtkMatrix4x4* pose, double timestamp)
+{
+  if (pose == nullptr)
+  {
+    vtkErrorMacro("AddPose: invalid pose");
+    return false;
+  }
+
+  int index = 0;
+  const double* previousRotation = nullptr;
+  if (this->NumberOfPoses > 0)
+  {
+    const int newest = this->GetStorageIndex(this->NumberOfPoses - 1);
+    if (timestamp < this->Timestamps[newest])
+    {
+      vtkErrorMacro("AddPose: timestamp " << timestamp << " is older than the newest pose (" << this->Timestamps[newest] << ")");
+      return false;
+    }
+    if (timestamp == this->Timestamps[newest])
+    {
+      index = newest;
+      if (this->NumberOfPoses > 1)
+      {
+        previousRotation = &this->Rotations[4 * this->GetStorageIndex(this->NumberOfPoses - 2)];
+      }
+    }
+    else
+    {
+      previousRotation = &this->Rotations[4 * newest];
+      if (this->NumberOfPoses < this->Capacity)
+      {
+        index = this->GetStorageIndex(this->NumberOfPoses);
+        ++this->NumberOfPoses;
+      }
+      else
+      {
+        // Overwrite the oldest pose
+        index = this->First;
+        this->First = (this->First + 1) % this->Capacity;
+      }
+    }
+  }
+  else
+  {
+    this->NumberOfPoses = 1;
+    index = this->First;
+  }
+
+  double rotation[3][3];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      rotation[i][j] = pose->GetElement(i, j);
+    }
+    this->Translations[3 * index + i] = pose->GetElement(i, 3);
+  }
+  double* quaternion = &this->Rotations[4 * index];
+  vtkMath::Matrix3x3ToQuaternion(rotation, quaternion);
+  // q and -q are the same rotation, keep consecutive quaternions on the same side so interpolation takes the short way
+  if (previousRotation != nullptr &&
+      quaternion[0] * previousRotation[0] + quaternion[1] * previousRotation[1] + quaternion[2] * previousRotation[2] + quaternion[3] * previousRotation[3] < 0.0)
+  {
+    std::transform(quaternion, quaternion + 4, quaternion, [](double value) { return -value; });
+  }
+  this->Timestamps[index] = timestamp;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraPoseBuffer::GetPoseAtTime(double timestamp, vtkMatrix4x4* pose)
+{
+  if (pose == nullptr)
+  {
+    vtkErrorMacro("GetPoseAtTime: invalid pose");
+    return false;
+  }
+  if (this->NumberOfPoses == 0)
+  {
+    return false;
+  }
+
+  const int oldest = this->First;
+  const int newest = this->GetStorageIndex(this->NumberOfPoses - 1);
+  if (timestamp <= this->Timestamps[oldest] || this->NumberOfPoses == 1)
+  {
+    this->InterpolatePose(oldest, oldest, 0.0, pose);
+    return timestamp == this->Timestamps[oldest];
+  }
+  if (timestamp >= this->Timestamps[newest])
+  {
+    this->InterpolatePose(newest, newest, 0.0, pose);
+    return timestamp == this->Timestamps[newest];
+  }
+
+  // Guess the pose just before the time from the mean period, then step to it: a step or two at a steady rate
+  const double span = this->Timestamps[newest] - this->Timestamps[oldest];
+  int before = static_cast<int>((timestamp - this->Timestamps[oldest]) / span * (this->NumberOfPoses - 1));
+  before = std::max(0, std::min(this->NumberOfPoses - 2, before));
+  while (before > 0 && this->Timestamps[this->GetStorageIndex(before)] > timestamp)
+  {
+    --before;
+  }
+  while (before < this->NumberOfPoses - 2 && this->Timestamps[this->GetStorageIndex(before + 1)] < timestamp)
+  {
+    ++before;
+  }
+
+  const int i = this->GetStorageIndex(before);
+  const int j = this->GetStorageIndex(before + 1);
+  const double interval = this->Timestamps[j] - this->Timestamps[i];
+  this->InterpolatePose(i, j, interval > 0.0 ? (timestamp - this->Timestamps[i]) / interval : 0.0, pose);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::InterpolatePose(int i, int j, double alpha, vtkMatrix4x4* pose) const
+{
+  const double* q0 = &this->Rotations[4 * i];
+  const double* q1 = &this->Rotations[4 * j];
+  double w0 = 1.0 - alpha;
+  double w1 = alpha;
+  const double cosine = std::min(1.0, q0[0] * q1[0] + q0[1] * q1[1] + q0[2] * q1[2] + q0[3] * q1[3]);
+  // Linear interpolation is accurate enough, and stable, between nearly equal rotations
+  if (cosine < 0.9995)
+  {
+    const double angle = std::acos(cosine);
+    const double sine = std::sin(angle);
+    w0 = std::sin((1.0 - alpha) * angle) / sine;
+    w1 = std::sin(alpha * angle) / sine;
+  }
+  double quaternion[4];
+  for (int k = 0; k < 4; ++k)
+  {
+    quaternion[k] = w0 * q0[k] + w1 * q1[k];
+  }
+  const double norm = std::sqrt(quaternion[0] * quaternion[0] + quaternion[1] * quaternion[1] + quaternion[2] * quaternion[2] + quaternion[3] * quaternion[3]);
+  std::transform(quaternion, quaternion + 4, quaternion, [norm](double value) { return value / norm; });
+
+  double rotation[3][3];
+  vtkMath::QuaternionToMatrix3x3(quaternion, rotation);
+  pose->Identity();
+  for (int r = 0; r < 3; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      pose->SetElement(r, c, rotation[r][c]);
+    }
+    pose->SetElement(r, 3, (1.0 - alpha) * this->Translations[3 * i + r] + alpha * this->Translations[3 * j + r]);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::SetTransformNode(vtkMRMLTransformNode* transformNode)
+{
+  if (transformNode == this->TransformNode)
+  {
+    return;
+  }
+  if (this->TransformNode != nullptr)
+  {
+    this->TransformNode->RemoveObserver(this->TransformCallback);
+    this->TransformNode->UnRegister(this);
+  }
+  // Poses of another node must not be interpolated with the new ones
+  this->Reset();
+  this->TransformNode = transformNode;
+  if (this->TransformNode != nullptr)
+  {
+    this->TransformNode->Register(this);
+    this->TransformNode->AddObserver(vtkMRMLTransformNode::TransformModifiedEvent, this->TransformCallback);
+    OnTransformModified(this->TransformNode, vtkMRMLTransformNode::TransformModifiedEvent, this, nullptr);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraPoseBuffer::OnTransformModified(vtkObject* caller, unsigned long vtkNotUsed(eventId), void* clientData, void* vtkNotUsed(callData))
+{
+  vtkPinholeCameraPoseBuffer* self = static_cast<vtkPinholeCameraPoseBuffer*>(clientData);
+  vtkMRMLTransformNode* transformNode = vtkMRMLTransformNode::SafeDownCast(caller);
+  if (self == nullptr || transformNode == nullptr)
+  {
+    return;
+  }
+  vtkNew<vtkMatrix4x4> pose;
+  transformNode->GetMatrixTransformToParent(pose.GetPointer());
+  self->AddPose(pose.GetPointer(), vtkTimerLog::GetUniversalTime());
+}
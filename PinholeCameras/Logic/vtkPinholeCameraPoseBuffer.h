@@ -0,0 +1,100 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPoseBuffer.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraPoseBuffer_h
+#define __vtkPinholeCameraPoseBuffer_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STL includes
+#include <vector>
+
+class vtkCallbackCommand;
+class vtkMatrix4x4;
+class vtkMRMLTransformNode;
+
+/// \brief Timestamped history of a tracked pose, to look up the pose at the time a video frame was acquired.
+///
+/// Poses are kept in a ring buffer of fixed capacity as a unit quaternion and a translation, the oldest pose being
+/// overwritten when the buffer is full. The pose at any time of the recorded span is interpolated between the two
+/// poses around it: spherical linear interpolation of the rotation, linear interpolation of the translation.
+/// The poses around a time are found from the mean sampling period, so a query takes constant time at a steady
+/// tracker rate.
+/// Poses are added explicitly with AddPose, or recorded on every change of an observed transform node.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraPoseBuffer : public vtkObject
+{
+public:
+  static vtkPinholeCameraPoseBuffer* New();
+  vtkTypeMacro(vtkPinholeCameraPoseBuffer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Largest number of poses kept (default 512, e.g. 8 s of tracking at 60 Hz). Changing it clears the buffer.
+  void SetCapacity(int capacity);
+  vtkGetMacro(Capacity, int);
+
+  ///
+  /// Add a pose with its timestamp in seconds. Only the rigid part is kept (closest rotation if the pose scales).
+  /// Timestamps must not decrease, a pose with the same timestamp as the newest one replaces it.
+  bool AddPose(vtkMatrix4x4* pose, double timestamp);
+
+  void Reset();
+
+  int GetNumberOfPoses();
+  double GetOldestTimestamp();
+  double GetNewestTimestamp();
+
+  ///
+  /// Interpolate the pose at a time. Return false if the buffer is empty (pose is left unchanged) or the time is
+  /// outside the recorded span (pose is set to the oldest or newest pose).
+  bool GetPoseAtTime(double timestamp, vtkMatrix4x4* pose);
+
+  ///
+  /// Record the transform to parent of a node each time it is modified, timestamped with
+  /// vtkTimerLog::GetUniversalTime. Changing the node clears the buffer, then the current pose is recorded right away.
+  /// Set to null to stop recording.
+  void SetTransformNode(vtkMRMLTransformNode* transformNode);
+  vtkGetObjectMacro(TransformNode, vtkMRMLTransformNode);
+
+protected:
+  vtkPinholeCameraPoseBuffer();
+  ~vtkPinholeCameraPoseBuffer();
+
+  static void OnTransformModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+
+  /// Storage index of the i-th oldest pose
+  int GetStorageIndex(int index) const;
+
+  /// Write pose i (storage index), or the interpolation between poses i and j at weight alpha of j
+  void InterpolatePose(int i, int j, double alpha, vtkMatrix4x4* pose) const;
+
+  int                   Capacity;
+  int                   First;
+  int                   NumberOfPoses;
+  std::vector<double>   Timestamps;
+  std::vector<double>   Rotations;
+  std::vector<double>   Translations;
+
+  vtkMRMLTransformNode* TransformNode;
+  vtkCallbackCommand*   TransformCallback;
+
+private:
+  vtkPinholeCameraPoseBuffer(const vtkPinholeCameraPoseBuffer&); // Not implemented
+  void operator=(const vtkPinholeCameraPoseBuffer&); // Not implemented
+};
+
+#endif
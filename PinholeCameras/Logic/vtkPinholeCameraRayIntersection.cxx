@@ -0,0 +1,454 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraRayIntersection.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraRayIntersection.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix3x3.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  /// Refinement rounds of the robust solve: the inliers are selected again from the refined point until they settle
+  const int MAXIMUM_ROBUST_REFINEMENTS = 3;
+
+  //----------------------------------------------------------------------------
+  /// Squared distance from a point to a ray of unit direction
+  inline double SquaredDistanceToRay(const double point[3], const double* origin, const double* direction)
+  {
+    const double v[3] = { point[0] - origin[0], point[1] - origin[1], point[2] - origin[2] };
+    double cross[3];
+    vtkMath::Cross(v, direction, cross);
+    return vtkMath::Dot(cross, cross);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Midpoint of the closest points of two rays of unit direction, false if they are parallel or meet behind an origin
+  inline bool ComputeClosestPoint(const double* origin1, const double* direction1, const double* origin2, const double* direction2, double point[3])
+  {
+    const double w[3] = { origin1[0] - origin2[0], origin1[1] - origin2[1], origin1[2] - origin2[2] };
+    const double b = vtkMath::Dot(direction1, direction2);
+    const double d = vtkMath::Dot(direction1, w);
+    const double e = vtkMath::Dot(direction2, w);
+    const double denominator = 1.0 - b * b;
+    if (denominator < 1e-12)
+    {
+      return false;
+    }
+    const double s = (b * e - d) / denominator;
+    const double t = (e - b * d) / denominator;
+    if (s <= 0.0 || t <= 0.0)
+    {
+      return false;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      point[i] = 0.5 * (origin1[i] + s * direction1[i] + origin2[i] + t * direction2[i]);
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Score candidate pairs of rays, keeping the best candidate of each thread
+  class ScoreCandidatesFunctor
+  {
+  public:
+    const std::vector<double>*                    Origins;
+    const std::vector<double>*                    Directions;
+    const std::vector<std::pair<int, int> >*      Pairs;
+    double                                        SquaredThreshold;
+
+    /// Cost and index of the best candidate
+    vtkSMPThreadLocal<std::pair<double, vtkIdType> > Best;
+
+    void Initialize()
+    {
+      this->Best.Local() = std::make_pair(std::numeric_limits<double>::infinity(), vtkIdType(-1));
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      const double* origins = this->Origins->data();
+      const double* directions = this->Directions->data();
+      const vtkIdType numberOfRays = static_cast<vtkIdType>(this->Origins->size() / 3);
+      std::pair<double, vtkIdType>& best = this->Best.Local();
+      for (vtkIdType candidate = begin; candidate < end; ++candidate)
+      {
+        const std::pair<int, int>& pair = (*this->Pairs)[candidate];
+        double point[3];
+        if (!ComputeClosestPoint(origins + 3 * pair.first, directions + 3 * pair.first, origins + 3 * pair.second, directions + 3 * pair.second, point))
+        {
+          continue;
+        }
+        double cost = 0.0;
+        for (vtkIdType ray = 0; ray < numberOfRays && cost <= best.first; ++ray)
+        {
+          cost += std::min(SquaredDistanceToRay(point, origins + 3 * ray, directions + 3 * ray), this->SquaredThreshold);
+        }
+        // Lowest index wins ties so the result does not depend on how candidates are split between threads
+        if (cost < best.first || (cost == best.first && candidate < best.second))
+        {
+          best = std::make_pair(cost, candidate);
+        }
+      }
+    }
+
+    void Reduce()
+    {
+    }
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraRayIntersection);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraRayIntersection::vtkPinholeCameraRayIntersection()
+  : Covariance(vtkMatrix3x3::New())
+  , ConditionThreshold(1e-10)
+  , RobustThreshold(2.0)
+  , RobustNumberOfIterations(500)
+{
+  this->Reset();
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraRayIntersection::~vtkPinholeCameraRayIntersection()
+{
+  this->Covariance->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraRayIntersection::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfRays: " << this->NumberOfRays << "\n";
+  os << indent << "Intersection: " << this->Intersection[0] << ", " << this->Intersection[1] << ", " << this->Intersection[2] << "\n";
+  os << indent << "Error: " << this->Error << "\n";
+  os << indent << "ConditionThreshold: " << this->ConditionThreshold << "\n";
+  os << indent << "RobustThreshold: " << this->RobustThreshold << "\n";
+  os << indent << "RobustNumberOfIterations: " << this->RobustNumberOfIterations << "\n";
+  os << indent << "Covariance:\n";
+  this->Covariance->PrintSelf(os, indent.GetNextIndent());
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraRayIntersection::AddRay(const double origin[3], const double direction[3], double weight /*= 1.0*/)
+{
+  if (weight <= 0.0)
+  {
+    vtkErrorMacro("AddRay: the weight must be positive");
+    return false;
+  }
+  return this->AccumulateRay(origin, direction, weight, 1);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraRayIntersection::RemoveRay(const double origin[3], const double direction[3], double weight /*= 1.0*/)
+{
+  if (weight <= 0.0 || this->NumberOfRays == 0)
+  {
+    vtkErrorMacro("RemoveRay: no such ray");
+    return false;
+  }
+  if (this->NumberOfRays == 1)
+  {
+    // Start again from exact zeros rather than from the rounding left by the subtraction
+    this->Reset();
+    return true;
+  }
+  return this->AccumulateRay(origin, direction, -weight, -1);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraRayIntersection::AccumulateRay(const double origin[3], const double direction[3], double weight, int count)
+{
+  double d[3] = { direction[0], direction[1], direction[2] };
+  if (vtkMath::Normalize(d) == 0.0)
+  {
+    vtkErrorMacro("AccumulateRay: the ray direction is null");
+    return false;
+  }
+
+  // P = I - d d^T projects onto the plane orthogonal to the ray
+  double projectedOrigin[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      const double p = (i == j ? 1.0 : 0.0) - d[i] * d[j];
+      this->NormalMatrix[i][j] += weight * p;
+    }
+  }
+  const double along = vtkMath::Dot(origin, d);
+  for (int i = 0; i < 3; ++i)
+  {
+    projectedOrigin[i] = origin[i] - along * d[i];
+    this->NormalVector[i] += weight * projectedOrigin[i];
+  }
+  this->SquaredDistanceSum += weight * vtkMath::Dot(projectedOrigin, projectedOrigin);
+  this->WeightSum += weight;
+  this->NumberOfRays += count;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraRayIntersection::Reset()
+{
+  for (int i = 0; i < 3; ++i)
+  {
+    std::fill(this->NormalMatrix[i], this->NormalMatrix[i] + 3, 0.0);
+  }
+  std::fill(this->NormalVector, this->NormalVector + 3, 0.0);
+  this->SquaredDistanceSum = 0.0;
+  this->WeightSum = 0.0;
+  this->NumberOfRays = 0;
+
+  std::fill(this->Intersection, this->Intersection + 3, 0.0);
+  this->Error = -1.0;
+  this->Covariance->Zero();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraRayIntersection::GetNumberOfRays()
+{
+  return this->NumberOfRays;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraRayIntersection::Update()
+{
+  std::fill(this->Intersection, this->Intersection + 3, 0.0);
+  this->Error = -1.0;
+  this->Covariance->Zero();
+
+  if (this->NumberOfRays < 2 || this->WeightSum <= 0.0)
+  {
+    return false;
+  }
+
+  // A is symmetric positive semi-definite, singular when all rays are parallel
+  double a[3][3];
+  double eigenvectors[3][3];
+  double eigenvalues[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    std::copy(this->NormalMatrix[i], this->NormalMatrix[i] + 3, a[i]);
+  }
+  double* aRows[3] = { a[0], a[1], a[2] };
+  double* eigenvectorRows[3] = { eigenvectors[0], eigenvectors[1], eigenvectors[2] };
+  vtkMath::Jacobi(aRows, eigenvalues, eigenvectorRows);
+  // Eigenvalues are sorted in decreasing order
+  if (eigenvalues[0] <= 0.0 || eigenvalues[2] < this->ConditionThreshold * eigenvalues[0])
+  {
+    vtkDebugMacro("Update: rays are parallel, no intersection");
+    return false;
+  }
+
+  // A^-1 = V diag(1 / lambda) V^T, eigenvectors are the columns of V
+  double inverse[3][3];
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      inverse[i][j] = 0.0;
+      for (int k = 0; k < 3; ++k)
+      {
+        inverse[i][j] += eigenvectors[i][k] * eigenvectors[j][k] / eigenvalues[k];
+      }
+    }
+  }
+  vtkMath::Multiply3x3(inverse, this->NormalVector, this->Intersection);
+
+  // Sum of weighted squared distances at the solution: x^T A x - 2 b^T x + c = c - b^T x
+  const double squaredDistance = std::max(0.0, this->SquaredDistanceSum - vtkMath::Dot(this->NormalVector, this->Intersection));
+  this->Error = std::sqrt(squaredDistance / this->WeightSum);
+
+  const int degreesOfFreedom = 2 * this->NumberOfRays - 3;
+  const double variance = squaredDistance / degreesOfFreedom;
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      this->Covariance->SetElement(i, j, variance * inverse[i][j]);
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraRayIntersection::UpdateRobust(vtkDoubleArray* origins, vtkDoubleArray* directions, vtkIntArray* inliers /*= nullptr*/)
+{
+  if (origins == nullptr || directions == nullptr || origins->GetNumberOfComponents() != 3 || directions->GetNumberOfComponents() != 3 ||
+      origins->GetNumberOfTuples() != directions->GetNumberOfTuples())
+  {
+    vtkErrorMacro("UpdateRobust: origins and directions must be 3 component arrays with one tuple per ray");
+    return false;
+  }
+  if (this->RobustThreshold <= 0.0)
+  {
+    vtkErrorMacro("UpdateRobust: the inlier threshold must be positive");
+    return false;
+  }
+
+  if (inliers != nullptr)
+  {
+    inliers->SetNumberOfComponents(1);
+    inliers->SetNumberOfTuples(origins->GetNumberOfTuples());
+    inliers->FillValue(0);
+  }
+  this->Reset();
+
+  // Rays with a null direction are left out, they are never inliers
+  std::vector<double> rayOrigins;
+  std::vector<double> rayDirections;
+  std::vector<vtkIdType> rayIds;
+  for (vtkIdType id = 0; id < origins->GetNumberOfTuples(); ++id)
+  {
+    double direction[3];
+    directions->GetTypedTuple(id, direction);
+    if (vtkMath::Normalize(direction) == 0.0)
+    {
+      continue;
+    }
+    const double* origin = origins->GetPointer(3 * id);
+    rayOrigins.insert(rayOrigins.end(), origin, origin + 3);
+    rayDirections.insert(rayDirections.end(), direction, direction + 3);
+    rayIds.push_back(id);
+  }
+  const int numberOfRays = static_cast<int>(rayIds.size());
+  std::vector<char> isInlier(numberOfRays, 0);
+
+  // All pairs when there are few, random pairs otherwise. The generator is seeded so that results are reproducible.
+  std::vector<std::pair<int, int> > pairs;
+  const long long numberOfPairs = static_cast<long long>(numberOfRays) * (numberOfRays - 1) / 2;
+  if (numberOfPairs <= std::max(this->RobustNumberOfIterations, 1))
+  {
+    for (int i = 0; i < numberOfRays; ++i)
+    {
+      for (int j = i + 1; j < numberOfRays; ++j)
+      {
+        pairs.push_back(std::make_pair(i, j));
+      }
+    }
+  }
+  else
+  {
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> first(0, numberOfRays - 1);
+    std::uniform_int_distribution<int> second(0, numberOfRays - 2);
+    for (int i = 0; i < this->RobustNumberOfIterations; ++i)
+    {
+      const int a = first(generator);
+      int b = second(generator);
+      b = b >= a ? b + 1 : b;
+      pairs.push_back(std::make_pair(a, b));
+    }
+  }
+  if (pairs.empty())
+  {
+    return false;
+  }
+
+  const double squaredThreshold = this->RobustThreshold * this->RobustThreshold;
+  ScoreCandidatesFunctor functor;
+  functor.Origins = &rayOrigins;
+  functor.Directions = &rayDirections;
+  functor.Pairs = &pairs;
+  functor.SquaredThreshold = squaredThreshold;
+  vtkSMPTools::For(0, static_cast<vtkIdType>(pairs.size()), 16, functor);
+
+  std::pair<double, vtkIdType> best(std::numeric_limits<double>::infinity(), -1);
+  for (const std::pair<double, vtkIdType>& threadBest : functor.Best)
+  {
+    if (threadBest.second >= 0 && (threadBest.first < best.first || (threadBest.first == best.first && threadBest.second < best.second)))
+    {
+      best = threadBest;
+    }
+  }
+  if (best.second < 0)
+  {
+    return false;
+  }
+
+  double point[3];
+  const std::pair<int, int>& bestPair = pairs[best.second];
+  ComputeClosestPoint(&rayOrigins[3 * bestPair.first], &rayDirections[3 * bestPair.first],
+                      &rayOrigins[3 * bestPair.second], &rayDirections[3 * bestPair.second], point);
+
+  // Refine on the inliers, then select the inliers again from the refined point
+  bool solved = false;
+  for (int refinement = 0; refinement < MAXIMUM_ROBUST_REFINEMENTS; ++refinement)
+  {
+    bool changed = false;
+    for (int ray = 0; ray < numberOfRays; ++ray)
+    {
+      const char inlier = SquaredDistanceToRay(point, &rayOrigins[3 * ray], &rayDirections[3 * ray]) < squaredThreshold ? 1 : 0;
+      changed = changed || inlier != isInlier[ray];
+      isInlier[ray] = inlier;
+    }
+    if (!changed && solved)
+    {
+      break;
+    }
+
+    this->Reset();
+    for (int ray = 0; ray < numberOfRays; ++ray)
+    {
+      if (isInlier[ray])
+      {
+        this->AccumulateRay(&rayOrigins[3 * ray], &rayDirections[3 * ray], 1.0, 1);
+      }
+    }
+    solved = this->Update();
+    if (!solved)
+    {
+      break;
+    }
+    std::copy(this->Intersection, this->Intersection + 3, point);
+  }
+
+  if (!solved)
+  {
+    this->Reset();
+    return false;
+  }
+
+  if (inliers != nullptr)
+  {
+    // When the refinements run out the point moved after the last selection, report the inliers of the final point
+    for (int ray = 0; ray < numberOfRays; ++ray)
+    {
+      inliers->SetValue(rayIds[ray], SquaredDistanceToRay(point, &rayOrigins[3 * ray], &rayDirections[3 * ray]) < squaredThreshold ? 1 : 0);
+    }
+  }
+  return true;
+}
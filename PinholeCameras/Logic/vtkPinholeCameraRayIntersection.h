@@ -0,0 +1,119 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraRayIntersection.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraRayIntersection_h
+#define __vtkPinholeCameraRayIntersection_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkDoubleArray;
+class vtkIntArray;
+class vtkMatrix3x3;
+
+/// \brief Least-squares intersection of rays, updated incrementally.
+///
+/// The point minimizing the sum of squared distances to all rays solves A x = b, with
+/// A = sum w (I - d d^T) and b = sum w (I - d d^T) o for rays of origin o and unit direction d.
+/// Only A, b and the weighted sum of squared origin distances are kept, so adding a ray and solving again take
+/// constant time and memory however many rays were added.
+/// The covariance of the estimate is s^2 A^-1, where s^2 is the residual variance (each ray constrains 2 degrees
+/// of freedom, the point takes 3).
+/// UpdateRobust solves from a complete set of rays instead, rejecting outliers (mis-clicked pixels, stale poses).
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraRayIntersection : public vtkObject
+{
+public:
+  static vtkPinholeCameraRayIntersection* New();
+  vtkTypeMacro(vtkPinholeCameraRayIntersection, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Add a ray, the direction does not need to be normalized. Rays with a larger weight pull the point closer.
+  /// Return false if the direction is null or the weight is not positive.
+  bool AddRay(const double origin[3], const double direction[3], double weight = 1.0);
+
+  ///
+  /// Remove a ray added before with the same parameters
+  bool RemoveRay(const double origin[3], const double direction[3], double weight = 1.0);
+
+  void Reset();
+
+  int GetNumberOfRays();
+
+  ///
+  /// Solve for the intersection of all rays added so far.
+  /// Return false if there are fewer than 2 rays or they are (nearly) parallel, the previous results are then cleared.
+  bool Update();
+
+  ///
+  /// Results of the last Update: intersection point, RMS distance from the point to the rays (-1 if there is no
+  /// solution) and 3x3 covariance of the point
+  vtkGetVector3Macro(Intersection, double);
+  vtkGetMacro(Error, double);
+  vtkGetObjectMacro(Covariance, vtkMatrix3x3);
+
+  ///
+  /// Robust intersection of a set of rays (RANSAC), origins and directions are 3 component arrays with one tuple per ray.
+  /// Candidate points are the closest points of pairs of rays (all pairs if there are few rays, otherwise
+  /// RobustNumberOfIterations random pairs), scored in parallel by the sum over all rays of the squared distance
+  /// truncated at RobustThreshold. The rays closer than RobustThreshold to the best candidate are the inliers, their
+  /// least-squares intersection then replaces the accumulated rays and the results, as if only they had been added.
+  /// inliers, if given, is set to 1 for kept rays and 0 for rejected rays.
+  /// Return false if no candidate has at least 2 inliers.
+  bool UpdateRobust(vtkDoubleArray* origins, vtkDoubleArray* directions, vtkIntArray* inliers = nullptr);
+
+  ///
+  /// Largest distance between an inlier ray and the intersection, in mm (default 2)
+  vtkSetMacro(RobustThreshold, double);
+  vtkGetMacro(RobustThreshold, double);
+
+  ///
+  /// Number of candidate pairs drawn when there are more pairs than this (default 500)
+  vtkSetMacro(RobustNumberOfIterations, int);
+  vtkGetMacro(RobustNumberOfIterations, int);
+
+  ///
+  /// Smallest ratio of the smallest to the largest eigenvalue of A for a solution to be accepted (default 1e-10)
+  vtkSetMacro(ConditionThreshold, double);
+  vtkGetMacro(ConditionThreshold, double);
+
+protected:
+  vtkPinholeCameraRayIntersection();
+  ~vtkPinholeCameraRayIntersection();
+
+  /// Add a ray with a signed weight to the normal equations
+  bool AccumulateRay(const double origin[3], const double direction[3], double weight, int count);
+
+  /// Normal equations: A (symmetric), b and the weighted sum of o^T (I - d d^T) o
+  double        NormalMatrix[3][3];
+  double        NormalVector[3];
+  double        SquaredDistanceSum;
+  double        WeightSum;
+  int           NumberOfRays;
+
+  double        Intersection[3];
+  double        Error;
+  vtkMatrix3x3* Covariance;
+  double        ConditionThreshold;
+  double        RobustThreshold;
+  int           RobustNumberOfIterations;
+
+private:
+  vtkPinholeCameraRayIntersection(const vtkPinholeCameraRayIntersection&); // Not implemented
+  void operator=(const vtkPinholeCameraRayIntersection&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,580 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraResidualAnalysis.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraResidualAnalysis.h"
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkPinholeCameraModel.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkIntArray.h>
+#include <vtkMatrix3x3.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkTable.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Bin of a value in bin units, values outside of the histogram go to the first or last bin
+  inline int GetBin(double position, int lastBin)
+  {
+    return static_cast<int>(std::max(0.0, std::min(static_cast<double>(lastBin), std::floor(position))));
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkPinholeCameraResidualAnalysis::vtkInternal
+{
+public:
+  vtkInternal();
+
+  /// Project the points of views [begin, end) and fill their residuals and view statistics
+  class ProjectViewsFunctor
+  {
+  public:
+    vtkInternal*  Internal;
+    double*       DetectedPixels;
+    double*       Residuals;
+    double*       Errors;
+    int*          NumberOfViewCorners;
+    double*       ViewRMSErrors;
+    double*       ViewMaximumErrors;
+
+    void operator()(vtkIdType begin, vtkIdType end) const;
+  };
+
+  /// Accumulate corners [begin, end) into the histograms and heatmap cells of each thread
+  class AccumulateFunctor
+  {
+  public:
+    const double*       DetectedPixels;
+    const double*       Residuals;
+    const double*       Errors;
+    int                 NumberOfBins;
+    double              Range;
+    int                 CellSize;
+    int                 NumberOfCells[2];
+
+    /// Error, residual x and residual y bin counts, then count, sum of squared errors and residual sums per cell
+    vtkSMPThreadLocal<std::vector<double> > Sums;
+
+    void Initialize()
+    {
+      this->Sums.Local().assign(3 * this->NumberOfBins + 4 * this->NumberOfCells[0] * this->NumberOfCells[1], 0.0);
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end);
+
+    void Reduce()
+    {
+    }
+  };
+
+  bool                        HasCamera;
+  int                         DistortionModel;
+  double                      Intrinsics[9];
+  double                      DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients];
+  double                      TiltMatrix[9];
+  double                      CameraPlaneOffset[3];
+
+  // Points of view i are [ViewStarts[i], ViewStarts[i + 1])
+  std::vector<vtkIdType>      ViewStarts;
+  std::vector<double>         ObjectPoints;
+  std::vector<double>         ImagePoints;
+  std::vector<double>         Poses;
+  std::vector<double>         ProjectedPixels;
+};
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraResidualAnalysis::vtkInternal::vtkInternal()
+  : HasCamera(false)
+  , DistortionModel(0)
+  , ViewStarts(1, 0)
+{
+  vtkMatrix3x3::Identity(this->Intrinsics);
+  std::fill(this->DistortionCoefficients, this->DistortionCoefficients + vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients, 0.0);
+  vtkMatrix3x3::Identity(this->TiltMatrix);
+  // Poses are relative to the optical center
+  std::fill(this->CameraPlaneOffset, this->CameraPlaneOffset + 3, 0.0);
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::vtkInternal::ProjectViewsFunctor::operator()(vtkIdType begin, vtkIdType end) const
+{
+  vtkInternal* internal = this->Internal;
+  vtkPinholeCameraModel::CameraView camera;
+  camera.Intrinsics = internal->Intrinsics;
+  camera.DistortionCoefficients = internal->DistortionCoefficients;
+  camera.TiltMatrix = internal->TiltMatrix;
+  camera.CameraPlaneOffset = internal->CameraPlaneOffset;
+  camera.InverseIntrinsics = nullptr;
+  camera.InverseTiltMatrix = nullptr;
+
+  for (vtkIdType view = begin; view < end; ++view)
+  {
+    const vtkIdType first = internal->ViewStarts[view];
+    const vtkIdType last = internal->ViewStarts[view + 1];
+    const double* pose = &internal->Poses[16 * view];
+    vtkPinholeCameraModelTemplateMacro(internal->DistortionModel,
+      vtkPinholeCameraModel::ProjectPoints<double, PINHOLE_CAMERA_MODEL>(camera, pose, internal->ObjectPoints.data(), first, last, internal->ProjectedPixels.data()));
+
+    int count = 0;
+    double squaredError = 0.0;
+    double maximumError = 0.0;
+    for (vtkIdType corner = first; corner < last; ++corner)
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        this->DetectedPixels[2 * corner + i] = internal->ImagePoints[2 * corner + i];
+        this->Residuals[2 * corner + i] = internal->ProjectedPixels[2 * corner + i] - internal->ImagePoints[2 * corner + i];
+      }
+      const double error = std::sqrt(this->Residuals[2 * corner] * this->Residuals[2 * corner] + this->Residuals[2 * corner + 1] * this->Residuals[2 * corner + 1]);
+      this->Errors[corner] = error;
+      if (std::isnan(error))
+      {
+        continue;
+      }
+      ++count;
+      squaredError += error * error;
+      maximumError = std::max(maximumError, error);
+    }
+    this->NumberOfViewCorners[view] = count;
+    this->ViewRMSErrors[view] = count > 0 ? std::sqrt(squaredError / count) : std::numeric_limits<double>::quiet_NaN();
+    this->ViewMaximumErrors[view] = count > 0 ? maximumError : std::numeric_limits<double>::quiet_NaN();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::vtkInternal::AccumulateFunctor::operator()(vtkIdType begin, vtkIdType end)
+{
+  std::vector<double>& sums = this->Sums.Local();
+  double* errorCounts = &sums[0];
+  double* residualXCounts = errorCounts + this->NumberOfBins;
+  double* residualYCounts = residualXCounts + this->NumberOfBins;
+  double* cells = residualYCounts + this->NumberOfBins;
+  const int lastBin = this->NumberOfBins - 1;
+  const double binsPerPixel = this->NumberOfBins / this->Range;
+
+  for (vtkIdType corner = begin; corner < end; ++corner)
+  {
+    const double error = this->Errors[corner];
+    if (std::isnan(error))
+    {
+      continue;
+    }
+    const double* residual = this->Residuals + 2 * corner;
+    errorCounts[GetBin(error * binsPerPixel, lastBin)] += 1.0;
+    residualXCounts[GetBin((residual[0] + this->Range) * 0.5 * binsPerPixel, lastBin)] += 1.0;
+    residualYCounts[GetBin((residual[1] + this->Range) * 0.5 * binsPerPixel, lastBin)] += 1.0;
+
+    if (this->CellSize > 0)
+    {
+      // The image spans [-0.5, size - 0.5], corners detected on its border go to the border cells
+      const double* pixel = this->DetectedPixels + 2 * corner;
+      const int i = std::max(0, std::min(this->NumberOfCells[0] - 1, static_cast<int>(std::floor((pixel[0] + 0.5) / this->CellSize))));
+      const int j = std::max(0, std::min(this->NumberOfCells[1] - 1, static_cast<int>(std::floor((pixel[1] + 0.5) / this->CellSize))));
+      double* cell = cells + 4 * (j * this->NumberOfCells[0] + i);
+      cell[0] += 1.0;
+      cell[1] += error * error;
+      cell[2] += residual[0];
+      cell[3] += residual[1];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraResidualAnalysis);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraResidualAnalysis::vtkPinholeCameraResidualAnalysis()
+  : NumberOfHistogramBins(40)
+  , HistogramRange(0.0)
+  , HeatmapCellSize(32)
+  , RMSError(-1.0)
+  , MaximumError(-1.0)
+  , ViewTable(vtkTable::New())
+  , CornerTable(vtkTable::New())
+  , HistogramTable(vtkTable::New())
+  , Heatmap(vtkImageData::New())
+  , Internal(new vtkInternal())
+{
+  this->ImageSize[0] = 0;
+  this->ImageSize[1] = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraResidualAnalysis::~vtkPinholeCameraResidualAnalysis()
+{
+  this->ViewTable->Delete();
+  this->CornerTable->Delete();
+  this->HistogramTable->Delete();
+  this->Heatmap->Delete();
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "ImageSize: " << this->ImageSize[0] << " x " << this->ImageSize[1] << "\n";
+  os << indent << "NumberOfViews: " << this->GetNumberOfViews() << "\n";
+  os << indent << "NumberOfCorners: " << this->GetNumberOfCorners() << "\n";
+  os << indent << "NumberOfHistogramBins: " << this->NumberOfHistogramBins << "\n";
+  os << indent << "HistogramRange: " << this->HistogramRange << "\n";
+  os << indent << "HeatmapCellSize: " << this->HeatmapCellSize << "\n";
+  os << indent << "RMSError: " << this->RMSError << "\n";
+  os << indent << "MaximumError: " << this->MaximumError << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraResidualAnalysis::SetCamera(vtkMRMLPinholeCameraNode* cameraNode)
+{
+  if (cameraNode == nullptr)
+  {
+    vtkErrorMacro("SetCamera: no camera node given");
+    return false;
+  }
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = cameraNode->GetParametersSnapshot();
+  return this->SetCamera(parameters->Intrinsics, parameters->DistortionCoefficients,
+    std::min(parameters->NumberOfDistortionCoefficients, vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients));
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraResidualAnalysis::SetCamera(const double intrinsics[9], const double* distortionCoefficients, int numberOfDistortionCoefficients)
+{
+  if (!(intrinsics[0] > 0.0) || !(intrinsics[4] > 0.0))
+  {
+    vtkErrorMacro("SetCamera: invalid focal length");
+    return false;
+  }
+  if (numberOfDistortionCoefficients < 0 || numberOfDistortionCoefficients > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("SetCamera: at most " << vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients << " distortion coefficients are supported");
+    return false;
+  }
+
+  vtkInternal* internal = this->Internal;
+  std::copy(intrinsics, intrinsics + 9, internal->Intrinsics);
+  std::fill(internal->DistortionCoefficients, internal->DistortionCoefficients + vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients, 0.0);
+  std::copy(distortionCoefficients, distortionCoefficients + numberOfDistortionCoefficients, internal->DistortionCoefficients);
+  internal->DistortionModel = vtkPinholeCameraModel::GetDistortionModel(internal->DistortionCoefficients);
+  vtkPinholeCameraModel::ComputeTiltMatrix(internal->DistortionCoefficients[12], internal->DistortionCoefficients[13], internal->TiltMatrix);
+  internal->HasCamera = true;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraResidualAnalysis::AddView(vtkPoints* objectPoints, vtkDoubleArray* imagePoints, vtkMatrix4x4* patternToCamera)
+{
+  if (objectPoints == nullptr || imagePoints == nullptr || patternToCamera == nullptr ||
+      imagePoints->GetNumberOfComponents() != 2 || imagePoints->GetNumberOfTuples() != objectPoints->GetNumberOfPoints())
+  {
+    vtkErrorMacro("AddView: expected one 2 component image point per object point and a pose");
+    return -1;
+  }
+
+  vtkInternal* internal = this->Internal;
+  const vtkIdType count = objectPoints->GetNumberOfPoints();
+  for (vtkIdType i = 0; i < count; ++i)
+  {
+    double point[3];
+    objectPoints->GetPoint(i, point);
+    internal->ObjectPoints.insert(internal->ObjectPoints.end(), point, point + 3);
+    internal->ImagePoints.push_back(imagePoints->GetComponent(i, 0));
+    internal->ImagePoints.push_back(imagePoints->GetComponent(i, 1));
+  }
+  internal->Poses.insert(internal->Poses.end(), &patternToCamera->Element[0][0], &patternToCamera->Element[0][0] + 16);
+  internal->ViewStarts.push_back(internal->ViewStarts.back() + count);
+  this->Modified();
+  return this->GetNumberOfViews() - 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraResidualAnalysis::AddView(const float* objectPoints, const float* imagePoints, int numberOfPoints, const double patternToCamera[16])
+{
+  if (objectPoints == nullptr || imagePoints == nullptr || patternToCamera == nullptr || numberOfPoints < 0)
+  {
+    vtkErrorMacro("AddView: expected numberOfPoints object points and image points, and a pose");
+    return -1;
+  }
+
+  vtkInternal* internal = this->Internal;
+  internal->ObjectPoints.insert(internal->ObjectPoints.end(), objectPoints, objectPoints + 3 * numberOfPoints);
+  internal->ImagePoints.insert(internal->ImagePoints.end(), imagePoints, imagePoints + 2 * numberOfPoints);
+  internal->Poses.insert(internal->Poses.end(), patternToCamera, patternToCamera + 16);
+  internal->ViewStarts.push_back(internal->ViewStarts.back() + numberOfPoints);
+  this->Modified();
+  return this->GetNumberOfViews() - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::RemoveAllViews()
+{
+  this->Internal->ViewStarts.assign(1, 0);
+  this->Internal->ObjectPoints.clear();
+  this->Internal->ImagePoints.clear();
+  this->Internal->Poses.clear();
+  this->ClearResults();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraResidualAnalysis::GetNumberOfViews()
+{
+  return static_cast<int>(this->Internal->ViewStarts.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkPinholeCameraResidualAnalysis::GetNumberOfCorners()
+{
+  return this->Internal->ViewStarts.back();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::ClearResults()
+{
+  this->RMSError = -1.0;
+  this->MaximumError = -1.0;
+  this->ViewTable->Initialize();
+  this->CornerTable->Initialize();
+  this->HistogramTable->Initialize();
+  this->Heatmap->Initialize();
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraResidualAnalysis::Update()
+{
+  this->ClearResults();
+  vtkInternal* internal = this->Internal;
+  const int numberOfViews = this->GetNumberOfViews();
+  const vtkIdType numberOfCorners = this->GetNumberOfCorners();
+  if (!internal->HasCamera || numberOfViews == 0)
+  {
+    vtkErrorMacro("Update: the camera and at least one view are needed");
+    return false;
+  }
+
+  // Per view and per corner results are written in place by the threads, each view to its own slots
+  vtkNew<vtkIntArray> viewIndices;
+  viewIndices->SetName("View");
+  viewIndices->SetNumberOfValues(numberOfViews);
+  std::iota(viewIndices->GetPointer(0), viewIndices->GetPointer(0) + numberOfViews, 0);
+  vtkNew<vtkIntArray> viewCornerCounts;
+  viewCornerCounts->SetName("NumberOfCorners");
+  viewCornerCounts->SetNumberOfValues(numberOfViews);
+  vtkNew<vtkDoubleArray> viewRMSErrors;
+  viewRMSErrors->SetName("RMSError");
+  viewRMSErrors->SetNumberOfValues(numberOfViews);
+  vtkNew<vtkDoubleArray> viewMaximumErrors;
+  viewMaximumErrors->SetName("MaximumError");
+  viewMaximumErrors->SetNumberOfValues(numberOfViews);
+
+  vtkNew<vtkIntArray> cornerViews;
+  cornerViews->SetName("View");
+  cornerViews->SetNumberOfValues(numberOfCorners);
+  vtkNew<vtkIntArray> cornerIndices;
+  cornerIndices->SetName("Corner");
+  cornerIndices->SetNumberOfValues(numberOfCorners);
+  for (int view = 0; view < numberOfViews; ++view)
+  {
+    for (vtkIdType corner = internal->ViewStarts[view]; corner < internal->ViewStarts[view + 1]; ++corner)
+    {
+      cornerViews->SetValue(corner, view);
+      cornerIndices->SetValue(corner, static_cast<int>(corner - internal->ViewStarts[view]));
+    }
+  }
+  // Interleaved (x,y) for the threads, split into columns for the table afterwards
+  std::vector<double> detectedPixels(2 * numberOfCorners);
+  std::vector<double> residuals(2 * numberOfCorners);
+  vtkNew<vtkDoubleArray> errors;
+  errors->SetName("Error");
+  errors->SetNumberOfValues(numberOfCorners);
+  internal->ProjectedPixels.resize(2 * numberOfCorners);
+
+  vtkInternal::ProjectViewsFunctor projection;
+  projection.Internal = internal;
+  projection.DetectedPixels = detectedPixels.data();
+  projection.Residuals = residuals.data();
+  projection.Errors = errors->GetPointer(0);
+  projection.NumberOfViewCorners = viewCornerCounts->GetPointer(0);
+  projection.ViewRMSErrors = viewRMSErrors->GetPointer(0);
+  projection.ViewMaximumErrors = viewMaximumErrors->GetPointer(0);
+  vtkSMPTools::For(0, numberOfViews, projection);
+  internal->ProjectedPixels.clear();
+
+  int numberOfValidCorners = 0;
+  double squaredError = 0.0;
+  double maximumError = 0.0;
+  for (int view = 0; view < numberOfViews; ++view)
+  {
+    const int count = viewCornerCounts->GetValue(view);
+    if (count > 0)
+    {
+      numberOfValidCorners += count;
+      squaredError += count * viewRMSErrors->GetValue(view) * viewRMSErrors->GetValue(view);
+      maximumError = std::max(maximumError, viewMaximumErrors->GetValue(view));
+    }
+  }
+  if (numberOfValidCorners == 0)
+  {
+    vtkErrorMacro("Update: all points are behind the camera");
+    return false;
+  }
+  this->RMSError = std::sqrt(squaredError / numberOfValidCorners);
+  this->MaximumError = maximumError;
+
+  this->ViewTable->AddColumn(viewIndices.GetPointer());
+  this->ViewTable->AddColumn(viewCornerCounts.GetPointer());
+  this->ViewTable->AddColumn(viewRMSErrors.GetPointer());
+  this->ViewTable->AddColumn(viewMaximumErrors.GetPointer());
+
+  const char* cornerColumnNames[4] = { "DetectedX", "DetectedY", "ResidualX", "ResidualY" };
+  const std::vector<double>* cornerColumnValues[4] = { &detectedPixels, &detectedPixels, &residuals, &residuals };
+  this->CornerTable->AddColumn(cornerViews.GetPointer());
+  this->CornerTable->AddColumn(cornerIndices.GetPointer());
+  for (int column = 0; column < 4; ++column)
+  {
+    vtkNew<vtkDoubleArray> values;
+    values->SetName(cornerColumnNames[column]);
+    values->SetNumberOfValues(numberOfCorners);
+    for (vtkIdType corner = 0; corner < numberOfCorners; ++corner)
+    {
+      values->SetValue(corner, (*cornerColumnValues[column])[2 * corner + column % 2]);
+    }
+    this->CornerTable->AddColumn(values.GetPointer());
+  }
+  this->CornerTable->AddColumn(errors.GetPointer());
+
+  // Histograms and heatmap are accumulated per thread and summed
+  vtkInternal::AccumulateFunctor accumulation;
+  accumulation.DetectedPixels = detectedPixels.data();
+  accumulation.Residuals = residuals.data();
+  accumulation.Errors = errors->GetPointer(0);
+  accumulation.NumberOfBins = this->NumberOfHistogramBins;
+  accumulation.Range = this->HistogramRange > 0.0 ? this->HistogramRange : (maximumError > 0.0 ? maximumError : 1.0);
+  const bool hasHeatmap = this->ImageSize[0] > 0 && this->ImageSize[1] > 0;
+  accumulation.CellSize = hasHeatmap ? this->HeatmapCellSize : 0;
+  accumulation.NumberOfCells[0] = hasHeatmap ? (this->ImageSize[0] + this->HeatmapCellSize - 1) / this->HeatmapCellSize : 0;
+  accumulation.NumberOfCells[1] = hasHeatmap ? (this->ImageSize[1] + this->HeatmapCellSize - 1) / this->HeatmapCellSize : 0;
+  vtkSMPTools::For(0, numberOfCorners, accumulation);
+
+  const int numberOfCells = accumulation.NumberOfCells[0] * accumulation.NumberOfCells[1];
+  std::vector<double> sums(3 * this->NumberOfHistogramBins + 4 * numberOfCells, 0.0);
+  for (vtkSMPThreadLocal<std::vector<double> >::iterator it = accumulation.Sums.begin(); it != accumulation.Sums.end(); ++it)
+  {
+    std::transform(sums.begin(), sums.end(), it->begin(), sums.begin(), std::plus<double>());
+  }
+
+  const char* histogramColumnNames[5] = { "Error", "ErrorCount", "Residual", "ResidualXCount", "ResidualYCount" };
+  vtkNew<vtkDoubleArray> histogramColumns[5];
+  for (int column = 0; column < 5; ++column)
+  {
+    histogramColumns[column]->SetName(histogramColumnNames[column]);
+    histogramColumns[column]->SetNumberOfValues(this->NumberOfHistogramBins);
+  }
+  const double binWidth = accumulation.Range / this->NumberOfHistogramBins;
+  for (int bin = 0; bin < this->NumberOfHistogramBins; ++bin)
+  {
+    // Bin centers: errors span [0, range], residual components [-range, range]
+    histogramColumns[0]->SetValue(bin, (bin + 0.5) * binWidth);
+    histogramColumns[1]->SetValue(bin, sums[bin]);
+    histogramColumns[2]->SetValue(bin, (2 * bin + 1) * binWidth - accumulation.Range);
+    histogramColumns[3]->SetValue(bin, sums[this->NumberOfHistogramBins + bin]);
+    histogramColumns[4]->SetValue(bin, sums[2 * this->NumberOfHistogramBins + bin]);
+  }
+  for (int column = 0; column < 5; ++column)
+  {
+    this->HistogramTable->AddColumn(histogramColumns[column].GetPointer());
+  }
+
+  if (hasHeatmap)
+  {
+    // Cell centers in pixel coordinates, pixel centers are at integer coordinates
+    const double cellSize = this->HeatmapCellSize;
+    this->Heatmap->SetDimensions(accumulation.NumberOfCells[0], accumulation.NumberOfCells[1], 1);
+    this->Heatmap->SetSpacing(cellSize, cellSize, 1.0);
+    this->Heatmap->SetOrigin(0.5 * cellSize - 0.5, 0.5 * cellSize - 0.5, 0.0);
+
+    vtkNew<vtkIntArray> cellCounts;
+    cellCounts->SetName("NumberOfCorners");
+    cellCounts->SetNumberOfValues(numberOfCells);
+    vtkNew<vtkDoubleArray> cellErrors;
+    cellErrors->SetName("RMSError");
+    cellErrors->SetNumberOfValues(numberOfCells);
+    vtkNew<vtkDoubleArray> cellResiduals;
+    cellResiduals->SetName("MeanResidual");
+    cellResiduals->SetNumberOfComponents(2);
+    cellResiduals->SetNumberOfTuples(numberOfCells);
+    const double* cells = &sums[3 * this->NumberOfHistogramBins];
+    for (int cell = 0; cell < numberOfCells; ++cell)
+    {
+      const double count = cells[4 * cell];
+      cellCounts->SetValue(cell, static_cast<int>(count));
+      cellErrors->SetValue(cell, count > 0.0 ? std::sqrt(cells[4 * cell + 1] / count) : 0.0);
+      cellResiduals->SetComponent(cell, 0, count > 0.0 ? cells[4 * cell + 2] / count : 0.0);
+      cellResiduals->SetComponent(cell, 1, count > 0.0 ? cells[4 * cell + 3] / count : 0.0);
+    }
+    this->Heatmap->GetPointData()->AddArray(cellCounts.GetPointer());
+    this->Heatmap->GetPointData()->AddArray(cellResiduals.GetPointer());
+    this->Heatmap->GetPointData()->SetScalars(cellErrors.GetPointer());
+  }
+
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraResidualAnalysis::GetViewsSortedByError(vtkIntArray* views)
+{
+  if (views == nullptr)
+  {
+    vtkErrorMacro("GetViewsSortedByError: invalid array");
+    return;
+  }
+  views->Initialize();
+  vtkDoubleArray* viewErrors = vtkDoubleArray::SafeDownCast(this->ViewTable->GetColumnByName("RMSError"));
+  if (viewErrors == nullptr)
+  {
+    return;
+  }
+
+  std::vector<int> order(viewErrors->GetNumberOfValues());
+  std::iota(order.begin(), order.end(), 0);
+  // Views without any point in front of the camera come first, their pose is wrong
+  std::stable_sort(order.begin(), order.end(), [viewErrors](int a, int b)
+  {
+    const double errorA = viewErrors->GetValue(a);
+    const double errorB = viewErrors->GetValue(b);
+    return (std::isnan(errorA) && !std::isnan(errorB)) || errorA > errorB;
+  });
+  views->SetNumberOfValues(static_cast<vtkIdType>(order.size()));
+  std::copy(order.begin(), order.end(), views->GetPointer(0));
+}
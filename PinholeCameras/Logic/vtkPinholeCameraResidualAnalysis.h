@@ -0,0 +1,142 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraResidualAnalysis.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraResidualAnalysis_h
+#define __vtkPinholeCameraResidualAnalysis_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkDoubleArray;
+class vtkImageData;
+class vtkIntArray;
+class vtkMatrix4x4;
+class vtkMRMLPinholeCameraNode;
+class vtkPoints;
+class vtkTable;
+
+/// \brief Reprojection residuals of calibration views, to find the views and image regions a calibration fits worst.
+///
+/// Each view holds pattern points, the pixels where they were detected and the pose of the pattern in the camera
+/// coordinate system of OpenCV (origin at the optical center, as solved by cv::calibrateCamera or cv::solvePnP).
+/// Update projects every point with the intrinsics and the full distortion model, views being split across threads,
+/// and gathers:
+/// - ViewTable: number of corners, RMS and largest error of each view
+/// - CornerTable: detected pixel, residual (projected minus detected pixel) and error (residual length) of each corner
+/// - HistogramTable: histograms of the error and of the x and y residual components
+/// - Heatmap: number of corners, RMS error and mean residual over a grid of cells covering the image, a mean residual
+///   far from zero in a region shows a distortion the model does not fit
+/// Points projected behind the camera have a NaN residual and are left out of all statistics.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraResidualAnalysis : public vtkObject
+{
+public:
+  static vtkPinholeCameraResidualAnalysis* New();
+  vtkTypeMacro(vtkPinholeCameraResidualAnalysis, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Copy the intrinsics and distortion coefficients of a camera, the marker to image sensor transform is not used
+  bool SetCamera(vtkMRMLPinholeCameraNode* cameraNode);
+
+  ///
+  /// Size in pixels of the calibration images, needed for the heatmap
+  vtkSetVector2Macro(ImageSize, int);
+  vtkGetVector2Macro(ImageSize, int);
+
+  ///
+  /// Add a view: pattern points, matching 2 component detected pixels and the pose of the pattern in the camera.
+  /// Return the index of the view, or -1 if the arrays do not match.
+  int AddView(vtkPoints* objectPoints, vtkDoubleArray* imagePoints, vtkMatrix4x4* patternToCamera);
+
+  void RemoveAllViews();
+  int GetNumberOfViews();
+  vtkIdType GetNumberOfCorners();
+
+#ifndef __VTK_WRAP__
+  ///
+  /// Same as the node version, distortion coefficients in the OpenCV order
+  bool SetCamera(const double intrinsics[9], const double* distortionCoefficients, int numberOfDistortionCoefficients);
+
+  ///
+  /// Same as the VTK version, points as packed (x,y,z) and pixels as packed (x,y), pose as a row-major 4x4 matrix
+  int AddView(const float* objectPoints, const float* imagePoints, int numberOfPoints, const double patternToCamera[16]);
+#endif
+
+  ///
+  /// Number of bins of the histograms (default 40)
+  vtkSetClampMacro(NumberOfHistogramBins, int, 1, 100000);
+  vtkGetMacro(NumberOfHistogramBins, int);
+
+  ///
+  /// Largest error covered by the histograms in pixels, residual components span [-range, range]. Larger values are
+  /// counted in the outermost bins. 0 (default) uses the largest error.
+  vtkSetMacro(HistogramRange, double);
+  vtkGetMacro(HistogramRange, double);
+
+  ///
+  /// Width and height in pixels of the heatmap cells (default 32)
+  vtkSetClampMacro(HeatmapCellSize, int, 1, 100000);
+  vtkGetMacro(HeatmapCellSize, int);
+
+  ///
+  /// Compute the residuals of all views. Return false if there is no view or no camera.
+  bool Update();
+
+  ///
+  /// Results of the last Update. RMS and largest error over all views, in pixels, -1 if there is no result.
+  vtkGetMacro(RMSError, double);
+  vtkGetMacro(MaximumError, double);
+  vtkGetObjectMacro(ViewTable, vtkTable);
+  vtkGetObjectMacro(CornerTable, vtkTable);
+  vtkGetObjectMacro(HistogramTable, vtkTable);
+
+  ///
+  /// One point per cell, centered on the cell in pixel coordinates. Point data holds NumberOfCorners, RMSError
+  /// (active scalars) and the 2 component MeanResidual. Empty if the image size is not set.
+  vtkGetObjectMacro(Heatmap, vtkImageData);
+
+  ///
+  /// Indices of the views from the largest to the smallest RMS error, the first ones are the views to inspect
+  void GetViewsSortedByError(vtkIntArray* views);
+
+protected:
+  vtkPinholeCameraResidualAnalysis();
+  ~vtkPinholeCameraResidualAnalysis();
+
+  /// Clear the results, keeping the views
+  void ClearResults();
+
+  int                 ImageSize[2];
+  int                 NumberOfHistogramBins;
+  double              HistogramRange;
+  int                 HeatmapCellSize;
+
+  double              RMSError;
+  double              MaximumError;
+  vtkTable*           ViewTable;
+  vtkTable*           CornerTable;
+  vtkTable*           HistogramTable;
+  vtkImageData*       Heatmap;
+
+  class vtkInternal;
+  vtkInternal*        Internal;
+
+private:
+  vtkPinholeCameraResidualAnalysis(const vtkPinholeCameraResidualAnalysis&); // Not implemented
+  void operator=(const vtkPinholeCameraResidualAnalysis&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,352 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraUndistortionFilter.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraUndistortionFilter.h"
+
+// PinholeCameras MRML includes
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkPinholeCameraModel.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkInformation.h>
+#include <vtkInformationVector.h>
+#include <vtkMatrix3x3.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  template<typename T>
+  inline typename std::enable_if<std::is_integral<T>::value, T>::type CastInterpolated(float value)
+  {
+    return static_cast<T>(std::floor(value + 0.5f));
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  inline typename std::enable_if<!std::is_integral<T>::value, T>::type CastInterpolated(float value)
+  {
+    return static_cast<T>(value);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Decode sample locations of a float undistortion map
+  class FloatMapLocation
+  {
+  public:
+    typedef float ValueType;
+
+    FloatMapLocation(int width, int height)
+      : MaxX(static_cast<float>(width - 1))
+      , MaxY(static_cast<float>(height - 1))
+    {
+    }
+
+    /// Get the top left input pixel and the interpolation weights, return false if the location is outside the input
+    inline bool Get(const float* map, int& x0, int& y0, float& fx, float& fy) const
+    {
+      const float x = map[0];
+      const float y = map[1];
+      if (!(x >= 0.f && y >= 0.f && x <= this->MaxX && y <= this->MaxY))
+      {
+        return false;
+      }
+      x0 = static_cast<int>(x);
+      y0 = static_cast<int>(y);
+      fx = x - x0;
+      fy = y - y0;
+      return true;
+    }
+
+  private:
+    float MaxX;
+    float MaxY;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Decode sample locations of a compact (fixed point) undistortion map
+  class CompactMapLocation
+  {
+  public:
+    typedef unsigned short ValueType;
+
+    CompactMapLocation(int fractionBits)
+      : FractionBits(fractionBits)
+      , FractionMask((1 << fractionBits) - 1)
+      , Step(1.f / static_cast<float>(1 << fractionBits))
+    {
+    }
+
+    inline bool Get(const unsigned short* map, int& x0, int& y0, float& fx, float& fy) const
+    {
+      if (map[0] == vtkPinholeCameraModel::CompactMapOutside)
+      {
+        return false;
+      }
+      x0 = map[0] >> this->FractionBits;
+      y0 = map[1] >> this->FractionBits;
+      fx = (map[0] & this->FractionMask) * this->Step;
+      fy = (map[1] & this->FractionMask) * this->Step;
+      return true;
+    }
+
+  private:
+    int   FractionBits;
+    int   FractionMask;
+    float Step;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Remap rows of an image. Components is the number of scalar components, or 0 to use NumberOfComponents
+  /// for uncommon layouts. Location decodes the map type.
+  template<typename T, int Components, typename Location>
+  class RemapFunctor
+  {
+  public:
+    typedef typename Location::ValueType MapType;
+
+    const T*        Input;
+    T*              Output;
+    const MapType*  Map;
+    const Location* MapLocation;
+    int             Width;
+    int             Height;
+    int             NumberOfComponents;
+
+    void operator()(vtkIdType beginRow, vtkIdType endRow) const
+    {
+      const int components = Components > 0 ? Components : this->NumberOfComponents;
+      const std::size_t rowLength = static_cast<std::size_t>(this->Width) * components;
+      const Location location = *this->MapLocation;
+
+      for (vtkIdType row = beginRow; row < endRow; ++row)
+      {
+        const MapType* map = this->Map + 2 * static_cast<std::size_t>(row) * this->Width;
+        T* output = this->Output + static_cast<std::size_t>(row) * rowLength;
+        for (int column = 0; column < this->Width; ++column, map += 2, output += components)
+        {
+          int x0;
+          int y0;
+          float fx;
+          float fy;
+          if (!location.Get(map, x0, y0, fx, fy))
+          {
+            std::fill(output, output + components, T(0));
+            continue;
+          }
+
+          // On the last row or column the second sample has a zero weight, reuse the first to stay in bounds
+          const std::size_t dx = x0 < this->Width - 1 ? components : 0;
+          const std::size_t dy = y0 < this->Height - 1 ? rowLength : 0;
+
+          const T* p00 = this->Input + y0 * rowLength + static_cast<std::size_t>(x0) * components;
+          const T* p01 = p00 + dx;
+          const T* p10 = p00 + dy;
+          const T* p11 = p10 + dx;
+          const float w00 = (1.f - fx) * (1.f - fy);
+          const float w01 = fx * (1.f - fy);
+          const float w10 = (1.f - fx) * fy;
+          const float w11 = fx * fy;
+          for (int c = 0; c < components; ++c)
+          {
+            output[c] = CastInterpolated<T>(w00 * p00[c] + w01 * p01[c] + w10 * p10[c] + w11 * p11[c]);
+          }
+        }
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename T, int Components, typename Location>
+  void Remap(const T* input, T* output, const typename Location::ValueType* map, const Location& location, int width, int height, int numberOfComponents)
+  {
+    RemapFunctor<T, Components, Location> functor;
+    functor.Input = input;
+    functor.Output = output;
+    functor.Map = map;
+    functor.MapLocation = &location;
+    functor.Width = width;
+    functor.Height = height;
+    functor.NumberOfComponents = numberOfComponents;
+    // A few rows per task keeps scheduling overhead low on large frames
+    vtkSMPTools::For(0, height, 8, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T, typename Location>
+  void Remap(const T* input, T* output, const typename Location::ValueType* map, const Location& location, int width, int height, int numberOfComponents)
+  {
+    // Specialize the common layouts so the component loop is unrolled
+    switch (numberOfComponents)
+    {
+      case 1:
+        Remap<T, 1>(input, output, map, location, width, height, numberOfComponents);
+        break;
+      case 3:
+        Remap<T, 3>(input, output, map, location, width, height, numberOfComponents);
+        break;
+      case 4:
+        Remap<T, 4>(input, output, map, location, width, height, numberOfComponents);
+        break;
+      default:
+        Remap<T, 0>(input, output, map, location, width, height, numberOfComponents);
+        break;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Remap a 2D image of any scalar type, return false if the scalar type is not supported
+  template<typename Location>
+  bool RemapImage(vtkImageData* input, vtkImageData* output, vtkImageData* map, const Location& location)
+  {
+    int dimensions[3];
+    input->GetDimensions(dimensions);
+    const typename Location::ValueType* mapPointer = static_cast<const typename Location::ValueType*>(map->GetScalarPointer());
+    const int components = input->GetNumberOfScalarComponents();
+    switch (input->GetScalarType())
+    {
+      vtkTemplateMacro(Remap<VTK_TT>(static_cast<const VTK_TT*>(input->GetScalarPointer()), static_cast<VTK_TT*>(output->GetScalarPointer()),
+                                     mapPointer, location, dimensions[0], dimensions[1], components));
+      default:
+        return false;
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraUndistortionFilter);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraUndistortionFilter::vtkPinholeCameraUndistortionFilter()
+  : CameraNode(nullptr)
+  , OutputIntrinsics(nullptr)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraUndistortionFilter::~vtkPinholeCameraUndistortionFilter()
+{
+  this->SetCameraNode(nullptr);
+  this->SetOutputIntrinsics(nullptr);
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraUndistortionFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "CameraNode: " << (this->CameraNode != nullptr ? this->CameraNode->GetID() : "(none)") << "\n";
+  os << indent << "OutputIntrinsics: " << (this->OutputIntrinsics != nullptr ? "set" : "(camera intrinsics)") << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraUndistortionFilter::SetCameraNode(vtkMRMLPinholeCameraNode* cameraNode)
+{
+  vtkSetObjectBodyMacro(CameraNode, vtkMRMLPinholeCameraNode, cameraNode);
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraUndistortionFilter::SetOutputIntrinsics(vtkMatrix3x3* outputIntrinsics)
+{
+  vtkSetObjectBodyMacro(OutputIntrinsics, vtkMatrix3x3, outputIntrinsics);
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkPinholeCameraUndistortionFilter::GetMTime()
+{
+  vtkMTimeType mTime = this->Superclass::GetMTime();
+  if (this->CameraNode != nullptr)
+  {
+    // Distortion coefficient changes only update the undistortion time of the node
+    mTime = std::max(mTime, this->CameraNode->GetMTime());
+    mTime = std::max(mTime, this->CameraNode->GetUndistortionMTime());
+  }
+  if (this->OutputIntrinsics != nullptr)
+  {
+    mTime = std::max(mTime, this->OutputIntrinsics->GetMTime());
+  }
+  return mTime;
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraUndistortionFilter::RequestData(vtkInformation* vtkNotUsed(request), vtkInformationVector** inputVector, vtkInformationVector* outputVector)
+{
+  vtkImageData* input = vtkImageData::GetData(inputVector[0]);
+  vtkImageData* output = vtkImageData::GetData(outputVector);
+  if (input == nullptr || output == nullptr)
+  {
+    return 0;
+  }
+
+  if (this->CameraNode == nullptr)
+  {
+    vtkErrorMacro("RequestData: no camera node set");
+    return 0;
+  }
+  int dimensions[3];
+  input->GetDimensions(dimensions);
+  if (dimensions[2] > 1)
+  {
+    vtkErrorMacro("RequestData: only 2D images can be undistorted, input has " << dimensions[2] << " slices");
+    return 0;
+  }
+
+  output->SetExtent(input->GetExtent());
+  output->AllocateScalars(input->GetScalarType(), input->GetNumberOfScalarComponents());
+  if (dimensions[0] <= 0 || dimensions[1] <= 0 || input->GetScalarPointer() == nullptr)
+  {
+    return 1;
+  }
+
+  // The node returns its map referenced, it stays valid even if the node replaces its cached map while this filter runs
+  vtkSmartPointer<vtkImageData> map;
+  bool remapped = false;
+  if (this->CameraNode->GetUndistortionMapFormat() == vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint)
+  {
+    map = this->CameraNode->GetCompactUndistortionMap(dimensions[0], dimensions[1], this->OutputIntrinsics);
+    if (map == nullptr)
+    {
+      return 0;
+    }
+    CompactMapLocation location(vtkPinholeCameraModel::GetCompactMapFractionBits(dimensions[0], dimensions[1]));
+    remapped = RemapImage(input, output, map, location);
+  }
+  else
+  {
+    map = this->CameraNode->GetUndistortionMap(dimensions[0], dimensions[1], this->OutputIntrinsics);
+    if (map == nullptr)
+    {
+      return 0;
+    }
+    FloatMapLocation location(dimensions[0], dimensions[1]);
+    remapped = RemapImage(input, output, map, location);
+  }
+
+  if (!remapped)
+  {
+    vtkErrorMacro("RequestData: unsupported scalar type " << input->GetScalarTypeAsString());
+    return 0;
+  }
+
+  return 1;
+}
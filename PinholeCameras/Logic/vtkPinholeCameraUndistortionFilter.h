@@ -0,0 +1,66 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraUndistortionFilter.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraUndistortionFilter_h
+#define __vtkPinholeCameraUndistortionFilter_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkImageAlgorithm.h>
+
+class vtkMatrix3x3;
+class vtkMRMLPinholeCameraNode;
+
+/// \brief Remove lens distortion from 2D images using the parameters of a pinhole camera node.
+///
+/// The output has the extent, scalar type and number of components (grayscale, RGB, RGBA, ...) of the input.
+/// Each output pixel is sampled with bilinear interpolation at the location given by the undistortion map cached
+/// in the camera node, pixels that map outside the input are set to 0. Rows are processed in parallel.
+/// Float or compact fixed point maps are used depending on the UndistortionMapFormat of the camera node.
+/// The filter executes again when the camera node, its intrinsics or distortion coefficients change.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraUndistortionFilter : public vtkImageAlgorithm
+{
+public:
+  static vtkPinholeCameraUndistortionFilter* New();
+  vtkTypeMacro(vtkPinholeCameraUndistortionFilter, vtkImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Camera that acquired the input images
+  void SetCameraNode(vtkMRMLPinholeCameraNode* cameraNode);
+  vtkGetObjectMacro(CameraNode, vtkMRMLPinholeCameraNode);
+
+  ///
+  /// Intrinsics of the undistorted output image, the camera intrinsics are used if not set
+  void SetOutputIntrinsics(vtkMatrix3x3* outputIntrinsics);
+  vtkGetObjectMacro(OutputIntrinsics, vtkMatrix3x3);
+
+  vtkMTimeType GetMTime() override;
+
+protected:
+  vtkPinholeCameraUndistortionFilter();
+  ~vtkPinholeCameraUndistortionFilter();
+
+  int RequestData(vtkInformation* request, vtkInformationVector** inputVector, vtkInformationVector* outputVector) override;
+
+  vtkMRMLPinholeCameraNode*   CameraNode;
+  vtkMatrix3x3*               OutputIntrinsics;
+
+private:
+  vtkPinholeCameraUndistortionFilter(const vtkPinholeCameraUndistortionFilter&); // Not implemented
+  void operator=(const vtkPinholeCameraUndistortionFilter&); // Not implemented
+};
+
+#endif
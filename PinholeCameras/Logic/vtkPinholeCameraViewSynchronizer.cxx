@@ -0,0 +1,280 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraViewSynchronizer.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraViewSynchronizer.h"
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkPinholeCameraModel.h"
+
+// MRML includes
+#include <vtkMRMLCameraNode.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkCamera.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPinholeCameraViewSynchronizer);
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraViewSynchronizer::vtkPinholeCameraViewSynchronizer()
+  : ViewCameraNode(nullptr)
+  , PinholeCameraNode(nullptr)
+  , TransformNode(nullptr)
+  , Callback(vtkCallbackCommand::New())
+  , HasViewCameraState(false)
+  , SavedViewAngle(30.0)
+  , NumberOfViewCameraUpdates(0)
+{
+  this->ImageSize[0] = 0;
+  this->ImageSize[1] = 0;
+  std::fill(this->ViewCameraState, this->ViewCameraState + 12, 0.0);
+  this->SavedWindowCenter[0] = 0.0;
+  this->SavedWindowCenter[1] = 0.0;
+  this->Callback->SetClientData(this);
+  this->Callback->SetCallback(vtkPinholeCameraViewSynchronizer::OnNodeModified);
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraViewSynchronizer::~vtkPinholeCameraViewSynchronizer()
+{
+  this->SetViewCameraNode(nullptr);
+  this->SetPinholeCameraNode(nullptr);
+  this->SetTransformNode(nullptr);
+  this->Callback->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "ViewCameraNode: " << (this->ViewCameraNode ? this->ViewCameraNode->GetID() : "(none)") << "\n";
+  os << indent << "PinholeCameraNode: " << (this->PinholeCameraNode ? this->PinholeCameraNode->GetID() : "(none)") << "\n";
+  os << indent << "TransformNode: " << (this->TransformNode ? this->TransformNode->GetID() : "(none)") << "\n";
+  os << indent << "ImageSize: " << this->ImageSize[0] << " x " << this->ImageSize[1] << "\n";
+  os << indent << "NumberOfViewCameraUpdates: " << this->NumberOfViewCameraUpdates << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::SetViewCameraNode(vtkMRMLCameraNode* viewCameraNode)
+{
+  if (viewCameraNode == this->ViewCameraNode)
+  {
+    return;
+  }
+  if (this->ViewCameraNode != nullptr)
+  {
+    this->ReleaseViewCamera();
+    this->ViewCameraNode->UnRegister(this);
+  }
+  this->ViewCameraNode = viewCameraNode;
+  this->HasViewCameraState = false;
+  if (this->ViewCameraNode != nullptr)
+  {
+    this->ViewCameraNode->Register(this);
+    if (this->ViewCameraNode->GetCamera() != nullptr)
+    {
+      this->SavedViewAngle = this->ViewCameraNode->GetCamera()->GetViewAngle();
+      this->ViewCameraNode->GetCamera()->GetWindowCenter(this->SavedWindowCenter);
+    }
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::SetPinholeCameraNode(vtkMRMLPinholeCameraNode* pinholeCameraNode)
+{
+  if (pinholeCameraNode == this->PinholeCameraNode)
+  {
+    return;
+  }
+  if (this->PinholeCameraNode != nullptr)
+  {
+    this->PinholeCameraNode->RemoveObserver(this->Callback);
+    this->PinholeCameraNode->UnRegister(this);
+  }
+  this->PinholeCameraNode = pinholeCameraNode;
+  if (this->PinholeCameraNode != nullptr)
+  {
+    this->PinholeCameraNode->Register(this);
+    // Distortion does not change the view camera
+    this->PinholeCameraNode->AddObserver(vtkMRMLPinholeCameraNode::IntrinsicsModifiedEvent, this->Callback);
+    this->PinholeCameraNode->AddObserver(vtkMRMLPinholeCameraNode::MarkerToSensorTransformModifiedEvent, this->Callback);
+    this->PinholeCameraNode->AddObserver(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent, this->Callback);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::SetTransformNode(vtkMRMLTransformNode* transformNode)
+{
+  if (transformNode == this->TransformNode)
+  {
+    return;
+  }
+  if (this->TransformNode != nullptr)
+  {
+    this->TransformNode->RemoveObserver(this->Callback);
+    this->TransformNode->UnRegister(this);
+  }
+  this->TransformNode = transformNode;
+  if (this->TransformNode != nullptr)
+  {
+    this->TransformNode->Register(this);
+    this->TransformNode->AddObserver(vtkMRMLTransformNode::TransformModifiedEvent, this->Callback);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::SetImageSize(int width, int height)
+{
+  if (width == this->ImageSize[0] && height == this->ImageSize[1])
+  {
+    return;
+  }
+  this->ImageSize[0] = width;
+  this->ImageSize[1] = height;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraViewSynchronizer::Update()
+{
+  if (this->ViewCameraNode == nullptr || this->ViewCameraNode->GetCamera() == nullptr)
+  {
+    return false;
+  }
+
+  double state[12];
+  if (!this->ComputeViewCamera(state))
+  {
+    return false;
+  }
+  if (this->HasViewCameraState && std::equal(state, state + 12, this->ViewCameraState))
+  {
+    return false;
+  }
+
+  vtkCamera* camera = this->ViewCameraNode->GetCamera();
+  double distance = camera->GetDistance();
+  if (!(distance > 0.0))
+  {
+    distance = 1.0;
+  }
+  const double focalPoint[3] =
+  {
+    state[0] + distance * state[3],
+    state[1] + distance * state[4],
+    state[2] + distance * state[5]
+  };
+
+  // Views render once for all the changes
+  int wasModifying = this->ViewCameraNode->StartModify();
+  camera->ParallelProjectionOff();
+  camera->SetPosition(state);
+  camera->SetFocalPoint(focalPoint);
+  camera->SetViewUp(state + 6);
+  camera->SetViewAngle(state[9]);
+  camera->SetWindowCenter(state[10], state[11]);
+  this->ViewCameraNode->EndModify(wasModifying);
+
+  std::copy(state, state + 12, this->ViewCameraState);
+  this->HasViewCameraState = true;
+  ++this->NumberOfViewCameraUpdates;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraViewSynchronizer::ComputeViewCamera(double state[12])
+{
+  if (this->PinholeCameraNode == nullptr || this->ImageSize[0] < 1 || this->ImageSize[1] < 1)
+  {
+    return false;
+  }
+
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = this->PinholeCameraNode->GetParametersSnapshot();
+  const double* intrinsics = parameters->Intrinsics;
+  if (!(intrinsics[0] > 0.0) || !(intrinsics[4] > 0.0))
+  {
+    return false;
+  }
+
+  double sensorToWorld[16];
+  if (this->TransformNode != nullptr)
+  {
+    vtkNew<vtkMatrix4x4> markerToWorld;
+    this->TransformNode->GetMatrixTransformToWorld(markerToWorld.GetPointer());
+    vtkMatrix4x4::Multiply4x4(&markerToWorld->Element[0][0], parameters->ImageSensorToMarker, sensorToWorld);
+  }
+  else
+  {
+    std::copy(parameters->ImageSensorToMarker, parameters->ImageSensorToMarker + 16, sensorToWorld);
+  }
+
+  // The optical center is at the camera plane offset in the image sensor coordinates, the sensor z axis points
+  // along the optical axis and its y axis down the image
+  const double* offset = parameters->CameraPlaneOffset;
+  for (int i = 0; i < 3; ++i)
+  {
+    state[i] = sensorToWorld[4 * i + 0] * offset[0] + sensorToWorld[4 * i + 1] * offset[1] + sensorToWorld[4 * i + 2] * offset[2] + sensorToWorld[4 * i + 3];
+    state[3 + i] = sensorToWorld[4 * i + 2];
+    state[6 + i] = -sensorToWorld[4 * i + 1];
+  }
+  if (vtkMath::Normalize(state + 3) == 0.0 || vtkMath::Normalize(state + 6) == 0.0)
+  {
+    return false;
+  }
+
+  // Pixel centers are at integer coordinates, the image spans [-0.5, size - 0.5]. VTK shows the optical axis at
+  // normalized view coordinates -WindowCenter, with y up.
+  const double width = this->ImageSize[0];
+  const double height = this->ImageSize[1];
+  state[9] = vtkMath::DegreesFromRadians(2.0 * std::atan(0.5 * height / intrinsics[4]));
+  state[10] = 1.0 - 2.0 * (intrinsics[2] + 0.5) / width;
+  state[11] = 2.0 * (intrinsics[5] + 0.5) / height - 1.0;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::ReleaseViewCamera()
+{
+  if (this->ViewCameraNode == nullptr || this->ViewCameraNode->GetCamera() == nullptr || !this->HasViewCameraState)
+  {
+    return;
+  }
+  int wasModifying = this->ViewCameraNode->StartModify();
+  this->ViewCameraNode->GetCamera()->SetViewAngle(this->SavedViewAngle);
+  this->ViewCameraNode->GetCamera()->SetWindowCenter(this->SavedWindowCenter[0], this->SavedWindowCenter[1]);
+  this->ViewCameraNode->EndModify(wasModifying);
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraViewSynchronizer::OnNodeModified(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eventId), void* clientData, void* vtkNotUsed(callData))
+{
+  vtkPinholeCameraViewSynchronizer* self = static_cast<vtkPinholeCameraViewSynchronizer*>(clientData);
+  if (self != nullptr)
+  {
+    self->Update();
+  }
+}
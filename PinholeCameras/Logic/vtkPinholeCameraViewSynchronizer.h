@@ -0,0 +1,104 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraViewSynchronizer.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraViewSynchronizer_h
+#define __vtkPinholeCameraViewSynchronizer_h
+
+#include "vtkSlicerPinholeCamerasModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkCallbackCommand;
+class vtkMRMLCameraNode;
+class vtkMRMLPinholeCameraNode;
+class vtkMRMLTransformNode;
+
+/// \brief Drive the camera of a view from a tracked pinhole camera, to overlay the scene on the camera video.
+///
+/// The view camera is placed at the optical center of the pinhole camera, looking along its optical axis with the
+/// image rows pointing down. The vertical view angle is set from the focal length and the image height, and the
+/// window center from the principal point, so the projection is off-axis when the principal point is not at the
+/// image center. The horizontal scale follows the aspect ratio of the view, which should be
+/// width * fy / (height * fx), i.e. the image aspect ratio for square pixels. Skew and lens distortion are ignored,
+/// overlay on undistorted video.
+/// The view camera is updated from the node events, only when the pose or projection actually changes: a new
+/// tracking matrix equal to the previous one does not modify the view camera.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkPinholeCameraViewSynchronizer : public vtkObject
+{
+public:
+  static vtkPinholeCameraViewSynchronizer* New();
+  vtkTypeMacro(vtkPinholeCameraViewSynchronizer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  ///
+  /// Camera of the view to drive. Its view angle and window center are restored when it is released.
+  void SetViewCameraNode(vtkMRMLCameraNode* viewCameraNode);
+  vtkGetObjectMacro(ViewCameraNode, vtkMRMLCameraNode);
+
+  ///
+  /// Intrinsics and marker to image sensor transform of the camera
+  void SetPinholeCameraNode(vtkMRMLPinholeCameraNode* pinholeCameraNode);
+  vtkGetObjectMacro(PinholeCameraNode, vtkMRMLPinholeCameraNode);
+
+  ///
+  /// Tracked transform of the camera marker, its transform to world is used. Without it the marker is at the origin.
+  void SetTransformNode(vtkMRMLTransformNode* transformNode);
+  vtkGetObjectMacro(TransformNode, vtkMRMLTransformNode);
+
+  ///
+  /// Size in pixels of the images the intrinsics were calibrated for
+  void SetImageSize(int width, int height);
+  vtkGetVector2Macro(ImageSize, int);
+
+  ///
+  /// Update the view camera if the pose or the projection changed. Called on every change of the nodes, so only
+  /// needed after setting the nodes. Return true if the view camera was modified.
+  bool Update();
+
+  ///
+  /// Number of times the view camera was modified
+  vtkGetMacro(NumberOfViewCameraUpdates, int);
+
+protected:
+  vtkPinholeCameraViewSynchronizer();
+  ~vtkPinholeCameraViewSynchronizer();
+
+  static void OnNodeModified(vtkObject* caller, unsigned long eventId, void* clientData, void* callData);
+
+  /// View camera position, direction of projection, view up, view angle and window center, false if undefined
+  bool ComputeViewCamera(double state[12]);
+
+  /// Give back the view angle and window center the view camera had before it was driven
+  void ReleaseViewCamera();
+
+  vtkMRMLCameraNode*          ViewCameraNode;
+  vtkMRMLPinholeCameraNode*   PinholeCameraNode;
+  vtkMRMLTransformNode*       TransformNode;
+  vtkCallbackCommand*         Callback;
+  int                         ImageSize[2];
+
+  /// Last state pushed to the view camera
+  bool                        HasViewCameraState;
+  double                      ViewCameraState[12];
+  double                      SavedViewAngle;
+  double                      SavedWindowCenter[2];
+  int                         NumberOfViewCameraUpdates;
+
+private:
+  vtkPinholeCameraViewSynchronizer(const vtkPinholeCameraViewSynchronizer&); // Not implemented
+  void operator=(const vtkPinholeCameraViewSynchronizer&); // Not implemented
+};
+
+#endif
@@ -14,41 +14,852 @@ Version:   $Revision: 1.0 $
 
 // PinholeCameras Logic includes
 #include "vtkSlicerPinholeCamerasLogic.h"
+#include "vtkPinholeCameraKeyframeSelector.h"
+#include "vtkPinholeCameraResidualAnalysis.h"
+#include "vtkPinholeCameraUndistortionFilter.h"
+#include "vtkPinholeCameraViewSynchronizer.h"
 #include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraRigNode.h"
+#include "vtkMRMLPinholeCameraRigStorageNode.h"
 #include "vtkMRMLPinholeCameraStorageNode.h"
 
 // MRML includes
+#include <vtkMRMLCameraNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLSequenceNode.h>
+#include <vtkMRMLTableNode.h>
+#include <vtkMRMLTransformNode.h>
+#include <vtkMRMLVolumeNode.h>
 
 // VTK includes
+#include <vtkCollection.h>
+#include <vtkCommand.h>
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
 #include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix3x3.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkSMPTools.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+
+// OpenCV includes
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
 
 // STD includes
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // ITK includes
 #include <itksys/Directory.hxx>
 #include <itksys/SystemTools.hxx>
 
+namespace
+{
+  /// Spacing of the candidate latencies compared by the tracker latency estimation, in seconds
+  const double LATENCY_SEARCH_STEP = 0.001;
+
+  /// Largest rotation between two video frames used by the tracker latency estimation. Symmetric patterns can be
+  /// detected with their corners in reverse order, which shows as a half turn between frames.
+  const double LATENCY_MAXIMUM_FRAME_ROTATION = vtkMath::Pi() / 4.0;
+
+  //----------------------------------------------------------------------------
+  /// Angle of the rotation between two unit quaternions (w, x, y, z), accurate for small angles
+  double GetRotationAngle(const double* q0, const double* q1)
+  {
+    // Vector part of q0^-1 q1
+    const double x = q0[0] * q1[1] - q0[1] * q1[0] - q0[2] * q1[3] + q0[3] * q1[2];
+    const double y = q0[0] * q1[2] + q0[1] * q1[3] - q0[2] * q1[0] - q0[3] * q1[1];
+    const double z = q0[0] * q1[3] - q0[1] * q1[2] + q0[2] * q1[1] - q0[3] * q1[0];
+    const double w = q0[0] * q1[0] + q0[1] * q1[1] + q0[2] * q1[2] + q0[3] * q1[3];
+    return 2.0 * std::atan2(std::sqrt(x * x + y * y + z * z), std::abs(w));
+  }
+
+  //----------------------------------------------------------------------------
+  /// Rotation at a time, interpolated linearly between the quaternions recorded around it (close enough to spherical
+  /// interpolation at tracking rates). Return false if the time is outside of the recorded span.
+  bool InterpolateRotation(const std::vector<double>& times, const std::vector<double>& rotations, double time, double rotation[4])
+  {
+    std::vector<double>::const_iterator after = std::upper_bound(times.begin(), times.end(), time);
+    if (after == times.begin() || (after == times.end() && time > times.back()))
+    {
+      return false;
+    }
+    if (after == times.end())
+    {
+      std::copy(rotations.end() - 4, rotations.end(), rotation);
+      return true;
+    }
+
+    const std::size_t j = after - times.begin();
+    const std::size_t i = j - 1;
+    const double alpha = (time - times[i]) / (times[j] - times[i]);
+    double norm = 0.0;
+    for (int k = 0; k < 4; ++k)
+    {
+      rotation[k] = (1.0 - alpha) * rotations[4 * i + k] + alpha * rotations[4 * j + k];
+      norm += rotation[k] * rotation[k];
+    }
+    norm = std::sqrt(norm);
+    for (int k = 0; k < 4; ++k)
+    {
+      rotation[k] /= norm;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// A file read off-scene by AddPinholeCameras
+  struct PendingCameraFile
+  {
+    std::string                             FileName;
+    vtkSmartPointer<vtkMRMLStorableNode>    Node;
+    vtkSmartPointer<vtkMRMLStorageNode>     StorageNode;
+    bool                                    Loaded;
+  };
+
+  //----------------------------------------------------------------------------
+  bool IsCameraRigFileName(const std::string& fileName)
+  {
+    const std::string name = itksys::SystemTools::LowerCase(fileName);
+    return itksys::SystemTools::StringEndsWith(name, ".rig.xml") || itksys::SystemTools::StringEndsWith(name, ".rig.pcb");
+  }
+
+  //----------------------------------------------------------------------------
+  /// Each file has its own nodes, not yet in the scene, so files can be parsed concurrently
+  class ReadCameraFilesFunctor
+  {
+  public:
+    std::vector<PendingCameraFile>* Files;
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType i = begin; i < end; ++i)
+      {
+        PendingCameraFile& file = (*this->Files)[i];
+        file.Loaded = file.StorageNode->ReadData(file.Node) == 1;
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  /// A frame of a sequence going through UndistortSequence
+  struct SequenceFrame
+  {
+    int                             Index;
+    vtkSmartPointer<vtkImageData>   Input;
+    /// Undistorted image, null if the frame could not be undistorted
+    vtkSmartPointer<vtkImageData>   Output;
+    /// Bytes held while in flight, input and output
+    std::size_t                     Size;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Undistortion stage of UndistortSequence, running on its own thread while the calling thread reads the next
+  /// frames and writes the finished ones. Frames come out in the order they were pushed.
+  /// The filter splits each frame across threads, so a single stage keeps all cores busy.
+  class SequenceUndistortionStage
+  {
+  public:
+    SequenceUndistortionStage(vtkMRMLPinholeCameraNode* cameraNode)
+      : CameraNode(cameraNode)
+      , Stop(false)
+    {
+      this->Thread = std::thread(&SequenceUndistortionStage::Run, this);
+    }
+
+    ~SequenceUndistortionStage()
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->Stop = true;
+      }
+      this->FrameQueued.notify_all();
+      this->Thread.join();
+    }
+
+    void Push(const SequenceFrame& frame)
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->Mutex);
+        this->Queued.push_back(frame);
+      }
+      this->FrameQueued.notify_one();
+    }
+
+    /// Wait for the oldest pushed frame to be undistorted
+    SequenceFrame Pop()
+    {
+      std::unique_lock<std::mutex> lock(this->Mutex);
+      this->FrameDone.wait(lock, [this] { return !this->Done.empty(); });
+      SequenceFrame frame = this->Done.front();
+      this->Done.pop_front();
+      return frame;
+    }
+
+  private:
+    void Run()
+    {
+      for (;;)
+      {
+        SequenceFrame frame;
+        {
+          std::unique_lock<std::mutex> lock(this->Mutex);
+          this->FrameQueued.wait(lock, [this] { return this->Stop || !this->Queued.empty(); });
+          if (this->Stop)
+          {
+            return;
+          }
+          frame = this->Queued.front();
+          this->Queued.pop_front();
+        }
+
+        // A new filter for each frame, so that every frame gets its own output buffer without copying it.
+        // The filter looks its map up in the camera node cache, so building one per frame costs no map computation.
+        vtkNew<vtkPinholeCameraUndistortionFilter> filter;
+        filter->SetCameraNode(this->CameraNode);
+        filter->SetInputData(frame.Input);
+        filter->Update();
+        if (filter->GetOutput()->GetPointData()->GetScalars() != NULL)
+        {
+          frame.Output = filter->GetOutput();
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(this->Mutex);
+          this->Done.push_back(frame);
+        }
+        this->FrameDone.notify_one();
+      }
+    }
+
+    vtkMRMLPinholeCameraNode*   CameraNode;
+    std::thread                 Thread;
+    std::mutex                  Mutex;
+    std::condition_variable     FrameQueued;
+    std::condition_variable     FrameDone;
+    std::deque<SequenceFrame>   Queued;
+    std::deque<SequenceFrame>   Done;
+    bool                        Stop;
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerPinholeCamerasLogic::vtkInternal
+{
+public:
+  /// Detection settings, copied into each captured frame so workers never read the logic
+  struct DetectionSettings
+  {
+    int             PatternType;
+    cv::Size        PatternSize;
+    int             DetectionFlags;
+    int             SubPixelRadius;
+    unsigned long   PatternVersion;
+  };
+
+  struct CaptureFrame
+  {
+    cv::Mat             Gray;
+    DetectionSettings   Settings;
+  };
+
+  struct CaptureResult
+  {
+    std::vector<cv::Point2f>  Corners;
+    cv::Size                  ImageSize;
+    unsigned long             PatternVersion;
+  };
+
+  /// A tracker latency estimation, inputs are set on the main thread before the worker starts and outputs are only
+  /// read once Finished is set. Frames are gray copies owned by the estimation, the sequence may change meanwhile.
+  struct LatencyEstimation
+  {
+    std::string                                   CameraNodeID;
+    /// Empty for frames with unsupported scalars, they are skipped
+    std::vector<cv::Mat>                          Frames;
+    std::vector<double>                           FrameTimes;
+    /// Tracked rotations as unit quaternions, consecutive ones on the same side so they interpolate the short way
+    std::vector<double>                           PoseTimes;
+    std::vector<double>                           PoseRotations;
+    DetectionSettings                             Settings;
+    std::vector<cv::Point3f>                      Pattern;
+    cv::Mat                                       CameraMatrix;
+    cv::Mat                                       DistortionCoefficients;
+    double                                        MaximumLatency;
+
+    bool                                          Succeeded;
+    double                                        Latency;
+    double                                        Correlation;
+    int                                           NumberOfFrames;
+    std::string                                   ErrorMessage;
+
+    std::atomic<bool>                             StopRequested;
+    std::atomic<bool>                             Finished;
+  };
+
+  /// Camera rotation in each frame of a latency estimation, frames are split across threads
+  class LatencyDetectionFunctor
+  {
+  public:
+    LatencyEstimation*    Estimation;
+    std::vector<double>*  Rotations;
+    std::vector<char>*    Found;
+
+    void operator()(vtkIdType begin, vtkIdType end) const;
+  };
+
+public:
+  vtkInternal();
+
+  /// Convert an image to an 8 bit single channel matrix, sharing the scalars when possible
+  static bool GetGrayImage(vtkImageData* image, bool invert, cv::Mat& gray);
+
+  /// Find the pattern in a gray image, thread safe. Throws cv::Exception on OpenCV errors.
+  static bool DetectPattern(const cv::Mat& gray, const DetectionSettings& settings, std::vector<cv::Point2f>& corners);
+
+  void UpdatePattern();
+
+  /// Add a view to the observations if the keyframe selector keeps it, possibly replacing a less useful one
+  bool AddObservation(const std::vector<cv::Point3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints, const cv::Size& imageSize);
+
+  /// Sum of squared reprojection errors of a view for the given camera pose
+  double ComputeViewSquaredError(int view, const cv::Mat& rotation, const cv::Mat& translation) const;
+
+  void StartWorkers(int numberOfThreads);
+  void StopWorkers();
+  void WorkerLoop();
+
+  /// Worker thread of the tracker latency estimation
+  static void EstimateTrackerLatency(LatencyEstimation* estimation);
+
+  int                                     PatternType;
+  int                                     PatternRows;
+  int                                     PatternColumns;
+  double                                  PatternSpacing;
+  unsigned long                           PatternVersion;
+  std::vector<cv::Point3f>                Pattern;
+
+  cv::Size                                ImageSize;
+  std::vector<std::vector<cv::Point3f>>   ObjectPoints;
+  std::vector<std::vector<cv::Point2f>>   ImagePoints;
+  vtkPinholeCameraKeyframeSelector        KeyframeSelector;
+  // Observations appended or replaced since the last public call adding observations
+  std::vector<int>                        ChangedObservations;
+
+  // Last solution, the starting point of the next solve. Views added since have no pose nor error yet.
+  bool                                    HasSolution;
+  cv::Mat                                 CameraMatrix;
+  cv::Mat                                 DistortionCoefficients;
+  std::vector<cv::Mat>                    Rotations;
+  std::vector<cv::Mat>                    Translations;
+  std::vector<double>                     ViewSquaredErrors;
+
+  // Live capture, the mutex guards the queues and StopRequested
+  vtkMRMLVolumeNode*                      CaptureVolumeNode;
+  bool                                    CaptureInvert;
+  std::vector<std::thread>                Workers;
+  std::mutex                              CaptureMutex;
+  std::condition_variable                 FrameQueued;
+  std::deque<CaptureFrame>                Frames;
+  std::deque<CaptureResult>               Results;
+  bool                                    StopRequested;
+  int                                     NumberOfCapturedFrames;
+  int                                     NumberOfDroppedFrames;
+  int                                     NumberOfDetectedFrames;
+
+  // Tracker latency estimation, the running one and the results of the last finished one
+  std::unique_ptr<LatencyEstimation>      Latency;
+  std::thread                             LatencyThread;
+  bool                                    LatencySucceeded;
+  double                                  EstimatedLatency;
+  double                                  LatencyCorrelation;
+  int                                     NumberOfLatencyFrames;
+  std::string                             LatencyErrorMessage;
+
+  // View cameras driven by a pinhole camera
+  std::map<vtkMRMLCameraNode*, vtkSmartPointer<vtkPinholeCameraViewSynchronizer>> ViewSynchronizers;
+};
+
+//----------------------------------------------------------------------------
+vtkSlicerPinholeCamerasLogic::vtkInternal::vtkInternal()
+  : PatternType(CalibrationPatternCheckerboard)
+  , PatternRows(6)
+  , PatternColumns(9)
+  , PatternSpacing(1.0)
+  , PatternVersion(0)
+  , HasSolution(false)
+  , CaptureVolumeNode(NULL)
+  , CaptureInvert(false)
+  , StopRequested(false)
+  , NumberOfCapturedFrames(0)
+  , NumberOfDroppedFrames(0)
+  , NumberOfDetectedFrames(0)
+  , LatencySucceeded(false)
+  , EstimatedLatency(0.0)
+  , LatencyCorrelation(0.0)
+  , NumberOfLatencyFrames(0)
+{
+  this->UpdatePattern();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::vtkInternal::GetGrayImage(vtkImageData* image, bool invert, cv::Mat& gray)
+{
+  int dimensions[3];
+  image->GetDimensions(dimensions);
+  const int components = image->GetNumberOfScalarComponents();
+  if (dimensions[0] < 1 || dimensions[1] < 1 || image->GetScalarPointer() == NULL || (components != 1 && components != 3 && components != 4))
+  {
+    return false;
+  }
+
+  // Rows of the VTK image are used in memory order, as the Python module does, so pixel coordinates match the scalars
+  cv::Mat mat;
+  switch (image->GetScalarType())
+  {
+    case VTK_UNSIGNED_CHAR:
+      mat = cv::Mat(dimensions[1], dimensions[0], CV_8UC(components), image->GetScalarPointer());
+      break;
+    case VTK_UNSIGNED_SHORT:
+      mat = cv::Mat(dimensions[1], dimensions[0], CV_16UC(components), image->GetScalarPointer());
+      break;
+    case VTK_FLOAT:
+      mat = cv::Mat(dimensions[1], dimensions[0], CV_32FC(components), image->GetScalarPointer());
+      break;
+    case VTK_DOUBLE:
+      mat = cv::Mat(dimensions[1], dimensions[0], CV_64FC(components), image->GetScalarPointer());
+      break;
+    default:
+      return false;
+  }
+
+  if (mat.depth() == CV_64F)
+  {
+    // Color conversion does not support double precision
+    mat.convertTo(mat, CV_32F);
+  }
+  if (components == 3)
+  {
+    cv::cvtColor(mat, mat, cv::COLOR_RGB2GRAY);
+  }
+  else if (components == 4)
+  {
+    cv::cvtColor(mat, mat, cv::COLOR_RGBA2GRAY);
+  }
+
+  if (mat.depth() != CV_8U)
+  {
+    cv::normalize(mat, gray, 0, 255, cv::NORM_MINMAX, CV_8U);
+  }
+  else
+  {
+    gray = mat;
+  }
+
+  if (invert)
+  {
+    // Never modify the scalars of the image in place
+    cv::Mat inverted;
+    cv::bitwise_not(gray, inverted);
+    gray = inverted;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::vtkInternal::DetectPattern(const cv::Mat& gray, const DetectionSettings& settings, std::vector<cv::Point2f>& corners)
+{
+  if (settings.PatternType == CalibrationPatternCheckerboard)
+  {
+    if (!cv::findChessboardCorners(gray, settings.PatternSize, corners, settings.DetectionFlags))
+    {
+      return false;
+    }
+    cv::cornerSubPix(gray, corners, cv::Size(settings.SubPixelRadius, settings.SubPixelRadius), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1));
+    return true;
+  }
+
+  // Circle grid flags overlap the checkerboard ones, only clustering is taken from the detection flags
+  const int gridFlag = settings.PatternType == CalibrationPatternCircleGrid ? cv::CALIB_CB_SYMMETRIC_GRID : cv::CALIB_CB_ASYMMETRIC_GRID;
+  return cv::findCirclesGrid(gray, settings.PatternSize, corners, gridFlag | (settings.DetectionFlags & cv::CALIB_CB_CLUSTERING));
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::UpdatePattern()
+{
+  ++this->PatternVersion;
+  this->Pattern.clear();
+  this->Pattern.reserve(this->PatternRows * this->PatternColumns);
+  for (int row = 0; row < this->PatternRows; ++row)
+  {
+    for (int column = 0; column < this->PatternColumns; ++column)
+    {
+      // Asymmetric grids have every other row shifted by half a spacing
+      const double x = this->PatternType == CalibrationPatternAsymmetricCircleGrid ? (2 * column + row % 2) * this->PatternSpacing : column * this->PatternSpacing;
+      this->Pattern.push_back(cv::Point3f(static_cast<float>(x), static_cast<float>(row * this->PatternSpacing), 0.f));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::vtkInternal::AddObservation(const std::vector<cv::Point3f>& objectPoints, const std::vector<cv::Point2f>& imagePoints, const cv::Size& imageSize)
+{
+  if (this->ImagePoints.empty())
+  {
+    this->ImageSize = imageSize;
+    this->KeyframeSelector.Reset();
+    this->KeyframeSelector.SetImageSize(imageSize.width, imageSize.height);
+  }
+
+  const int decision = this->KeyframeSelector.AddView(&objectPoints[0].x, &imagePoints[0].x, static_cast<int>(imagePoints.size()));
+  if (decision == vtkPinholeCameraKeyframeSelector::Rejected)
+  {
+    return false;
+  }
+  int index = decision;
+  if (decision == vtkPinholeCameraKeyframeSelector::Appended)
+  {
+    index = static_cast<int>(this->ImagePoints.size());
+    this->ObjectPoints.push_back(objectPoints);
+    this->ImagePoints.push_back(imagePoints);
+    this->Rotations.push_back(cv::Mat());
+    this->Translations.push_back(cv::Mat());
+    this->ViewSquaredErrors.push_back(-1.0);
+  }
+  else
+  {
+    this->ObjectPoints[decision] = objectPoints;
+    this->ImagePoints[decision] = imagePoints;
+    this->Rotations[decision] = cv::Mat();
+    this->Translations[decision] = cv::Mat();
+    this->ViewSquaredErrors[decision] = -1.0;
+  }
+  if (std::find(this->ChangedObservations.begin(), this->ChangedObservations.end(), index) == this->ChangedObservations.end())
+  {
+    this->ChangedObservations.push_back(index);
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::vtkInternal::ComputeViewSquaredError(int view, const cv::Mat& rotation, const cv::Mat& translation) const
+{
+  std::vector<cv::Point2f> projected;
+  cv::projectPoints(this->ObjectPoints[view], rotation, translation, this->CameraMatrix, this->DistortionCoefficients, projected);
+
+  double squaredError = 0.0;
+  for (std::size_t i = 0; i < projected.size(); ++i)
+  {
+    const cv::Point2f difference = projected[i] - this->ImagePoints[view][i];
+    squaredError += difference.dot(difference);
+  }
+  return squaredError;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::StartWorkers(int numberOfThreads)
+{
+  this->StopRequested = false;
+  for (int i = 0; i < numberOfThreads; ++i)
+  {
+    this->Workers.push_back(std::thread(&vtkInternal::WorkerLoop, this));
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::StopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->CaptureMutex);
+    this->StopRequested = true;
+    this->Frames.clear();
+  }
+  this->FrameQueued.notify_all();
+  for (std::vector<std::thread>::iterator it = this->Workers.begin(); it != this->Workers.end(); ++it)
+  {
+    it->join();
+  }
+  this->Workers.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::WorkerLoop()
+{
+  for (;;)
+  {
+    CaptureFrame frame;
+    {
+      std::unique_lock<std::mutex> lock(this->CaptureMutex);
+      this->FrameQueued.wait(lock, [this]() { return this->StopRequested || !this->Frames.empty(); });
+      if (this->StopRequested)
+      {
+        return;
+      }
+      frame = this->Frames.front();
+      this->Frames.pop_front();
+    }
+
+    CaptureResult result;
+    bool found = false;
+    try
+    {
+      found = DetectPattern(frame.Gray, frame.Settings, result.Corners);
+    }
+    catch (const cv::Exception&)
+    {
+      // A frame that cannot be processed is treated as one without the pattern
+      found = false;
+    }
+    if (!found)
+    {
+      continue;
+    }
+
+    result.ImageSize = frame.Gray.size();
+    result.PatternVersion = frame.Settings.PatternVersion;
+    std::lock_guard<std::mutex> lock(this->CaptureMutex);
+    this->Results.push_back(result);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::LatencyDetectionFunctor::operator()(vtkIdType begin, vtkIdType end) const
+{
+  for (vtkIdType frame = begin; frame < end && !this->Estimation->StopRequested; ++frame)
+  {
+    try
+    {
+      const cv::Mat& gray = this->Estimation->Frames[frame];
+      std::vector<cv::Point2f> corners;
+      cv::Mat rotationVector;
+      cv::Mat translation;
+      if (gray.empty() ||
+          !DetectPattern(gray, this->Estimation->Settings, corners) ||
+          !cv::solvePnP(this->Estimation->Pattern, corners, this->Estimation->CameraMatrix, this->Estimation->DistortionCoefficients, rotationVector, translation))
+      {
+        continue;
+      }
+
+      cv::Mat rotationMatrix;
+      cv::Rodrigues(rotationVector, rotationMatrix);
+      double rotation[3][3];
+      for (int i = 0; i < 3; ++i)
+      {
+        for (int j = 0; j < 3; ++j)
+        {
+          rotation[i][j] = rotationMatrix.at<double>(i, j);
+        }
+      }
+      vtkMath::Matrix3x3ToQuaternion(rotation, &(*this->Rotations)[4 * frame]);
+      (*this->Found)[frame] = 1;
+    }
+    catch (const cv::Exception&)
+    {
+      // A frame that cannot be processed is treated as one without the pattern
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::vtkInternal::EstimateTrackerLatency(LatencyEstimation* estimation)
+{
+  const vtkIdType numberOfFrames = static_cast<vtkIdType>(estimation->Frames.size());
+  std::vector<double> cameraRotations(4 * numberOfFrames, 0.0);
+  std::vector<char> found(numberOfFrames, 0);
+  LatencyDetectionFunctor detection;
+  detection.Estimation = estimation;
+  detection.Rotations = &cameraRotations;
+  detection.Found = &found;
+  vtkSMPTools::For(0, numberOfFrames, detection);
+  estimation->NumberOfFrames = static_cast<int>(std::count(found.begin(), found.end(), 1));
+  if (estimation->StopRequested)
+  {
+    estimation->ErrorMessage = "The estimation was stopped.";
+    estimation->Finished = true;
+    return;
+  }
+
+  // Mean rotation speed of the camera between consecutive frames with the pattern. Frames further apart than a
+  // few frame periods are not paired, the speed would average out the motion.
+  std::vector<double> periods;
+  for (std::size_t frame = 1; frame < estimation->FrameTimes.size(); ++frame)
+  {
+    periods.push_back(estimation->FrameTimes[frame] - estimation->FrameTimes[frame - 1]);
+  }
+  std::nth_element(periods.begin(), periods.begin() + periods.size() / 2, periods.end());
+  const double maximumInterval = 2.5 * periods[periods.size() / 2];
+
+  std::vector<double> intervalStarts;
+  std::vector<double> intervalEnds;
+  std::vector<double> cameraSpeeds;
+  vtkIdType previous = -1;
+  for (vtkIdType frame = 0; frame < numberOfFrames; ++frame)
+  {
+    if (!found[frame])
+    {
+      continue;
+    }
+    if (previous >= 0 && estimation->FrameTimes[frame] - estimation->FrameTimes[previous] <= maximumInterval)
+    {
+      const double angle = GetRotationAngle(&cameraRotations[4 * previous], &cameraRotations[4 * frame]);
+      if (angle <= LATENCY_MAXIMUM_FRAME_ROTATION)
+      {
+        intervalStarts.push_back(estimation->FrameTimes[previous]);
+        intervalEnds.push_back(estimation->FrameTimes[frame]);
+        cameraSpeeds.push_back(angle / (estimation->FrameTimes[frame] - estimation->FrameTimes[previous]));
+      }
+    }
+    previous = frame;
+  }
+  const int numberOfIntervals = static_cast<int>(cameraSpeeds.size());
+  if (numberOfIntervals < 10)
+  {
+    estimation->ErrorMessage = "The pattern was found in too few consecutive frames.";
+    estimation->Finished = true;
+    return;
+  }
+
+  // Normalized cross-correlation of the camera speeds with the tracker speeds over the same intervals shifted by
+  // each candidate latency. Shifts leaving less than half of the intervals within the tracking are not compared.
+  const int numberOfSteps = static_cast<int>(estimation->MaximumLatency / LATENCY_SEARCH_STEP);
+  std::vector<double> correlations(2 * numberOfSteps + 1, -2.0);
+  for (int step = -numberOfSteps; step <= numberOfSteps && !estimation->StopRequested; ++step)
+  {
+    const double shift = step * LATENCY_SEARCH_STEP;
+    double sumCamera = 0.0, sumTracker = 0.0, sumCamera2 = 0.0, sumTracker2 = 0.0, sumProduct = 0.0;
+    int count = 0;
+    for (int interval = 0; interval < numberOfIntervals; ++interval)
+    {
+      double start[4];
+      double end[4];
+      if (!InterpolateRotation(estimation->PoseTimes, estimation->PoseRotations, intervalStarts[interval] + shift, start) ||
+          !InterpolateRotation(estimation->PoseTimes, estimation->PoseRotations, intervalEnds[interval] + shift, end))
+      {
+        continue;
+      }
+      const double trackerSpeed = GetRotationAngle(start, end) / (intervalEnds[interval] - intervalStarts[interval]);
+      const double cameraSpeed = cameraSpeeds[interval];
+      sumCamera += cameraSpeed;
+      sumTracker += trackerSpeed;
+      sumCamera2 += cameraSpeed * cameraSpeed;
+      sumTracker2 += trackerSpeed * trackerSpeed;
+      sumProduct += cameraSpeed * trackerSpeed;
+      ++count;
+    }
+    if (2 * count < numberOfIntervals)
+    {
+      continue;
+    }
+    const double varianceProduct = (count * sumCamera2 - sumCamera * sumCamera) * (count * sumTracker2 - sumTracker * sumTracker);
+    if (varianceProduct > 0.0)
+    {
+      correlations[step + numberOfSteps] = (count * sumProduct - sumCamera * sumTracker) / std::sqrt(varianceProduct);
+    }
+  }
+  if (estimation->StopRequested)
+  {
+    estimation->ErrorMessage = "The estimation was stopped.";
+    estimation->Finished = true;
+    return;
+  }
+
+  const int peak = static_cast<int>(std::max_element(correlations.begin(), correlations.end()) - correlations.begin());
+  if (correlations[peak] < -1.0)
+  {
+    estimation->ErrorMessage = "The camera did not rotate, or the video and the tracking do not overlap in time.";
+    estimation->Finished = true;
+    return;
+  }
+  if (peak == 0 || peak == 2 * numberOfSteps || correlations[peak - 1] < -1.0 || correlations[peak + 1] < -1.0)
+  {
+    estimation->ErrorMessage = "The best match is at the edge of the searched latencies, increase the maximum latency.";
+    estimation->Finished = true;
+    return;
+  }
+
+  // Fit a parabola through the peak and its neighbours for a latency finer than the search step
+  const double before = correlations[peak - 1];
+  const double at = correlations[peak];
+  const double after = correlations[peak + 1];
+  const double curvature = before - 2.0 * at + after;
+  const double offset = curvature < 0.0 ? std::max(-0.5, std::min(0.5, 0.5 * (before - after) / curvature)) : 0.0;
+
+  estimation->Latency = (peak - numberOfSteps + offset) * LATENCY_SEARCH_STEP;
+  estimation->Correlation = at;
+  estimation->Succeeded = true;
+  estimation->Finished = true;
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerPinholeCamerasLogic);
 
 //----------------------------------------------------------------------------
 vtkSlicerPinholeCamerasLogic::vtkSlicerPinholeCamerasLogic()
+  : CalibrationDetectionFlags(cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE)
+  , CalibrationSolveFlags(0)
+  , CalibrationSubPixelRadius(5)
+  , CalibrationCaptureQueueSize(4)
+  , CalibrationWarmStart(true)
+  , CalibrationMaximumIterations(30)
+  , CalibrationTolerance(1e-6)
+  , UndistortionPrefetchSize(8)
+  , UndistortionMemoryLimit(512)
+  , Internal(new vtkInternal())
 {
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerPinholeCamerasLogic::~vtkSlicerPinholeCamerasLogic()
 {
+  this->StopCalibrationCapture();
+  this->StopTrackerLatencyEstimation();
+  this->Internal->ViewSynchronizers.clear();
+  delete this->Internal;
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerPinholeCamerasLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "CalibrationPatternType: " << this->Internal->PatternType << "\n";
+  os << indent << "CalibrationPatternRows: " << this->Internal->PatternRows << "\n";
+  os << indent << "CalibrationPatternColumns: " << this->Internal->PatternColumns << "\n";
+  os << indent << "CalibrationPatternSpacing: " << this->Internal->PatternSpacing << "\n";
+  os << indent << "CalibrationDetectionFlags: " << this->CalibrationDetectionFlags << "\n";
+  os << indent << "CalibrationSolveFlags: " << this->CalibrationSolveFlags << "\n";
+  os << indent << "CalibrationSubPixelRadius: " << this->CalibrationSubPixelRadius << "\n";
+  os << indent << "CalibrationWarmStart: " << (this->CalibrationWarmStart ? "true" : "false") << "\n";
+  os << indent << "CalibrationMaximumIterations: " << this->CalibrationMaximumIterations << "\n";
+  os << indent << "CalibrationTolerance: " << this->CalibrationTolerance << "\n";
+  os << indent << "CalibrationKeyframeBudget: " << this->Internal->KeyframeSelector.GetBudget() << "\n";
+  os << indent << "NumberOfCalibrationObservations: " << this->Internal->ImagePoints.size() << "\n";
+  os << indent << "CalibrationCaptureQueueSize: " << this->CalibrationCaptureQueueSize << "\n";
+  os << indent << "CalibrationCaptureActive: " << (this->Internal->CaptureVolumeNode != NULL ? "true" : "false") << "\n";
+  os << indent << "UndistortionPrefetchSize: " << this->UndistortionPrefetchSize << "\n";
+  os << indent << "UndistortionMemoryLimit: " << this->UndistortionMemoryLimit << " MB\n";
+  os << indent << "TrackerLatencyEstimationActive: " << (this->Internal->Latency ? "true" : "false") << "\n";
+  os << indent << "EstimatedTrackerLatency: " << this->Internal->EstimatedLatency << " s\n";
+  os << indent << "TrackerLatencyCorrelation: " << this->Internal->LatencyCorrelation << "\n";
+  os << indent << "NumberOfBoundViewCameras: " << this->Internal->ViewSynchronizers.size() << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -110,29 +921,1114 @@ vtkMRMLPinholeCameraNode* vtkSlicerPinholeCamerasLogic::AddPinholeCamera(const c
   return videoCameraNode.GetPointer();
 }
 
-//---------------------------------------------------------------------------
-void vtkSlicerPinholeCamerasLogic::SetMRMLSceneInternal(vtkMRMLScene* newScene)
+//----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigNode* vtkSlicerPinholeCamerasLogic::AddPinholeCameraRig(const char* filename, const char* nodeName /*= NULL*/)
 {
-  vtkNew<vtkIntArray> events;
-  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
-  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
-  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
-  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
-}
+  if (this->GetMRMLScene() == NULL || filename == NULL)
+  {
+    return NULL;
+  }
+  vtkNew<vtkMRMLPinholeCameraRigNode> rigNode;
+  vtkNew<vtkMRMLPinholeCameraRigStorageNode> storageNode;
 
-//-----------------------------------------------------------------------------
-void vtkSlicerPinholeCamerasLogic::RegisterNodes()
-{
-  assert(this->GetMRMLScene() != 0);
+  storageNode->SetFileName(filename);
 
-  vtkMRMLScene* scene = this->GetMRMLScene();
+  const std::string fname(filename);
+  std::string name = itksys::SystemTools::GetFilenameName(fname);
+  if (!storageNode->SupportedFileType(name.c_str()))
+  {
+    vtkErrorMacro("Couldn't read file: " << filename);
+    return NULL;
+  }
 
-  // Nodes
-  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraNode>::New());
-  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraStorageNode>::New());
-}
+  // the rig node name is based on the file name, without the compound .rig.xml extension
+  std::string baseName = storageNode->GetFileNameWithoutExtension(name.c_str());
+  std::string uname(this->GetMRMLScene()->GetUniqueNameByString(nodeName != NULL ? nodeName : baseName.c_str()));
+  rigNode->SetName(uname.c_str());
 
-//---------------------------------------------------------------------------
+  this->GetMRMLScene()->SaveStateForUndo();
+
+  this->GetMRMLScene()->AddNode(storageNode.GetPointer());
+
+  rigNode->SetScene(this->GetMRMLScene());
+  rigNode->SetAndObserveStorageNodeID(storageNode->GetID());
+
+  this->GetMRMLScene()->AddNode(rigNode.GetPointer());
+
+  vtkDebugMacro("AddPinholeCameraRig: calling read on the storage node");
+  if (storageNode->ReadData(rigNode.GetPointer()) != 1)
+  {
+    vtkErrorMacro("AddPinholeCameraRig: error reading " << filename);
+    this->GetMRMLScene()->RemoveNode(rigNode.GetPointer());
+    return NULL;
+  }
+
+  return rigNode.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::AddPinholeCameras(vtkStringArray* filenames, vtkCollection* loadedNodes /*= NULL*/)
+{
+  if (this->GetMRMLScene() == NULL || filenames == NULL)
+  {
+    return 0;
+  }
+
+  std::vector<PendingCameraFile> files;
+  for (vtkIdType i = 0; i < filenames->GetNumberOfValues(); ++i)
+  {
+    PendingCameraFile file;
+    file.FileName = filenames->GetValue(i);
+    file.Loaded = false;
+    if (IsCameraRigFileName(file.FileName))
+    {
+      file.Node = vtkSmartPointer<vtkMRMLPinholeCameraRigNode>::New();
+      file.StorageNode = vtkSmartPointer<vtkMRMLPinholeCameraRigStorageNode>::New();
+    }
+    else
+    {
+      file.Node = vtkSmartPointer<vtkMRMLPinholeCameraNode>::New();
+      file.StorageNode = vtkSmartPointer<vtkMRMLPinholeCameraStorageNode>::New();
+    }
+    file.StorageNode->SetFileName(file.FileName.c_str());
+
+    if (!file.StorageNode->SupportedFileType(itksys::SystemTools::GetFilenameName(file.FileName).c_str()))
+    {
+      vtkErrorMacro("Couldn't read file: " << file.FileName);
+      continue;
+    }
+    files.push_back(file);
+  }
+
+  ReadCameraFilesFunctor functor;
+  functor.Files = &files;
+  vtkSMPTools::For(0, static_cast<vtkIdType>(files.size()), 1, functor);
+
+  // Insert everything at once, observers see a single batch and undo restores the scene before the whole load
+  int numberOfLoadedFiles = 0;
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  scene->SaveStateForUndo();
+  scene->StartState(vtkMRMLScene::BatchProcessState);
+  for (std::vector<PendingCameraFile>::iterator it = files.begin(); it != files.end(); ++it)
+  {
+    if (!it->Loaded)
+    {
+      vtkErrorMacro("AddPinholeCameras: error reading " << it->FileName);
+      continue;
+    }
+
+    std::string baseName = it->StorageNode->GetFileNameWithoutExtension(itksys::SystemTools::GetFilenameName(it->FileName).c_str());
+    std::string uname(scene->GetUniqueNameByString(baseName.c_str()));
+    it->Node->SetName(uname.c_str());
+
+    scene->AddNode(it->StorageNode);
+    it->Node->SetScene(scene);
+    it->Node->SetAndObserveStorageNodeID(it->StorageNode->GetID());
+    scene->AddNode(it->Node);
+
+    if (loadedNodes != NULL)
+    {
+      loadedNodes->AddItem(it->Node);
+    }
+    ++numberOfLoadedFiles;
+  }
+  scene->EndState(vtkMRMLScene::BatchProcessState);
+
+  return numberOfLoadedFiles;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::AddPinholeCamerasFromDirectory(const char* directory, vtkCollection* loadedNodes /*= NULL*/)
+{
+  if (directory == NULL)
+  {
+    return 0;
+  }
+
+  itksys::Directory dir;
+  if (!dir.Load(directory))
+  {
+    vtkErrorMacro("Couldn't open directory: " << directory);
+    return 0;
+  }
+
+  vtkNew<vtkStringArray> filenames;
+  for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i)
+  {
+    std::string fileName = std::string(directory) + "/" + dir.GetFile(i);
+    std::string extension = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(fileName));
+    if (!itksys::SystemTools::FileIsDirectory(fileName) && (extension == ".xml" || extension == ".pcb"))
+    {
+      filenames->InsertNextValue(fileName);
+    }
+  }
+
+  return this->AddPinholeCameras(filenames, loadedNodes);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::UndistortImage(vtkMRMLPinholeCameraNode* cameraNode, vtkImageData* input, vtkImageData* output)
+{
+  if (cameraNode == NULL || input == NULL || output == NULL)
+  {
+    vtkErrorMacro("UndistortImage: invalid arguments");
+    return false;
+  }
+
+  vtkNew<vtkPinholeCameraUndistortionFilter> filter;
+  filter->SetCameraNode(cameraNode);
+  filter->SetInputData(input);
+  filter->Update();
+  if (filter->GetOutput()->GetPointData()->GetScalars() == NULL)
+  {
+    return false;
+  }
+
+  output->ShallowCopy(filter->GetOutput());
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::UndistortSequence(vtkMRMLPinholeCameraNode* cameraNode, vtkMRMLSequenceNode* inputSequence, vtkMRMLSequenceNode* outputSequence)
+{
+  if (cameraNode == NULL || inputSequence == NULL || outputSequence == NULL)
+  {
+    vtkErrorMacro("UndistortSequence: invalid arguments");
+    return false;
+  }
+  if (inputSequence == outputSequence)
+  {
+    vtkErrorMacro("UndistortSequence: a sequence cannot be undistorted in place");
+    return false;
+  }
+
+  const int numberOfFrames = inputSequence->GetNumberOfDataNodes();
+  const int prefetchSize = std::max(1, this->UndistortionPrefetchSize);
+  const std::size_t memoryLimit = static_cast<std::size_t>(std::max(0, this->UndistortionMemoryLimit)) * 1024 * 1024;
+
+  int wasModifying = outputSequence->StartModify();
+  outputSequence->RemoveAllDataNodes();
+  outputSequence->SetIndexName(inputSequence->GetIndexName());
+  outputSequence->SetIndexUnit(inputSequence->GetIndexUnit());
+  outputSequence->SetIndexType(inputSequence->GetIndexType());
+
+  // Read, undistort and write are pipelined: the sequence nodes are only accessed from this thread, which reads
+  // frames ahead into the undistortion stage and writes the frames it returns. Frames in flight hold an output
+  // image each, so their number and size are capped. At least one frame is always in flight.
+  bool succeeded = true;
+  {
+    SequenceUndistortionStage undistortionStage(cameraNode);
+    int nextReadFrame = 0;
+    int nextWriteFrame = 0;
+    int framesInFlight = 0;
+    std::size_t bytesInFlight = 0;
+
+    while (succeeded && nextWriteFrame < numberOfFrames)
+    {
+      while (nextReadFrame < numberOfFrames && framesInFlight < prefetchSize)
+      {
+        vtkMRMLVolumeNode* volumeNode = vtkMRMLVolumeNode::SafeDownCast(inputSequence->GetNthDataNode(nextReadFrame));
+        if (volumeNode == NULL || volumeNode->GetImageData() == NULL)
+        {
+          vtkErrorMacro("UndistortSequence: frame " << nextReadFrame << " is not an image");
+          succeeded = false;
+          break;
+        }
+
+        SequenceFrame frame;
+        frame.Index = nextReadFrame;
+        frame.Input = volumeNode->GetImageData();
+        // The undistorted image has the extent and scalar type of the input
+        frame.Size = 2 * static_cast<std::size_t>(frame.Input->GetActualMemorySize()) * 1024;
+        if (framesInFlight > 0 && bytesInFlight + frame.Size > memoryLimit)
+        {
+          break;
+        }
+        undistortionStage.Push(frame);
+        ++framesInFlight;
+        bytesInFlight += frame.Size;
+        ++nextReadFrame;
+      }
+      if (!succeeded || framesInFlight == 0)
+      {
+        break;
+      }
+
+      SequenceFrame frame = undistortionStage.Pop();
+      --framesInFlight;
+      bytesInFlight -= frame.Size;
+      if (frame.Output == NULL)
+      {
+        vtkErrorMacro("UndistortSequence: unable to undistort frame " << frame.Index);
+        succeeded = false;
+        break;
+      }
+
+      vtkMRMLVolumeNode* inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(inputSequence->GetNthDataNode(frame.Index));
+      vtkSmartPointer<vtkMRMLVolumeNode> outputVolumeNode = vtkSmartPointer<vtkMRMLVolumeNode>::Take(
+            vtkMRMLVolumeNode::SafeDownCast(inputVolumeNode->CreateNodeInstance()));
+      outputVolumeNode->SetName(inputVolumeNode->GetName());
+      outputVolumeNode->CopyOrientation(inputVolumeNode);
+      outputVolumeNode->SetAndObserveImageData(frame.Output);
+      outputSequence->SetDataNodeAtValue(outputVolumeNode, inputSequence->GetNthIndexValue(frame.Index));
+      ++nextWriteFrame;
+
+      double progress = static_cast<double>(nextWriteFrame) / numberOfFrames;
+      this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+    }
+    // Frames still in flight after a failure are discarded when the stage stops
+  }
+
+  outputSequence->EndModify(wasModifying);
+  return succeeded;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::SetCalibrationPattern(int patternType, int rows, int columns, double spacing)
+{
+  if (patternType < CalibrationPatternCheckerboard || patternType > CalibrationPatternAsymmetricCircleGrid)
+  {
+    vtkErrorMacro("SetCalibrationPattern: unknown pattern type " << patternType);
+    return;
+  }
+  if (rows < 2 || columns < 2 || spacing <= 0.0)
+  {
+    vtkErrorMacro("SetCalibrationPattern: a pattern needs at least 2 rows and columns and a positive spacing");
+    return;
+  }
+  if (patternType == this->Internal->PatternType && rows == this->Internal->PatternRows &&
+      columns == this->Internal->PatternColumns && spacing == this->Internal->PatternSpacing)
+  {
+    return;
+  }
+
+  this->Internal->PatternType = patternType;
+  this->Internal->PatternRows = rows;
+  this->Internal->PatternColumns = columns;
+  this->Internal->PatternSpacing = spacing;
+  this->Internal->UpdatePattern();
+  this->ResetCalibration();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetCalibrationPatternType()
+{
+  return this->Internal->PatternType;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetCalibrationPatternRows()
+{
+  return this->Internal->PatternRows;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetCalibrationPatternColumns()
+{
+  return this->Internal->PatternColumns;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::GetCalibrationPatternSpacing()
+{
+  return this->Internal->PatternSpacing;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::AddCalibrationImage(vtkImageData* image, bool invert /*= false*/)
+{
+  this->Internal->ChangedObservations.clear();
+  if (image == NULL)
+  {
+    return false;
+  }
+
+  cv::Mat gray;
+  if (!vtkInternal::GetGrayImage(image, invert, gray))
+  {
+    vtkErrorMacro("AddCalibrationImage: unsupported image, expected 1, 3 or 4 components of an integer or floating point type");
+    return false;
+  }
+
+  const cv::Size imageSize(gray.cols, gray.rows);
+  if (!this->Internal->ImagePoints.empty() && imageSize != this->Internal->ImageSize)
+  {
+    vtkErrorMacro("AddCalibrationImage: image size differs from the previous calibration images");
+    return false;
+  }
+
+  vtkInternal::DetectionSettings settings;
+  settings.PatternType = this->Internal->PatternType;
+  settings.PatternSize = cv::Size(this->Internal->PatternColumns, this->Internal->PatternRows);
+  settings.DetectionFlags = this->CalibrationDetectionFlags;
+  settings.SubPixelRadius = this->CalibrationSubPixelRadius;
+  settings.PatternVersion = this->Internal->PatternVersion;
+
+  std::vector<cv::Point2f> corners;
+  bool found = false;
+  try
+  {
+    found = vtkInternal::DetectPattern(gray, settings, corners);
+  }
+  catch (const cv::Exception& e)
+  {
+    vtkErrorMacro("AddCalibrationImage: pattern detection failed: " << e.what());
+    return false;
+  }
+
+  if (!found)
+  {
+    return false;
+  }
+
+  this->Internal->AddObservation(this->Internal->Pattern, corners, imageSize);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::AddCalibrationObservation(vtkPoints* objectPoints, vtkDoubleArray* imagePoints, int imageWidth, int imageHeight)
+{
+  this->Internal->ChangedObservations.clear();
+  if (objectPoints == NULL || imagePoints == NULL)
+  {
+    return false;
+  }
+  if (imagePoints->GetNumberOfComponents() != 2 || imagePoints->GetNumberOfTuples() != objectPoints->GetNumberOfPoints())
+  {
+    vtkErrorMacro("AddCalibrationObservation: expected one 2 component image point per object point");
+    return false;
+  }
+  if (objectPoints->GetNumberOfPoints() < 4)
+  {
+    vtkErrorMacro("AddCalibrationObservation: at least 4 points are needed per observation");
+    return false;
+  }
+  const cv::Size imageSize(imageWidth, imageHeight);
+  if (imageWidth < 1 || imageHeight < 1 || (!this->Internal->ImagePoints.empty() && imageSize != this->Internal->ImageSize))
+  {
+    vtkErrorMacro("AddCalibrationObservation: invalid image size or size differs from the previous observations");
+    return false;
+  }
+
+  const vtkIdType numberOfPoints = objectPoints->GetNumberOfPoints();
+  std::vector<cv::Point3f> object(numberOfPoints);
+  std::vector<cv::Point2f> image(numberOfPoints);
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+  {
+    double point[3];
+    objectPoints->GetPoint(i, point);
+    object[i] = cv::Point3f(static_cast<float>(point[0]), static_cast<float>(point[1]), static_cast<float>(point[2]));
+    image[i] = cv::Point2f(static_cast<float>(imagePoints->GetComponent(i, 0)), static_cast<float>(imagePoints->GetComponent(i, 1)));
+  }
+
+  return this->Internal->AddObservation(object, image, imageSize);
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfCalibrationObservations()
+{
+  return static_cast<int>(this->Internal->ImagePoints.size());
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfCalibrationPoints()
+{
+  std::size_t count = 0;
+  for (std::vector<std::vector<cv::Point2f>>::const_iterator it = this->Internal->ImagePoints.begin(); it != this->Internal->ImagePoints.end(); ++it)
+  {
+    count += it->size();
+  }
+  return static_cast<int>(count);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::ResetCalibration()
+{
+  this->Internal->ObjectPoints.clear();
+  this->Internal->ImagePoints.clear();
+  this->Internal->ImageSize = cv::Size();
+  this->Internal->KeyframeSelector.Reset();
+  this->Internal->Rotations.clear();
+  this->Internal->Translations.clear();
+  this->Internal->ViewSquaredErrors.clear();
+  this->Internal->ChangedObservations.clear();
+  this->Internal->HasSolution = false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::GetCalibrationObservation(int index, vtkPoints* objectPoints, vtkDoubleArray* imagePoints)
+{
+  if (objectPoints == NULL || imagePoints == NULL)
+  {
+    vtkErrorMacro("GetCalibrationObservation: invalid output");
+    return false;
+  }
+  if (index < 0 || index >= static_cast<int>(this->Internal->ImagePoints.size()))
+  {
+    vtkErrorMacro("GetCalibrationObservation: observation " << index << " does not exist");
+    return false;
+  }
+
+  const std::vector<cv::Point3f>& object = this->Internal->ObjectPoints[index];
+  const std::vector<cv::Point2f>& image = this->Internal->ImagePoints[index];
+  const vtkIdType numberOfPoints = static_cast<vtkIdType>(image.size());
+  objectPoints->SetNumberOfPoints(numberOfPoints);
+  imagePoints->SetNumberOfComponents(2);
+  imagePoints->SetNumberOfTuples(numberOfPoints);
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+  {
+    objectPoints->SetPoint(i, object[i].x, object[i].y, object[i].z);
+    imagePoints->SetComponent(i, 0, image[i].x);
+    imagePoints->SetComponent(i, 1, image[i].y);
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::GetLastChangedCalibrationObservations(vtkIntArray* indices)
+{
+  if (indices == NULL)
+  {
+    return;
+  }
+  indices->SetNumberOfComponents(1);
+  indices->SetNumberOfTuples(static_cast<vtkIdType>(this->Internal->ChangedObservations.size()));
+  for (std::size_t i = 0; i < this->Internal->ChangedObservations.size(); ++i)
+  {
+    indices->SetValue(static_cast<vtkIdType>(i), this->Internal->ChangedObservations[i]);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::SetCalibrationKeyframeBudget(int budget)
+{
+  if (budget == this->Internal->KeyframeSelector.GetBudget())
+  {
+    return;
+  }
+
+  // A lower budget evicts kept views, drop them from the observations and shift the indices of the changed ones
+  std::vector<int> evicted;
+  this->Internal->KeyframeSelector.SetBudget(budget, &evicted);
+  for (std::vector<int>::const_iterator it = evicted.begin(); it != evicted.end(); ++it)
+  {
+    const int view = *it;
+    this->Internal->ObjectPoints.erase(this->Internal->ObjectPoints.begin() + view);
+    this->Internal->ImagePoints.erase(this->Internal->ImagePoints.begin() + view);
+    this->Internal->Rotations.erase(this->Internal->Rotations.begin() + view);
+    this->Internal->Translations.erase(this->Internal->Translations.begin() + view);
+    this->Internal->ViewSquaredErrors.erase(this->Internal->ViewSquaredErrors.begin() + view);
+
+    std::vector<int>& changed = this->Internal->ChangedObservations;
+    changed.erase(std::remove(changed.begin(), changed.end(), view), changed.end());
+    for (std::vector<int>::iterator changedIt = changed.begin(); changedIt != changed.end(); ++changedIt)
+    {
+      if (*changedIt > view)
+      {
+        --*changedIt;
+      }
+    }
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetCalibrationKeyframeBudget()
+{
+  return this->Internal->KeyframeSelector.GetBudget();
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::GetLastCalibrationViewScore()
+{
+  return this->Internal->KeyframeSelector.GetLastScore();
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::CalibratePinholeCamera(vtkMRMLPinholeCameraNode* cameraNode)
+{
+  if (cameraNode == NULL)
+  {
+    vtkErrorMacro("CalibratePinholeCamera: no camera node given");
+    return -1.0;
+  }
+  if (this->Internal->ImagePoints.empty())
+  {
+    vtkErrorMacro("CalibratePinholeCamera: no calibration observations");
+    return -1.0;
+  }
+
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  int flags = this->CalibrationSolveFlags;
+  if (this->CalibrationWarmStart && this->Internal->HasSolution)
+  {
+    // Refine the previous solution, it is close to the optimum when only a few views were added
+    cameraMatrix = this->Internal->CameraMatrix.clone();
+    distCoeffs = this->Internal->DistortionCoefficients.clone();
+    flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+  }
+
+  std::vector<cv::Mat> rotations;
+  std::vector<cv::Mat> translations;
+  double error;
+  try
+  {
+    error = cv::calibrateCamera(this->Internal->ObjectPoints, this->Internal->ImagePoints, this->Internal->ImageSize,
+                                cameraMatrix, distCoeffs, rotations, translations, flags,
+                                cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, this->CalibrationMaximumIterations, this->CalibrationTolerance));
+  }
+  catch (const cv::Exception& e)
+  {
+    vtkErrorMacro("CalibratePinholeCamera: calibration failed: " << e.what());
+    return -1.0;
+  }
+
+  cameraMatrix.convertTo(cameraMatrix, CV_64F);
+  distCoeffs = distCoeffs.reshape(1, 1);
+  distCoeffs.convertTo(distCoeffs, CV_64F);
+
+  this->Internal->HasSolution = true;
+  this->Internal->CameraMatrix = cameraMatrix;
+  this->Internal->DistortionCoefficients = distCoeffs;
+  this->Internal->Rotations = rotations;
+  this->Internal->Translations = translations;
+  for (std::size_t view = 0; view < rotations.size(); ++view)
+  {
+    this->Internal->ViewSquaredErrors[view] = this->Internal->ComputeViewSquaredError(static_cast<int>(view), rotations[view], translations[view]);
+  }
+
+  double intrinsics[9];
+  for (int i = 0; i < 9; ++i)
+  {
+    intrinsics[i] = cameraMatrix.at<double>(i / 3, i % 3);
+  }
+
+  // All parameters change together, observers are notified once
+  int wasModifying = cameraNode->StartModify();
+  cameraNode->GetIntrinsicMatrix()->DeepCopy(intrinsics);
+  cameraNode->SetDistortionCoefficientValues(distCoeffs.ptr<double>(), static_cast<vtkIdType>(distCoeffs.total()));
+  cameraNode->SetReprojectionError(error);
+  cameraNode->EndModify(wasModifying);
+
+  return error;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::EstimateCalibrationError()
+{
+  if (!this->Internal->HasSolution || this->Internal->ImagePoints.empty())
+  {
+    return -1.0;
+  }
+
+  double squaredError = 0.0;
+  std::size_t numberOfPoints = 0;
+  for (std::size_t view = 0; view < this->Internal->ImagePoints.size(); ++view)
+  {
+    if (this->Internal->ViewSquaredErrors[view] < 0.0)
+    {
+      // New view: only its pose is solved, the intrinsics and all other poses are kept
+      try
+      {
+        cv::solvePnP(this->Internal->ObjectPoints[view], this->Internal->ImagePoints[view], this->Internal->CameraMatrix,
+                     this->Internal->DistortionCoefficients, this->Internal->Rotations[view], this->Internal->Translations[view]);
+      }
+      catch (const cv::Exception& e)
+      {
+        vtkErrorMacro("EstimateCalibrationError: pose estimation failed: " << e.what());
+        return -1.0;
+      }
+      this->Internal->ViewSquaredErrors[view] = this->Internal->ComputeViewSquaredError(static_cast<int>(view),
+        this->Internal->Rotations[view], this->Internal->Translations[view]);
+    }
+    squaredError += this->Internal->ViewSquaredErrors[view];
+    numberOfPoints += this->Internal->ImagePoints[view].size();
+  }
+
+  return std::sqrt(squaredError / numberOfPoints);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::AnalyzeCalibrationResiduals(vtkPinholeCameraResidualAnalysis* analysis,
+  vtkMRMLTableNode* viewTableNode /*= NULL*/, vtkMRMLTableNode* cornerTableNode /*= NULL*/)
+{
+  if (analysis == NULL)
+  {
+    vtkErrorMacro("AnalyzeCalibrationResiduals: no analysis given");
+    return false;
+  }
+  // Solves the board poses of the views added since the last solve
+  if (this->EstimateCalibrationError() < 0.0)
+  {
+    vtkErrorMacro("AnalyzeCalibrationResiduals: the observations were not solved");
+    return false;
+  }
+
+  analysis->RemoveAllViews();
+  if (!analysis->SetCamera(this->Internal->CameraMatrix.ptr<double>(), this->Internal->DistortionCoefficients.ptr<double>(),
+                           static_cast<int>(this->Internal->DistortionCoefficients.total())))
+  {
+    return false;
+  }
+  analysis->SetImageSize(this->Internal->ImageSize.width, this->Internal->ImageSize.height);
+  for (std::size_t view = 0; view < this->Internal->ImagePoints.size(); ++view)
+  {
+    cv::Mat rotation;
+    cv::Rodrigues(this->Internal->Rotations[view], rotation);
+    rotation.convertTo(rotation, CV_64F);
+    cv::Mat translation;
+    this->Internal->Translations[view].convertTo(translation, CV_64F);
+
+    double patternToCamera[16];
+    vtkMatrix4x4::Identity(patternToCamera);
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        patternToCamera[4 * i + j] = rotation.at<double>(i, j);
+      }
+      patternToCamera[4 * i + 3] = translation.at<double>(i);
+    }
+    analysis->AddView(&this->Internal->ObjectPoints[view][0].x, &this->Internal->ImagePoints[view][0].x,
+                      static_cast<int>(this->Internal->ImagePoints[view].size()), patternToCamera);
+  }
+  if (!analysis->Update())
+  {
+    return false;
+  }
+
+  if (viewTableNode != NULL)
+  {
+    vtkNew<vtkTable> table;
+    table->DeepCopy(analysis->GetViewTable());
+    viewTableNode->SetAndObserveTable(table.GetPointer());
+  }
+  if (cornerTableNode != NULL)
+  {
+    vtkNew<vtkTable> table;
+    table->DeepCopy(analysis->GetCornerTable());
+    cornerTableNode->SetAndObserveTable(table.GetPointer());
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::StartCalibrationCapture(vtkMRMLVolumeNode* volumeNode, bool invert /*= false*/, int numberOfThreads /*= 0*/)
+{
+  if (volumeNode == NULL)
+  {
+    vtkErrorMacro("StartCalibrationCapture: no volume node given");
+    return false;
+  }
+  if (this->CalibrationCaptureQueueSize < 1)
+  {
+    vtkErrorMacro("StartCalibrationCapture: the capture queue must hold at least one frame");
+    return false;
+  }
+  this->StopCalibrationCapture();
+
+  if (numberOfThreads <= 0)
+  {
+    numberOfThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+  }
+
+  this->Internal->CaptureInvert = invert;
+  this->Internal->NumberOfCapturedFrames = 0;
+  this->Internal->NumberOfDroppedFrames = 0;
+  this->Internal->NumberOfDetectedFrames = 0;
+  this->Internal->StartWorkers(numberOfThreads);
+
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLVolumeNode::ImageDataModifiedEvent);
+  vtkSetAndObserveMRMLNodeEventsMacro(this->Internal->CaptureVolumeNode, volumeNode, events.GetPointer());
+
+  // The current image is the first frame
+  this->QueueCalibrationCaptureFrame();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::StopCalibrationCapture()
+{
+  if (this->Internal->CaptureVolumeNode == NULL)
+  {
+    return;
+  }
+
+  vtkSetAndObserveMRMLNodeEventsMacro(this->Internal->CaptureVolumeNode, NULL, NULL);
+  this->Internal->StopWorkers();
+
+  // Keep what was detected before stopping
+  this->ProcessCalibrationCaptureResults();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::IsCalibrationCaptureActive()
+{
+  return this->Internal->CaptureVolumeNode != NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::QueueCalibrationCaptureFrame()
+{
+  vtkImageData* image = this->Internal->CaptureVolumeNode != NULL ? this->Internal->CaptureVolumeNode->GetImageData() : NULL;
+  if (image == NULL)
+  {
+    return;
+  }
+
+  vtkInternal::CaptureFrame frame;
+  if (!vtkInternal::GetGrayImage(image, this->Internal->CaptureInvert, frame.Gray))
+  {
+    return;
+  }
+  if (frame.Gray.data == image->GetScalarPointer())
+  {
+    // The scalars are overwritten by the next frame, workers need their own copy
+    frame.Gray = frame.Gray.clone();
+  }
+  frame.Settings.PatternType = this->Internal->PatternType;
+  frame.Settings.PatternSize = cv::Size(this->Internal->PatternColumns, this->Internal->PatternRows);
+  frame.Settings.DetectionFlags = this->CalibrationDetectionFlags;
+  frame.Settings.SubPixelRadius = this->CalibrationSubPixelRadius;
+  frame.Settings.PatternVersion = this->Internal->PatternVersion;
+
+  {
+    std::lock_guard<std::mutex> lock(this->Internal->CaptureMutex);
+    // Drop the oldest frames rather than the newest, the user sees the board where it is now
+    while (static_cast<int>(this->Internal->Frames.size()) >= this->CalibrationCaptureQueueSize)
+    {
+      this->Internal->Frames.pop_front();
+      ++this->Internal->NumberOfDroppedFrames;
+    }
+    this->Internal->Frames.push_back(frame);
+  }
+  ++this->Internal->NumberOfCapturedFrames;
+  this->Internal->FrameQueued.notify_one();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::ProcessCalibrationCaptureResults()
+{
+  this->Internal->ChangedObservations.clear();
+  std::deque<vtkInternal::CaptureResult> results;
+  {
+    std::lock_guard<std::mutex> lock(this->Internal->CaptureMutex);
+    results.swap(this->Internal->Results);
+  }
+
+  int numberOfAddedObservations = 0;
+  for (std::deque<vtkInternal::CaptureResult>::iterator it = results.begin(); it != results.end(); ++it)
+  {
+    // Skip detections of a pattern that was changed since the frame was queued, or of a different image size
+    if (it->PatternVersion != this->Internal->PatternVersion ||
+        (!this->Internal->ImagePoints.empty() && it->ImageSize != this->Internal->ImageSize))
+    {
+      continue;
+    }
+    ++this->Internal->NumberOfDetectedFrames;
+    if (this->Internal->AddObservation(this->Internal->Pattern, it->Corners, it->ImageSize))
+    {
+      ++numberOfAddedObservations;
+    }
+  }
+
+  if (numberOfAddedObservations > 0)
+  {
+    this->InvokeEvent(CalibrationObservationsAddedEvent);
+  }
+  return numberOfAddedObservations;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfCapturedFrames()
+{
+  return this->Internal->NumberOfCapturedFrames;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfDroppedFrames()
+{
+  return this->Internal->NumberOfDroppedFrames;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfDetectedFrames()
+{
+  return this->Internal->NumberOfDetectedFrames;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::StartTrackerLatencyEstimation(vtkMRMLPinholeCameraNode* cameraNode, vtkMRMLSequenceNode* videoSequence,
+  vtkMRMLSequenceNode* transformSequence, double maximumLatency /*= 0.5*/, bool invert /*= false*/)
+{
+  if (cameraNode == NULL || cameraNode->GetID() == NULL || videoSequence == NULL || transformSequence == NULL)
+  {
+    vtkErrorMacro("StartTrackerLatencyEstimation: invalid arguments");
+    return false;
+  }
+  if (this->Internal->Latency)
+  {
+    vtkErrorMacro("StartTrackerLatencyEstimation: an estimation is already running");
+    return false;
+  }
+  if (maximumLatency < LATENCY_SEARCH_STEP)
+  {
+    vtkErrorMacro("StartTrackerLatencyEstimation: the maximum latency must be at least " << LATENCY_SEARCH_STEP << " s");
+    return false;
+  }
+
+  std::unique_ptr<vtkInternal::LatencyEstimation> estimation(new vtkInternal::LatencyEstimation());
+  estimation->CameraNodeID = cameraNode->GetID();
+  estimation->MaximumLatency = maximumLatency;
+  estimation->Succeeded = false;
+  estimation->Latency = 0.0;
+  estimation->Correlation = 0.0;
+  estimation->NumberOfFrames = 0;
+  estimation->StopRequested = false;
+  estimation->Finished = false;
+  estimation->Settings.PatternType = this->Internal->PatternType;
+  estimation->Settings.PatternSize = cv::Size(this->Internal->PatternColumns, this->Internal->PatternRows);
+  estimation->Settings.DetectionFlags = this->CalibrationDetectionFlags;
+  estimation->Settings.SubPixelRadius = this->CalibrationSubPixelRadius;
+  estimation->Settings.PatternVersion = this->Internal->PatternVersion;
+  estimation->Pattern = this->Internal->Pattern;
+
+  estimation->CameraMatrix = cv::Mat(3, 3, CV_64F);
+  for (int i = 0; i < 9; ++i)
+  {
+    estimation->CameraMatrix.at<double>(i / 3, i % 3) = cameraNode->GetIntrinsicMatrix()->GetData()[i];
+  }
+  estimation->DistortionCoefficients = cv::Mat::zeros(1, 5, CV_64F);
+  if (cameraNode->HasDistortionCoefficents())
+  {
+    estimation->DistortionCoefficients = cv::Mat(1, static_cast<int>(cameraNode->GetNumberOfDistortionCoefficients()), CV_64F);
+    for (vtkIdType i = 0; i < cameraNode->GetNumberOfDistortionCoefficients(); ++i)
+    {
+      estimation->DistortionCoefficients.at<double>(0, static_cast<int>(i)) = cameraNode->GetDistortionCoefficientValue(i);
+    }
+  }
+
+  // Sequences are only read here: the worker gets its own gray copy of each frame, as live capture does, so it never
+  // reads images the sequence or a browser may modify or release while it runs
+  for (int frame = 0; frame < videoSequence->GetNumberOfDataNodes(); ++frame)
+  {
+    vtkMRMLVolumeNode* volumeNode = vtkMRMLVolumeNode::SafeDownCast(videoSequence->GetNthDataNode(frame));
+    if (volumeNode == NULL || volumeNode->GetImageData() == NULL)
+    {
+      vtkErrorMacro("StartTrackerLatencyEstimation: frame " << frame << " is not an image");
+      return false;
+    }
+    const double time = std::atof(videoSequence->GetNthIndexValue(frame).c_str());
+    if (!estimation->FrameTimes.empty() && time <= estimation->FrameTimes.back())
+    {
+      vtkErrorMacro("StartTrackerLatencyEstimation: video frames must be indexed by increasing time");
+      return false;
+    }
+    vtkImageData* image = volumeNode->GetImageData();
+    cv::Mat gray;
+    if (vtkInternal::GetGrayImage(image, invert, gray) && gray.data == image->GetScalarPointer())
+    {
+      gray = gray.clone();
+    }
+    estimation->Frames.push_back(gray);
+    estimation->FrameTimes.push_back(time);
+  }
+
+  vtkNew<vtkMatrix4x4> pose;
+  for (int index = 0; index < transformSequence->GetNumberOfDataNodes(); ++index)
+  {
+    vtkMRMLTransformNode* transformNode = vtkMRMLTransformNode::SafeDownCast(transformSequence->GetNthDataNode(index));
+    if (transformNode == NULL || !transformNode->IsLinear())
+    {
+      vtkErrorMacro("StartTrackerLatencyEstimation: item " << index << " of the transform sequence is not a linear transform");
+      return false;
+    }
+    const double time = std::atof(transformSequence->GetNthIndexValue(index).c_str());
+    if (!estimation->PoseTimes.empty() && time <= estimation->PoseTimes.back())
+    {
+      vtkErrorMacro("StartTrackerLatencyEstimation: transforms must be indexed by increasing time");
+      return false;
+    }
+
+    transformNode->GetMatrixTransformToParent(pose.GetPointer());
+    double rotation[3][3];
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        rotation[i][j] = pose->GetElement(i, j);
+      }
+    }
+    double quaternion[4];
+    vtkMath::Matrix3x3ToQuaternion(rotation, quaternion);
+    if (!estimation->PoseRotations.empty())
+    {
+      const double* previous = &estimation->PoseRotations[estimation->PoseRotations.size() - 4];
+      if (quaternion[0] * previous[0] + quaternion[1] * previous[1] + quaternion[2] * previous[2] + quaternion[3] * previous[3] < 0.0)
+      {
+        std::transform(quaternion, quaternion + 4, quaternion, [](double value) { return -value; });
+      }
+    }
+    estimation->PoseRotations.insert(estimation->PoseRotations.end(), quaternion, quaternion + 4);
+    estimation->PoseTimes.push_back(time);
+  }
+
+  if (estimation->Frames.size() < 2 || estimation->PoseTimes.size() < 2)
+  {
+    vtkErrorMacro("StartTrackerLatencyEstimation: at least two frames and two transforms are needed");
+    return false;
+  }
+
+  this->Internal->Latency = std::move(estimation);
+  this->Internal->LatencyThread = std::thread(&vtkInternal::EstimateTrackerLatency, this->Internal->Latency.get());
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::StopTrackerLatencyEstimation()
+{
+  if (!this->Internal->Latency)
+  {
+    return;
+  }
+
+  this->Internal->Latency->StopRequested = true;
+  this->Internal->LatencyThread.join();
+  this->Internal->Latency.reset();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::IsTrackerLatencyEstimationActive()
+{
+  return this->Internal->Latency != nullptr;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::ProcessTrackerLatencyEstimationResult()
+{
+  if (!this->Internal->Latency || !this->Internal->Latency->Finished)
+  {
+    return false;
+  }
+
+  this->Internal->LatencyThread.join();
+  std::unique_ptr<vtkInternal::LatencyEstimation> estimation = std::move(this->Internal->Latency);
+  this->Internal->LatencySucceeded = estimation->Succeeded;
+  this->Internal->EstimatedLatency = estimation->Latency;
+  this->Internal->LatencyCorrelation = estimation->Correlation;
+  this->Internal->NumberOfLatencyFrames = estimation->NumberOfFrames;
+  this->Internal->LatencyErrorMessage = estimation->ErrorMessage;
+
+  // The camera may have been removed from the scene while the estimation was running
+  vtkMRMLPinholeCameraNode* cameraNode = this->GetMRMLScene() != NULL ?
+    vtkMRMLPinholeCameraNode::SafeDownCast(this->GetMRMLScene()->GetNodeByID(estimation->CameraNodeID.c_str())) : NULL;
+  if (estimation->Succeeded && cameraNode != NULL)
+  {
+    cameraNode->SetTrackerLatency(estimation->Latency);
+  }
+
+  this->InvokeEvent(TrackerLatencyEstimatedEvent);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::GetTrackerLatencyEstimationSucceeded()
+{
+  return this->Internal->LatencySucceeded;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::GetEstimatedTrackerLatency()
+{
+  return this->Internal->EstimatedLatency;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerPinholeCamerasLogic::GetTrackerLatencyCorrelation()
+{
+  return this->Internal->LatencyCorrelation;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerPinholeCamerasLogic::GetNumberOfTrackerLatencyFrames()
+{
+  return this->Internal->NumberOfLatencyFrames;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkSlicerPinholeCamerasLogic::GetTrackerLatencyEstimationError()
+{
+  return this->Internal->LatencyErrorMessage.c_str();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::BindViewCamera(vtkMRMLCameraNode* viewCameraNode, vtkMRMLPinholeCameraNode* cameraNode,
+  vtkMRMLTransformNode* markerTransformNode, int imageWidth, int imageHeight)
+{
+  if (viewCameraNode == NULL || cameraNode == NULL)
+  {
+    vtkErrorMacro("BindViewCamera: invalid arguments");
+    return false;
+  }
+  if (imageWidth < 1 || imageHeight < 1)
+  {
+    vtkErrorMacro("BindViewCamera: invalid image size " << imageWidth << " x " << imageHeight);
+    return false;
+  }
+
+  vtkSmartPointer<vtkPinholeCameraViewSynchronizer>& synchronizer = this->Internal->ViewSynchronizers[viewCameraNode];
+  if (synchronizer == NULL)
+  {
+    synchronizer = vtkSmartPointer<vtkPinholeCameraViewSynchronizer>::New();
+    synchronizer->SetViewCameraNode(viewCameraNode);
+  }
+  synchronizer->SetPinholeCameraNode(cameraNode);
+  synchronizer->SetTransformNode(markerTransformNode);
+  synchronizer->SetImageSize(imageWidth, imageHeight);
+  synchronizer->Update();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::UnbindViewCamera(vtkMRMLCameraNode* viewCameraNode)
+{
+  this->Internal->ViewSynchronizers.erase(viewCameraNode);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerPinholeCamerasLogic::IsViewCameraBound(vtkMRMLCameraNode* viewCameraNode)
+{
+  return this->Internal->ViewSynchronizers.count(viewCameraNode) > 0;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::SetMRMLSceneInternal(vtkMRMLScene* newScene)
+{
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
+  events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
+  events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
+  this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::RegisterNodes()
+{
+  assert(this->GetMRMLScene() != 0);
+
+  vtkMRMLScene* scene = this->GetMRMLScene();
+
+  // Nodes
+  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraNode>::New());
+  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraStorageNode>::New());
+  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraRigNode>::New());
+  scene->RegisterNodeClass(vtkSmartPointer<vtkMRMLPinholeCameraRigStorageNode>::New());
+}
+
+//---------------------------------------------------------------------------
 void vtkSlicerPinholeCamerasLogic::UpdateFromMRMLScene()
 {
   assert(this->GetMRMLScene() != 0);
@@ -146,6 +2042,35 @@ void vtkSlicerPinholeCamerasLogic
 
 //---------------------------------------------------------------------------
 void vtkSlicerPinholeCamerasLogic
-::OnMRMLSceneNodeRemoved(vtkMRMLNode* vtkNotUsed(node))
+::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
 {
+  if (node != NULL && node == this->Internal->CaptureVolumeNode)
+  {
+    this->StopCalibrationCapture();
+  }
+
+  for (auto it = this->Internal->ViewSynchronizers.begin(); it != this->Internal->ViewSynchronizers.end();)
+  {
+    vtkPinholeCameraViewSynchronizer* synchronizer = it->second;
+    if (node == synchronizer->GetViewCameraNode() || node == synchronizer->GetPinholeCameraNode() || node == synchronizer->GetTransformNode())
+    {
+      it = this->Internal->ViewSynchronizers.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPinholeCamerasLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
+{
+  if (caller != NULL && caller == this->Internal->CaptureVolumeNode && event == vtkMRMLVolumeNode::ImageDataModifiedEvent)
+  {
+    this->ProcessCalibrationCaptureResults();
+    this->QueueCalibrationCaptureFrame();
+    return;
+  }
+  this->Superclass::ProcessMRMLNodesEvents(caller, event, callData);
 }
@@ -31,12 +31,41 @@ Version:   $Revision: 1.0 $
 
 #include "vtkSlicerPinholeCamerasModuleLogicExport.h"
 
+class vtkCollection;
+class vtkDoubleArray;
+class vtkImageData;
+class vtkIntArray;
+class vtkMRMLCameraNode;
 class vtkMRMLPinholeCameraNode;
+class vtkMRMLPinholeCameraRigNode;
+class vtkMRMLSequenceNode;
+class vtkMRMLTableNode;
+class vtkMRMLTransformNode;
+class vtkMRMLVolumeNode;
+class vtkPinholeCameraResidualAnalysis;
+class vtkPoints;
+class vtkStringArray;
 
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class VTK_SLICER_PINHOLECAMERAS_MODULE_LOGIC_EXPORT vtkSlicerPinholeCamerasLogic :
   public vtkSlicerModuleLogic
 {
+public:
+  enum CalibrationPatternType
+  {
+    CalibrationPatternCheckerboard = 0,
+    CalibrationPatternCircleGrid,
+    CalibrationPatternAsymmetricCircleGrid
+  };
+
+  enum
+  {
+    /// Invoked on the main thread when frames detected by the live capture were added to the observations
+    CalibrationObservationsAddedEvent = 404201,
+    /// Invoked on the main thread when a tracker latency estimation finished, successfully or not
+    TrackerLatencyEstimatedEvent
+  };
+
 public:
   static vtkSlicerPinholeCamerasLogic* New();
   vtkTypeMacro(vtkSlicerPinholeCamerasLogic, vtkSlicerModuleLogic);
@@ -48,6 +77,218 @@ public:
   /// A storage node is also added into the scene
   vtkMRMLPinholeCameraNode* AddPinholeCamera(const char* filename, const char* nodeName = NULL);
 
+  ///
+  /// Add into the scene a new mrml camera rig node and
+  /// read all of its cameras from a specified file
+  /// A storage node is also added into the scene
+  vtkMRMLPinholeCameraRigNode* AddPinholeCameraRig(const char* filename, const char* nodeName = NULL);
+
+  ///
+  /// Read many camera and camera rig files in parallel, then add them into the scene
+  /// in a single batch process with one undo state
+  /// Files that cannot be read are skipped, loaded nodes are appended to loadedNodes if given
+  /// Return the number of files loaded
+  int AddPinholeCameras(vtkStringArray* filenames, vtkCollection* loadedNodes = NULL);
+
+  ///
+  /// Load all camera and camera rig files of a directory, see AddPinholeCameras
+  int AddPinholeCamerasFromDirectory(const char* directory, vtkCollection* loadedNodes = NULL);
+
+  ///
+  /// Remove lens distortion from a grayscale, RGB or RGBA image acquired by a camera, see vtkPinholeCameraUndistortionFilter
+  /// For video, keep a vtkPinholeCameraUndistortionFilter instead so its output is reused between frames
+  bool UndistortImage(vtkMRMLPinholeCameraNode* cameraNode, vtkImageData* input, vtkImageData* output);
+
+  ///
+  /// Undistort every frame of a recorded sequence of images into outputSequence, replacing its content
+  /// Frames are read, undistorted and written in a pipeline, without returning to the caller between frames.
+  /// Frames are undistorted one at a time on a single worker thread, parallelism comes from the remap of
+  /// vtkPinholeCameraUndistortionFilter which splits each frame across the vtkSMPTools threads.
+  /// vtkCommand::ProgressEvent is invoked with the fraction of frames written.
+  /// Return false if a frame is not an image or cannot be undistorted, frames written until then are kept
+  bool UndistortSequence(vtkMRMLPinholeCameraNode* cameraNode, vtkMRMLSequenceNode* inputSequence, vtkMRMLSequenceNode* outputSequence);
+
+  ///
+  /// Maximum number of frames UndistortSequence reads ahead of the frame being written (default 8), and maximum
+  /// memory taken by these frames in MB (default 512), counting the input and undistorted image of each
+  vtkSetMacro(UndistortionPrefetchSize, int);
+  vtkGetMacro(UndistortionPrefetchSize, int);
+  vtkSetMacro(UndistortionMemoryLimit, int);
+  vtkGetMacro(UndistortionMemoryLimit, int);
+
+  ///
+  /// Intrinsic calibration
+  /// Observations of a planar calibration pattern are accumulated, either detected in images by
+  /// AddCalibrationImage or given directly by AddCalibrationObservation, then solved by CalibratePinholeCamera
+
+  ///
+  /// Describe the calibration pattern: number of inner corners (or circles) per row and column, and their spacing in mm
+  /// Changing the pattern clears the accumulated observations
+  void SetCalibrationPattern(int patternType, int rows, int columns, double spacing);
+  int GetCalibrationPatternType();
+  int GetCalibrationPatternRows();
+  int GetCalibrationPatternColumns();
+  double GetCalibrationPatternSpacing();
+
+  ///
+  /// OpenCV flags passed to pattern detection (cv::CALIB_CB_*) and to the solve (cv::CALIB_*)
+  vtkSetMacro(CalibrationDetectionFlags, int);
+  vtkGetMacro(CalibrationDetectionFlags, int);
+  vtkSetMacro(CalibrationSolveFlags, int);
+  vtkGetMacro(CalibrationSolveFlags, int);
+
+  ///
+  /// Half size of the search window used to refine checkerboard corners, in pixels
+  vtkSetMacro(CalibrationSubPixelRadius, int);
+  vtkGetMacro(CalibrationSubPixelRadius, int);
+
+  ///
+  /// Detect the calibration pattern in an image and keep its corners if found
+  /// Scalars of any type with 1, 3 or 4 components are accepted, invert is for patterns printed white on black
+  /// Return true if the pattern was found
+  bool AddCalibrationImage(vtkImageData* image, bool invert = false);
+
+  ///
+  /// Add one view of points detected elsewhere (e.g. charuco corners): pattern coordinates in mm and
+  /// matching 2 component pixel coordinates, imageWidth and imageHeight give the size of the image
+  /// Return true if the view was kept (see SetCalibrationKeyframeBudget)
+  bool AddCalibrationObservation(vtkPoints* objectPoints, vtkDoubleArray* imagePoints, int imageWidth, int imageHeight);
+
+  int GetNumberOfCalibrationObservations();
+  int GetNumberOfCalibrationPoints();
+  void ResetCalibration();
+
+  ///
+  /// Copy an observation as given to AddCalibrationObservation: pattern coordinates in mm and matching 2 component
+  /// pixel coordinates. Return false if index is out of range.
+  bool GetCalibrationObservation(int index, vtkPoints* objectPoints, vtkDoubleArray* imagePoints);
+
+  ///
+  /// Indices of the observations appended or replaced by the last call to AddCalibrationImage,
+  /// AddCalibrationObservation or ProcessCalibrationCaptureResults, e.g. to archive views as they are captured.
+  /// During live capture read them from a CalibrationObservationsAddedEvent observer: results are also processed
+  /// on each new frame, not only when the application calls ProcessCalibrationCaptureResults.
+  void GetLastChangedCalibrationObservations(vtkIntArray* indices);
+
+  ///
+  /// Maximum number of views kept for the solve, 0 keeps every view (default 40)
+  /// New views are scored on image coverage and board pose diversity: near duplicates of kept views are
+  /// dropped, and once the budget is reached a new view replaces the least useful kept view if it scores higher.
+  /// AddCalibrationImage still returns true for a detected pattern when the view is not kept.
+  /// Lowering the budget below the number of kept views drops the least useful ones, later views move down.
+  void SetCalibrationKeyframeBudget(int budget);
+  int GetCalibrationKeyframeBudget();
+
+  ///
+  /// Score in [0, 1] of the last view offered to the observations, higher adds more information
+  double GetLastCalibrationViewScore();
+
+  ///
+  /// Solve the intrinsics from all observations and write them, the distortion coefficients and the
+  /// reprojection error into cameraNode
+  /// Return the RMS reprojection error in pixels, or a negative value if the calibration failed
+  /// The previous solution is the starting point when CalibrationWarmStart is on, so solving again after
+  /// adding a few views only takes a few iterations
+  double CalibratePinholeCamera(vtkMRMLPinholeCameraNode* cameraNode);
+
+  ///
+  /// Start each solve from the previous solution instead of from scratch (default on)
+  vtkSetMacro(CalibrationWarmStart, bool);
+  vtkGetMacro(CalibrationWarmStart, bool);
+  vtkBooleanMacro(CalibrationWarmStart, bool);
+
+  ///
+  /// Stop the solve after CalibrationMaximumIterations iterations, or once parameters change by less than
+  /// CalibrationTolerance (relative) between iterations
+  vtkSetMacro(CalibrationMaximumIterations, int);
+  vtkGetMacro(CalibrationMaximumIterations, int);
+  vtkSetMacro(CalibrationTolerance, double);
+  vtkGetMacro(CalibrationTolerance, double);
+
+  ///
+  /// RMS reprojection error of all observations with the intrinsics of the last solve, without solving again
+  /// Only the board poses of views added since the last solve are estimated, so the cost is a few milliseconds
+  /// per new view. Return a negative value if there was no solve since the observations were reset.
+  double EstimateCalibrationError();
+
+  ///
+  /// Compute the reprojection residuals of all observations with the intrinsics of the last solve, see
+  /// vtkPinholeCameraResidualAnalysis. The board poses of views added since the last solve are estimated first, as by
+  /// EstimateCalibrationError. Views are analyzed in the order of the observations. The view and corner tables are
+  /// copied into viewTableNode and cornerTableNode if given.
+  /// Return false if there was no solve since the observations were reset.
+  bool AnalyzeCalibrationResiduals(vtkPinholeCameraResidualAnalysis* analysis, vtkMRMLTableNode* viewTableNode = NULL,
+    vtkMRMLTableNode* cornerTableNode = NULL);
+
+  ///
+  /// Live calibration capture
+  /// Every new image of volumeNode is queued for pattern detection on a pool of worker threads. The queue holds
+  /// CalibrationCaptureQueueSize frames, when workers fall behind the oldest queued frames are dropped.
+  /// Detections are added to the observations by ProcessCalibrationCaptureResults, which runs on each new frame
+  /// and should also be called periodically (e.g. from a timer) by the application.
+  /// numberOfThreads <= 0 uses all but one of the available cores
+  bool StartCalibrationCapture(vtkMRMLVolumeNode* volumeNode, bool invert = false, int numberOfThreads = 0);
+  void StopCalibrationCapture();
+  bool IsCalibrationCaptureActive();
+
+  vtkSetMacro(CalibrationCaptureQueueSize, int);
+  vtkGetMacro(CalibrationCaptureQueueSize, int);
+
+  ///
+  /// Add detections finished by the capture workers to the observations, main thread only
+  /// Invoke CalibrationObservationsAddedEvent and return the number of observations added
+  int ProcessCalibrationCaptureResults();
+
+  ///
+  /// Capture statistics since the capture was started
+  int GetNumberOfCapturedFrames();
+  int GetNumberOfDroppedFrames();
+  int GetNumberOfDetectedFrames();
+
+  ///
+  /// Tracker latency estimation
+  /// Estimate the delay of the tracked pose of a camera behind its video from a recording of both, made while moving
+  /// the tracked camera with varied rotations in front of the still calibration pattern. The camera rotation speed is
+  /// measured in each video frame from the pose of the pattern, and compared to the rotation speed of the tracked
+  /// transform shifted by every candidate latency within maximumLatency seconds: the latency is the shift giving the
+  /// highest normalized cross-correlation. Rotation speeds do not depend on the coordinate systems, so neither the
+  /// marker to image sensor transform nor the pattern position in the tracker coordinates are needed, only the
+  /// intrinsics of cameraNode and the calibration pattern (see SetCalibrationPattern).
+  /// videoSequence holds the frames and transformSequence the linear transforms of the camera marker, both indexed
+  /// by time in seconds. Frames and poses are copied when starting, the detection and correlation run on a
+  /// worker thread. Return false if the inputs are invalid or an estimation is already running.
+  bool StartTrackerLatencyEstimation(vtkMRMLPinholeCameraNode* cameraNode, vtkMRMLSequenceNode* videoSequence,
+    vtkMRMLSequenceNode* transformSequence, double maximumLatency = 0.5, bool invert = false);
+  void StopTrackerLatencyEstimation();
+  bool IsTrackerLatencyEstimationActive();
+
+  ///
+  /// Write the estimated latency into the camera node if the estimation finished, main thread only.
+  /// Invoke TrackerLatencyEstimatedEvent and return true once the estimation finished, successfully or not.
+  /// Should be called periodically (e.g. from a timer) by the application while the estimation is active.
+  bool ProcessTrackerLatencyEstimationResult();
+
+  ///
+  /// Result of the last finished estimation: success, latency in seconds, peak normalized cross-correlation of the
+  /// rotation speeds in [-1, 1] (values below 0.5 suggest too little or too uniform motion), number of frames where
+  /// the pattern was found, and the reason of a failure
+  bool GetTrackerLatencyEstimationSucceeded();
+  double GetEstimatedTrackerLatency();
+  double GetTrackerLatencyCorrelation();
+  int GetNumberOfTrackerLatencyFrames();
+  const char* GetTrackerLatencyEstimationError();
+
+  ///
+  /// Augmented reality overlay
+  /// Drive the camera of a view from a pinhole camera and the tracked transform of its marker, so the view renders
+  /// the scene as seen by the camera, see vtkPinholeCameraViewSynchronizer. The view camera is updated in C++ on each
+  /// change of the transform or camera parameters, without any application callback.
+  /// Binding a view camera again replaces its previous binding. Bindings are removed with any of their nodes.
+  bool BindViewCamera(vtkMRMLCameraNode* viewCameraNode, vtkMRMLPinholeCameraNode* cameraNode, vtkMRMLTransformNode* markerTransformNode,
+    int imageWidth, int imageHeight);
+  void UnbindViewCamera(vtkMRMLCameraNode* viewCameraNode);
+  bool IsViewCameraBound(vtkMRMLCameraNode* viewCameraNode);
+
 protected:
   vtkSlicerPinholeCamerasLogic();
   virtual ~vtkSlicerPinholeCamerasLogic();
@@ -58,6 +299,25 @@ protected:
   virtual void UpdateFromMRMLScene();
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
+  virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData);
+
+  /// Queue the current image of the captured volume for detection
+  void QueueCalibrationCaptureFrame();
+
+protected:
+  int CalibrationDetectionFlags;
+  int CalibrationSolveFlags;
+  int CalibrationSubPixelRadius;
+  int CalibrationCaptureQueueSize;
+  bool CalibrationWarmStart;
+  int CalibrationMaximumIterations;
+  double CalibrationTolerance;
+  int UndistortionPrefetchSize;
+  int UndistortionMemoryLimit;
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
 private:
 
   vtkSlicerPinholeCamerasLogic(const vtkSlicerPinholeCamerasLogic&); // Not implemented
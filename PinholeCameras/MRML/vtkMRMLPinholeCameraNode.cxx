@@ -14,16 +14,172 @@ Version:   $Revision: 1.0 $
 
 #include "vtkMRMLPinholeCameraNode.h"
 #include "vtkMRMLPinholeCameraStorageNode.h"
+#include "vtkPinholeCameraModel.h"
 
 // VTK includes
 #include <vtkCallbackCommand.h>
 #include <vtkCommand.h>
+#include <vtkFieldData.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkTimeStamp.h>
 #include <vtkXMLUtilities.h>
 
+// OpenCV includes
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
 // STL includes
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <mutex>
 #include <sstream>
 
+namespace
+{
+  const size_t MAXIMUM_CACHED_UNDISTORTION_MAPS = 4;
+  const vtkIdType SMP_GRAIN_SIZE = vtkPinholeCameraModel::ProjectionBlockSize * 16;
+
+  //----------------------------------------------------------------------------
+  template<typename PointType, int Model>
+  class ProjectPointsFunctor
+  {
+  public:
+    vtkPinholeCameraModel::CameraView Camera;
+    double                            ReferenceToSensor[16];
+    const PointType*                  Points;
+    double*                           Pixels;
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      vtkPinholeCameraModel::ProjectPoints<PointType, Model>(this->Camera, this->ReferenceToSensor, this->Points, begin, end, this->Pixels);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename PointType, int Model>
+  void ProjectPointsParallel(const vtkPinholeCameraModel::Parameters& parameters, const double referenceToSensor[16], const PointType* points, vtkIdType count, double* pixels)
+  {
+    ProjectPointsFunctor<PointType, Model> functor;
+    functor.Camera = vtkPinholeCameraModel::GetCameraView(parameters);
+    std::copy(referenceToSensor, referenceToSensor + 16, functor.ReferenceToSensor);
+    functor.Points = points;
+    functor.Pixels = pixels;
+    vtkSMPTools::For(0, count, SMP_GRAIN_SIZE, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  template<int Model>
+  class ComputeRaysFunctor
+  {
+  public:
+    vtkPinholeCameraModel::CameraView Camera;
+    double                            SensorToReference[16];
+    const double*                     Pixels;
+    double*                           Directions;
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType i = begin; i < end; ++i)
+      {
+        vtkPinholeCameraModel::ComputeRayDirection<Model>(this->Camera, this->SensorToReference, this->Pixels + 2 * i, this->Directions + 3 * i);
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<int Model>
+  void ComputeRaysParallel(const vtkPinholeCameraModel::Parameters& parameters, const double sensorToReference[16], const double* pixels, vtkIdType count, double* directions)
+  {
+    ComputeRaysFunctor<Model> functor;
+    functor.Camera = vtkPinholeCameraModel::GetCameraView(parameters);
+    std::copy(sensorToReference, sensorToReference + 16, functor.SensorToReference);
+    functor.Pixels = pixels;
+    functor.Directions = directions;
+    vtkSMPTools::For(0, count, SMP_GRAIN_SIZE, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Convert float sample locations to compact fixed point locations and measure the largest rounding error
+  class CompactMapFunctor
+  {
+  public:
+    const float*              Map;
+    unsigned short*           CompactMap;
+    int                       Width;
+    int                       Height;
+    int                       FractionBits;
+    vtkSMPThreadLocal<double> MaximumError;
+
+    void Initialize()
+    {
+      this->MaximumError.Local() = 0.0;
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      const float scale = static_cast<float>(1 << this->FractionBits);
+      const float maxX = static_cast<float>(this->Width - 1);
+      const float maxY = static_cast<float>(this->Height - 1);
+      double& maximumError = this->MaximumError.Local();
+      for (vtkIdType i = begin; i < end; ++i)
+      {
+        const float x = this->Map[2 * i];
+        const float y = this->Map[2 * i + 1];
+        unsigned short* location = this->CompactMap + 2 * i;
+        // Same bounds as the float map sampling, locations within them fit below CompactMapOutside
+        if (!(x >= 0.f && y >= 0.f && x <= maxX && y <= maxY))
+        {
+          location[0] = vtkPinholeCameraModel::CompactMapOutside;
+          location[1] = vtkPinholeCameraModel::CompactMapOutside;
+          continue;
+        }
+        location[0] = static_cast<unsigned short>(std::floor(x * scale + 0.5f));
+        location[1] = static_cast<unsigned short>(std::floor(y * scale + 0.5f));
+        const double dx = location[0] / static_cast<double>(scale) - x;
+        const double dy = location[1] / static_cast<double>(scale) - y;
+        maximumError = std::max(maximumError, std::sqrt(dx * dx + dy * dy));
+      }
+    }
+
+    void Reduce()
+    {
+    }
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkMRMLPinholeCameraNode::vtkInternal
+{
+public:
+  struct UndistortionMapEntry
+  {
+    unsigned long UndistortionVersion;
+    int Format;
+    int Width;
+    int Height;
+    double OutputIntrinsics[9];
+    vtkSmartPointer<vtkImageData> Map;
+  };
+
+  std::mutex                          UndistortionMapMutex;
+  std::deque<UndistortionMapEntry>    UndistortionMaps;
+
+  // Published with std::atomic_store/atomic_load, never modified once published
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> Snapshot;
+  std::atomic<bool>                   SnapshotPending{ false };
+  unsigned long                       SnapshotVersion = 0;
+  unsigned long                       UndistortionVersion = 0;
+  vtkTimeStamp                        UndistortionTime;
+};
+
 //----------------------------------------------------------------------------
 
 vtkMRMLNodeNewMacro(vtkMRMLPinholeCameraNode);
@@ -39,6 +195,9 @@ vtkMRMLPinholeCameraNode::vtkMRMLPinholeCameraNode()
   , CameraPlaneOffset(nullptr)
   , ReprojectionError(-1.0)
   , RegistrationError(-1.0)
+  , TrackerLatency(0.0)
+  , UndistortionMapFormat(UndistortionMapFloat)
+  , Internal(new vtkInternal())
 {
   this->SetAndObserveIntrinsicMatrix(vtkSmartPointer<vtkMatrix3x3>::New());
   this->SetDistortionCoefficients(vtkSmartPointer<vtkDoubleArray>::New());
@@ -48,6 +207,7 @@ vtkMRMLPinholeCameraNode::vtkMRMLPinholeCameraNode()
   this->SetCameraPlaneOffset(vtkSmartPointer<vtkDoubleArray>::New());
   this->GetCameraPlaneOffset()->SetNumberOfValues(3);
   this->GetCameraPlaneOffset()->FillValue(0.0);
+  this->UpdateParametersSnapshot();
 }
 
 //-----------------------------------------------------------------------------
@@ -57,6 +217,7 @@ vtkMRMLPinholeCameraNode::~vtkMRMLPinholeCameraNode()
   this->SetDistortionCoefficients(nullptr);
   this->SetAndObserveMarkerToImageSensorTransform(nullptr);
   this->SetCameraPlaneOffset(nullptr);
+  delete this->Internal;
 }
 
 //----------------------------------------------------------------------------
@@ -68,10 +229,14 @@ void vtkMRMLPinholeCameraNode::Copy(vtkMRMLNode* anode)
 
   this->GetIntrinsicMatrix()->DeepCopy(node->GetIntrinsicMatrix());
   this->GetDistortionCoefficients()->DeepCopy(node->GetDistortionCoefficients());
+  this->ParameterModified(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent);
   this->GetMarkerToImageSensorTransform()->DeepCopy(node->GetMarkerToImageSensorTransform());
   this->GetCameraPlaneOffset()->DeepCopy(node->GetCameraPlaneOffset());
+  this->ParameterModified(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent);
   this->SetReprojectionError(node->GetReprojectionError());
   this->SetRegistrationError(node->GetRegistrationError());
+  this->SetTrackerLatency(node->GetTrackerLatency());
+  this->SetUndistortionMapFormat(node->GetUndistortionMapFormat());
 
   this->EndModify(disabledModify);
 }
@@ -91,7 +256,7 @@ void vtkMRMLPinholeCameraNode::SetAndObserveIntrinsicMatrix(vtkMatrix3x3* intrin
     this->IntrinsicObserverObserverTag = this->IntrinsicMatrix->AddObserver(vtkCommand::ModifiedEvent, this, &vtkMRMLPinholeCameraNode::OnIntrinsicsModified);
   }
 
-  this->InvokeEvent(vtkMRMLPinholeCameraNode::IntrinsicsModifiedEvent);
+  this->ParameterModified(vtkMRMLPinholeCameraNode::IntrinsicsModifiedEvent);
 }
 
 //----------------------------------------------------------------------------
@@ -109,7 +274,7 @@ void vtkMRMLPinholeCameraNode::SetAndObserveMarkerToImageSensorTransform(vtkMatr
     this->MarkerTransformObserverTag = this->MarkerToImageSensorTransform->AddObserver(vtkCommand::ModifiedEvent, this, &vtkMRMLPinholeCameraNode::OnMarkerTransformModified);
   }
 
-  this->InvokeEvent(vtkMRMLPinholeCameraNode::MarkerToSensorTransformModifiedEvent);
+  this->ParameterModified(vtkMRMLPinholeCameraNode::MarkerToSensorTransformModifiedEvent);
 }
 
 //----------------------------------------------------------------------------
@@ -122,6 +287,7 @@ bool vtkMRMLPinholeCameraNode::HasDistortionCoefficents() const
 void vtkMRMLPinholeCameraNode::SetNumberOfDistortionCoefficients(vtkIdType num)
 {
   this->DistortionCoefficients->SetNumberOfValues(num);
+  this->ParameterModified(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent);
 }
 
 //----------------------------------------------------------------------------
@@ -137,7 +303,7 @@ void vtkMRMLPinholeCameraNode::SetDistortionCoefficientValue(vtkIdType idx, doub
   {
     this->DistortionCoefficients->SetValue(idx, value);
     this->DistortionCoefficientsExist = true;
-    this->InvokeEvent(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent);
+    this->ParameterModified(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent);
   }
 }
 
@@ -153,7 +319,7 @@ void vtkMRMLPinholeCameraNode::SetCameraPlaneOffsetValue(vtkIdType idx, double v
   if (this->CameraPlaneOffset->GetNumberOfValues() > idx)
   {
     this->CameraPlaneOffset->SetValue(idx, value);
-    this->InvokeEvent(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent);
+    this->ParameterModified(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent);
   }
 }
 
@@ -163,6 +329,46 @@ double vtkMRMLPinholeCameraNode::GetCameraPlaneOffsetValue(vtkIdType idx)
   return this->CameraPlaneOffset->GetValue(idx);
 }
 
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::SetDistortionCoefficientValues(vtkDoubleArray* values)
+{
+  if (values == nullptr)
+  {
+    vtkErrorMacro("SetDistortionCoefficientValues: invalid array.");
+    return;
+  }
+
+  this->SetDistortionCoefficientValues(values->GetPointer(0), values->GetNumberOfValues());
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::SetDistortionCoefficientValues(const double* values, vtkIdType count)
+{
+  if (values == nullptr && count > 0)
+  {
+    vtkErrorMacro("SetDistortionCoefficientValues: invalid values.");
+    return;
+  }
+
+  this->DistortionCoefficients->SetNumberOfValues(count);
+  for (vtkIdType i = 0; i < count; ++i)
+  {
+    this->DistortionCoefficients->SetValue(i, values[i]);
+  }
+  this->DistortionCoefficientsExist = true;
+  this->ParameterModified(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::SetCameraPlaneOffsetValues(const double offset[3])
+{
+  for (vtkIdType i = 0; i < 3; ++i)
+  {
+    this->CameraPlaneOffset->SetValue(i, offset[i]);
+  }
+  this->ParameterModified(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent);
+}
+
 //----------------------------------------------------------------------------
 vtkMRMLStorageNode* vtkMRMLPinholeCameraNode::CreateDefaultStorageNode()
 {
@@ -184,17 +390,429 @@ bool vtkMRMLPinholeCameraNode::IsRegistrationErrorValid() const
 //----------------------------------------------------------------------------
 void vtkMRMLPinholeCameraNode::OnIntrinsicsModified(vtkObject* caller, unsigned long event, void* data)
 {
-  this->InvokeEvent(IntrinsicsModifiedEvent);
+  this->ParameterModified(IntrinsicsModifiedEvent);
   this->Modified();
 }
 
 //----------------------------------------------------------------------------
 void vtkMRMLPinholeCameraNode::OnMarkerTransformModified(vtkObject* caller, unsigned long event, void* data)
 {
-  this->InvokeEvent(MarkerToSensorTransformModifiedEvent);
+  this->ParameterModified(MarkerToSensorTransformModifiedEvent);
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::ParameterModified(unsigned long event)
+{
+  if (event == IntrinsicsModifiedEvent || event == DistortionCoefficientsModifiedEvent)
+  {
+    ++this->Internal->UndistortionVersion;
+    this->Internal->UndistortionTime.Modified();
+    this->ClearUndistortionMaps();
+  }
+
+  // Inside a StartModify/EndModify block the snapshot is published once, from InvokePendingModifiedEvent
+  if (this->GetDisableModifiedEvent())
+  {
+    this->Internal->SnapshotPending = true;
+  }
+  else
+  {
+    this->UpdateParametersSnapshot();
+  }
+
+  this->InvokeCustomModifiedEvent(event);
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraNode::InvokePendingModifiedEvent()
+{
+  if (this->Internal->SnapshotPending)
+  {
+    this->UpdateParametersSnapshot();
+  }
+  return Superclass::InvokePendingModifiedEvent();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::UpdateParametersSnapshot()
+{
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> snapshot = this->BuildParametersSnapshot();
+  std::atomic_store(&this->Internal->Snapshot, snapshot);
+  this->Internal->SnapshotPending = false;
+}
+
+//----------------------------------------------------------------------------
+std::shared_ptr<vtkPinholeCameraModel::Parameters> vtkMRMLPinholeCameraNode::BuildParametersSnapshot()
+{
+  auto parameters = std::make_shared<vtkPinholeCameraModel::Parameters>();
+  parameters->Version = ++this->Internal->SnapshotVersion;
+  parameters->UndistortionVersion = this->Internal->UndistortionVersion;
+
+  vtkMatrix3x3::Identity(parameters->Intrinsics);
+  if (this->IntrinsicMatrix != nullptr)
+  {
+    std::copy(this->IntrinsicMatrix->GetData(), this->IntrinsicMatrix->GetData() + 9, parameters->Intrinsics);
+  }
+  vtkMatrix3x3::Invert(parameters->Intrinsics, parameters->InverseIntrinsics);
+
+  // Coefficients beyond the supported model are kept out of the snapshot, consumers check the count
+  std::fill(parameters->DistortionCoefficients, parameters->DistortionCoefficients + vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients, 0.0);
+  parameters->NumberOfDistortionCoefficients = 0;
+  if (this->DistortionCoefficients != nullptr)
+  {
+    parameters->NumberOfDistortionCoefficients = static_cast<int>(this->DistortionCoefficients->GetNumberOfValues());
+    const int count = std::min(parameters->NumberOfDistortionCoefficients, vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients);
+    for (int i = 0; i < count; ++i)
+    {
+      parameters->DistortionCoefficients[i] = this->DistortionCoefficients->GetValue(i);
+    }
+  }
+  // Select the specialized kernels once here rather than for every batch of points
+  parameters->DistortionModel = vtkPinholeCameraModel::GetDistortionModel(parameters->DistortionCoefficients);
+  vtkPinholeCameraModel::ComputeTiltMatrix(parameters->DistortionCoefficients[12], parameters->DistortionCoefficients[13], parameters->TiltMatrix);
+  vtkMatrix3x3::Invert(parameters->TiltMatrix, parameters->InverseTiltMatrix);
+
+  std::fill(parameters->CameraPlaneOffset, parameters->CameraPlaneOffset + 3, 0.0);
+  if (this->CameraPlaneOffset != nullptr)
+  {
+    for (vtkIdType i = 0; i < std::min<vtkIdType>(3, this->CameraPlaneOffset->GetNumberOfValues()); ++i)
+    {
+      parameters->CameraPlaneOffset[i] = this->CameraPlaneOffset->GetValue(i);
+    }
+  }
+
+  vtkMatrix4x4::Identity(parameters->MarkerToImageSensor);
+  if (this->MarkerToImageSensorTransform != nullptr)
+  {
+    std::copy(&this->MarkerToImageSensorTransform->Element[0][0], &this->MarkerToImageSensorTransform->Element[0][0] + 16, parameters->MarkerToImageSensor);
+  }
+  vtkMatrix4x4::Invert(parameters->MarkerToImageSensor, parameters->ImageSensorToMarker);
+
+  return parameters;
+}
+
+//----------------------------------------------------------------------------
+std::shared_ptr<const vtkPinholeCameraModel::Parameters> vtkMRMLPinholeCameraNode::GetParametersSnapshot() const
+{
+  return std::atomic_load(&this->Internal->Snapshot);
+}
+
+//----------------------------------------------------------------------------
+std::shared_ptr<const vtkPinholeCameraModel::Parameters> vtkMRMLPinholeCameraNode::GetCurrentParameters()
+{
+  // Changes made inside an unfinished StartModify/EndModify block are not published yet, use a private copy
+  if (this->Internal->SnapshotPending)
+  {
+    return this->BuildParametersSnapshot();
+  }
+  return this->GetParametersSnapshot();
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> vtkMRMLPinholeCameraNode::GetUndistortionMap(int width, int height, vtkMatrix3x3* outputIntrinsics /*= nullptr*/)
+{
+  return this->GetCachedUndistortionMap(UndistortionMapFloat, width, height, outputIntrinsics);
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> vtkMRMLPinholeCameraNode::GetCompactUndistortionMap(int width, int height, vtkMatrix3x3* outputIntrinsics /*= nullptr*/)
+{
+  return this->GetCachedUndistortionMap(UndistortionMapFixedPoint, width, height, outputIntrinsics);
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLPinholeCameraNode::GetCompactUndistortionMapErrorBound(int width, int height)
+{
+  return vtkPinholeCameraModel::GetCompactMapErrorBound(width, height);
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> vtkMRMLPinholeCameraNode::GetCachedUndistortionMap(int format, int width, int height, vtkMatrix3x3* outputIntrinsics)
+{
+  if (width <= 0 || height <= 0)
+  {
+    vtkErrorMacro("Invalid image size requested for undistortion map: " << width << "x" << height);
+    return nullptr;
+  }
+  if (format == UndistortionMapFixedPoint && vtkPinholeCameraModel::GetCompactMapFractionBits(width, height) < 0)
+  {
+    vtkErrorMacro("Image size " << width << "x" << height << " is too large for a compact undistortion map.");
+    return nullptr;
+  }
+
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = this->GetParametersSnapshot();
+  if (parameters->NumberOfDistortionCoefficients > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("Unsupported number of distortion coefficients: " << parameters->NumberOfDistortionCoefficients);
+    return nullptr;
+  }
+
+  const double* newIntrinsics = outputIntrinsics != nullptr ? outputIntrinsics->GetData() : parameters->Intrinsics;
+  auto matches = [&](const vtkInternal::UndistortionMapEntry& entry)
+  {
+    return entry.UndistortionVersion == parameters->UndistortionVersion && entry.Format == format && entry.Width == width &&
+      entry.Height == height && std::equal(entry.OutputIntrinsics, entry.OutputIntrinsics + 9, newIntrinsics);
+  };
+
+  {
+    std::lock_guard<std::mutex> guard(this->Internal->UndistortionMapMutex);
+    for (auto& entry : this->Internal->UndistortionMaps)
+    {
+      if (matches(entry))
+      {
+        // Referenced before the lock is released, the cache may drop its own reference right after
+        return entry.Map;
+      }
+    }
+  }
+
+  // Built without holding the lock, requests for other maps are not held up. Two threads missing the same map
+  // both build it, only the first one is cached.
+  cv::Mat intrinMat(3, 3, CV_64F, const_cast<double*>(parameters->Intrinsics));
+  cv::Mat newIntrinMat(3, 3, CV_64F, const_cast<double*>(newIntrinsics));
+  cv::Mat distCoeffs;
+  if (parameters->NumberOfDistortionCoefficients > 0)
+  {
+    distCoeffs = cv::Mat(parameters->NumberOfDistortionCoefficients, 1, CV_64F, const_cast<double*>(parameters->DistortionCoefficients));
+  }
+
+  vtkSmartPointer<vtkImageData> map = vtkSmartPointer<vtkImageData>::New();
+  map->SetDimensions(width, height, 1);
+  map->AllocateScalars(format == UndistortionMapFixedPoint ? VTK_UNSIGNED_SHORT : VTK_FLOAT, 2);
+
+  // Float maps are built directly into the image buffer, OpenCV will not reallocate a matrix of the correct size and type.
+  // Compact maps are converted from a temporary float map that is not kept.
+  cv::Mat mapMat;
+  if (format == UndistortionMapFloat)
+  {
+    mapMat = cv::Mat(height, width, CV_32FC2, map->GetScalarPointer());
+  }
+  cv::Mat unusedMap;
+  try
+  {
+    cv::initUndistortRectifyMap(intrinMat, distCoeffs, cv::Mat(), newIntrinMat, cv::Size(width, height), CV_32FC2, mapMat, unusedMap);
+  }
+  catch (const cv::Exception& e)
+  {
+    vtkErrorMacro("Unable to compute undistortion map: " << e.what());
+    return nullptr;
+  }
+
+  if (format == UndistortionMapFixedPoint)
+  {
+    CompactMapFunctor functor;
+    functor.Map = mapMat.ptr<float>();
+    functor.CompactMap = static_cast<unsigned short*>(map->GetScalarPointer());
+    functor.Width = width;
+    functor.Height = height;
+    functor.FractionBits = vtkPinholeCameraModel::GetCompactMapFractionBits(width, height);
+    vtkSMPTools::For(0, static_cast<vtkIdType>(width) * height, SMP_GRAIN_SIZE, functor);
+
+    double maximumError = 0.0;
+    for (double threadError : functor.MaximumError)
+    {
+      maximumError = std::max(maximumError, threadError);
+    }
+    vtkNew<vtkDoubleArray> errorArray;
+    errorArray->SetName("MaximumSamplingError");
+    errorArray->InsertNextValue(maximumError);
+    map->GetFieldData()->AddArray(errorArray);
+  }
+
+  std::lock_guard<std::mutex> guard(this->Internal->UndistortionMapMutex);
+  auto& maps = this->Internal->UndistortionMaps;
+  for (auto& entry : maps)
+  {
+    if (matches(entry))
+    {
+      return entry.Map;
+    }
+    if (entry.UndistortionVersion > parameters->UndistortionVersion)
+    {
+      // The parameters changed while building, the map is still valid for the snapshot it was requested with
+      return map;
+    }
+  }
+  // Maps of an older version may have been added by another thread after the parameters changed
+  maps.erase(std::remove_if(maps.begin(), maps.end(), [&parameters](const vtkInternal::UndistortionMapEntry& entry)
+  {
+    return entry.UndistortionVersion != parameters->UndistortionVersion;
+  }), maps.end());
+
+  vtkInternal::UndistortionMapEntry entry;
+  entry.UndistortionVersion = parameters->UndistortionVersion;
+  entry.Format = format;
+  entry.Width = width;
+  entry.Height = height;
+  std::copy(newIntrinsics, newIntrinsics + 9, entry.OutputIntrinsics);
+  entry.Map = map;
+
+  if (maps.size() >= MAXIMUM_CACHED_UNDISTORTION_MAPS)
+  {
+    maps.pop_front();
+  }
+  maps.push_back(entry);
+
+  return map;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkMRMLPinholeCameraNode::GetUndistortionMapFormatAsString(int format)
+{
+  switch (format)
+  {
+    case UndistortionMapFloat:
+      return "Float";
+    case UndistortionMapFixedPoint:
+      return "FixedPoint";
+    default:
+      return "";
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraNode::GetUndistortionMapFormatFromString(const char* name)
+{
+  if (name == nullptr)
+  {
+    return -1;
+  }
+  for (int format = 0; format < UndistortionMapFormat_Last; ++format)
+  {
+    if (strcmp(name, GetUndistortionMapFormatAsString(format)) == 0)
+    {
+      return format;
+    }
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraNode::ClearUndistortionMaps()
+{
+  std::lock_guard<std::mutex> guard(this->Internal->UndistortionMapMutex);
+  this->Internal->UndistortionMaps.clear();
+}
+
+//----------------------------------------------------------------------------
+vtkMTimeType vtkMRMLPinholeCameraNode::GetUndistortionMTime()
+{
+  return this->Internal->UndistortionTime.GetMTime();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraNode::ComputeRaysFromPixels(vtkDoubleArray* pixels, vtkMatrix4x4* markerToReference, vtkDoubleArray* origins, vtkDoubleArray* directions)
+{
+  if (pixels == nullptr || origins == nullptr || directions == nullptr)
+  {
+    vtkErrorMacro("ComputeRaysFromPixels: invalid arguments.");
+    return false;
+  }
+  if (pixels->GetNumberOfComponents() != 2)
+  {
+    vtkErrorMacro("ComputeRaysFromPixels: pixels must have 2 components, " << pixels->GetNumberOfComponents() << " given.");
+    return false;
+  }
+
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = this->GetCurrentParameters();
+  if (parameters->NumberOfDistortionCoefficients > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("ComputeRaysFromPixels: unsupported number of distortion coefficients: " << parameters->NumberOfDistortionCoefficients);
+    return false;
+  }
+
+  const vtkIdType count = pixels->GetNumberOfTuples();
+  origins->SetNumberOfComponents(3);
+  origins->SetNumberOfTuples(count);
+  directions->SetNumberOfComponents(3);
+  directions->SetNumberOfTuples(count);
+  if (count == 0)
+  {
+    return true;
+  }
+
+  double sensorToReference[16];
+  if (markerToReference != nullptr)
+  {
+    vtkMatrix4x4::Multiply4x4(&markerToReference->Element[0][0], parameters->ImageSensorToMarker, sensorToReference);
+  }
+  else
+  {
+    std::copy(parameters->ImageSensorToMarker, parameters->ImageSensorToMarker + 16, sensorToReference);
+  }
+
+  vtkPinholeCameraModelTemplateMacro(parameters->DistortionModel,
+    ComputeRaysParallel<PINHOLE_CAMERA_MODEL>(*parameters, sensorToReference, pixels->GetPointer(0), count, directions->GetPointer(0)));
+
+  // All rays share the camera origin
+  double origin[3];
+  vtkPinholeCameraModel::ComputeRayOrigin(vtkPinholeCameraModel::GetCameraView(*parameters), sensorToReference, origin);
+  for (vtkIdType i = 0; i < count; ++i)
+  {
+    origins->SetTypedTuple(i, origin);
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraNode::ProjectPoints(vtkPoints* points, vtkMatrix4x4* markerToReference, vtkDoubleArray* pixels)
+{
+  if (points == nullptr || pixels == nullptr)
+  {
+    vtkErrorMacro("ProjectPoints: invalid arguments.");
+    return false;
+  }
+
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = this->GetCurrentParameters();
+  if (parameters->NumberOfDistortionCoefficients > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("ProjectPoints: unsupported number of distortion coefficients: " << parameters->NumberOfDistortionCoefficients);
+    return false;
+  }
+
+  const vtkIdType count = points->GetNumberOfPoints();
+  pixels->SetNumberOfComponents(2);
+  pixels->SetNumberOfTuples(count);
+  if (count == 0)
+  {
+    return true;
+  }
+
+  double referenceToSensor[16];
+  if (markerToReference != nullptr)
+  {
+    double referenceToMarker[16];
+    vtkMatrix4x4::Invert(&markerToReference->Element[0][0], referenceToMarker);
+    vtkMatrix4x4::Multiply4x4(parameters->MarkerToImageSensor, referenceToMarker, referenceToSensor);
+  }
+  else
+  {
+    std::copy(parameters->MarkerToImageSensor, parameters->MarkerToImageSensor + 16, referenceToSensor);
+  }
+
+  if (points->GetDataType() == VTK_FLOAT)
+  {
+    vtkPinholeCameraModelTemplateMacro(parameters->DistortionModel,
+      ProjectPointsParallel<float, PINHOLE_CAMERA_MODEL>(*parameters, referenceToSensor, static_cast<float*>(points->GetVoidPointer(0)), count, pixels->GetPointer(0)));
+    return true;
+  }
+
+  // Any other point type is projected in double precision
+  vtkSmartPointer<vtkDoubleArray> pointData = vtkDoubleArray::SafeDownCast(points->GetData());
+  if (pointData == nullptr)
+  {
+    pointData = vtkSmartPointer<vtkDoubleArray>::New();
+    pointData->DeepCopy(points->GetData());
+  }
+
+  vtkPinholeCameraModelTemplateMacro(parameters->DistortionModel,
+    ProjectPointsParallel<double, PINHOLE_CAMERA_MODEL>(*parameters, referenceToSensor, pointData->GetPointer(0), count, pixels->GetPointer(0)));
+
+  return true;
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLPinholeCameraNode::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -208,4 +826,6 @@ void vtkMRMLPinholeCameraNode::PrintSelf(ostream& os, vtkIndent indent)
   this->MarkerToImageSensorTransform->PrintSelf(os, indent);
   os << "Camera Plane Offset: " << std::endl;
   this->CameraPlaneOffset->PrintSelf(os, indent);
+  os << indent << "TrackerLatency: " << this->TrackerLatency << std::endl;
+  os << indent << "UndistortionMapFormat: " << GetUndistortionMapFormatAsString(this->UndistortionMapFormat) << std::endl;
 }
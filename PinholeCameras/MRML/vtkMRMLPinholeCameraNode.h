@@ -25,6 +25,20 @@ Version:   $Revision: 1.0 $
 #include <vtkDoubleArray.h>
 #include <vtkMatrix3x3.h>
 #include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <memory>
+
+class vtkImageData;
+class vtkPoints;
+
+#ifndef __VTK_WRAP__
+namespace vtkPinholeCameraModel
+{
+  struct Parameters;
+}
+#endif
 
 class VTK_SLICER_PINHOLECAMERAS_MODULE_MRML_EXPORT vtkMRMLPinholeCameraNode : public vtkMRMLStorableNode
 {
@@ -37,6 +51,13 @@ public:
     MarkerToSensorTransformModifiedEvent
   };
 
+  enum
+  {
+    UndistortionMapFloat = 0,
+    UndistortionMapFixedPoint,
+    UndistortionMapFormat_Last
+  };
+
 public:
   static vtkMRMLPinholeCameraNode* New();
   vtkTypeMacro(vtkMRMLPinholeCameraNode, vtkMRMLStorableNode);
@@ -66,6 +87,15 @@ public:
   void SetCameraPlaneOffsetValue(vtkIdType idx, double value);
   double GetCameraPlaneOffsetValue(vtkIdType idx);
 
+  ///
+  /// Replace all distortion coefficients at once, DistortionCoefficientsModifiedEvent is fired a single time
+  void SetDistortionCoefficientValues(vtkDoubleArray* values);
+  void SetDistortionCoefficientValues(const double* values, vtkIdType count);
+
+  ///
+  /// Replace the camera plane offset at once, CameraPlaneOffsetModifiedEvent is fired a single time
+  void SetCameraPlaneOffsetValues(const double offset[3]);
+
   virtual vtkMRMLStorageNode* CreateDefaultStorageNode() override;
 
   bool IsReprojectionErrorValid() const;
@@ -76,6 +106,79 @@ public:
   vtkSetMacro(RegistrationError, double);
   vtkGetMacro(RegistrationError, double);
 
+  ///
+  /// Delay of the tracked pose of the camera behind its video frames, in seconds: the pose matching a frame acquired
+  /// at time t is the one the tracker reports at t + TrackerLatency. Negative if the tracker leads the video.
+  /// Estimated by vtkSlicerPinholeCamerasLogic::StartTrackerLatencyEstimation, 0 by default.
+  vtkSetMacro(TrackerLatency, double);
+  vtkGetMacro(TrackerLatency, double);
+
+  ///
+  /// Get the undistortion map for an image of the given size.
+  /// The map is a 2 component float image of the same size as the undistorted output image, each pixel holding the
+  /// (x,y) location to sample in the distorted input image. If outputIntrinsics is null, the camera intrinsics are used.
+  /// Maps are built on first request and cached until the intrinsics or distortion coefficients change. The reference
+  /// to the map is taken while the cache is locked, so the returned map stays valid for as long as it is held, even if
+  /// the cache drops it meanwhile (new parameters, ClearUndistortionMaps).
+  /// Maps are built from the parameters snapshot, so this can be called from any thread.
+  vtkSmartPointer<vtkImageData> GetUndistortionMap(int width, int height, vtkMatrix3x3* outputIntrinsics = nullptr);
+
+  ///
+  /// Get the compact undistortion map for an image of the given size.
+  /// Same as GetUndistortionMap, but the map is a 2 component unsigned short image holding each (x,y) location in
+  /// fixed point with vtkPinholeCameraModel::GetCompactMapFractionBits fractional bits, or
+  /// vtkPinholeCameraModel::CompactMapOutside if the location is outside of the input image. The map takes half the
+  /// memory of the float map. The largest sampling error measured while building the map is stored in its field data
+  /// as "MaximumSamplingError".
+  vtkSmartPointer<vtkImageData> GetCompactUndistortionMap(int width, int height, vtkMatrix3x3* outputIntrinsics = nullptr);
+
+  ///
+  /// Upper bound of the sampling error of compact undistortion maps for an image size, in pixels
+  static double GetCompactUndistortionMapErrorBound(int width, int height);
+
+  ///
+  /// Representation of the undistortion maps used to undistort images of this camera.
+  /// UndistortionMapFixedPoint halves the memory bandwidth of undistortion, at the cost of a sampling error bounded by
+  /// GetCompactUndistortionMapErrorBound (0.044 pixel for 4K images).
+  vtkSetClampMacro(UndistortionMapFormat, int, UndistortionMapFloat, UndistortionMapFormat_Last - 1);
+  vtkGetMacro(UndistortionMapFormat, int);
+  static const char* GetUndistortionMapFormatAsString(int format);
+  static int GetUndistortionMapFormatFromString(const char* name);
+
+  ///
+  /// Discard all cached undistortion maps
+  void ClearUndistortionMaps();
+
+  ///
+  /// Time of the last change of the intrinsics or distortion coefficients, the inputs of undistortion maps.
+  /// Distortion coefficient changes do not modify the node itself, pipelines using the maps depend on this time.
+  vtkMTimeType GetUndistortionMTime();
+
+  ///
+  /// Compute the rays passing through a batch of (distorted) pixel locations.
+  /// pixels is a 2 component array of (x,y) pixel locations. origins and directions are resized to hold one
+  /// 3 component tuple per pixel, expressed in the reference coordinate system given by markerToReference,
+  /// the tracked pose of the camera marker. If markerToReference is null the rays are expressed in the marker
+  /// coordinate system.
+  bool ComputeRaysFromPixels(vtkDoubleArray* pixels, vtkMatrix4x4* markerToReference, vtkDoubleArray* origins, vtkDoubleArray* directions);
+
+  ///
+  /// Project a batch of points into the image, applying the full distortion model.
+  /// points are expressed in the reference coordinate system given by markerToReference, the tracked pose of the
+  /// camera marker, or in the marker coordinate system if markerToReference is null. pixels is resized to hold one
+  /// 2 component (x,y) distorted pixel location per point, points behind the camera are set to NaN.
+  /// Large batches are split across threads.
+  bool ProjectPoints(vtkPoints* points, vtkMatrix4x4* markerToReference, vtkDoubleArray* pixels);
+
+#ifndef __VTK_WRAP__
+  ///
+  /// Get an immutable snapshot of all camera parameters and their precomputed inverses.
+  /// The snapshot is rebuilt whenever a parameter changes (once per StartModify/EndModify block) and published
+  /// atomically, so it can be read from any thread without locking. Readers see a consistent version for as long
+  /// as they hold the pointer.
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> GetParametersSnapshot() const;
+#endif
+
 protected:
   vtkSetObjectMacro(IntrinsicMatrix, vtkMatrix3x3);
   vtkSetObjectMacro(DistortionCoefficients, vtkDoubleArray);
@@ -92,6 +195,27 @@ protected:
   void OnIntrinsicsModified(vtkObject* caller, unsigned long event, void* data);
   void OnMarkerTransformModified(vtkObject* caller, unsigned long event, void* data);
 
+  /// Drop anything derived from the modified parameter and notify observers.
+  /// Notifications are deferred and merged while modified events are disabled (see StartModify/EndModify).
+  void ParameterModified(unsigned long event);
+
+  /// Publish the pending parameter snapshot before notifying observers
+  virtual int InvokePendingModifiedEvent() override;
+
+  /// Rebuild and publish the parameter snapshot
+  void UpdateParametersSnapshot();
+
+  /// Get a cached undistortion map of the given format, building it if needed
+  vtkSmartPointer<vtkImageData> GetCachedUndistortionMap(int format, int width, int height, vtkMatrix3x3* outputIntrinsics);
+
+#ifndef __VTK_WRAP__
+  /// Build a snapshot from the current state of the node
+  std::shared_ptr<vtkPinholeCameraModel::Parameters> BuildParametersSnapshot();
+
+  /// Get parameters reflecting all changes made so far, even inside a StartModify/EndModify block (main thread only)
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> GetCurrentParameters();
+#endif
+
 protected:
   vtkMRMLPinholeCameraNode();
   ~vtkMRMLPinholeCameraNode();
@@ -102,9 +226,14 @@ protected:
   vtkDoubleArray*     DistortionCoefficients;
   double              ReprojectionError;
   double              RegistrationError;
+  double              TrackerLatency;
   bool                DistortionCoefficientsExist;
   vtkDoubleArray*     CameraPlaneOffset;
   vtkMatrix4x4*       MarkerToImageSensorTransform;
+  int                 UndistortionMapFormat;
+
+  class vtkInternal;
+  vtkInternal*        Internal;
 };
 
 #endif
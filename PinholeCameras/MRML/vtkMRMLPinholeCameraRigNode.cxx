@@ -0,0 +1,913 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkMRMLPinholeCameraRigNode.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraRigNode.h"
+#include "vtkMRMLPinholeCameraRigStorageNode.h"
+#include "vtkPinholeCameraModel.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkMatrix3x3.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkSMPTools.h>
+
+// STL includes
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const vtkIdType SMP_GRAIN_SIZE = vtkPinholeCameraModel::ProjectionBlockSize * 16;
+
+  //----------------------------------------------------------------------------
+  /// Project over the flattened (camera, point) range so that all cameras share one parallel loop
+  template<typename PointType, int Model>
+  class ProjectRigPointsFunctor
+  {
+  public:
+    const vtkPinholeCameraModel::CameraView*  Cameras;
+    const double*                             ReferenceToSensor;
+    const PointType*                          Points;
+    vtkIdType                                 NumberOfPoints;
+    double*                                   Pixels;
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType camera = begin / this->NumberOfPoints; camera * this->NumberOfPoints < end; ++camera)
+      {
+        const vtkIdType cameraStart = camera * this->NumberOfPoints;
+        const vtkIdType first = std::max(begin, cameraStart) - cameraStart;
+        const vtkIdType last = std::min(end, cameraStart + this->NumberOfPoints) - cameraStart;
+        vtkPinholeCameraModel::ProjectPoints<PointType, Model>(this->Cameras[camera], this->ReferenceToSensor + 16 * camera,
+            this->Points, first, last, this->Pixels + 2 * cameraStart);
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename PointType, int Model>
+  void ProjectRigPointsParallel(const std::vector<vtkPinholeCameraModel::CameraView>& cameras, const double* referenceToSensor,
+                                const PointType* points, vtkIdType numberOfPoints, double* pixels)
+  {
+    ProjectRigPointsFunctor<PointType, Model> functor;
+    functor.Cameras = cameras.data();
+    functor.ReferenceToSensor = referenceToSensor;
+    functor.Points = points;
+    functor.NumberOfPoints = numberOfPoints;
+    functor.Pixels = pixels;
+    vtkSMPTools::For(0, numberOfPoints * static_cast<vtkIdType>(cameras.size()), SMP_GRAIN_SIZE, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  template<int Model>
+  class ComputeRigRaysFunctor
+  {
+  public:
+    const vtkPinholeCameraModel::CameraView*  Cameras;
+    const double*                             SensorToReference;
+    const double*                             CameraOrigins;
+    const double*                             Pixels;
+    const int*                                CameraIndices;
+    double*                                   Origins;
+    double*                                   Directions;
+
+    void operator()(vtkIdType begin, vtkIdType end) const
+    {
+      for (vtkIdType i = begin; i < end; ++i)
+      {
+        const int camera = this->CameraIndices[i];
+        vtkPinholeCameraModel::ComputeRayDirection<Model>(this->Cameras[camera], this->SensorToReference + 16 * camera, this->Pixels + 2 * i, this->Directions + 3 * i);
+        std::copy(this->CameraOrigins + 3 * camera, this->CameraOrigins + 3 * camera + 3, this->Origins + 3 * i);
+      }
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  template<int Model>
+  void ComputeRigRaysParallel(const std::vector<vtkPinholeCameraModel::CameraView>& cameras, const double* sensorToReference, const double* cameraOrigins,
+                              const double* pixels, const int* cameraIndices, vtkIdType count, double* origins, double* directions)
+  {
+    ComputeRigRaysFunctor<Model> functor;
+    functor.Cameras = cameras.data();
+    functor.SensorToReference = sensorToReference;
+    functor.CameraOrigins = cameraOrigins;
+    functor.Pixels = pixels;
+    functor.CameraIndices = cameraIndices;
+    functor.Origins = origins;
+    functor.Directions = directions;
+    vtkSMPTools::For(0, count, SMP_GRAIN_SIZE, functor);
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkMRMLPinholeCameraRigNode::vtkInternal
+{
+public:
+  void Resize(int numberOfCameras);
+  void Erase(int index);
+  vtkPinholeCameraModel::CameraView GetCameraView(int index) const;
+  void UpdateDerivedParameters(int index);
+  void UpdateRigDistortionModel();
+
+  // One buffer per parameter, camera i occupies [i * size, (i + 1) * size)
+  std::vector<std::string>  Names;
+  std::vector<double>       Intrinsics;               // 9 per camera, row major
+  std::vector<double>       InverseIntrinsics;        // 9 per camera
+  std::vector<double>       DistortionCoefficients;   // vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients per camera, zero padded
+  std::vector<int>          NumberOfDistortionCoefficients;
+  std::vector<int>          DistortionModels;
+  std::vector<double>       TiltMatrices;             // 9 per camera
+  std::vector<double>       InverseTiltMatrices;      // 9 per camera
+  std::vector<double>       CameraPlaneOffsets;       // 3 per camera
+  std::vector<double>       MarkerToImageSensor;      // 16 per camera, row major
+  std::vector<double>       ImageSensorToMarker;      // 16 per camera
+  std::vector<double>       ReprojectionErrors;
+  std::vector<double>       RegistrationErrors;
+  std::vector<double>       TrackerLatencies;         // seconds
+  std::vector<int>          UndistortionMapFormats;
+
+  /// Cameras modified inside a StartModify/EndModify block, their derived parameters are not up to date
+  std::vector<char>         PendingCameras;
+  bool                      HasPendingCameras = false;
+
+  /// Largest distortion model of all cameras, a whole rig batch runs with a single kernel
+  int                       RigDistortionModel = 0;
+};
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::vtkInternal::Resize(int numberOfCameras)
+{
+  const size_t oldCount = this->Names.size();
+  const size_t count = static_cast<size_t>(numberOfCameras);
+  const int coefficientCount = vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients;
+
+  this->Names.resize(count);
+  this->Intrinsics.resize(9 * count);
+  this->InverseIntrinsics.resize(9 * count);
+  this->DistortionCoefficients.resize(coefficientCount * count, 0.0);
+  this->NumberOfDistortionCoefficients.resize(count, 5);
+  this->DistortionModels.resize(count, 0);
+  this->TiltMatrices.resize(9 * count);
+  this->InverseTiltMatrices.resize(9 * count);
+  this->CameraPlaneOffsets.resize(3 * count, 0.0);
+  this->MarkerToImageSensor.resize(16 * count);
+  this->ImageSensorToMarker.resize(16 * count);
+  this->ReprojectionErrors.resize(count, -1.0);
+  this->RegistrationErrors.resize(count, -1.0);
+  this->TrackerLatencies.resize(count, 0.0);
+  this->UndistortionMapFormats.resize(count, vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+  this->PendingCameras.resize(count, 0);
+
+  for (size_t i = oldCount; i < count; ++i)
+  {
+    vtkMatrix3x3::Identity(&this->Intrinsics[9 * i]);
+    vtkMatrix4x4::Identity(&this->MarkerToImageSensor[16 * i]);
+    this->UpdateDerivedParameters(static_cast<int>(i));
+  }
+  this->UpdateRigDistortionModel();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::vtkInternal::Erase(int index)
+{
+  const int coefficientCount = vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients;
+
+  this->Names.erase(this->Names.begin() + index);
+  this->Intrinsics.erase(this->Intrinsics.begin() + 9 * index, this->Intrinsics.begin() + 9 * (index + 1));
+  this->InverseIntrinsics.erase(this->InverseIntrinsics.begin() + 9 * index, this->InverseIntrinsics.begin() + 9 * (index + 1));
+  this->DistortionCoefficients.erase(this->DistortionCoefficients.begin() + coefficientCount * index, this->DistortionCoefficients.begin() + coefficientCount * (index + 1));
+  this->NumberOfDistortionCoefficients.erase(this->NumberOfDistortionCoefficients.begin() + index);
+  this->DistortionModels.erase(this->DistortionModels.begin() + index);
+  this->TiltMatrices.erase(this->TiltMatrices.begin() + 9 * index, this->TiltMatrices.begin() + 9 * (index + 1));
+  this->InverseTiltMatrices.erase(this->InverseTiltMatrices.begin() + 9 * index, this->InverseTiltMatrices.begin() + 9 * (index + 1));
+  this->CameraPlaneOffsets.erase(this->CameraPlaneOffsets.begin() + 3 * index, this->CameraPlaneOffsets.begin() + 3 * (index + 1));
+  this->MarkerToImageSensor.erase(this->MarkerToImageSensor.begin() + 16 * index, this->MarkerToImageSensor.begin() + 16 * (index + 1));
+  this->ImageSensorToMarker.erase(this->ImageSensorToMarker.begin() + 16 * index, this->ImageSensorToMarker.begin() + 16 * (index + 1));
+  this->ReprojectionErrors.erase(this->ReprojectionErrors.begin() + index);
+  this->RegistrationErrors.erase(this->RegistrationErrors.begin() + index);
+  this->TrackerLatencies.erase(this->TrackerLatencies.begin() + index);
+  this->UndistortionMapFormats.erase(this->UndistortionMapFormats.begin() + index);
+  this->PendingCameras.erase(this->PendingCameras.begin() + index);
+
+  this->UpdateRigDistortionModel();
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraModel::CameraView vtkMRMLPinholeCameraRigNode::vtkInternal::GetCameraView(int index) const
+{
+  vtkPinholeCameraModel::CameraView view;
+  view.Intrinsics = &this->Intrinsics[9 * index];
+  view.InverseIntrinsics = &this->InverseIntrinsics[9 * index];
+  view.DistortionCoefficients = &this->DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients * index];
+  view.TiltMatrix = &this->TiltMatrices[9 * index];
+  view.InverseTiltMatrix = &this->InverseTiltMatrices[9 * index];
+  view.CameraPlaneOffset = &this->CameraPlaneOffsets[3 * index];
+  return view;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::vtkInternal::UpdateDerivedParameters(int index)
+{
+  const double* coefficients = &this->DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients * index];
+
+  vtkMatrix3x3::Invert(&this->Intrinsics[9 * index], &this->InverseIntrinsics[9 * index]);
+  this->DistortionModels[index] = vtkPinholeCameraModel::GetDistortionModel(coefficients);
+  vtkPinholeCameraModel::ComputeTiltMatrix(coefficients[12], coefficients[13], &this->TiltMatrices[9 * index]);
+  vtkMatrix3x3::Invert(&this->TiltMatrices[9 * index], &this->InverseTiltMatrices[9 * index]);
+  vtkMatrix4x4::Invert(&this->MarkerToImageSensor[16 * index], &this->ImageSensorToMarker[16 * index]);
+
+  this->UpdateRigDistortionModel();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::vtkInternal::UpdateRigDistortionModel()
+{
+  this->RigDistortionModel = this->DistortionModels.empty() ? 0 : *std::max_element(this->DistortionModels.begin(), this->DistortionModels.end());
+}
+
+//----------------------------------------------------------------------------
+
+vtkMRMLNodeNewMacro(vtkMRMLPinholeCameraRigNode);
+
+//-----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigNode::vtkMRMLPinholeCameraRigNode()
+  : vtkMRMLStorableNode()
+  , Internal(new vtkInternal())
+{
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigNode::~vtkMRMLPinholeCameraRigNode()
+{
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::Copy(vtkMRMLNode* anode)
+{
+  int disabledModify = this->StartModify();
+  Superclass::Copy(anode);
+  vtkMRMLPinholeCameraRigNode* node = vtkMRMLPinholeCameraRigNode::SafeDownCast(anode);
+  if (!node)
+  {
+    this->EndModify(disabledModify);
+    return;
+  }
+
+  *this->Internal = *node->Internal;
+  this->InvokeCustomModifiedEvent(CamerasModifiedEvent);
+  this->Modified();
+
+  this->EndModify(disabledModify);
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLStorageNode* vtkMRMLPinholeCameraRigNode::CreateDefaultStorageNode()
+{
+  return vtkMRMLPinholeCameraRigStorageNode::New();
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigNode::GetNumberOfCameras() const
+{
+  return static_cast<int>(this->Internal->Names.size());
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetNumberOfCameras(int numberOfCameras)
+{
+  if (numberOfCameras < 0 || numberOfCameras == this->GetNumberOfCameras())
+  {
+    return;
+  }
+
+  this->Internal->Resize(numberOfCameras);
+  this->InvokeCustomModifiedEvent(CamerasModifiedEvent);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigNode::AddCamera(vtkMRMLPinholeCameraNode* cameraNode)
+{
+  if (cameraNode == nullptr)
+  {
+    vtkErrorMacro("AddCamera: invalid camera node.");
+    return -1;
+  }
+
+  int disabledModify = this->StartModify();
+  const int index = this->GetNumberOfCameras();
+  this->SetNumberOfCameras(index + 1);
+  this->SetCamera(index, cameraNode);
+  this->EndModify(disabledModify);
+
+  return index;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::RemoveCamera(int index)
+{
+  if (!this->IsValidCameraIndex(index, "RemoveCamera"))
+  {
+    return;
+  }
+
+  this->Internal->Erase(index);
+  this->InvokeCustomModifiedEvent(CamerasModifiedEvent);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::RemoveAllCameras()
+{
+  this->SetNumberOfCameras(0);
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::SetCamera(int index, vtkMRMLPinholeCameraNode* cameraNode)
+{
+  if (cameraNode == nullptr || !this->IsValidCameraIndex(index, "SetCamera"))
+  {
+    return false;
+  }
+
+  std::shared_ptr<const vtkPinholeCameraModel::Parameters> parameters = cameraNode->GetParametersSnapshot();
+  if (parameters->NumberOfDistortionCoefficients > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("SetCamera: unsupported number of distortion coefficients: " << parameters->NumberOfDistortionCoefficients);
+    return false;
+  }
+
+  vtkInternal* internal = this->Internal;
+  const int coefficientCount = vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients;
+  internal->Names[index] = cameraNode->GetName() != nullptr ? cameraNode->GetName() : "";
+  std::copy(parameters->Intrinsics, parameters->Intrinsics + 9, &internal->Intrinsics[9 * index]);
+  std::copy(parameters->DistortionCoefficients, parameters->DistortionCoefficients + coefficientCount, &internal->DistortionCoefficients[coefficientCount * index]);
+  internal->NumberOfDistortionCoefficients[index] = parameters->NumberOfDistortionCoefficients;
+  std::copy(parameters->CameraPlaneOffset, parameters->CameraPlaneOffset + 3, &internal->CameraPlaneOffsets[3 * index]);
+  std::copy(parameters->MarkerToImageSensor, parameters->MarkerToImageSensor + 16, &internal->MarkerToImageSensor[16 * index]);
+  internal->ReprojectionErrors[index] = cameraNode->GetReprojectionError();
+  internal->RegistrationErrors[index] = cameraNode->GetRegistrationError();
+  internal->TrackerLatencies[index] = cameraNode->GetTrackerLatency();
+  internal->UndistortionMapFormats[index] = cameraNode->GetUndistortionMapFormat();
+
+  this->CameraModified(index);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::GetCamera(int index, vtkMRMLPinholeCameraNode* cameraNode)
+{
+  if (cameraNode == nullptr || !this->IsValidCameraIndex(index, "GetCamera"))
+  {
+    return false;
+  }
+
+  vtkInternal* internal = this->Internal;
+  int disabledModify = cameraNode->StartModify();
+
+  vtkNew<vtkMatrix3x3> intrinsics;
+  this->GetIntrinsicMatrix(index, intrinsics);
+  cameraNode->SetAndObserveIntrinsicMatrix(intrinsics);
+  cameraNode->SetDistortionCoefficientValues(&internal->DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients * index],
+      internal->NumberOfDistortionCoefficients[index]);
+  vtkNew<vtkMatrix4x4> markerToImageSensor;
+  this->GetMarkerToImageSensorTransform(index, markerToImageSensor);
+  cameraNode->SetAndObserveMarkerToImageSensorTransform(markerToImageSensor);
+  cameraNode->SetCameraPlaneOffsetValues(&internal->CameraPlaneOffsets[3 * index]);
+  cameraNode->SetReprojectionError(internal->ReprojectionErrors[index]);
+  cameraNode->SetRegistrationError(internal->RegistrationErrors[index]);
+  cameraNode->SetTrackerLatency(internal->TrackerLatencies[index]);
+  cameraNode->SetUndistortionMapFormat(internal->UndistortionMapFormats[index]);
+
+  cameraNode->EndModify(disabledModify);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetCameraName(int index, const char* name)
+{
+  if (!this->IsValidCameraIndex(index, "SetCameraName"))
+  {
+    return;
+  }
+
+  this->Internal->Names[index] = name != nullptr ? name : "";
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+const char* vtkMRMLPinholeCameraRigNode::GetCameraName(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetCameraName"))
+  {
+    return nullptr;
+  }
+
+  return this->Internal->Names[index].c_str();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetIntrinsics(int index, const double intrinsics[9])
+{
+  if (!this->IsValidCameraIndex(index, "SetIntrinsics"))
+  {
+    return;
+  }
+
+  std::copy(intrinsics, intrinsics + 9, &this->Internal->Intrinsics[9 * index]);
+  this->CameraModified(index);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::GetIntrinsics(int index, double intrinsics[9])
+{
+  if (!this->IsValidCameraIndex(index, "GetIntrinsics"))
+  {
+    return;
+  }
+
+  std::copy(&this->Internal->Intrinsics[9 * index], &this->Internal->Intrinsics[9 * index] + 9, intrinsics);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetIntrinsicMatrix(int index, vtkMatrix3x3* intrinsicMatrix)
+{
+  if (intrinsicMatrix == nullptr)
+  {
+    vtkErrorMacro("SetIntrinsicMatrix: invalid matrix.");
+    return;
+  }
+
+  this->SetIntrinsics(index, intrinsicMatrix->GetData());
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::GetIntrinsicMatrix(int index, vtkMatrix3x3* intrinsicMatrix)
+{
+  if (intrinsicMatrix == nullptr)
+  {
+    vtkErrorMacro("GetIntrinsicMatrix: invalid matrix.");
+    return;
+  }
+
+  this->GetIntrinsics(index, intrinsicMatrix->GetData());
+  intrinsicMatrix->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::SetDistortionCoefficientValues(int index, const double* values, int count)
+{
+  if (!this->IsValidCameraIndex(index, "SetDistortionCoefficientValues"))
+  {
+    return false;
+  }
+  if ((values == nullptr && count > 0) || count < 0 || count > vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("SetDistortionCoefficientValues: invalid coefficients, at most " << vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients << " are supported.");
+    return false;
+  }
+
+  double* coefficients = &this->Internal->DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients * index];
+  std::fill(coefficients, coefficients + vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients, 0.0);
+  std::copy(values, values + count, coefficients);
+  this->Internal->NumberOfDistortionCoefficients[index] = count;
+  this->CameraModified(index);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::SetDistortionCoefficientValues(int index, vtkDoubleArray* values)
+{
+  if (values == nullptr)
+  {
+    vtkErrorMacro("SetDistortionCoefficientValues: invalid array.");
+    return false;
+  }
+
+  return this->SetDistortionCoefficientValues(index, values->GetPointer(0), static_cast<int>(values->GetNumberOfValues()));
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigNode::GetNumberOfDistortionCoefficients(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetNumberOfDistortionCoefficients"))
+  {
+    return 0;
+  }
+
+  return this->Internal->NumberOfDistortionCoefficients[index];
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLPinholeCameraRigNode::GetDistortionCoefficientValue(int index, int coefficient)
+{
+  if (!this->IsValidCameraIndex(index, "GetDistortionCoefficientValue"))
+  {
+    return 0.0;
+  }
+  if (coefficient < 0 || coefficient >= this->Internal->NumberOfDistortionCoefficients[index])
+  {
+    vtkErrorMacro("GetDistortionCoefficientValue: invalid coefficient index " << coefficient);
+    return 0.0;
+  }
+
+  return this->Internal->DistortionCoefficients[vtkPinholeCameraModel::MaximumNumberOfDistortionCoefficients * index + coefficient];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetMarkerToImageSensor(int index, const double markerToImageSensor[16])
+{
+  if (!this->IsValidCameraIndex(index, "SetMarkerToImageSensor"))
+  {
+    return;
+  }
+
+  std::copy(markerToImageSensor, markerToImageSensor + 16, &this->Internal->MarkerToImageSensor[16 * index]);
+  this->CameraModified(index);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::GetMarkerToImageSensor(int index, double markerToImageSensor[16])
+{
+  if (!this->IsValidCameraIndex(index, "GetMarkerToImageSensor"))
+  {
+    return;
+  }
+
+  std::copy(&this->Internal->MarkerToImageSensor[16 * index], &this->Internal->MarkerToImageSensor[16 * index] + 16, markerToImageSensor);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetMarkerToImageSensorTransform(int index, vtkMatrix4x4* markerToImageSensorTransform)
+{
+  if (markerToImageSensorTransform == nullptr)
+  {
+    vtkErrorMacro("SetMarkerToImageSensorTransform: invalid matrix.");
+    return;
+  }
+
+  this->SetMarkerToImageSensor(index, &markerToImageSensorTransform->Element[0][0]);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::GetMarkerToImageSensorTransform(int index, vtkMatrix4x4* markerToImageSensorTransform)
+{
+  if (markerToImageSensorTransform == nullptr)
+  {
+    vtkErrorMacro("GetMarkerToImageSensorTransform: invalid matrix.");
+    return;
+  }
+
+  this->GetMarkerToImageSensor(index, &markerToImageSensorTransform->Element[0][0]);
+  markerToImageSensorTransform->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetCameraPlaneOffset(int index, const double offset[3])
+{
+  if (!this->IsValidCameraIndex(index, "SetCameraPlaneOffset"))
+  {
+    return;
+  }
+
+  std::copy(offset, offset + 3, &this->Internal->CameraPlaneOffsets[3 * index]);
+  this->CameraModified(index);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::GetCameraPlaneOffset(int index, double offset[3])
+{
+  if (!this->IsValidCameraIndex(index, "GetCameraPlaneOffset"))
+  {
+    return;
+  }
+
+  std::copy(&this->Internal->CameraPlaneOffsets[3 * index], &this->Internal->CameraPlaneOffsets[3 * index] + 3, offset);
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetReprojectionError(int index, double error)
+{
+  if (!this->IsValidCameraIndex(index, "SetReprojectionError"))
+  {
+    return;
+  }
+
+  this->Internal->ReprojectionErrors[index] = error;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLPinholeCameraRigNode::GetReprojectionError(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetReprojectionError"))
+  {
+    return -1.0;
+  }
+
+  return this->Internal->ReprojectionErrors[index];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetRegistrationError(int index, double error)
+{
+  if (!this->IsValidCameraIndex(index, "SetRegistrationError"))
+  {
+    return;
+  }
+
+  this->Internal->RegistrationErrors[index] = error;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLPinholeCameraRigNode::GetRegistrationError(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetRegistrationError"))
+  {
+    return -1.0;
+  }
+
+  return this->Internal->RegistrationErrors[index];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetTrackerLatency(int index, double latency)
+{
+  if (!this->IsValidCameraIndex(index, "SetTrackerLatency"))
+  {
+    return;
+  }
+
+  this->Internal->TrackerLatencies[index] = latency;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLPinholeCameraRigNode::GetTrackerLatency(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetTrackerLatency"))
+  {
+    return 0.0;
+  }
+
+  return this->Internal->TrackerLatencies[index];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::SetUndistortionMapFormat(int index, int format)
+{
+  if (!this->IsValidCameraIndex(index, "SetUndistortionMapFormat"))
+  {
+    return;
+  }
+
+  this->Internal->UndistortionMapFormats[index] = std::min(std::max(format, static_cast<int>(vtkMRMLPinholeCameraNode::UndistortionMapFloat)),
+      vtkMRMLPinholeCameraNode::UndistortionMapFormat_Last - 1);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigNode::GetUndistortionMapFormat(int index)
+{
+  if (!this->IsValidCameraIndex(index, "GetUndistortionMapFormat"))
+  {
+    return vtkMRMLPinholeCameraNode::UndistortionMapFloat;
+  }
+
+  return this->Internal->UndistortionMapFormats[index];
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::CameraModified(int index)
+{
+  // Setting several parameters of a camera, or loading a rig, inverts each matrix once, from InvokePendingModifiedEvent
+  if (this->GetDisableModifiedEvent())
+  {
+    this->Internal->PendingCameras[index] = 1;
+    this->Internal->HasPendingCameras = true;
+  }
+  else
+  {
+    this->Internal->UpdateDerivedParameters(index);
+  }
+  this->InvokeCustomModifiedEvent(CamerasModifiedEvent);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::UpdatePendingCameras()
+{
+  vtkInternal* internal = this->Internal;
+  if (!internal->HasPendingCameras)
+  {
+    return;
+  }
+  for (int index = 0; index < this->GetNumberOfCameras(); ++index)
+  {
+    if (internal->PendingCameras[index])
+    {
+      internal->UpdateDerivedParameters(index);
+      internal->PendingCameras[index] = 0;
+    }
+  }
+  internal->HasPendingCameras = false;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigNode::InvokePendingModifiedEvent()
+{
+  this->UpdatePendingCameras();
+  return Superclass::InvokePendingModifiedEvent();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::IsValidCameraIndex(int index, const char* caller)
+{
+  if (index < 0 || index >= this->GetNumberOfCameras())
+  {
+    vtkErrorMacro(caller << ": invalid camera index " << index << ", the rig has " << this->GetNumberOfCameras() << " cameras.");
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::GetMarkerToReferenceTransforms(vtkDoubleArray* markerToReferenceTransforms, const char* caller, double* transforms)
+{
+  const int numberOfCameras = this->GetNumberOfCameras();
+  if (markerToReferenceTransforms == nullptr)
+  {
+    for (int i = 0; i < numberOfCameras; ++i)
+    {
+      vtkMatrix4x4::Identity(transforms + 16 * i);
+    }
+    return true;
+  }
+
+  if (markerToReferenceTransforms->GetNumberOfComponents() != 16 || markerToReferenceTransforms->GetNumberOfTuples() != numberOfCameras)
+  {
+    vtkErrorMacro(caller << ": one 16 component transform is required per camera.");
+    return false;
+  }
+
+  std::copy(markerToReferenceTransforms->GetPointer(0), markerToReferenceTransforms->GetPointer(0) + 16 * numberOfCameras, transforms);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::ProjectPoints(vtkPoints* points, vtkDoubleArray* markerToReferenceTransforms, vtkDoubleArray* pixels)
+{
+  if (points == nullptr || pixels == nullptr)
+  {
+    vtkErrorMacro("ProjectPoints: invalid arguments.");
+    return false;
+  }
+  // Called inside a StartModify/EndModify block, parameters set so far are used
+  this->UpdatePendingCameras();
+
+  const int numberOfCameras = this->GetNumberOfCameras();
+  std::vector<double> referenceToSensor(16 * numberOfCameras);
+  if (!this->GetMarkerToReferenceTransforms(markerToReferenceTransforms, "ProjectPoints", referenceToSensor.data()))
+  {
+    return false;
+  }
+
+  const vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  pixels->SetNumberOfComponents(2);
+  pixels->SetNumberOfTuples(numberOfPoints * numberOfCameras);
+  if (numberOfPoints == 0 || numberOfCameras == 0)
+  {
+    return true;
+  }
+
+  std::vector<vtkPinholeCameraModel::CameraView> cameras(numberOfCameras);
+  for (int i = 0; i < numberOfCameras; ++i)
+  {
+    cameras[i] = this->Internal->GetCameraView(i);
+
+    double referenceToMarker[16];
+    vtkMatrix4x4::Invert(&referenceToSensor[16 * i], referenceToMarker);
+    vtkMatrix4x4::Multiply4x4(&this->Internal->MarkerToImageSensor[16 * i], referenceToMarker, &referenceToSensor[16 * i]);
+  }
+
+  if (points->GetDataType() == VTK_FLOAT)
+  {
+    vtkPinholeCameraModelTemplateMacro(this->Internal->RigDistortionModel,
+      ProjectRigPointsParallel<float, PINHOLE_CAMERA_MODEL>(cameras, referenceToSensor.data(), static_cast<float*>(points->GetVoidPointer(0)), numberOfPoints, pixels->GetPointer(0)));
+    return true;
+  }
+
+  // Any other point type is projected in double precision
+  vtkSmartPointer<vtkDoubleArray> pointData = vtkDoubleArray::SafeDownCast(points->GetData());
+  if (pointData == nullptr)
+  {
+    pointData = vtkSmartPointer<vtkDoubleArray>::New();
+    pointData->DeepCopy(points->GetData());
+  }
+
+  vtkPinholeCameraModelTemplateMacro(this->Internal->RigDistortionModel,
+    ProjectRigPointsParallel<double, PINHOLE_CAMERA_MODEL>(cameras, referenceToSensor.data(), pointData->GetPointer(0), numberOfPoints, pixels->GetPointer(0)));
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigNode::ComputeRaysFromPixels(vtkDoubleArray* pixels, vtkIntArray* cameraIndices, vtkDoubleArray* markerToReferenceTransforms,
+    vtkDoubleArray* origins, vtkDoubleArray* directions)
+{
+  if (pixels == nullptr || cameraIndices == nullptr || origins == nullptr || directions == nullptr)
+  {
+    vtkErrorMacro("ComputeRaysFromPixels: invalid arguments.");
+    return false;
+  }
+  if (pixels->GetNumberOfComponents() != 2 || cameraIndices->GetNumberOfValues() != pixels->GetNumberOfTuples())
+  {
+    vtkErrorMacro("ComputeRaysFromPixels: pixels must have 2 components and one camera index each.");
+    return false;
+  }
+  this->UpdatePendingCameras();
+
+  const int numberOfCameras = this->GetNumberOfCameras();
+  const vtkIdType count = pixels->GetNumberOfTuples();
+  const int* indices = cameraIndices->GetPointer(0);
+  for (vtkIdType i = 0; i < count; ++i)
+  {
+    if (indices[i] < 0 || indices[i] >= numberOfCameras)
+    {
+      vtkErrorMacro("ComputeRaysFromPixels: invalid camera index " << indices[i] << " for pixel " << i);
+      return false;
+    }
+  }
+
+  std::vector<double> sensorToReference(16 * numberOfCameras);
+  if (!this->GetMarkerToReferenceTransforms(markerToReferenceTransforms, "ComputeRaysFromPixels", sensorToReference.data()))
+  {
+    return false;
+  }
+
+  origins->SetNumberOfComponents(3);
+  origins->SetNumberOfTuples(count);
+  directions->SetNumberOfComponents(3);
+  directions->SetNumberOfTuples(count);
+  if (count == 0)
+  {
+    return true;
+  }
+
+  std::vector<vtkPinholeCameraModel::CameraView> cameras(numberOfCameras);
+  std::vector<double> cameraOrigins(3 * numberOfCameras);
+  for (int i = 0; i < numberOfCameras; ++i)
+  {
+    cameras[i] = this->Internal->GetCameraView(i);
+
+    double markerToReference[16];
+    std::copy(&sensorToReference[16 * i], &sensorToReference[16 * i] + 16, markerToReference);
+    vtkMatrix4x4::Multiply4x4(markerToReference, &this->Internal->ImageSensorToMarker[16 * i], &sensorToReference[16 * i]);
+
+    // All rays of a camera share its origin
+    vtkPinholeCameraModel::ComputeRayOrigin(cameras[i], &sensorToReference[16 * i], &cameraOrigins[3 * i]);
+  }
+
+  vtkPinholeCameraModelTemplateMacro(this->Internal->RigDistortionModel,
+    ComputeRigRaysParallel<PINHOLE_CAMERA_MODEL>(cameras, sensorToReference.data(), cameraOrigins.data(), pixels->GetPointer(0), indices, count,
+        origins->GetPointer(0), directions->GetPointer(0)));
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigNode::PrintSelf(ostream& os, vtkIndent indent)
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfCameras: " << this->GetNumberOfCameras() << std::endl;
+  for (int i = 0; i < this->GetNumberOfCameras(); ++i)
+  {
+    os << indent << "Camera " << i << ": " << this->Internal->Names[i] << std::endl;
+    os << indent.GetNextIndent() << "DistortionModel: " << this->Internal->DistortionModels[i] << std::endl;
+    os << indent.GetNextIndent() << "ReprojectionError: " << this->Internal->ReprojectionErrors[i] << std::endl;
+    os << indent.GetNextIndent() << "RegistrationError: " << this->Internal->RegistrationErrors[i] << std::endl;
+    os << indent.GetNextIndent() << "TrackerLatency: " << this->Internal->TrackerLatencies[i] << std::endl;
+    os << indent.GetNextIndent() << "UndistortionMapFormat: "
+       << vtkMRMLPinholeCameraNode::GetUndistortionMapFormatAsString(this->Internal->UndistortionMapFormats[i]) << std::endl;
+  }
+}
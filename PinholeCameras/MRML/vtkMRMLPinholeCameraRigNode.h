@@ -0,0 +1,158 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkMRMLPinholeCameraRigNode.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkMRMLPinholeCameraRigNode_h
+#define __vtkMRMLPinholeCameraRigNode_h
+
+// MRML includes
+#include "vtkSlicerPinholeCamerasModuleMRMLExport.h"
+
+// MRML includes
+#include <vtkMRMLStorableNode.h>
+
+class vtkDoubleArray;
+class vtkIntArray;
+class vtkMatrix3x3;
+class vtkMatrix4x4;
+class vtkMRMLPinholeCameraNode;
+class vtkPoints;
+
+/// \brief MRML node holding all cameras of a tracked multi-camera rig.
+///
+/// Parameters of all member cameras are kept in contiguous structure-of-arrays buffers (all intrinsics, then all
+/// distortion coefficients, ...) instead of one vtkMRMLPinholeCameraNode with its own matrices and observers per
+/// camera. Projection and ray computation run over the whole rig in a single call.
+/// The rig is stored as a single file.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_MRML_EXPORT vtkMRMLPinholeCameraRigNode : public vtkMRMLStorableNode
+{
+public:
+  enum
+  {
+    CamerasModifiedEvent = 404101
+  };
+
+public:
+  static vtkMRMLPinholeCameraRigNode* New();
+  vtkTypeMacro(vtkMRMLPinholeCameraRigNode, vtkMRMLStorableNode);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  virtual vtkMRMLNode* CreateNodeInstance() override;
+
+  ///
+  /// Copy the node's attributes to this object
+  virtual void Copy(vtkMRMLNode* node) override;
+
+  ///
+  /// Get node XML tag name (like Volume, Model)
+  virtual const char* GetNodeTagName() override {return "PinholeCameraRig";};
+
+  virtual vtkMRMLStorageNode* CreateDefaultStorageNode() override;
+
+  ///
+  /// Number of cameras in the rig, new cameras have identity intrinsics and marker to sensor transform and no distortion
+  int GetNumberOfCameras() const;
+  void SetNumberOfCameras(int numberOfCameras);
+
+  ///
+  /// Append a camera, copying the parameters and name of a camera node. Return the index of the new camera.
+  int AddCamera(vtkMRMLPinholeCameraNode* cameraNode);
+  void RemoveCamera(int index);
+  void RemoveAllCameras();
+
+  ///
+  /// Copy all parameters of a camera node into an existing camera of the rig, or from the rig into a camera node
+  bool SetCamera(int index, vtkMRMLPinholeCameraNode* cameraNode);
+  bool GetCamera(int index, vtkMRMLPinholeCameraNode* cameraNode);
+
+  void SetCameraName(int index, const char* name);
+  const char* GetCameraName(int index);
+
+  void SetIntrinsics(int index, const double intrinsics[9]);
+  void GetIntrinsics(int index, double intrinsics[9]);
+  void SetIntrinsicMatrix(int index, vtkMatrix3x3* intrinsicMatrix);
+  void GetIntrinsicMatrix(int index, vtkMatrix3x3* intrinsicMatrix);
+
+  ///
+  /// Return false, leaving the camera unchanged, if there are more coefficients than the model supports (14)
+  bool SetDistortionCoefficientValues(int index, const double* values, int count);
+  bool SetDistortionCoefficientValues(int index, vtkDoubleArray* values);
+  int GetNumberOfDistortionCoefficients(int index);
+  double GetDistortionCoefficientValue(int index, int coefficient);
+
+  void SetMarkerToImageSensor(int index, const double markerToImageSensor[16]);
+  void GetMarkerToImageSensor(int index, double markerToImageSensor[16]);
+  void SetMarkerToImageSensorTransform(int index, vtkMatrix4x4* markerToImageSensorTransform);
+  void GetMarkerToImageSensorTransform(int index, vtkMatrix4x4* markerToImageSensorTransform);
+
+  void SetCameraPlaneOffset(int index, const double offset[3]);
+  void GetCameraPlaneOffset(int index, double offset[3]);
+
+  void SetReprojectionError(int index, double error);
+  double GetReprojectionError(int index);
+  void SetRegistrationError(int index, double error);
+  double GetRegistrationError(int index);
+
+  ///
+  /// Delay of the tracked pose of a camera behind its video frames, in seconds, see vtkMRMLPinholeCameraNode
+  void SetTrackerLatency(int index, double latency);
+  double GetTrackerLatency(int index);
+
+  ///
+  /// Undistortion map format of a camera, see vtkMRMLPinholeCameraNode::UndistortionMapFormat. Values out of range
+  /// are clamped like the camera node does.
+  void SetUndistortionMapFormat(int index, int format);
+  int GetUndistortionMapFormat(int index);
+
+  ///
+  /// Project reference points into every camera of the rig.
+  /// markerToReferenceTransforms holds one 16 component tuple (row major) per camera, or is null to project marker
+  /// coordinates. Pixels are written camera major: the pixel of point i in camera c is tuple c * numberOfPoints + i.
+  /// Points behind a camera are projected to NaN.
+  bool ProjectPoints(vtkPoints* points, vtkDoubleArray* markerToReferenceTransforms, vtkDoubleArray* pixels);
+
+  ///
+  /// Compute reference space rays through pixels of any camera of the rig.
+  /// cameraIndices holds the camera of each pixel, markerToReferenceTransforms is as for ProjectPoints.
+  bool ComputeRaysFromPixels(vtkDoubleArray* pixels, vtkIntArray* cameraIndices, vtkDoubleArray* markerToReferenceTransforms,
+                             vtkDoubleArray* origins, vtkDoubleArray* directions);
+
+protected:
+  /// Recompute the derived parameters of a camera and notify observers.
+  /// While modified events are disabled (see StartModify/EndModify) notifications are merged and derived parameters
+  /// are recomputed once per modified camera, when the block ends.
+  void CameraModified(int index);
+
+  /// Recompute the derived parameters of the cameras modified in the current StartModify/EndModify block
+  void UpdatePendingCameras();
+
+  /// Recompute pending derived parameters before notifying observers
+  virtual int InvokePendingModifiedEvent() override;
+
+  /// Return true if index refers to a camera of the rig, report an error otherwise
+  bool IsValidCameraIndex(int index, const char* caller);
+
+  /// Check and flatten per camera transforms, identity when none are given
+  bool GetMarkerToReferenceTransforms(vtkDoubleArray* markerToReferenceTransforms, const char* caller, double* transforms);
+
+protected:
+  vtkMRMLPinholeCameraRigNode();
+  ~vtkMRMLPinholeCameraRigNode();
+  vtkMRMLPinholeCameraRigNode(const vtkMRMLPinholeCameraRigNode&);
+  void operator=(const vtkMRMLPinholeCameraRigNode&);
+
+  class vtkInternal;
+  vtkInternal*        Internal;
+};
+
+#endif
@@ -0,0 +1,378 @@
+/*=auto=========================================================================
+
+  Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Program:   3D Slicer
+  Module:    $RCSfile: vtkMRMLPinholeCameraRigStorageNode.cxx,v $
+  Date:      $Date: 2018/6/16 10:54:09 $
+  Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraRigNode.h"
+#include "vtkMRMLPinholeCameraRigStorageNode.h"
+#include "vtkMRMLScene.h"
+#include "vtkPinholeCameraBinaryFile.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkStringArray.h>
+#include <vtksys/SystemTools.hxx>
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// OpenCV includes
+#include <opencv2/core/persistence.hpp>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  bool IsBinaryFileName(const std::string& fileName)
+  {
+    const std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(fileName));
+    return extension == ".pcb";
+  }
+
+  //----------------------------------------------------------------------------
+  /// Read a matrix entry of a camera, converted to double, or the default value if it is missing
+  cv::Mat ReadMatrix(const cv::FileNode& cameraNode, const char* name, const cv::Mat& defaultValue)
+  {
+    cv::Mat mat;
+    if (cameraNode[name].empty())
+    {
+      return defaultValue;
+    }
+    cameraNode[name] >> mat;
+    mat.convertTo(mat, CV_64F);
+    return mat;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+vtkMRMLNodeNewMacro(vtkMRMLPinholeCameraRigStorageNode);
+
+//----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigStorageNode::vtkMRMLPinholeCameraRigStorageNode()
+{
+  this->DefaultWriteFileExtension = "rig.xml";
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigStorageNode::~vtkMRMLPinholeCameraRigStorageNode()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigStorageNode::PrintSelf(ostream& os, vtkIndent indent)
+{
+  vtkMRMLStorageNode::PrintSelf(os, indent);
+}
+
+//----------------------------------------------------------------------------
+bool vtkMRMLPinholeCameraRigStorageNode::CanReadInReferenceNode(vtkMRMLNode* refNode)
+{
+  return refNode->IsA("vtkMRMLPinholeCameraRigNode");
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
+{
+  vtkMRMLPinholeCameraRigNode* rigNode = dynamic_cast <vtkMRMLPinholeCameraRigNode*>(refNode);
+
+  std::string fullName = this->GetFullNameFromFileName();
+  if (fullName.empty())
+  {
+    vtkErrorMacro("File name not specified");
+    return 0;
+  }
+
+  // check that the file exists
+  if (vtksys::SystemTools::FileExists(fullName.c_str()) == false)
+  {
+    vtkErrorMacro("Camera rig file '" << fullName.c_str() << "' not found.");
+    return 0;
+  }
+
+  if (IsBinaryFileName(fullName))
+  {
+    return this->ReadBinaryData(rigNode, fullName);
+  }
+
+  cv::FileStorage fs(fullName, cv::FileStorage::READ);
+  if (!fs.isOpened())
+  {
+    vtkErrorMacro("File cannot be opened for reading.");
+    return 0;
+  }
+
+  cv::FileNode camerasNode = fs["Cameras"];
+  if (camerasNode.type() != cv::FileNode::SEQ)
+  {
+    vtkErrorMacro("Camera rig file does not contain a Cameras sequence.");
+    return 0;
+  }
+
+  // Apply everything as one update so observers are notified once for the whole rig, and the derived parameters of
+  // each camera are computed once, when the update ends
+  int wasModifying = rigNode->StartModify();
+  rigNode->SetNumberOfCameras(static_cast<int>(camerasNode.size()));
+
+  int index = 0;
+  for (cv::FileNodeIterator it = camerasNode.begin(); it != camerasNode.end(); ++it, ++index)
+  {
+    const cv::FileNode& cameraNode = *it;
+
+    std::string name;
+    if (!cameraNode["Name"].empty())
+    {
+      cameraNode["Name"] >> name;
+    }
+    rigNode->SetCameraName(index, name.c_str());
+
+    cv::Mat intrinMat = ReadMatrix(cameraNode, "IntrinsicMatrix", cv::Mat::eye(3, 3, CV_64F));
+    cv::Mat distCoeffs = ReadMatrix(cameraNode, "DistortionCoefficients", cv::Mat::zeros(5, 1, CV_64F));
+    cv::Mat markerToSensor = ReadMatrix(cameraNode, "MarkerToSensor", cv::Mat::eye(4, 4, CV_64F));
+    cv::Mat cameraPlaneOffset = ReadMatrix(cameraNode, "CameraPlaneOffset", cv::Mat::zeros(3, 1, CV_64F));
+    if (intrinMat.total() != 9 || markerToSensor.total() != 16 || cameraPlaneOffset.total() < 3)
+    {
+      vtkErrorMacro("Camera " << index << " of the rig file has invalid parameters.");
+      rigNode->EndModify(wasModifying);
+      return 0;
+    }
+
+    rigNode->SetIntrinsics(index, intrinMat.ptr<double>());
+    if (!rigNode->SetDistortionCoefficientValues(index, distCoeffs.ptr<double>(), static_cast<int>(distCoeffs.total())))
+    {
+      vtkErrorMacro("Camera " << index << " of the rig file has invalid distortion coefficients.");
+      rigNode->EndModify(wasModifying);
+      return 0;
+    }
+    rigNode->SetMarkerToImageSensor(index, markerToSensor.ptr<double>());
+    rigNode->SetCameraPlaneOffset(index, cameraPlaneOffset.ptr<double>());
+
+    if (!cameraNode["ReprojectionError"].empty())
+    {
+      rigNode->SetReprojectionError(index, (double)cameraNode["ReprojectionError"]);
+    }
+    if (!cameraNode["RegistrationError"].empty())
+    {
+      rigNode->SetRegistrationError(index, (double)cameraNode["RegistrationError"]);
+    }
+    // Files written before latency estimation have none, the tracker is then assumed in sync with the video
+    rigNode->SetTrackerLatency(index, cameraNode["TrackerLatency"].empty() ? 0.0 : (double)cameraNode["TrackerLatency"]);
+
+    int format = vtkMRMLPinholeCameraNode::UndistortionMapFloat;
+    if (!cameraNode["UndistortionMapFormat"].empty())
+    {
+      std::string formatName = (std::string)cameraNode["UndistortionMapFormat"];
+      format = vtkMRMLPinholeCameraNode::GetUndistortionMapFormatFromString(formatName.c_str());
+      if (format < 0)
+      {
+        vtkWarningMacro("Unknown undistortion map format '" << formatName << "' for camera " << index << ", using float maps.");
+        format = vtkMRMLPinholeCameraNode::UndistortionMapFloat;
+      }
+    }
+    rigNode->SetUndistortionMapFormat(index, format);
+  }
+
+  rigNode->EndModify(wasModifying);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigStorageNode::WriteDataInternal(vtkMRMLNode* refNode)
+{
+  vtkMRMLPinholeCameraRigNode* rigNode = vtkMRMLPinholeCameraRigNode::SafeDownCast(refNode);
+
+  std::string fullName = this->GetFullNameFromFileName();
+  if (fullName.empty())
+  {
+    vtkErrorMacro("File name not specified");
+    return 0;
+  }
+
+  if (IsBinaryFileName(fullName))
+  {
+    return this->WriteBinaryData(rigNode, fullName);
+  }
+
+  cv::FileStorage fs(fullName, cv::FileStorage::WRITE);
+
+  if (!fs.isOpened())
+  {
+    vtkErrorMacro("Cannot open " << fullName << " for writing.");
+    return 0;
+  }
+
+  fs << "Cameras" << "[";
+  for (int index = 0; index < rigNode->GetNumberOfCameras(); ++index)
+  {
+    fs << "{";
+    fs << "Name" << std::string(rigNode->GetCameraName(index));
+
+    cv::Mat intrinMat(3, 3, CV_64F);
+    rigNode->GetIntrinsics(index, intrinMat.ptr<double>());
+    fs << "IntrinsicMatrix" << intrinMat;
+
+    cv::Mat distCoeffs(rigNode->GetNumberOfDistortionCoefficients(index), 1, CV_64F);
+    for (int i = 0; i < distCoeffs.rows; ++i)
+    {
+      distCoeffs.at<double>(i, 0) = rigNode->GetDistortionCoefficientValue(index, i);
+    }
+    fs << "DistortionCoefficients" << distCoeffs;
+
+    cv::Mat markerToSensor(4, 4, CV_64F);
+    rigNode->GetMarkerToImageSensor(index, markerToSensor.ptr<double>());
+    fs << "MarkerToSensor" << markerToSensor;
+
+    cv::Mat planeOffsets(3, 1, CV_64F);
+    rigNode->GetCameraPlaneOffset(index, planeOffsets.ptr<double>());
+    fs << "CameraPlaneOffset" << planeOffsets;
+
+    if (rigNode->GetReprojectionError(index) != -1.0)
+    {
+      fs << "ReprojectionError" << rigNode->GetReprojectionError(index);
+    }
+    if (rigNode->GetRegistrationError(index) != -1.0)
+    {
+      fs << "RegistrationError" << rigNode->GetRegistrationError(index);
+    }
+    fs << "TrackerLatency" << rigNode->GetTrackerLatency(index);
+    fs << "UndistortionMapFormat" << vtkMRMLPinholeCameraNode::GetUndistortionMapFormatAsString(rigNode->GetUndistortionMapFormat(index));
+    fs << "}";
+  }
+  fs << "]";
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigStorageNode::ReadBinaryData(vtkMRMLPinholeCameraRigNode* rigNode, const std::string& fullName)
+{
+  vtkPinholeCameraBinaryFile file;
+  if (!file.Open(fullName))
+  {
+    vtkErrorMacro("Unable to read '" << fullName << "': " << file.GetErrorMessage());
+    return 0;
+  }
+
+  // Records are copied from the mapped file, fields missing from older versions keep their defaults
+  int wasModifying = rigNode->StartModify();
+  rigNode->SetNumberOfCameras(file.GetNumberOfCameras());
+  for (int index = 0; index < file.GetNumberOfCameras(); ++index)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord record;
+    file.ReadCamera(index, record);
+    if (record.NumberOfDistortionCoefficients > vtkPinholeCameraBinaryFile::MaximumNumberOfDistortionCoefficients)
+    {
+      vtkErrorMacro("Camera " << index << " of the rig file has an invalid number of distortion coefficients.");
+      rigNode->EndModify(wasModifying);
+      return 0;
+    }
+
+    std::string name(record.Name, std::find(record.Name, record.Name + vtkPinholeCameraBinaryFile::MaximumNameLength, '\0'));
+    rigNode->SetCameraName(index, name.c_str());
+    rigNode->SetIntrinsics(index, record.Intrinsics);
+    if (!rigNode->SetDistortionCoefficientValues(index, record.DistortionCoefficients, static_cast<int>(record.NumberOfDistortionCoefficients)))
+    {
+      vtkErrorMacro("Camera " << index << " of the rig file has invalid distortion coefficients.");
+      rigNode->EndModify(wasModifying);
+      return 0;
+    }
+    rigNode->SetMarkerToImageSensor(index, record.MarkerToImageSensor);
+    rigNode->SetCameraPlaneOffset(index, record.CameraPlaneOffset);
+    rigNode->SetReprojectionError(index, record.ReprojectionError);
+    rigNode->SetRegistrationError(index, record.RegistrationError);
+    rigNode->SetTrackerLatency(index, record.TrackerLatency);
+    // Unknown formats (a writer that left the field set to something else) fall back to float maps
+    rigNode->SetUndistortionMapFormat(index, record.UndistortionMapFormat < static_cast<std::uint32_t>(vtkMRMLPinholeCameraNode::UndistortionMapFormat_Last) ?
+                                      static_cast<int>(record.UndistortionMapFormat) : vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+  }
+  rigNode->EndModify(wasModifying);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigStorageNode::WriteBinaryData(vtkMRMLPinholeCameraRigNode* rigNode, const std::string& fullName)
+{
+  std::vector<vtkPinholeCameraBinaryFile::CameraRecord> records(rigNode->GetNumberOfCameras());
+  for (int index = 0; index < rigNode->GetNumberOfCameras(); ++index)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord& record = records[index];
+    vtkPinholeCameraBinaryFile::InitializeRecord(record);
+
+    std::strncpy(record.Name, rigNode->GetCameraName(index), vtkPinholeCameraBinaryFile::MaximumNameLength - 1);
+    rigNode->GetIntrinsics(index, record.Intrinsics);
+    record.NumberOfDistortionCoefficients = static_cast<std::uint32_t>(rigNode->GetNumberOfDistortionCoefficients(index));
+    for (std::uint32_t i = 0; i < record.NumberOfDistortionCoefficients; ++i)
+    {
+      record.DistortionCoefficients[i] = rigNode->GetDistortionCoefficientValue(index, static_cast<int>(i));
+    }
+    rigNode->GetMarkerToImageSensor(index, record.MarkerToImageSensor);
+    rigNode->GetCameraPlaneOffset(index, record.CameraPlaneOffset);
+    record.ReprojectionError = rigNode->GetReprojectionError(index);
+    record.RegistrationError = rigNode->GetRegistrationError(index);
+    record.TrackerLatency = rigNode->GetTrackerLatency(index);
+    record.UndistortionMapFormat = static_cast<std::uint32_t>(rigNode->GetUndistortionMapFormat(index));
+  }
+
+  std::string errorMessage;
+  if (!vtkPinholeCameraBinaryFile::Write(fullName, records.data(), static_cast<int>(records.size()), errorMessage))
+  {
+    vtkErrorMacro(errorMessage);
+    return 0;
+  }
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigStorageNode::InitializeSupportedReadFileTypes()
+{
+  this->SupportedReadFileTypes->InsertNextValue("Pinhole Camera Rig (.rig.xml)");
+  this->SupportedReadFileTypes->InsertNextValue("Pinhole Camera Rig Binary (.rig.pcb)");
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLPinholeCameraRigStorageNode::InitializeSupportedWriteFileTypes()
+{
+  this->SupportedWriteFileTypes->InsertNextValue("Pinhole Camera Rig (.rig.xml)");
+  this->SupportedWriteFileTypes->InsertNextValue("Pinhole Camera Rig Binary (.rig.pcb)");
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLPinholeCameraRigNode* vtkMRMLPinholeCameraRigStorageNode::GetAssociatedDataNode()
+{
+  if (!this->GetScene())
+  {
+    return NULL;
+  }
+
+  std::vector<vtkMRMLNode*> nodes;
+  unsigned int numberOfNodes = this->GetScene()->GetNodesByClass("vtkMRMLPinholeCameraRigNode", nodes);
+  for (unsigned int nodeIndex = 0; nodeIndex < numberOfNodes; nodeIndex++)
+  {
+    vtkMRMLPinholeCameraRigNode* node = vtkMRMLPinholeCameraRigNode::SafeDownCast(nodes[nodeIndex]);
+    if (node)
+    {
+      const char* storageNodeID = node->GetStorageNodeID();
+      if (storageNodeID && !strcmp(storageNodeID, this->ID))
+      {
+        return vtkMRMLPinholeCameraRigNode::SafeDownCast(node);
+      }
+    }
+  }
+
+  return NULL;
+}
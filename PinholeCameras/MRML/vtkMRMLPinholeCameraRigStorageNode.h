@@ -0,0 +1,72 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkMRMLPinholeCameraRigStorageNode.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkMRMLPinholeCameraRigStorageNode_h
+#define __vtkMRMLPinholeCameraRigStorageNode_h
+
+// MRML includes
+#include "vtkSlicerPinholeCamerasModuleMRMLExport.h"
+
+// Slicer includes
+#include "vtkMRMLStorageNode.h"
+
+class vtkMRMLPinholeCameraRigNode;
+
+/// \brief MRML node for camera rig storage on disk.
+///
+/// All cameras of a rig are read from and written to a single OpenCV XML file.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_MRML_EXPORT vtkMRMLPinholeCameraRigStorageNode : public vtkMRMLStorageNode
+{
+public:
+  static vtkMRMLPinholeCameraRigStorageNode* New();
+  vtkTypeMacro(vtkMRMLPinholeCameraRigStorageNode, vtkMRMLStorageNode);
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+
+  virtual vtkMRMLNode* CreateNodeInstance() override;
+
+  ///
+  /// Get node XML tag name (like Storage, Model)
+  virtual const char* GetNodeTagName() override {return "PinholeCameraRigStorage";}
+
+  /// Return true if the reference node can be read in
+  virtual bool CanReadInReferenceNode(vtkMRMLNode* refNode) override;
+
+protected:
+  vtkMRMLPinholeCameraRigStorageNode();
+  ~vtkMRMLPinholeCameraRigStorageNode();
+  vtkMRMLPinholeCameraRigStorageNode(const vtkMRMLPinholeCameraRigStorageNode&);
+  void operator=(const vtkMRMLPinholeCameraRigStorageNode&);
+
+  /// Initialize all the supported read file types
+  virtual void InitializeSupportedReadFileTypes() override;
+
+  /// Initialize all the supported write file types
+  virtual void InitializeSupportedWriteFileTypes() override;
+
+  /// Get data node that is associated with this storage node
+  vtkMRMLPinholeCameraRigNode* GetAssociatedDataNode();
+
+  /// Read data and set it in the referenced node
+  virtual int ReadDataInternal(vtkMRMLNode* refNode) override;
+
+  /// Write data from a  referenced node
+  virtual int WriteDataInternal(vtkMRMLNode* refNode) override;
+
+  /// Read and write the memory-mapped binary format, see vtkPinholeCameraBinaryFile
+  int ReadBinaryData(vtkMRMLPinholeCameraRigNode* node, const std::string& fullName);
+  int WriteBinaryData(vtkMRMLPinholeCameraRigNode* node, const std::string& fullName);
+
+};
+
+#endif
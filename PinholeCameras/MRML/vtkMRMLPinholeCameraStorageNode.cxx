@@ -15,6 +15,7 @@
 #include "vtkMRMLPinholeCameraNode.h"
 #include "vtkMRMLPinholeCameraStorageNode.h"
 #include "vtkMRMLScene.h"
+#include "vtkPinholeCameraBinaryFile.h"
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -22,10 +23,24 @@
 #include <vtkVersion.h>
 #include <vtksys/SystemTools.hxx>
 
+// STL includes
+#include <algorithm>
+#include <cstring>
+
 // OpenCV includes
 #include <opencv2/videoio.hpp>
 #include <opencv2/core/persistence.hpp>
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  bool IsBinaryFileName(const std::string& fileName)
+  {
+    const std::string extension = vtksys::SystemTools::LowerCase(vtksys::SystemTools::GetFilenameLastExtension(fileName));
+    return extension == ".pcb";
+  }
+}
+
 //----------------------------------------------------------------------------
 
 vtkMRMLNodeNewMacro(vtkMRMLPinholeCameraStorageNode);
@@ -72,6 +87,11 @@ int vtkMRMLPinholeCameraStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
     return 0;
   }
 
+  if (IsBinaryFileName(fullName))
+  {
+    return this->ReadBinaryData(cameraNode, fullName);
+  }
+
   // compute file prefix
   cv::FileStorage fs(fullName, cv::FileStorage::READ);
   if (!fs.isOpened())
@@ -128,6 +148,14 @@ int vtkMRMLPinholeCameraStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
     cameraPlaneNode >> cameraPlaneOffset;
   }
 
+  intrinMat.convertTo(intrinMat, CV_64F);
+  distCoeffs.convertTo(distCoeffs, CV_64F);
+  markerToSensor.convertTo(markerToSensor, CV_64F);
+  cameraPlaneOffset.convertTo(cameraPlaneOffset, CV_64F);
+
+  // Apply everything as one update so observers are notified once per parameter
+  int wasModifying = cameraNode->StartModify();
+
   if (!fs["ReprojectionError"].empty())
   {
     cameraNode->SetReprojectionError((double)fs["ReprojectionError"]);
@@ -138,10 +166,20 @@ int vtkMRMLPinholeCameraStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
     cameraNode->SetRegistrationError((double)fs["RegistrationError"]);
   }
 
-  intrinMat.convertTo(intrinMat, CV_64F);
-  distCoeffs.convertTo(distCoeffs, CV_64F);
-  markerToSensor.convertTo(markerToSensor, CV_64F);
-  cameraPlaneOffset.convertTo(cameraPlaneOffset, CV_64F);
+  // Files written before latency estimation have none, the tracker is then assumed in sync with the video
+  cameraNode->SetTrackerLatency(fs["TrackerLatency"].empty() ? 0.0 : (double)fs["TrackerLatency"]);
+
+  if (!fs["UndistortionMapFormat"].empty())
+  {
+    std::string formatName = (std::string)fs["UndistortionMapFormat"];
+    int format = vtkMRMLPinholeCameraNode::GetUndistortionMapFormatFromString(formatName.c_str());
+    if (format < 0)
+    {
+      vtkWarningMacro("Unknown undistortion map format '" << formatName << "', using float maps.");
+      format = vtkMRMLPinholeCameraNode::UndistortionMapFloat;
+    }
+    cameraNode->SetUndistortionMapFormat(format);
+  }
 
   vtkNew<vtkMatrix3x3> mat;
   for (int i = 0; i < 3; ++i)
@@ -153,11 +191,7 @@ int vtkMRMLPinholeCameraStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
   }
   cameraNode->SetAndObserveIntrinsicMatrix(mat);
 
-  for (int i = 0; i < distCoeffs.rows; ++i)
-  {
-    cameraNode->SetNumberOfDistortionCoefficients(distCoeffs.rows);
-    cameraNode->SetDistortionCoefficientValue(i, cameraPlaneOffset.at<double>(i, 0));
-  }
+  cameraNode->SetDistortionCoefficientValues(distCoeffs.ptr<double>(), static_cast<vtkIdType>(distCoeffs.total()));
 
   vtkNew<vtkMatrix4x4> markerToImageSensor;
   for (int i = 0; i < 4; ++i)
@@ -169,10 +203,14 @@ int vtkMRMLPinholeCameraStorageNode::ReadDataInternal(vtkMRMLNode* refNode)
   }
   cameraNode->SetAndObserveMarkerToImageSensorTransform(markerToImageSensor);
 
-  for (int i = 0; i < cameraPlaneOffset.rows; ++i)
+  double offset[3] = { 0.0, 0.0, 0.0 };
+  for (int i = 0; i < std::min<int>(3, static_cast<int>(cameraPlaneOffset.total())); ++i)
   {
-    cameraNode->SetCameraPlaneOffsetValue(i, cameraPlaneOffset.at<double>(i, 0));
+    offset[i] = cameraPlaneOffset.ptr<double>()[i];
   }
+  cameraNode->SetCameraPlaneOffsetValues(offset);
+
+  cameraNode->EndModify(wasModifying);
 
   return 1;
 }
@@ -189,6 +227,11 @@ int vtkMRMLPinholeCameraStorageNode::WriteDataInternal(vtkMRMLNode* refNode)
     return 0;
   }
 
+  if (IsBinaryFileName(fullName))
+  {
+    return this->WriteBinaryData(PinholeCameraNode, fullName);
+  }
+
   cv::FileStorage fs(fullName, cv::FileStorage::WRITE);
 
   if (!fs.isOpened())
@@ -265,6 +308,115 @@ int vtkMRMLPinholeCameraStorageNode::WriteDataInternal(vtkMRMLNode* refNode)
     fs << "RegistrationError" << PinholeCameraNode->GetRegistrationError();
   }
 
+  fs << "TrackerLatency" << PinholeCameraNode->GetTrackerLatency();
+
+  fs << "UndistortionMapFormat" << vtkMRMLPinholeCameraNode::GetUndistortionMapFormatAsString(PinholeCameraNode->GetUndistortionMapFormat());
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraStorageNode::ReadBinaryData(vtkMRMLPinholeCameraNode* cameraNode, const std::string& fullName)
+{
+  vtkPinholeCameraBinaryFile file;
+  if (!file.Open(fullName))
+  {
+    vtkErrorMacro("Unable to read '" << fullName << "': " << file.GetErrorMessage());
+    return 0;
+  }
+  if (file.GetNumberOfCameras() != 1)
+  {
+    vtkErrorMacro("Camera file '" << fullName << "' holds " << file.GetNumberOfCameras() << " cameras, load it as a camera rig.");
+    return 0;
+  }
+
+  // Records of older versions are shorter, copy the stored fields over the defaults of the current version
+  vtkPinholeCameraBinaryFile::CameraRecord record;
+  file.ReadCamera(0, record);
+  if (record.NumberOfDistortionCoefficients > vtkPinholeCameraBinaryFile::MaximumNumberOfDistortionCoefficients)
+  {
+    vtkErrorMacro("Camera file '" << fullName << "' has an invalid number of distortion coefficients.");
+    return 0;
+  }
+
+  int wasModifying = cameraNode->StartModify();
+
+  cameraNode->SetReprojectionError(record.ReprojectionError);
+  cameraNode->SetRegistrationError(record.RegistrationError);
+  cameraNode->SetTrackerLatency(record.TrackerLatency);
+  // Unknown formats (a writer that left the field set to something else) fall back to float maps
+  cameraNode->SetUndistortionMapFormat(record.UndistortionMapFormat < static_cast<std::uint32_t>(vtkMRMLPinholeCameraNode::UndistortionMapFormat_Last) ?
+                                       static_cast<int>(record.UndistortionMapFormat) : vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+
+  vtkNew<vtkMatrix3x3> mat;
+  std::copy(record.Intrinsics, record.Intrinsics + 9, mat->GetData());
+  cameraNode->SetAndObserveIntrinsicMatrix(mat);
+
+  cameraNode->SetDistortionCoefficientValues(record.DistortionCoefficients, record.NumberOfDistortionCoefficients);
+
+  vtkNew<vtkMatrix4x4> markerToImageSensor;
+  markerToImageSensor->DeepCopy(record.MarkerToImageSensor);
+  cameraNode->SetAndObserveMarkerToImageSensorTransform(markerToImageSensor);
+
+  cameraNode->SetCameraPlaneOffsetValues(record.CameraPlaneOffset);
+
+  cameraNode->EndModify(wasModifying);
+
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraStorageNode::WriteBinaryData(vtkMRMLPinholeCameraNode* cameraNode, const std::string& fullName)
+{
+  vtkPinholeCameraBinaryFile::CameraRecord record;
+  vtkPinholeCameraBinaryFile::InitializeRecord(record);
+
+  if (cameraNode->GetIntrinsicMatrix() != NULL)
+  {
+    std::copy(cameraNode->GetIntrinsicMatrix()->GetData(), cameraNode->GetIntrinsicMatrix()->GetData() + 9, record.Intrinsics);
+  }
+
+  // Same as the XML format, cameras without distortion are stored with 5 zero coefficients
+  record.NumberOfDistortionCoefficients = 5;
+  if (cameraNode->HasDistortionCoefficents())
+  {
+    if (cameraNode->GetNumberOfDistortionCoefficients() > vtkPinholeCameraBinaryFile::MaximumNumberOfDistortionCoefficients)
+    {
+      vtkErrorMacro("Binary camera files support at most 14 distortion coefficients.");
+      return 0;
+    }
+    record.NumberOfDistortionCoefficients = static_cast<std::uint32_t>(cameraNode->GetNumberOfDistortionCoefficients());
+    for (std::uint32_t i = 0; i < record.NumberOfDistortionCoefficients; ++i)
+    {
+      record.DistortionCoefficients[i] = cameraNode->GetDistortionCoefficientValue(i);
+    }
+  }
+
+  if (cameraNode->GetMarkerToImageSensorTransform() != NULL)
+  {
+    vtkMatrix4x4::DeepCopy(record.MarkerToImageSensor, cameraNode->GetMarkerToImageSensorTransform());
+  }
+
+  for (int i = 0; i < 3; ++i)
+  {
+    record.CameraPlaneOffset[i] = cameraNode->GetCameraPlaneOffsetValue(i);
+  }
+  record.ReprojectionError = cameraNode->GetReprojectionError();
+  record.RegistrationError = cameraNode->GetRegistrationError();
+  record.TrackerLatency = cameraNode->GetTrackerLatency();
+  record.UndistortionMapFormat = static_cast<std::uint32_t>(cameraNode->GetUndistortionMapFormat());
+  if (cameraNode->GetName() != NULL)
+  {
+    std::strncpy(record.Name, cameraNode->GetName(), vtkPinholeCameraBinaryFile::MaximumNameLength - 1);
+  }
+
+  std::string errorMessage;
+  if (!vtkPinholeCameraBinaryFile::Write(fullName, &record, 1, errorMessage))
+  {
+    vtkErrorMacro(errorMessage);
+    return 0;
+  }
+
   return 1;
 }
 
@@ -272,12 +424,14 @@ int vtkMRMLPinholeCameraStorageNode::WriteDataInternal(vtkMRMLNode* refNode)
 void vtkMRMLPinholeCameraStorageNode::InitializeSupportedReadFileTypes()
 {
   this->SupportedReadFileTypes->InsertNextValue("OpenCV XML (.xml)");
+  this->SupportedReadFileTypes->InsertNextValue("Pinhole Camera Binary (.pcb)");
 }
 
 //----------------------------------------------------------------------------
 void vtkMRMLPinholeCameraStorageNode::InitializeSupportedWriteFileTypes()
 {
   this->SupportedWriteFileTypes->InsertNextValue("OpenCV XML (.xml)");
+  this->SupportedWriteFileTypes->InsertNextValue("Pinhole Camera Binary (.pcb)");
 }
 
 //----------------------------------------------------------------------------
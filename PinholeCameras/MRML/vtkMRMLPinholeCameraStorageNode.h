@@ -63,6 +63,10 @@ protected:
   /// Write data from a  referenced node
   virtual int WriteDataInternal(vtkMRMLNode* refNode) override;
 
+  /// Read and write the memory-mapped binary format, see vtkPinholeCameraBinaryFile
+  int ReadBinaryData(vtkMRMLPinholeCameraNode* node, const std::string& fullName);
+  int WriteBinaryData(vtkMRMLPinholeCameraNode* node, const std::string& fullName);
+
 };
 
 #endif
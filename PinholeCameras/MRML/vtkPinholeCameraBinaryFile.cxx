@@ -0,0 +1,387 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraBinaryFile.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#include "vtkPinholeCameraBinaryFile.h"
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// OS includes
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const char MAGIC[4] = { 'P', 'H', 'C', 'B' };
+  const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+  //----------------------------------------------------------------------------
+  struct FileHeader
+  {
+    char            Magic[4];
+    std::uint32_t   ByteOrderMark;
+    std::uint32_t   Version;
+    std::uint32_t   HeaderSize;
+    std::uint32_t   RecordSize;
+    std::uint32_t   NumberOfCameras;
+    std::uint32_t   Reserved[2];
+  };
+
+  static_assert(sizeof(FileHeader) == 32, "Binary camera file header must be 32 bytes");
+  static_assert(sizeof(vtkPinholeCameraBinaryFile::CameraRecord) % 8 == 0, "Binary camera records must keep doubles aligned");
+
+  //----------------------------------------------------------------------------
+  struct ChecksumTable
+  {
+    std::uint32_t Values[256];
+
+    ChecksumTable()
+    {
+      for (std::uint32_t i = 0; i < 256; ++i)
+      {
+        std::uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+          value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+        }
+        this->Values[i] = value;
+      }
+    }
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkPinholeCameraBinaryFile::vtkInternal
+{
+public:
+  bool Map(const std::string& fileName);
+  void Unmap();
+
+  const unsigned char*  Data = nullptr;
+  std::size_t           Size = 0;
+  std::string           ErrorMessage;
+
+#ifdef _WIN32
+  HANDLE                File = INVALID_HANDLE_VALUE;
+  HANDLE                Mapping = NULL;
+#else
+  int                   File = -1;
+#endif
+};
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraBinaryFile::vtkInternal::Map(const std::string& fileName)
+{
+#ifdef _WIN32
+  this->File = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (this->File == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(this->File, &size) || size.QuadPart == 0)
+  {
+    return false;
+  }
+  this->Size = static_cast<std::size_t>(size.QuadPart);
+  this->Mapping = CreateFileMappingA(this->File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (this->Mapping == NULL)
+  {
+    return false;
+  }
+  this->Data = static_cast<const unsigned char*>(MapViewOfFile(this->Mapping, FILE_MAP_READ, 0, 0, 0));
+  return this->Data != nullptr;
+#else
+  this->File = open(fileName.c_str(), O_RDONLY);
+  if (this->File < 0)
+  {
+    return false;
+  }
+  struct stat fileStat;
+  if (fstat(this->File, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    return false;
+  }
+  this->Size = static_cast<std::size_t>(fileStat.st_size);
+  void* data = mmap(nullptr, this->Size, PROT_READ, MAP_PRIVATE, this->File, 0);
+  if (data == MAP_FAILED)
+  {
+    return false;
+  }
+  this->Data = static_cast<const unsigned char*>(data);
+  return true;
+#endif
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraBinaryFile::vtkInternal::Unmap()
+{
+#ifdef _WIN32
+  if (this->Data != nullptr)
+  {
+    UnmapViewOfFile(this->Data);
+  }
+  if (this->Mapping != NULL)
+  {
+    CloseHandle(this->Mapping);
+  }
+  if (this->File != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(this->File);
+  }
+  this->Mapping = NULL;
+  this->File = INVALID_HANDLE_VALUE;
+#else
+  if (this->Data != nullptr)
+  {
+    munmap(const_cast<unsigned char*>(this->Data), this->Size);
+  }
+  if (this->File >= 0)
+  {
+    close(this->File);
+  }
+  this->File = -1;
+#endif
+  this->Data = nullptr;
+  this->Size = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraBinaryFile::vtkPinholeCameraBinaryFile()
+  : Internal(new vtkInternal())
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPinholeCameraBinaryFile::~vtkPinholeCameraBinaryFile()
+{
+  this->Close();
+  delete this->Internal;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraBinaryFile::Open(const std::string& fileName)
+{
+  this->Close();
+
+  if (!this->Internal->Map(fileName))
+  {
+    this->Close();
+    this->Internal->ErrorMessage = "Unable to map file " + fileName;
+    return false;
+  }
+
+  const std::size_t size = this->Internal->Size;
+  if (size < sizeof(FileHeader) + sizeof(std::uint32_t))
+  {
+    this->Close();
+    this->Internal->ErrorMessage = "File is too small to be a binary camera file.";
+    return false;
+  }
+
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(this->Internal->Data);
+  std::string error;
+  if (std::memcmp(header->Magic, MAGIC, sizeof(MAGIC)) != 0)
+  {
+    error = "File is not a binary camera file.";
+  }
+  else if (header->ByteOrderMark != BYTE_ORDER_MARK)
+  {
+    error = "File was written with an unsupported byte order.";
+  }
+  else if (header->Version == 0 || header->Version > CurrentVersion)
+  {
+    error = "Unsupported binary camera file version " + std::to_string(header->Version) + ".";
+  }
+  else if (header->HeaderSize < sizeof(FileHeader) || header->HeaderSize % 8 != 0 ||
+           header->RecordSize < GetRecordSize(header->Version) || header->RecordSize % 8 != 0)
+  {
+    error = "Binary camera file has an invalid layout.";
+  }
+  else if (static_cast<std::size_t>(header->HeaderSize) + static_cast<std::size_t>(header->RecordSize) * header->NumberOfCameras + sizeof(std::uint32_t) != size)
+  {
+    error = "Binary camera file is truncated or has trailing data.";
+  }
+  else
+  {
+    std::uint32_t storedChecksum;
+    std::memcpy(&storedChecksum, this->Internal->Data + size - sizeof(std::uint32_t), sizeof(std::uint32_t));
+    if (ComputeChecksum(this->Internal->Data, size - sizeof(std::uint32_t)) != storedChecksum)
+    {
+      error = "Binary camera file checksum does not match, the file is corrupted.";
+    }
+  }
+
+  if (!error.empty())
+  {
+    this->Close();
+    this->Internal->ErrorMessage = error;
+    return false;
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraBinaryFile::Close()
+{
+  this->Internal->Unmap();
+  this->Internal->ErrorMessage.clear();
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraBinaryFile::GetNumberOfCameras() const
+{
+  if (this->Internal->Data == nullptr)
+  {
+    return 0;
+  }
+  return static_cast<int>(reinterpret_cast<const FileHeader*>(this->Internal->Data)->NumberOfCameras);
+}
+
+//----------------------------------------------------------------------------
+std::uint32_t vtkPinholeCameraBinaryFile::GetVersion() const
+{
+  if (this->Internal->Data == nullptr)
+  {
+    return 0;
+  }
+  return reinterpret_cast<const FileHeader*>(this->Internal->Data)->Version;
+}
+
+//----------------------------------------------------------------------------
+const vtkPinholeCameraBinaryFile::CameraRecord* vtkPinholeCameraBinaryFile::GetCamera(int index) const
+{
+  if (index < 0 || index >= this->GetNumberOfCameras())
+  {
+    return nullptr;
+  }
+
+  const FileHeader* header = reinterpret_cast<const FileHeader*>(this->Internal->Data);
+  return reinterpret_cast<const CameraRecord*>(this->Internal->Data + header->HeaderSize + static_cast<std::size_t>(header->RecordSize) * index);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraBinaryFile::ReadCamera(int index, CameraRecord& record) const
+{
+  const CameraRecord* storedRecord = this->GetCamera(index);
+  InitializeRecord(record);
+  if (storedRecord == nullptr)
+  {
+    return false;
+  }
+
+  const std::size_t recordSize = reinterpret_cast<const FileHeader*>(this->Internal->Data)->RecordSize;
+  std::memcpy(&record, storedRecord, std::min(recordSize, sizeof(CameraRecord)));
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::size_t vtkPinholeCameraBinaryFile::GetRecordSize(std::uint32_t version)
+{
+  switch (version)
+  {
+    case 1:
+      return offsetof(CameraRecord, TrackerLatency);
+    case 2:
+      return sizeof(CameraRecord);
+    default:
+      return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+const std::string& vtkPinholeCameraBinaryFile::GetErrorMessage() const
+{
+  return this->Internal->ErrorMessage;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPinholeCameraBinaryFile::Write(const std::string& fileName, const CameraRecord* records, int numberOfCameras, std::string& errorMessage)
+{
+  if (numberOfCameras < 0 || (records == nullptr && numberOfCameras > 0))
+  {
+    errorMessage = "Invalid camera records.";
+    return false;
+  }
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+  header.ByteOrderMark = BYTE_ORDER_MARK;
+  header.Version = CurrentVersion;
+  header.HeaderSize = sizeof(FileHeader);
+  header.RecordSize = sizeof(CameraRecord);
+  header.NumberOfCameras = static_cast<std::uint32_t>(numberOfCameras);
+
+  // Assemble the whole file in memory, it is small and the checksum covers all of it
+  std::vector<unsigned char> buffer(sizeof(FileHeader) + sizeof(CameraRecord) * numberOfCameras + sizeof(std::uint32_t));
+  std::memcpy(buffer.data(), &header, sizeof(FileHeader));
+  if (numberOfCameras > 0)
+  {
+    std::memcpy(buffer.data() + sizeof(FileHeader), records, sizeof(CameraRecord) * numberOfCameras);
+  }
+  const std::uint32_t checksum = ComputeChecksum(buffer.data(), buffer.size() - sizeof(std::uint32_t));
+  std::memcpy(buffer.data() + buffer.size() - sizeof(std::uint32_t), &checksum, sizeof(std::uint32_t));
+
+  std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    errorMessage = "Cannot open " + fileName + " for writing.";
+    return false;
+  }
+  file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+  if (!file)
+  {
+    errorMessage = "Unable to write " + fileName;
+    return false;
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPinholeCameraBinaryFile::InitializeRecord(CameraRecord& record)
+{
+  std::memset(&record, 0, sizeof(CameraRecord));
+  record.Intrinsics[0] = record.Intrinsics[4] = record.Intrinsics[8] = 1.0;
+  for (int i = 0; i < 4; ++i)
+  {
+    record.MarkerToImageSensor[5 * i] = 1.0;
+  }
+  record.ReprojectionError = -1.0;
+  record.RegistrationError = -1.0;
+}
+
+//----------------------------------------------------------------------------
+std::uint32_t vtkPinholeCameraBinaryFile::ComputeChecksum(const unsigned char* data, std::size_t size)
+{
+  static const ChecksumTable table;
+
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    crc = table.Values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
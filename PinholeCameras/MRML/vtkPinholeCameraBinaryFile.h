@@ -0,0 +1,102 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraBinaryFile.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraBinaryFile_h
+#define __vtkPinholeCameraBinaryFile_h
+
+// MRML includes
+#include "vtkSlicerPinholeCamerasModuleMRMLExport.h"
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// \brief Compact binary file holding the parameters of one or more pinhole cameras.
+///
+/// Layout (native byte order, verified through a byte order mark on read):
+///   Header, 32 bytes: "PHCB", byte order mark, version, header size, record size, number of cameras, 2 reserved words
+///   One CameraRecord per camera, RecordSize bytes each
+///   CRC-32 (IEEE) of everything before it
+///
+/// Files are read by memory-mapping: after Open succeeds, records point directly into the mapped file.
+/// Readers use the record size stored in the header, so later versions can append fields to the record.
+/// Version history:
+///   1: initial layout, UndistortionMapFormat was first a reserved word that writers must set to 0
+///   2: TrackerLatency appended to the camera record
+/// UndistortionMapFormat reuses the reserved word of version 1 without a version change: 0 selects float maps as
+/// before, and readers fall back to float maps for any value they do not know.
+class VTK_SLICER_PINHOLECAMERAS_MODULE_MRML_EXPORT vtkPinholeCameraBinaryFile
+{
+public:
+  static const std::uint32_t CurrentVersion = 2;
+  static const int MaximumNameLength = 64;
+  static const int MaximumNumberOfDistortionCoefficients = 14;
+
+  /// Parameters of one camera as stored in the file, 8 byte aligned
+  struct CameraRecord
+  {
+    double          Intrinsics[9];
+    double          DistortionCoefficients[MaximumNumberOfDistortionCoefficients];
+    double          CameraPlaneOffset[3];
+    double          MarkerToImageSensor[16];
+    double          ReprojectionError;
+    double          RegistrationError;
+    std::uint32_t   NumberOfDistortionCoefficients;
+    std::uint32_t   UndistortionMapFormat;  // vtkMRMLPinholeCameraNode::UndistortionMap..., reserved (0, float) in early version 1 files
+    char            Name[MaximumNameLength];
+    double          TrackerLatency;         // seconds, version 2
+  };
+
+  /// Size of the camera records of a version, 0 if the version is unknown
+  static std::size_t GetRecordSize(std::uint32_t version);
+
+  vtkPinholeCameraBinaryFile();
+  ~vtkPinholeCameraBinaryFile();
+
+  /// Map a file and validate its header and checksum
+  bool Open(const std::string& fileName);
+  void Close();
+
+  int GetNumberOfCameras() const;
+  std::uint32_t GetVersion() const;
+
+  /// Get a record of the mapped file, valid until Close.
+  /// Only the fields of the file version are stored, use ReadCamera to read files of older versions.
+  const CameraRecord* GetCamera(int index) const;
+
+  /// Copy a record of the mapped file, fields missing from older versions keep the InitializeRecord defaults
+  bool ReadCamera(int index, CameraRecord& record) const;
+
+  const std::string& GetErrorMessage() const;
+
+  /// Write records to a file in the current version
+  static bool Write(const std::string& fileName, const CameraRecord* records, int numberOfCameras, std::string& errorMessage);
+
+  /// Fill a record with identity intrinsics and transform, and no distortion
+  static void InitializeRecord(CameraRecord& record);
+
+  /// CRC-32 (IEEE 802.3) of a buffer
+  static std::uint32_t ComputeChecksum(const unsigned char* data, std::size_t size);
+
+protected:
+  class vtkInternal;
+  vtkInternal* Internal;
+
+private:
+  vtkPinholeCameraBinaryFile(const vtkPinholeCameraBinaryFile&); // Not implemented
+  void operator=(const vtkPinholeCameraBinaryFile&); // Not implemented
+};
+
+#endif
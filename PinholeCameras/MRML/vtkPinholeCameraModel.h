@@ -0,0 +1,406 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraModel.h,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+#ifndef __vtkPinholeCameraModel_h
+#define __vtkPinholeCameraModel_h
+
+// VTK includes
+#include <vtkType.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// \brief Inline kernels of the OpenCV pinhole camera model.
+///
+/// Distortion coefficients follow the OpenCV ordering
+/// (k1, k2, p1, p2[, k3[, k4, k5, k6[, s1, s2, s3, s4[, tauX, tauY]]]]).
+/// The kernels are branch free so that loops over contiguous blocks of points can be vectorized by the compiler.
+/// Distort and Undistort are specialized on the distortion model (the number of coefficients: 0, 4, 5, 8, 12 or 14),
+/// terms of higher order than the model are removed at compile time. Pick the model once per parameter change with
+/// GetDistortionModel and dispatch to the matching instantiation once per batch.
+namespace vtkPinholeCameraModel
+{
+  const int MaximumNumberOfDistortionCoefficients = 14;
+
+  /// Fixed number of iterations of the undistortion solver, same as the cv::undistortPoints default
+  const int NumberOfUndistortIterations = 5;
+
+  /// Number of points transformed together by the batch projection kernel
+  const int ProjectionBlockSize = 256;
+
+  //----------------------------------------------------------------------------
+  /// Immutable snapshot of the parameters of one camera, stored as a single contiguous block
+  struct Parameters
+  {
+    /// Incremented every time the owning node publishes a new snapshot
+    unsigned long Version;
+    /// Incremented when the intrinsics or the distortion coefficients change, the only inputs of undistortion maps
+    unsigned long UndistortionVersion;
+
+    /// Number of distortion coefficients of the node, DistortionCoefficients is padded with zeros
+    int           NumberOfDistortionCoefficients;
+    /// Smallest distortion model reproducing the coefficients, see GetDistortionModel
+    int           DistortionModel;
+
+    double        Intrinsics[9];
+    double        InverseIntrinsics[9];
+    double        DistortionCoefficients[MaximumNumberOfDistortionCoefficients];
+    double        TiltMatrix[9];
+    double        InverseTiltMatrix[9];
+    double        CameraPlaneOffset[3];
+    double        MarkerToImageSensor[16];
+    double        ImageSensorToMarker[16];
+  };
+
+  //----------------------------------------------------------------------------
+  /// Compute the projection matrix of a sensor tilted by tauX, tauY (identity when both are zero)
+  inline void ComputeTiltMatrix(double tauX, double tauY, double matTilt[9])
+  {
+    const double cTauX = std::cos(tauX);
+    const double sTauX = std::sin(tauX);
+    const double cTauY = std::cos(tauY);
+    const double sTauY = std::sin(tauY);
+
+    // matRotXY = matRotY * matRotX
+    const double rotXY[9] =
+    {
+      cTauY, sTauY * sTauX, -sTauY * cTauX,
+      0.0, cTauX, sTauX,
+      sTauY, -cTauY * sTauX, cTauY * cTauX
+    };
+
+    // matTilt = matProjZ * matRotXY
+    const double projZ[9] =
+    {
+      rotXY[8], 0.0, -rotXY[2],
+      0.0, rotXY[8], -rotXY[5],
+      0.0, 0.0, 1.0
+    };
+
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        matTilt[3 * i + j] = projZ[3 * i + 0] * rotXY[0 + j] + projZ[3 * i + 1] * rotXY[3 + j] + projZ[3 * i + 2] * rotXY[6 + j];
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Get the smallest model, in number of coefficients, that reproduces the given coefficients.
+  /// k must hold MaximumNumberOfDistortionCoefficients values, unused coefficients set to zero.
+  inline int GetDistortionModel(const double k[14])
+  {
+    if (k[12] != 0.0 || k[13] != 0.0)
+    {
+      return 14;
+    }
+    if (k[8] != 0.0 || k[9] != 0.0 || k[10] != 0.0 || k[11] != 0.0)
+    {
+      return 12;
+    }
+    if (k[5] != 0.0 || k[6] != 0.0 || k[7] != 0.0)
+    {
+      return 8;
+    }
+    if (k[4] != 0.0)
+    {
+      return 5;
+    }
+    if (k[0] != 0.0 || k[1] != 0.0 || k[2] != 0.0 || k[3] != 0.0)
+    {
+      return 4;
+    }
+    return 0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Apply lens distortion to normalized image coordinates.
+  /// k must hold MaximumNumberOfDistortionCoefficients values, coefficients beyond Model are ignored.
+  template<int Model>
+  inline void Distort(const double k[14], const double matTilt[9], double x, double y, double& xd, double& yd)
+  {
+    static_assert(Model == 0 || Model == 4 || Model == 5 || Model == 8 || Model == 12 || Model == 14, "Unsupported distortion model");
+
+    if (Model == 0)
+    {
+      xd = x;
+      yd = y;
+      return;
+    }
+
+    const double r2 = x * x + y * y;
+    const double r4 = r2 * r2;
+    const double a1 = 2.0 * x * y;
+    const double a2 = r2 + 2.0 * x * x;
+    const double a3 = r2 + 2.0 * y * y;
+
+    double radial = 1.0 + k[0] * r2 + k[1] * r4;
+    if (Model >= 5)
+    {
+      radial += k[4] * r4 * r2;
+    }
+    if (Model >= 8)
+    {
+      radial /= 1.0 + k[5] * r2 + k[6] * r4 + k[7] * r4 * r2;
+    }
+
+    double xd0 = x * radial + k[2] * a1 + k[3] * a2;
+    double yd0 = y * radial + k[2] * a3 + k[3] * a1;
+    if (Model >= 12)
+    {
+      xd0 += k[8] * r2 + k[9] * r4;
+      yd0 += k[10] * r2 + k[11] * r4;
+    }
+
+    if (Model < 14)
+    {
+      xd = xd0;
+      yd = yd0;
+      return;
+    }
+
+    const double tiltX = matTilt[0] * xd0 + matTilt[1] * yd0 + matTilt[2];
+    const double tiltY = matTilt[3] * xd0 + matTilt[4] * yd0 + matTilt[5];
+    const double tiltZ = matTilt[6] * xd0 + matTilt[7] * yd0 + matTilt[8];
+    const double invProj = tiltZ != 0.0 ? 1.0 / tiltZ : 1.0;
+
+    xd = invProj * tiltX;
+    yd = invProj * tiltY;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Remove lens distortion from normalized image coordinates, iterating like cv::undistortPoints.
+  /// invMatTilt is the inverse of the tilt matrix, only used by the 14 coefficient model.
+  template<int Model>
+  inline void Undistort(const double k[14], const double invMatTilt[9], double xd, double yd, double& x, double& y)
+  {
+    static_assert(Model == 0 || Model == 4 || Model == 5 || Model == 8 || Model == 12 || Model == 14, "Unsupported distortion model");
+
+    if (Model == 0)
+    {
+      x = xd;
+      y = yd;
+      return;
+    }
+
+    double x0 = xd;
+    double y0 = yd;
+    if (Model >= 14)
+    {
+      const double untiltX = invMatTilt[0] * xd + invMatTilt[1] * yd + invMatTilt[2];
+      const double untiltY = invMatTilt[3] * xd + invMatTilt[4] * yd + invMatTilt[5];
+      const double untiltZ = invMatTilt[6] * xd + invMatTilt[7] * yd + invMatTilt[8];
+      const double invProj = untiltZ != 0.0 ? 1.0 / untiltZ : 1.0;
+      x0 = invProj * untiltX;
+      y0 = invProj * untiltY;
+    }
+
+    double xu = x0;
+    double yu = y0;
+    bool diverged = false;
+    for (int i = 0; i < NumberOfUndistortIterations; ++i)
+    {
+      const double r2 = xu * xu + yu * yu;
+      const double r4 = r2 * r2;
+
+      double radial = 1.0 + k[0] * r2 + k[1] * r4;
+      if (Model >= 5)
+      {
+        radial += k[4] * r4 * r2;
+      }
+      double invRadial = 1.0 / radial;
+      if (Model >= 8)
+      {
+        invRadial *= 1.0 + k[5] * r2 + k[6] * r4 + k[7] * r4 * r2;
+      }
+
+      double deltaX = 2.0 * k[2] * xu * yu + k[3] * (r2 + 2.0 * xu * xu);
+      double deltaY = k[2] * (r2 + 2.0 * yu * yu) + 2.0 * k[3] * xu * yu;
+      if (Model >= 12)
+      {
+        deltaX += k[8] * r2 + k[9] * r4;
+        deltaY += k[10] * r2 + k[11] * r4;
+      }
+
+      // Like OpenCV, give up on points where the model folds over and return the distorted coordinates
+      diverged = diverged || invRadial < 0.0;
+      xu = diverged ? xu : (x0 - deltaX) * invRadial;
+      yu = diverged ? yu : (y0 - deltaY) * invRadial;
+    }
+
+    x = diverged ? xd : xu;
+    y = diverged ? yd : yu;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Pointers to the parameters of one camera, wherever they are stored (node snapshot or rig buffers)
+  struct CameraView
+  {
+    const double* Intrinsics;
+    const double* InverseIntrinsics;
+    const double* DistortionCoefficients;
+    const double* TiltMatrix;
+    const double* InverseTiltMatrix;
+    const double* CameraPlaneOffset;
+  };
+
+  //----------------------------------------------------------------------------
+  inline CameraView GetCameraView(const Parameters& parameters)
+  {
+    CameraView view;
+    view.Intrinsics = parameters.Intrinsics;
+    view.InverseIntrinsics = parameters.InverseIntrinsics;
+    view.DistortionCoefficients = parameters.DistortionCoefficients;
+    view.TiltMatrix = parameters.TiltMatrix;
+    view.InverseTiltMatrix = parameters.InverseTiltMatrix;
+    view.CameraPlaneOffset = parameters.CameraPlaneOffset;
+    return view;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Project points [begin, end) to pixels [begin, end).
+  /// Points are processed in blocks: transformed into contiguous per-axis buffers first so the distortion loop vectorizes.
+  /// Points behind the camera are projected to NaN.
+  template<typename PointType, int Model>
+  inline void ProjectPoints(const CameraView& camera, const double referenceToSensor[16], const PointType* points, vtkIdType begin, vtkIdType end, double* pixels)
+  {
+    double x[ProjectionBlockSize];
+    double y[ProjectionBlockSize];
+    double z[ProjectionBlockSize];
+    const double* m = referenceToSensor;
+    const double* offset = camera.CameraPlaneOffset;
+    const double* intrinsics = camera.Intrinsics;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    for (vtkIdType blockStart = begin; blockStart < end; blockStart += ProjectionBlockSize)
+    {
+      const int count = static_cast<int>(std::min<vtkIdType>(ProjectionBlockSize, end - blockStart));
+      const PointType* blockPoints = points + 3 * blockStart;
+      for (int i = 0; i < count; ++i)
+      {
+        const double px = blockPoints[3 * i + 0];
+        const double py = blockPoints[3 * i + 1];
+        const double pz = blockPoints[3 * i + 2];
+        x[i] = m[0] * px + m[1] * py + m[2] * pz + m[3] - offset[0];
+        y[i] = m[4] * px + m[5] * py + m[6] * pz + m[7] - offset[1];
+        z[i] = m[8] * px + m[9] * py + m[10] * pz + m[11] - offset[2];
+      }
+
+      double* blockPixels = pixels + 2 * blockStart;
+      for (int i = 0; i < count; ++i)
+      {
+        const double invZ = 1.0 / z[i];
+        double xd;
+        double yd;
+        Distort<Model>(camera.DistortionCoefficients, camera.TiltMatrix, x[i] * invZ, y[i] * invZ, xd, yd);
+        const bool inFront = z[i] > 0.0;
+        blockPixels[2 * i + 0] = inFront ? intrinsics[0] * xd + intrinsics[1] * yd + intrinsics[2] : nan;
+        blockPixels[2 * i + 1] = inFront ? intrinsics[4] * yd + intrinsics[5] : nan;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compute the origin shared by all rays of a camera, in the frame of sensorToReference
+  inline void ComputeRayOrigin(const CameraView& camera, const double sensorToReference[16], double origin[3])
+  {
+    const double* offset = camera.CameraPlaneOffset;
+    for (int i = 0; i < 3; ++i)
+    {
+      origin[i] = sensorToReference[4 * i + 0] * offset[0] +
+                  sensorToReference[4 * i + 1] * offset[1] +
+                  sensorToReference[4 * i + 2] * offset[2] +
+                  sensorToReference[4 * i + 3];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Back-project one pixel to a unit ray direction: undistort in normalized coordinates, then rotate into the reference frame
+  template<int Model>
+  inline void ComputeRayDirection(const CameraView& camera, const double sensorToReference[16], const double pixel[2], double direction[3])
+  {
+    const double* inv = camera.InverseIntrinsics;
+    const double invW = 1.0 / (inv[6] * pixel[0] + inv[7] * pixel[1] + inv[8]);
+    const double xd = (inv[0] * pixel[0] + inv[1] * pixel[1] + inv[2]) * invW;
+    const double yd = (inv[3] * pixel[0] + inv[4] * pixel[1] + inv[5]) * invW;
+    double x;
+    double y;
+    Undistort<Model>(camera.DistortionCoefficients, camera.InverseTiltMatrix, xd, yd, x, y);
+
+    const double invNorm = 1.0 / std::sqrt(x * x + y * y + 1.0);
+    const double dir[3] = { x * invNorm, y * invNorm, invNorm };
+    const double* m = sensorToReference;
+    for (int j = 0; j < 3; ++j)
+    {
+      direction[j] = m[4 * j + 0] * dir[0] + m[4 * j + 1] * dir[1] + m[4 * j + 2] * dir[2];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compact undistortion maps store each sample location as two 16 bit fixed point values, the fractional bits
+  /// give the bilinear interpolation weights. Samples outside of the input image are marked with CompactMapOutside.
+  const unsigned short CompactMapOutside = 0xFFFF;
+
+  /// Finer locations would not improve 8 bit interpolation
+  const int MaximumCompactMapFractionBits = 8;
+
+  //----------------------------------------------------------------------------
+  /// Number of fractional bits of compact map locations for an image size, as many as fit the largest location
+  /// in 16 bits. Returns -1 if the image is too large to be addressed.
+  inline int GetCompactMapFractionBits(int width, int height)
+  {
+    const long maximumLocation = std::max(std::max(width, height) - 1, 1);
+    if (maximumLocation >= CompactMapOutside)
+    {
+      return -1;
+    }
+    int bits = 0;
+    while (bits < MaximumCompactMapFractionBits && (maximumLocation << (bits + 1)) < CompactMapOutside)
+    {
+      ++bits;
+    }
+    return bits;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Largest distance in pixels between a sample location and its compact map encoding (half a step on both axes)
+  inline double GetCompactMapErrorBound(int width, int height)
+  {
+    const int bits = GetCompactMapFractionBits(width, height);
+    if (bits < 0)
+    {
+      return std::numeric_limits<double>::infinity();
+    }
+    return std::sqrt(0.5) / static_cast<double>(1 << bits);
+  }
+}
+
+//----------------------------------------------------------------------------
+/// Instantiate a call for the distortion model known at run time, like vtkTemplateMacro.
+/// The model is available to the call as the compile time constant PINHOLE_CAMERA_MODEL.
+#define vtkPinholeCameraModelTemplateMacro(model, ...) \
+  switch (model) \
+  { \
+    case 0: { const int PINHOLE_CAMERA_MODEL = 0; __VA_ARGS__; } break; \
+    case 4: { const int PINHOLE_CAMERA_MODEL = 4; __VA_ARGS__; } break; \
+    case 5: { const int PINHOLE_CAMERA_MODEL = 5; __VA_ARGS__; } break; \
+    case 8: { const int PINHOLE_CAMERA_MODEL = 8; __VA_ARGS__; } break; \
+    case 12: { const int PINHOLE_CAMERA_MODEL = 12; __VA_ARGS__; } break; \
+    default: { const int PINHOLE_CAMERA_MODEL = 14; __VA_ARGS__; } break; \
+  }
+
+#endif
@@ -0,0 +1,186 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkMRMLPinholeCameraRigStorageNodeTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras MRML includes
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraRigNode.h"
+#include "vtkMRMLPinholeCameraRigStorageNode.h"
+#include "vtkPinholeCameraBinaryFile.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkNew.h>
+
+// STL includes
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  void FillCamera(vtkMRMLPinholeCameraNode* cameraNode, int camera)
+  {
+    const double scale = 1.0 + camera;
+    vtkMatrix3x3* intrinsics = cameraNode->GetIntrinsicMatrix();
+    intrinsics->Identity();
+    intrinsics->SetElement(0, 0, 800.0 * scale);
+    intrinsics->SetElement(1, 1, 805.0 * scale);
+    intrinsics->SetElement(0, 2, 320.5 * scale);
+    intrinsics->SetElement(1, 2, 240.25 * scale);
+    const double coefficients[8] = { -0.2 * scale, 0.05, 0.001, -0.002, 0.01, 0.002, -0.001, 0.0005 };
+    cameraNode->SetDistortionCoefficientValues(coefficients, 8);
+    cameraNode->GetMarkerToImageSensorTransform()->SetElement(0, 3, 10.0 * scale);
+    const double offset[3] = { 0.0, 0.0, -2.5 * scale };
+    cameraNode->SetCameraPlaneOffsetValues(offset);
+    cameraNode->SetReprojectionError(0.25 * scale);
+    cameraNode->SetTrackerLatency(0.033 * scale);
+    cameraNode->SetUndistortionMapFormat(camera == 0 ? vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint : vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+    cameraNode->SetName(camera == 0 ? "Left" : "Right");
+  }
+
+  //----------------------------------------------------------------------------
+  int CheckCamera(vtkMRMLPinholeCameraRigNode* rigNode, int index, vtkMRMLPinholeCameraNode* expected)
+  {
+    vtkNew<vtkMRMLPinholeCameraNode> cameraNode;
+    CHECK_BOOL(rigNode->GetCamera(index, cameraNode.GetPointer()), true);
+    CHECK_STRING(rigNode->GetCameraName(index), expected->GetName());
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        CHECK_DOUBLE(cameraNode->GetIntrinsicMatrix()->GetElement(i, j), expected->GetIntrinsicMatrix()->GetElement(i, j));
+      }
+    }
+    CHECK_INT(static_cast<int>(cameraNode->GetNumberOfDistortionCoefficients()), static_cast<int>(expected->GetNumberOfDistortionCoefficients()));
+    for (vtkIdType i = 0; i < expected->GetNumberOfDistortionCoefficients(); ++i)
+    {
+      CHECK_DOUBLE(cameraNode->GetDistortionCoefficientValue(i), expected->GetDistortionCoefficientValue(i));
+    }
+    CHECK_DOUBLE(cameraNode->GetMarkerToImageSensorTransform()->GetElement(0, 3), expected->GetMarkerToImageSensorTransform()->GetElement(0, 3));
+    CHECK_DOUBLE(cameraNode->GetCameraPlaneOffsetValue(2), expected->GetCameraPlaneOffsetValue(2));
+    CHECK_DOUBLE(cameraNode->GetReprojectionError(), expected->GetReprojectionError());
+    CHECK_DOUBLE(cameraNode->GetTrackerLatency(), expected->GetTrackerLatency());
+    CHECK_INT(cameraNode->GetUndistortionMapFormat(), expected->GetUndistortionMapFormat());
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestRoundTrip(const std::string& fileName)
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkMRMLPinholeCameraNode> cameraNodes[2];
+    vtkNew<vtkMRMLPinholeCameraRigNode> rigNode;
+    scene->AddNode(rigNode.GetPointer());
+    for (int camera = 0; camera < 2; ++camera)
+    {
+      FillCamera(cameraNodes[camera].GetPointer(), camera);
+      CHECK_INT(rigNode->AddCamera(cameraNodes[camera].GetPointer()), camera);
+      CHECK_EXIT_SUCCESS(CheckCamera(rigNode.GetPointer(), camera, cameraNodes[camera].GetPointer()));
+    }
+
+    vtkNew<vtkMRMLPinholeCameraRigStorageNode> storageNode;
+    scene->AddNode(storageNode.GetPointer());
+    storageNode->SetFileName(fileName.c_str());
+    CHECK_INT(storageNode->WriteData(rigNode.GetPointer()), 1);
+
+    vtkNew<vtkMRMLPinholeCameraRigNode> readNode;
+    scene->AddNode(readNode.GetPointer());
+    CHECK_INT(storageNode->ReadData(readNode.GetPointer()), 1);
+    CHECK_INT(readNode->GetNumberOfCameras(), 2);
+    for (int camera = 0; camera < 2; ++camera)
+    {
+      CHECK_EXIT_SUCCESS(CheckCamera(readNode.GetPointer(), camera, cameraNodes[camera].GetPointer()));
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestInvalidCoefficients(const std::string& fileName)
+  {
+    // 15 coefficients, one more than the model supports
+    std::ofstream file(fileName.c_str(), std::ios::trunc);
+    file << "<?xml version=\"1.0\"?>\n<opencv_storage>\n<Cameras>\n  <_>\n    <Name>Left</Name>\n"
+         << "    <DistortionCoefficients type_id=\"opencv-matrix\"><rows>15</rows><cols>1</cols><dt>d</dt>\n"
+         << "      <data>0. 0. 0. 0. 0. 0. 0. 0. 0. 0. 0. 0. 0. 0. 0.</data></DistortionCoefficients></_></Cameras>\n</opencv_storage>\n";
+    file.close();
+
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkMRMLPinholeCameraRigNode> rigNode;
+    scene->AddNode(rigNode.GetPointer());
+    vtkNew<vtkMRMLPinholeCameraRigStorageNode> storageNode;
+    scene->AddNode(storageNode.GetPointer());
+    storageNode->SetFileName(fileName.c_str());
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_INT(storageNode->ReadData(rigNode.GetPointer()), 0);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestUnknownMapFormat(const std::string& xmlFileName, const std::string& binaryFileName)
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkMRMLPinholeCameraRigNode> rigNode;
+    scene->AddNode(rigNode.GetPointer());
+    vtkNew<vtkMRMLPinholeCameraRigStorageNode> storageNode;
+    scene->AddNode(storageNode.GetPointer());
+
+    // Unknown format names select float maps with a warning
+    std::ofstream file(xmlFileName.c_str(), std::ios::trunc);
+    file << "<?xml version=\"1.0\"?>\n<opencv_storage>\n<Cameras>\n  <_>\n    <Name>Left</Name>\n"
+         << "    <UndistortionMapFormat>Unknown</UndistortionMapFormat></_></Cameras>\n</opencv_storage>\n";
+    file.close();
+    storageNode->SetFileName(xmlFileName.c_str());
+    TESTING_OUTPUT_ASSERT_WARNINGS_BEGIN();
+    CHECK_INT(storageNode->ReadData(rigNode.GetPointer()), 1);
+    TESTING_OUTPUT_ASSERT_WARNINGS_END();
+    CHECK_INT(rigNode->GetUndistortionMapFormat(0), vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+
+    // Unknown format values in binary records select float maps
+    vtkPinholeCameraBinaryFile::CameraRecord records[2];
+    vtkPinholeCameraBinaryFile::InitializeRecord(records[0]);
+    vtkPinholeCameraBinaryFile::InitializeRecord(records[1]);
+    records[0].UndistortionMapFormat = vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint;
+    records[1].UndistortionMapFormat = 0xDEADBEEF;
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(binaryFileName, records, 2, errorMessage), true);
+    storageNode->SetFileName(binaryFileName.c_str());
+    CHECK_INT(storageNode->ReadData(rigNode.GetPointer()), 1);
+    CHECK_INT(rigNode->GetUndistortionMapFormat(0), vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint);
+    CHECK_INT(rigNode->GetUndistortionMapFormat(1), vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLPinholeCameraRigStorageNodeTest1(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkMRMLPinholeCameraRigStorageNodeTest1 /path/to/temp" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string tempDirectory = argv[1];
+
+  CHECK_EXIT_SUCCESS(TestRoundTrip(tempDirectory + "/vtkMRMLPinholeCameraRigStorageNodeTest1.rig.xml"));
+  CHECK_EXIT_SUCCESS(TestRoundTrip(tempDirectory + "/vtkMRMLPinholeCameraRigStorageNodeTest1.rig.pcb"));
+  CHECK_EXIT_SUCCESS(TestInvalidCoefficients(tempDirectory + "/vtkMRMLPinholeCameraRigStorageNodeTest1_Invalid.rig.xml"));
+  CHECK_EXIT_SUCCESS(TestUnknownMapFormat(tempDirectory + "/vtkMRMLPinholeCameraRigStorageNodeTest1_Format.rig.xml",
+                                          tempDirectory + "/vtkMRMLPinholeCameraRigStorageNodeTest1_Format.rig.pcb"));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraBinaryFileTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras MRML includes
+#include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraStorageNode.h"
+#include "vtkPinholeCameraBinaryFile.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkNew.h>
+
+// STL includes
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // Offsets of the header fields, see vtkPinholeCameraBinaryFile.h
+  const std::size_t VERSION_OFFSET = 8;
+  const std::size_t HEADER_SIZE_OFFSET = 12;
+  const std::size_t RECORD_SIZE_OFFSET = 16;
+
+  //----------------------------------------------------------------------------
+  std::vector<unsigned char> ReadFile(const std::string& fileName)
+  {
+    std::ifstream file(fileName.c_str(), std::ios::binary);
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteFile(const std::string& fileName, const std::vector<unsigned char>& data)
+  {
+    std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+  }
+
+  //----------------------------------------------------------------------------
+  std::uint32_t GetWord(const std::vector<unsigned char>& data, std::size_t offset)
+  {
+    std::uint32_t value;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    return value;
+  }
+
+  //----------------------------------------------------------------------------
+  void SetWord(std::vector<unsigned char>& data, std::size_t offset, std::uint32_t value)
+  {
+    std::memcpy(data.data() + offset, &value, sizeof(value));
+  }
+
+  //----------------------------------------------------------------------------
+  // Store the checksum of an edited file, so that only the edit is checked
+  void UpdateChecksum(std::vector<unsigned char>& data)
+  {
+    SetWord(data, data.size() - sizeof(std::uint32_t), vtkPinholeCameraBinaryFile::ComputeChecksum(data.data(), data.size() - sizeof(std::uint32_t)));
+  }
+
+  //----------------------------------------------------------------------------
+  void FillRecord(vtkPinholeCameraBinaryFile::CameraRecord& record, int camera)
+  {
+    vtkPinholeCameraBinaryFile::InitializeRecord(record);
+    const double scale = 1.0 + camera;
+    record.Intrinsics[0] = 800.0 * scale;
+    record.Intrinsics[2] = 320.5 * scale;
+    record.Intrinsics[4] = 805.0 * scale;
+    record.Intrinsics[5] = 240.25 * scale;
+    record.NumberOfDistortionCoefficients = 8;
+    for (int i = 0; i < 8; ++i)
+    {
+      record.DistortionCoefficients[i] = 0.01 * (i + 1) * scale;
+    }
+    record.CameraPlaneOffset[2] = -2.5 * scale;
+    record.MarkerToImageSensor[3] = 10.0 * scale;
+    record.MarkerToImageSensor[7] = -20.0 * scale;
+    record.ReprojectionError = 0.25 * scale;
+    record.RegistrationError = 1.5 * scale;
+    record.UndistortionMapFormat = vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint;
+    record.TrackerLatency = 0.033 * scale;
+    std::strncpy(record.Name, camera == 0 ? "Left" : "Right", vtkPinholeCameraBinaryFile::MaximumNameLength - 1);
+  }
+
+  //----------------------------------------------------------------------------
+  int TestRoundTrip(const std::string& fileName)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord records[2];
+    FillRecord(records[0], 0);
+    FillRecord(records[1], 1);
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, records, 2, errorMessage), true);
+
+    vtkPinholeCameraBinaryFile file;
+    CHECK_BOOL(file.Open(fileName), true);
+    CHECK_INT(static_cast<int>(file.GetVersion()), static_cast<int>(vtkPinholeCameraBinaryFile::CurrentVersion));
+    CHECK_INT(file.GetNumberOfCameras(), 2);
+    for (int camera = 0; camera < 2; ++camera)
+    {
+      vtkPinholeCameraBinaryFile::CameraRecord record;
+      CHECK_BOOL(file.ReadCamera(camera, record), true);
+      CHECK_INT(std::memcmp(&record, &records[camera], sizeof(record)), 0);
+      CHECK_NOT_NULL(file.GetCamera(camera));
+      CHECK_INT(std::memcmp(file.GetCamera(camera), &records[camera], sizeof(record)), 0);
+    }
+    CHECK_NULL(file.GetCamera(2));
+    vtkPinholeCameraBinaryFile::CameraRecord record;
+    CHECK_BOOL(file.ReadCamera(-1, record), false);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestVersion1(const std::string& fileName)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord records[2];
+    FillRecord(records[0], 0);
+    FillRecord(records[1], 1);
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, records, 2, errorMessage), true);
+
+    // Version 1 records end before TrackerLatency
+    const std::vector<unsigned char> current = ReadFile(fileName);
+    const std::size_t headerSize = GetWord(current, HEADER_SIZE_OFFSET);
+    const std::size_t recordSize = vtkPinholeCameraBinaryFile::GetRecordSize(1);
+    CHECK_BOOL(recordSize > 0 && recordSize < sizeof(vtkPinholeCameraBinaryFile::CameraRecord), true);
+    std::vector<unsigned char> data(current.begin(), current.begin() + headerSize);
+    for (int camera = 0; camera < 2; ++camera)
+    {
+      const unsigned char* record = reinterpret_cast<const unsigned char*>(&records[camera]);
+      data.insert(data.end(), record, record + recordSize);
+    }
+    data.resize(data.size() + sizeof(std::uint32_t));
+    SetWord(data, VERSION_OFFSET, 1);
+    SetWord(data, RECORD_SIZE_OFFSET, static_cast<std::uint32_t>(recordSize));
+    UpdateChecksum(data);
+    WriteFile(fileName, data);
+
+    vtkPinholeCameraBinaryFile file;
+    CHECK_BOOL(file.Open(fileName), true);
+    CHECK_INT(static_cast<int>(file.GetVersion()), 1);
+    CHECK_INT(file.GetNumberOfCameras(), 2);
+    for (int camera = 0; camera < 2; ++camera)
+    {
+      // Fields of version 1 are read back, the tracker latency keeps its default
+      vtkPinholeCameraBinaryFile::CameraRecord record;
+      CHECK_BOOL(file.ReadCamera(camera, record), true);
+      CHECK_INT(std::memcmp(&record, &records[camera], recordSize), 0);
+      CHECK_DOUBLE(record.TrackerLatency, 0.0);
+    }
+
+    // A version 1 record shorter than the version 1 layout is rejected
+    SetWord(data, RECORD_SIZE_OFFSET, static_cast<std::uint32_t>(recordSize - 8));
+    UpdateChecksum(data);
+    WriteFile(fileName, data);
+    CHECK_BOOL(file.Open(fileName), false);
+
+    // Files of a later version are rejected
+    data = current;
+    SetWord(data, VERSION_OFFSET, vtkPinholeCameraBinaryFile::CurrentVersion + 1);
+    UpdateChecksum(data);
+    WriteFile(fileName, data);
+    CHECK_BOOL(file.Open(fileName), false);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestChecksum(const std::string& fileName)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord record;
+    FillRecord(record, 0);
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, &record, 1, errorMessage), true);
+    const std::vector<unsigned char> data = ReadFile(fileName);
+
+    // CRC-32 check value of the IEEE polynomial
+    const char checkInput[] = "123456789";
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::ComputeChecksum(reinterpret_cast<const unsigned char*>(checkInput), 9) == 0xCBF43926u, true);
+
+    // One flipped bit in a record, then in the stored checksum
+    std::vector<unsigned char> corrupted = data;
+    corrupted[GetWord(data, HEADER_SIZE_OFFSET) + 3] ^= 0x10;
+    WriteFile(fileName, corrupted);
+    vtkPinholeCameraBinaryFile file;
+    CHECK_BOOL(file.Open(fileName), false);
+    CHECK_BOOL(file.GetErrorMessage().empty(), false);
+    CHECK_INT(file.GetNumberOfCameras(), 0);
+
+    corrupted = data;
+    corrupted[corrupted.size() - 1] ^= 0x01;
+    WriteFile(fileName, corrupted);
+    CHECK_BOOL(file.Open(fileName), false);
+
+    WriteFile(fileName, data);
+    CHECK_BOOL(file.Open(fileName), true);
+    CHECK_BOOL(file.GetErrorMessage().empty(), true);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestTruncated(const std::string& fileName)
+  {
+    vtkPinholeCameraBinaryFile::CameraRecord records[2];
+    FillRecord(records[0], 0);
+    FillRecord(records[1], 1);
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, records, 2, errorMessage), true);
+    const std::vector<unsigned char> data = ReadFile(fileName);
+
+    vtkPinholeCameraBinaryFile file;
+    const std::size_t sizes[] = { data.size() - 8, data.size() - sizeof(vtkPinholeCameraBinaryFile::CameraRecord), 20, 0 };
+    for (std::size_t size : sizes)
+    {
+      WriteFile(fileName, std::vector<unsigned char>(data.begin(), data.begin() + size));
+      CHECK_BOOL(file.Open(fileName), false);
+      CHECK_INT(file.GetNumberOfCameras(), 0);
+    }
+
+    // A truncated file is rejected even if its checksum is updated, the layout does not match the header
+    std::vector<unsigned char> truncated(data.begin(), data.end() - 8);
+    UpdateChecksum(truncated);
+    WriteFile(fileName, truncated);
+    CHECK_BOOL(file.Open(fileName), false);
+
+    // Trailing data is rejected as well
+    std::vector<unsigned char> extended = data;
+    extended.insert(extended.end(), 8, 0);
+    WriteFile(fileName, extended);
+    CHECK_BOOL(file.Open(fileName), false);
+
+    CHECK_BOOL(file.Open(fileName + ".missing"), false);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestStorageNode(const std::string& fileName)
+  {
+    vtkNew<vtkMRMLScene> scene;
+    vtkNew<vtkMRMLPinholeCameraNode> cameraNode;
+    scene->AddNode(cameraNode.GetPointer());
+    vtkNew<vtkMRMLPinholeCameraStorageNode> storageNode;
+    scene->AddNode(storageNode.GetPointer());
+    storageNode->SetFileName(fileName.c_str());
+
+    // 14 coefficients, the most a record holds, round trip through the storage node
+    double coefficients[15];
+    for (int i = 0; i < 15; ++i)
+    {
+      coefficients[i] = 0.001 * (i + 1);
+    }
+    cameraNode->SetDistortionCoefficientValues(coefficients, 14);
+    cameraNode->SetTrackerLatency(0.02);
+    CHECK_INT(storageNode->WriteData(cameraNode.GetPointer()), 1);
+    vtkNew<vtkMRMLPinholeCameraNode> readNode;
+    scene->AddNode(readNode.GetPointer());
+    CHECK_INT(storageNode->ReadData(readNode.GetPointer()), 1);
+    CHECK_INT(static_cast<int>(readNode->GetNumberOfDistortionCoefficients()), 14);
+    for (int i = 0; i < 14; ++i)
+    {
+      CHECK_DOUBLE(readNode->GetDistortionCoefficientValue(i), coefficients[i]);
+    }
+    CHECK_DOUBLE(readNode->GetTrackerLatency(), 0.02);
+
+    // More than 14 coefficients cannot be written, and a record claiming more is rejected
+    cameraNode->SetDistortionCoefficientValues(coefficients, 15);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_INT(storageNode->WriteData(cameraNode.GetPointer()), 0);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+
+    vtkPinholeCameraBinaryFile::CameraRecord record;
+    FillRecord(record, 0);
+    record.NumberOfDistortionCoefficients = vtkPinholeCameraBinaryFile::MaximumNumberOfDistortionCoefficients + 1;
+    std::string errorMessage;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, &record, 1, errorMessage), true);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_INT(storageNode->ReadData(readNode.GetPointer()), 0);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+
+    // The map format field was reserved in early version 1 files, values a reader does not know select float maps
+    FillRecord(record, 0);
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, &record, 1, errorMessage), true);
+    CHECK_INT(storageNode->ReadData(readNode.GetPointer()), 1);
+    CHECK_INT(readNode->GetUndistortionMapFormat(), vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint);
+    record.UndistortionMapFormat = 0xDEADBEEF;
+    CHECK_BOOL(vtkPinholeCameraBinaryFile::Write(fileName, &record, 1, errorMessage), true);
+    CHECK_INT(storageNode->ReadData(readNode.GetPointer()), 1);
+    CHECK_INT(readNode->GetUndistortionMapFormat(), vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraBinaryFileTest1(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: vtkPinholeCameraBinaryFileTest1 /path/to/temp" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string tempDirectory = argv[1];
+
+  CHECK_EXIT_SUCCESS(TestRoundTrip(tempDirectory + "/vtkPinholeCameraBinaryFileTest1_RoundTrip.pcb"));
+  CHECK_EXIT_SUCCESS(TestVersion1(tempDirectory + "/vtkPinholeCameraBinaryFileTest1_Version1.pcb"));
+  CHECK_EXIT_SUCCESS(TestChecksum(tempDirectory + "/vtkPinholeCameraBinaryFileTest1_Checksum.pcb"));
+  CHECK_EXIT_SUCCESS(TestTruncated(tempDirectory + "/vtkPinholeCameraBinaryFileTest1_Truncated.pcb"));
+  CHECK_EXIT_SUCCESS(TestStorageNode(tempDirectory + "/vtkPinholeCameraBinaryFileTest1_StorageNode.pcb"));
+
+  return EXIT_SUCCESS;
+}
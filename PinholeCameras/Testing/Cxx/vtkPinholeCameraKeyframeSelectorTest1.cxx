@@ -0,0 +1,153 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraKeyframeSelectorTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraKeyframeSelector.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// STL includes
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  const int WIDTH = 640;
+  const int HEIGHT = 480;
+  const int BOARD_SIZE = 4;
+
+  //----------------------------------------------------------------------------
+  // A fronto-parallel 4x4 board of 10 mm squares imaged at the given pixel offset, 8 pixels per mm
+  struct View
+  {
+    View(float x, float y)
+    {
+      for (int row = 0; row < BOARD_SIZE; ++row)
+      {
+        for (int column = 0; column < BOARD_SIZE; ++column)
+        {
+          ObjectPoints.push_back(10.f * column);
+          ObjectPoints.push_back(10.f * row);
+          ObjectPoints.push_back(0.f);
+          ImagePoints.push_back(x + 8.f * 10.f * column);
+          ImagePoints.push_back(y + 8.f * 10.f * row);
+        }
+      }
+    }
+
+    int Add(vtkPinholeCameraKeyframeSelector& selector) const
+    {
+      return selector.AddView(&ObjectPoints[0], &ImagePoints[0], BOARD_SIZE * BOARD_SIZE);
+    }
+
+    std::vector<float> ObjectPoints;
+    std::vector<float> ImagePoints;
+  };
+
+  //----------------------------------------------------------------------------
+  int TestAddView()
+  {
+    vtkPinholeCameraKeyframeSelector selector;
+    selector.SetBudget(3);
+    selector.SetImageSize(WIDTH, HEIGHT);
+
+    // Too few points cannot be scored
+    const View topLeft(10.f, 10.f);
+    CHECK_INT(selector.AddView(&topLeft.ObjectPoints[0], &topLeft.ImagePoints[0], 3), vtkPinholeCameraKeyframeSelector::Rejected);
+    CHECK_DOUBLE(selector.GetLastScore(), 0.0);
+
+    // The first view adds everything, a repeated view adds nothing
+    CHECK_INT(topLeft.Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_DOUBLE(selector.GetLastScore(), 1.0);
+    CHECK_INT(topLeft.Add(selector), vtkPinholeCameraKeyframeSelector::Rejected);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 1);
+
+    // Two views near the first one fill the budget
+    CHECK_INT(View(30.f, 10.f).Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(View(10.f, 30.f).Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 3);
+
+    // Once the budget is reached, a view of an unseen part of the image replaces the least useful keyframe
+    const int replaced = View(360.f, 200.f).Add(selector);
+    CHECK_BOOL(replaced >= 0 && replaced < 3, true);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 3);
+
+    // Changing the image size starts over
+    selector.SetImageSize(WIDTH / 2, HEIGHT / 2);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 0);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestSetBudget()
+  {
+    vtkPinholeCameraKeyframeSelector selector;
+    selector.SetBudget(0);
+    selector.SetImageSize(WIDTH, HEIGHT);
+
+    // Without a budget every view is kept, repeated ones included
+    const View topLeft(10.f, 10.f);
+    CHECK_INT(topLeft.Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(topLeft.Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(View(360.f, 200.f).Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(View(360.f, 10.f).Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(View(10.f, 200.f).Add(selector), vtkPinholeCameraKeyframeSelector::Appended);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 5);
+
+    // Raising the budget evicts nothing
+    std::vector<int> evicted;
+    selector.SetBudget(10, &evicted);
+    CHECK_INT(static_cast<int>(evicted.size()), 0);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 5);
+
+    // One of the two identical views is the least useful, the first one found is evicted
+    selector.SetBudget(4, &evicted);
+    CHECK_INT(static_cast<int>(evicted.size()), 1);
+    CHECK_INT(evicted[0], 0);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 4);
+    CHECK_INT(selector.GetBudget(), 4);
+
+    // The remaining copy is still kept, a view like it is a duplicate
+    CHECK_INT(topLeft.Add(selector), vtkPinholeCameraKeyframeSelector::Rejected);
+
+    // Evicting several keyframes reports distinct indices from the highest down
+    evicted.clear();
+    selector.SetBudget(1, &evicted);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 1);
+    CHECK_INT(static_cast<int>(evicted.size()), 3);
+    for (std::size_t i = 0; i < evicted.size(); ++i)
+    {
+      CHECK_BOOL(evicted[i] >= 0 && evicted[i] < 4, true);
+      if (i > 0)
+      {
+        CHECK_BOOL(evicted[i] < evicted[i - 1], true);
+      }
+    }
+
+    // The budget stays reached, a new view can only replace the keyframe left
+    const int decision = View(200.f, 100.f).Add(selector);
+    CHECK_BOOL(decision == vtkPinholeCameraKeyframeSelector::Rejected || decision == 0, true);
+    CHECK_INT(selector.GetNumberOfKeyframes(), 1);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraKeyframeSelectorTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestAddView());
+  CHECK_EXIT_SUCCESS(TestSetBudget());
+  return EXIT_SUCCESS;
+}
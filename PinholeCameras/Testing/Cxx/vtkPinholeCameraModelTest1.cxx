@@ -0,0 +1,147 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraModelTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras MRML includes
+#include "vtkPinholeCameraModel.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// VTK includes
+#include <vtkMatrix3x3.h>
+
+// OpenCV includes
+#include <opencv2/calib3d.hpp>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  const int MODELS[] = { 0, 4, 5, 8, 12, 14 };
+
+  // Strong enough for every term to matter, mild enough for the rational model to stay monotonic over the points
+  const double COEFFICIENTS[14] =
+  {
+    -0.28, 0.07, 0.001, -0.0008, -0.01, 0.02, -0.005, 0.001, 0.002, -0.001, 0.0015, -0.0007, 0.01, -0.02
+  };
+
+  //----------------------------------------------------------------------------
+  int TestModel(int model)
+  {
+    vtkPinholeCameraModel::Parameters parameters;
+    const double intrinsics[9] = { 812.5, 0.0, 331.25, 0.0, 808.0, 242.75, 0.0, 0.0, 1.0 };
+    std::copy(intrinsics, intrinsics + 9, parameters.Intrinsics);
+    vtkMatrix3x3::Invert(parameters.Intrinsics, parameters.InverseIntrinsics);
+    std::fill(parameters.DistortionCoefficients, parameters.DistortionCoefficients + 14, 0.0);
+    std::copy(COEFFICIENTS, COEFFICIENTS + model, parameters.DistortionCoefficients);
+    vtkPinholeCameraModel::ComputeTiltMatrix(parameters.DistortionCoefficients[12], parameters.DistortionCoefficients[13], parameters.TiltMatrix);
+    vtkMatrix3x3::Invert(parameters.TiltMatrix, parameters.InverseTiltMatrix);
+    const double offset[3] = { 0.5, -0.25, 1.0 };
+    std::copy(offset, offset + 3, parameters.CameraPlaneOffset);
+    CHECK_INT(vtkPinholeCameraModel::GetDistortionModel(parameters.DistortionCoefficients), model);
+
+    // Reference to sensor: a rotation about a skewed axis and a translation
+    cv::Mat rotationVector = (cv::Mat_<double>(3, 1) << 0.1, -0.2, 0.05);
+    cv::Mat translation = (cv::Mat_<double>(3, 1) << 5.0, -3.0, 20.0);
+    cv::Mat rotation;
+    cv::Rodrigues(rotationVector, rotation);
+    double referenceToSensor[16] = { 0.0 };
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        referenceToSensor[4 * i + j] = rotation.at<double>(i, j);
+      }
+      referenceToSensor[4 * i + 3] = translation.at<double>(i);
+    }
+    referenceToSensor[15] = 1.0;
+
+    // More points than a projection block, spread over the field of view, the last one behind the camera
+    std::vector<cv::Point3d> points;
+    for (int i = 0; i < 20; ++i)
+    {
+      for (int j = 0; j < 15; ++j)
+      {
+        const double depth = 30.0 + 2.0 * ((i + j) % 7);
+        points.push_back(cv::Point3d((i - 9.5) * 0.025 * depth, (j - 7.0) * 0.025 * depth, depth - 20.0));
+      }
+    }
+    points.push_back(cv::Point3d(0.0, 0.0, -40.0));
+    const int numberOfPoints = static_cast<int>(points.size());
+
+    std::vector<double> pixels(2 * numberOfPoints);
+    vtkPinholeCameraModel::CameraView view = vtkPinholeCameraModel::GetCameraView(parameters);
+    vtkPinholeCameraModelTemplateMacro(model,
+      vtkPinholeCameraModel::ProjectPoints<double, PINHOLE_CAMERA_MODEL>(view, referenceToSensor, &points[0].x, 0, numberOfPoints, pixels.data()));
+
+    // OpenCV projects from the optical center, the camera plane offset moves it away from the sensor origin
+    cv::Mat opencvTranslation = translation - (cv::Mat_<double>(3, 1) << offset[0], offset[1], offset[2]);
+    cv::Mat cameraMatrix(3, 3, CV_64F, const_cast<double*>(intrinsics));
+    cv::Mat distCoeffs;
+    if (model > 0)
+    {
+      distCoeffs = cv::Mat(1, model, CV_64F, const_cast<double*>(COEFFICIENTS));
+    }
+    std::vector<cv::Point2d> expected;
+    cv::projectPoints(std::vector<cv::Point3d>(points.begin(), points.end() - 1), rotationVector, opencvTranslation, cameraMatrix, distCoeffs, expected);
+
+    double maximumError = 0.0;
+    for (int i = 0; i < numberOfPoints - 1; ++i)
+    {
+      maximumError = std::max(maximumError, std::hypot(pixels[2 * i] - expected[i].x, pixels[2 * i + 1] - expected[i].y));
+    }
+    if (maximumError > 1e-6)
+    {
+      std::cerr << "Model " << model << ": projections differ from cv::projectPoints by up to " << maximumError << " pixels" << std::endl;
+      return EXIT_FAILURE;
+    }
+    CHECK_BOOL(std::isnan(pixels[2 * (numberOfPoints - 1)]), true);
+    CHECK_BOOL(std::isnan(pixels[2 * (numberOfPoints - 1) + 1]), true);
+
+    // Float points go through the same kernel
+    std::vector<float> floatPoints;
+    for (int i = 0; i < numberOfPoints - 1; ++i)
+    {
+      floatPoints.push_back(static_cast<float>(points[i].x));
+      floatPoints.push_back(static_cast<float>(points[i].y));
+      floatPoints.push_back(static_cast<float>(points[i].z));
+    }
+    std::vector<double> floatPixels(2 * (numberOfPoints - 1));
+    vtkPinholeCameraModelTemplateMacro(model,
+      vtkPinholeCameraModel::ProjectPoints<float, PINHOLE_CAMERA_MODEL>(view, referenceToSensor, floatPoints.data(), 0, numberOfPoints - 1, floatPixels.data()));
+    for (int i = 0; i < numberOfPoints - 1; ++i)
+    {
+      if (std::hypot(floatPixels[2 * i] - expected[i].x, floatPixels[2 * i + 1] - expected[i].y) > 1e-2)
+      {
+        std::cerr << "Model " << model << ": float point " << i << " projects too far from cv::projectPoints" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraModelTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  for (int model : MODELS)
+  {
+    CHECK_EXIT_SUCCESS(TestModel(model));
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPointToLineRegistrationTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraPointToLineRegistration.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// STL includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  const int NUMBER_OF_PAIRS = 12;
+
+  //----------------------------------------------------------------------------
+  // Marker to image sensor like transform: a rotation of 2.5 rad about a skewed axis and a translation
+  void SetGroundTruth(vtkMatrix4x4* transform)
+  {
+    double axis[3] = { 0.4, -1.2, 2.0 };
+    vtkMath::Normalize(axis);
+    const double angle = 2.5;
+    const double c = std::cos(angle);
+    const double s = std::sin(angle);
+    const double skew[3][3] = { { 0.0, -axis[2], axis[1] }, { axis[2], 0.0, -axis[0] }, { -axis[1], axis[0], 0.0 } };
+    const double translation[3] = { 35.0, -12.0, 80.0 };
+    transform->Identity();
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        transform->SetElement(i, j, (i == j ? c : 0.0) + s * skew[i][j] + (1.0 - c) * axis[i] * axis[j]);
+      }
+      transform->SetElement(i, 3, translation[i]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Points around the marker, far from the origin, seen from two line origins as camera rays would be
+  void GetPair(vtkMatrix4x4* transform, int index, double point[3], double lineOrigin[3], double lineDirection[3])
+  {
+    point[0] = 1000.0 + 40.0 * std::sin(1.7 * index);
+    point[1] = -500.0 + 40.0 * std::cos(2.3 * index);
+    point[2] = 200.0 + 25.0 * std::sin(0.9 * index + 0.5);
+    lineOrigin[0] = (index % 2) ? 60.0 : 0.0;
+    lineOrigin[1] = 0.0;
+    lineOrigin[2] = (index % 2) ? -10.0 : 0.0;
+    const double homogeneous[4] = { point[0], point[1], point[2], 1.0 };
+    double transformed[4];
+    transform->MultiplyPoint(homogeneous, transformed);
+    for (int i = 0; i < 3; ++i)
+    {
+      lineDirection[i] = transformed[i] - lineOrigin[i];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  int CheckTransform(vtkMatrix4x4* actual, vtkMatrix4x4* expected, double tolerance)
+  {
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+      {
+        if (std::abs(actual->GetElement(i, j) - expected->GetElement(i, j)) > tolerance)
+        {
+          std::cerr << "Transform element (" << i << ", " << j << ") is " << actual->GetElement(i, j)
+                    << ", expected " << expected->GetElement(i, j) << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestRegistration()
+  {
+    vtkNew<vtkMatrix4x4> groundTruth;
+    SetGroundTruth(groundTruth.GetPointer());
+
+    vtkNew<vtkPinholeCameraPointToLineRegistration> registration;
+    double point[3];
+    double lineOrigin[3];
+    double lineDirection[3];
+    const double nullDirection[3] = { 0.0, 0.0, 0.0 };
+    GetPair(groundTruth.GetPointer(), 0, point, lineOrigin, lineDirection);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(registration->AddPointAndLine(point, lineOrigin, nullDirection), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    CHECK_INT(registration->GetNumberOfPairs(), 0);
+
+    // Two pairs leave two degrees of freedom
+    for (int pair = 0; pair < 2; ++pair)
+    {
+      GetPair(groundTruth.GetPointer(), pair, point, lineOrigin, lineDirection);
+      CHECK_BOOL(registration->AddPointAndLine(point, lineOrigin, lineDirection), true);
+    }
+    CHECK_BOOL(registration->Update(), false);
+    CHECK_INT(registration->GetStatus(), vtkPinholeCameraPointToLineRegistration::InsufficientData);
+    CHECK_DOUBLE(registration->GetError(), -1.0);
+
+    // From scratch, the rotation is far from the identity and the norm constrained start has to find it
+    for (int pair = 2; pair < NUMBER_OF_PAIRS; ++pair)
+    {
+      GetPair(groundTruth.GetPointer(), pair, point, lineOrigin, lineDirection);
+      registration->AddPointAndLine(point, lineOrigin, lineDirection);
+    }
+    CHECK_INT(registration->GetNumberOfPairs(), NUMBER_OF_PAIRS);
+    CHECK_BOOL(registration->Update(), true);
+    CHECK_INT(registration->GetStatus(), vtkPinholeCameraPointToLineRegistration::Converged);
+    CHECK_EXIT_SUCCESS(CheckTransform(registration->GetTransform(), groundTruth.GetPointer(), 1e-6));
+    CHECK_BOOL(registration->GetError() < 1e-6, true);
+
+    vtkNew<vtkDoubleArray> residuals;
+    CHECK_BOOL(registration->GetResiduals(residuals.GetPointer()), true);
+    CHECK_INT(residuals->GetNumberOfTuples(), NUMBER_OF_PAIRS);
+    for (int pair = 0; pair < NUMBER_OF_PAIRS; ++pair)
+    {
+      CHECK_BOOL(residuals->GetValue(pair) < 1e-6, true);
+    }
+
+    // Reset keeps the transform, the next Update starts from it and only needs to confirm it
+    registration->Reset();
+    CHECK_INT(registration->GetNumberOfPairs(), 0);
+    CHECK_EXIT_SUCCESS(CheckTransform(registration->GetTransform(), groundTruth.GetPointer(), 1e-6));
+    for (int pair = NUMBER_OF_PAIRS; pair < 2 * NUMBER_OF_PAIRS; ++pair)
+    {
+      GetPair(groundTruth.GetPointer(), pair, point, lineOrigin, lineDirection);
+      registration->AddPointAndLine(point, lineOrigin, lineDirection);
+    }
+    CHECK_BOOL(registration->Update(), true);
+    CHECK_BOOL(registration->GetNumberOfIterations() <= 2, true);
+    CHECK_EXIT_SUCCESS(CheckTransform(registration->GetTransform(), groundTruth.GetPointer(), 1e-6));
+
+    // A line moved across its point stands out in the residuals
+    vtkNew<vtkPinholeCameraPointToLineRegistration> offsetRegistration;
+    for (int pair = 0; pair < NUMBER_OF_PAIRS; ++pair)
+    {
+      GetPair(groundTruth.GetPointer(), pair, point, lineOrigin, lineDirection);
+      double shiftedOrigin[3] = { lineOrigin[0], lineOrigin[1], lineOrigin[2] };
+      if (pair == 3)
+      {
+        double normal[3] = { -lineDirection[1], lineDirection[0], 0.0 };
+        vtkMath::Normalize(normal);
+        for (int i = 0; i < 3; ++i)
+        {
+          shiftedOrigin[i] += 5.0 * normal[i];
+        }
+      }
+      offsetRegistration->AddPointAndLine(point, shiftedOrigin, lineDirection);
+    }
+    CHECK_BOOL(offsetRegistration->Update(), true);
+    CHECK_BOOL(offsetRegistration->GetError() > 0.1, true);
+    CHECK_BOOL(offsetRegistration->GetResiduals(residuals.GetPointer()), true);
+    for (int pair = 0; pair < NUMBER_OF_PAIRS; ++pair)
+    {
+      CHECK_BOOL(pair == 3 || residuals->GetValue(pair) < residuals->GetValue(3), true);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestDegenerate()
+  {
+    // Parallel lines leave the translation along them undetermined
+    vtkNew<vtkPinholeCameraPointToLineRegistration> registration;
+    const double lineDirection[3] = { 0.0, 0.0, 1.0 };
+    for (int pair = 0; pair < NUMBER_OF_PAIRS; ++pair)
+    {
+      const double point[3] = { 10.0 * std::cos(pair), 10.0 * std::sin(pair), 5.0 * pair };
+      const double lineOrigin[3] = { point[0], point[1], 0.0 };
+      registration->AddPointAndLine(point, lineOrigin, lineDirection);
+    }
+    CHECK_BOOL(registration->Update(), false);
+    CHECK_INT(registration->GetStatus(), vtkPinholeCameraPointToLineRegistration::Degenerate);
+    CHECK_DOUBLE(registration->GetError(), -1.0);
+    CHECK_STRING(vtkPinholeCameraPointToLineRegistration::GetStatusAsString(registration->GetStatus()), "Degenerate");
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPointToLineRegistrationTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestRegistration());
+  CHECK_EXIT_SUCCESS(TestDegenerate());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,195 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraPoseBufferTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraPoseBuffer.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLLinearTransformNode.h>
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// STL includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Rotation of angle degrees about z, translated by (translation, 2 * translation, 5)
+  void SetPose(vtkMatrix4x4* pose, double angle, double translation)
+  {
+    const double radians = vtkMath::RadiansFromDegrees(angle);
+    pose->Identity();
+    pose->SetElement(0, 0, std::cos(radians));
+    pose->SetElement(0, 1, -std::sin(radians));
+    pose->SetElement(1, 0, std::sin(radians));
+    pose->SetElement(1, 1, std::cos(radians));
+    pose->SetElement(0, 3, translation);
+    pose->SetElement(1, 3, 2.0 * translation);
+    pose->SetElement(2, 3, 5.0);
+  }
+
+  //----------------------------------------------------------------------------
+  int CheckPose(vtkMatrix4x4* actual, double angle, double translation)
+  {
+    vtkNew<vtkMatrix4x4> expected;
+    SetPose(expected.GetPointer(), angle, translation);
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+      {
+        if (std::abs(actual->GetElement(i, j) - expected->GetElement(i, j)) > 1e-9)
+        {
+          std::cerr << "Element (" << i << ", " << j << ") is " << actual->GetElement(i, j) << ", expected "
+                    << expected->GetElement(i, j) << " for a rotation of " << angle << " degrees" << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestInterpolation()
+  {
+    vtkNew<vtkPinholeCameraPoseBuffer> buffer;
+    vtkNew<vtkMatrix4x4> pose;
+
+    // An empty buffer leaves the pose unchanged
+    SetPose(pose.GetPointer(), 45.0, 1.0);
+    CHECK_BOOL(buffer->GetPoseAtTime(0.0, pose.GetPointer()), false);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 45.0, 1.0));
+
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    buffer->SetCapacity(1);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    buffer->SetCapacity(4);
+    CHECK_INT(buffer->GetCapacity(), 4);
+
+    // 30 degrees and 10 mm per second
+    for (int i = 0; i < 4; ++i)
+    {
+      SetPose(pose.GetPointer(), 30.0 * i, 10.0 * i);
+      CHECK_BOOL(buffer->AddPose(pose.GetPointer(), i), true);
+    }
+    CHECK_INT(buffer->GetNumberOfPoses(), 4);
+    CHECK_DOUBLE(buffer->GetOldestTimestamp(), 0.0);
+    CHECK_DOUBLE(buffer->GetNewestTimestamp(), 3.0);
+
+    // At the samples and between them, the rotation turns at a constant rate
+    for (int i = 0; i < 4; ++i)
+    {
+      CHECK_BOOL(buffer->GetPoseAtTime(i, pose.GetPointer()), true);
+      CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 30.0 * i, 10.0 * i));
+    }
+    CHECK_BOOL(buffer->GetPoseAtTime(1.25, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 37.5, 12.5));
+    CHECK_BOOL(buffer->GetPoseAtTime(2.5, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 75.0, 25.0));
+
+    // A full buffer overwrites its oldest pose, interpolation goes on across the end of the storage
+    SetPose(pose.GetPointer(), 120.0, 40.0);
+    CHECK_BOOL(buffer->AddPose(pose.GetPointer(), 4.0), true);
+    CHECK_INT(buffer->GetNumberOfPoses(), 4);
+    CHECK_DOUBLE(buffer->GetOldestTimestamp(), 1.0);
+    CHECK_DOUBLE(buffer->GetNewestTimestamp(), 4.0);
+    CHECK_BOOL(buffer->GetPoseAtTime(3.5, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 105.0, 35.0));
+    CHECK_BOOL(buffer->GetPoseAtTime(1.5, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 45.0, 15.0));
+
+    // Outside of the recorded span the closest pose is returned, but the time is not covered
+    CHECK_BOOL(buffer->GetPoseAtTime(0.5, pose.GetPointer()), false);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 30.0, 10.0));
+    CHECK_BOOL(buffer->GetPoseAtTime(10.0, pose.GetPointer()), false);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 120.0, 40.0));
+
+    // Timestamps cannot go back, an equal timestamp replaces the newest pose
+    SetPose(pose.GetPointer(), 0.0, 0.0);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(buffer->AddPose(pose.GetPointer(), 3.5), false);
+    CHECK_BOOL(buffer->AddPose(nullptr, 5.0), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    SetPose(pose.GetPointer(), 100.0, 30.0);
+    CHECK_BOOL(buffer->AddPose(pose.GetPointer(), 4.0), true);
+    CHECK_INT(buffer->GetNumberOfPoses(), 4);
+    CHECK_BOOL(buffer->GetPoseAtTime(3.5, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 95.0, 30.0));
+
+    buffer->Reset();
+    CHECK_INT(buffer->GetNumberOfPoses(), 0);
+    CHECK_BOOL(buffer->GetPoseAtTime(3.5, pose.GetPointer()), false);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestShortestPath()
+  {
+    // From 170 to 190 degrees the rotation goes through 180 degrees, not back through 0
+    vtkNew<vtkPinholeCameraPoseBuffer> buffer;
+    vtkNew<vtkMatrix4x4> pose;
+    SetPose(pose.GetPointer(), 170.0, 0.0);
+    CHECK_BOOL(buffer->AddPose(pose.GetPointer(), 0.0), true);
+    SetPose(pose.GetPointer(), 190.0, 0.0);
+    CHECK_BOOL(buffer->AddPose(pose.GetPointer(), 1.0), true);
+    CHECK_BOOL(buffer->GetPoseAtTime(0.5, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 180.0, 0.0));
+    CHECK_BOOL(buffer->GetPoseAtTime(0.25, pose.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(pose.GetPointer(), 175.0, 0.0));
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestTransformNode()
+  {
+    vtkNew<vtkPinholeCameraPoseBuffer> buffer;
+    vtkNew<vtkMRMLLinearTransformNode> transformNode;
+    vtkNew<vtkMatrix4x4> pose;
+    SetPose(pose.GetPointer(), 60.0, 3.0);
+    transformNode->SetMatrixTransformToParent(pose.GetPointer());
+
+    // The current pose is recorded as soon as the node is set
+    buffer->SetTransformNode(transformNode.GetPointer());
+    CHECK_INT(buffer->GetNumberOfPoses(), 1);
+    vtkNew<vtkMatrix4x4> recorded;
+    CHECK_BOOL(buffer->GetPoseAtTime(buffer->GetNewestTimestamp(), recorded.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(recorded.GetPointer(), 60.0, 3.0));
+
+    // Later changes are recorded, a change within the timer resolution replaces the newest pose
+    SetPose(pose.GetPointer(), 70.0, 4.0);
+    transformNode->SetMatrixTransformToParent(pose.GetPointer());
+    CHECK_BOOL(buffer->GetNumberOfPoses() >= 1 && buffer->GetNumberOfPoses() <= 2, true);
+    CHECK_BOOL(buffer->GetPoseAtTime(buffer->GetNewestTimestamp(), recorded.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPose(recorded.GetPointer(), 70.0, 4.0));
+
+    buffer->SetTransformNode(nullptr);
+    CHECK_NULL(buffer->GetTransformNode());
+    CHECK_INT(buffer->GetNumberOfPoses(), 0);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraPoseBufferTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestInterpolation());
+  CHECK_EXIT_SUCCESS(TestShortestPath());
+  CHECK_EXIT_SUCCESS(TestTransformNode());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraRayIntersectionTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraRayIntersection.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix3x3.h>
+#include <vtkNew.h>
+
+// STL includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  int CheckPoint(const double* actual, const double expected[3], double tolerance)
+  {
+    for (int i = 0; i < 3; ++i)
+    {
+      if (!(std::abs(actual[i] - expected[i]) <= tolerance))
+      {
+        std::cerr << "Point (" << actual[0] << ", " << actual[1] << ", " << actual[2] << "), expected ("
+                  << expected[0] << ", " << expected[1] << ", " << expected[2] << ")" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestExactIntersection()
+  {
+    vtkNew<vtkPinholeCameraRayIntersection> intersection;
+    const double point[3] = { 10.0, 20.0, 30.0 };
+
+    // Directions are normalized, origins can be anywhere on the rays
+    const double directions[3][3] = { { 5.0, 0.0, 0.0 }, { 0.0, 1.0, 1.0 }, { 1.0, -2.0, 3.0 } };
+    for (int ray = 0; ray < 3; ++ray)
+    {
+      double origin[3];
+      for (int i = 0; i < 3; ++i)
+      {
+        origin[i] = point[i] - (10.0 + ray) * directions[ray][i];
+      }
+      // Fewer than two rays have no intersection
+      CHECK_BOOL(intersection->Update(), ray >= 2);
+      CHECK_BOOL(intersection->GetError() >= 0.0, ray >= 2);
+      CHECK_BOOL(intersection->AddRay(origin, directions[ray]), true);
+    }
+    CHECK_INT(intersection->GetNumberOfRays(), 3);
+    CHECK_BOOL(intersection->Update(), true);
+    CHECK_EXIT_SUCCESS(CheckPoint(intersection->GetIntersection(), point, 1e-9));
+    CHECK_DOUBLE_TOLERANCE(intersection->GetError(), 0.0, 1e-6);
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        CHECK_DOUBLE_TOLERANCE(intersection->GetCovariance()->GetElement(i, j), 0.0, 1e-9);
+      }
+    }
+
+    // Null directions and weights that are not positive are rejected
+    const double nullDirection[3] = { 0.0, 0.0, 0.0 };
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(intersection->AddRay(point, nullDirection), false);
+    CHECK_BOOL(intersection->AddRay(point, directions[0], 0.0), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    CHECK_INT(intersection->GetNumberOfRays(), 3);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestCovariance()
+  {
+    // Rays along x, y and z passing 2 mm from each other: A = 2 I, the point is (1, 1, 1) at sqrt(2) from every ray.
+    // With 3 degrees of freedom left the variance is 6 / 3 = 2, and the covariance 2 A^-1 = I.
+    vtkNew<vtkPinholeCameraRayIntersection> intersection;
+    const double origins[3][3] = { { -10.0, 2.0, 0.0 }, { 0.0, -10.0, 2.0 }, { 2.0, 0.0, -10.0 } };
+    const double directions[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+    for (int ray = 0; ray < 3; ++ray)
+    {
+      CHECK_BOOL(intersection->AddRay(origins[ray], directions[ray]), true);
+    }
+    CHECK_BOOL(intersection->Update(), true);
+    const double expected[3] = { 1.0, 1.0, 1.0 };
+    CHECK_EXIT_SUCCESS(CheckPoint(intersection->GetIntersection(), expected, 1e-9));
+    CHECK_DOUBLE_TOLERANCE(intersection->GetError(), std::sqrt(2.0), 1e-9);
+    for (int i = 0; i < 3; ++i)
+    {
+      for (int j = 0; j < 3; ++j)
+      {
+        CHECK_DOUBLE_TOLERANCE(intersection->GetCovariance()->GetElement(i, j), i == j ? 1.0 : 0.0, 1e-9);
+      }
+    }
+
+    // Adding a ray then removing it gives back the same results
+    const double extraOrigin[3] = { 50.0, 40.0, 30.0 };
+    const double extraDirection[3] = { -1.0, -1.0, -0.5 };
+    CHECK_BOOL(intersection->AddRay(extraOrigin, extraDirection, 3.0), true);
+    CHECK_INT(intersection->GetNumberOfRays(), 4);
+    CHECK_BOOL(intersection->Update(), true);
+    CHECK_BOOL(std::abs(intersection->GetIntersection()[0] - 1.0) > 1e-3, true);
+    CHECK_BOOL(intersection->RemoveRay(extraOrigin, extraDirection, 3.0), true);
+    CHECK_INT(intersection->GetNumberOfRays(), 3);
+    CHECK_BOOL(intersection->Update(), true);
+    CHECK_EXIT_SUCCESS(CheckPoint(intersection->GetIntersection(), expected, 1e-9));
+    CHECK_DOUBLE_TOLERANCE(intersection->GetError(), std::sqrt(2.0), 1e-9);
+    CHECK_DOUBLE_TOLERANCE(intersection->GetCovariance()->GetElement(1, 1), 1.0, 1e-9);
+
+    // A much heavier ray pulls the point onto it
+    intersection->Reset();
+    CHECK_INT(intersection->GetNumberOfRays(), 0);
+    CHECK_BOOL(intersection->AddRay(origins[0], directions[0]), true);
+    CHECK_BOOL(intersection->AddRay(origins[1], directions[1]), true);
+    CHECK_BOOL(intersection->AddRay(origins[2], directions[2], 1e6), true);
+    CHECK_BOOL(intersection->Update(), true);
+    CHECK_DOUBLE_TOLERANCE(intersection->GetIntersection()[0], 2.0, 1e-3);
+    CHECK_DOUBLE_TOLERANCE(intersection->GetIntersection()[1], 0.0, 1e-3);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestParallelRays()
+  {
+    vtkNew<vtkPinholeCameraRayIntersection> intersection;
+    const double direction[3] = { 0.0, 0.0, 1.0 };
+    const double origin1[3] = { 0.0, 0.0, 0.0 };
+    const double origin2[3] = { 5.0, 0.0, 0.0 };
+    CHECK_BOOL(intersection->AddRay(origin1, direction), true);
+    CHECK_BOOL(intersection->AddRay(origin2, direction), true);
+    CHECK_BOOL(intersection->Update(), false);
+    CHECK_DOUBLE(intersection->GetError(), -1.0);
+
+    // Removing from an empty accumulation is an error
+    intersection->Reset();
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(intersection->RemoveRay(origin1, direction), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Ray from 100 mm before point along direction, its origin moved by offset
+  void InsertRay(vtkDoubleArray* origins, vtkDoubleArray* directions, const double point[3], const double direction[3], const double offset[3])
+  {
+    double normalized[3] = { direction[0], direction[1], direction[2] };
+    vtkMath::Normalize(normalized);
+    origins->InsertNextTuple3(point[0] - 100.0 * normalized[0] + offset[0], point[1] - 100.0 * normalized[1] + offset[1],
+                              point[2] - 100.0 * normalized[2] + offset[2]);
+    directions->InsertNextTuple3(direction[0], direction[1], direction[2]);
+  }
+
+  //----------------------------------------------------------------------------
+  // Every ray is flagged as an inlier exactly when it passes closer than the threshold to the intersection
+  int CheckInliers(vtkPinholeCameraRayIntersection* intersection, vtkDoubleArray* origins, vtkDoubleArray* directions, vtkIntArray* inliers)
+  {
+    CHECK_INT(static_cast<int>(inliers->GetNumberOfTuples()), static_cast<int>(origins->GetNumberOfTuples()));
+    int numberOfInliers = 0;
+    for (vtkIdType id = 0; id < origins->GetNumberOfTuples(); ++id)
+    {
+      double origin[3];
+      double direction[3];
+      origins->GetTypedTuple(id, origin);
+      directions->GetTypedTuple(id, direction);
+      int inlier = 0;
+      if (vtkMath::Normalize(direction) > 0.0)
+      {
+        double toPoint[3];
+        vtkMath::Subtract(intersection->GetIntersection(), origin, toPoint);
+        const double along = vtkMath::Dot(toPoint, direction);
+        const double squaredDistance = vtkMath::Dot(toPoint, toPoint) - along * along;
+        inlier = squaredDistance < intersection->GetRobustThreshold() * intersection->GetRobustThreshold() ? 1 : 0;
+      }
+      CHECK_INT(inliers->GetValue(id), inlier);
+      numberOfInliers += inlier;
+    }
+    CHECK_INT(intersection->GetNumberOfRays(), numberOfInliers);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestRobust()
+  {
+    vtkNew<vtkPinholeCameraRayIntersection> intersection;
+    vtkNew<vtkDoubleArray> origins;
+    origins->SetNumberOfComponents(3);
+    vtkNew<vtkDoubleArray> directions;
+    directions->SetNumberOfComponents(3);
+    vtkNew<vtkIntArray> inliers;
+    const double point[3] = { 10.0, 20.0, 30.0 };
+
+    // 6 rays within 0.1 mm of the point, a ray 20 mm away and a ray without direction
+    const double rayDirections[6][3] = { { 1.0, 0.0, 0.2 }, { 0.0, 1.0, 0.3 }, { -1.0, 0.5, 1.0 },
+                                         { 0.5, -1.0, 1.0 }, { 1.0, 1.0, 1.0 }, { -0.3, -0.2, 1.0 } };
+    for (int ray = 0; ray < 6; ++ray)
+    {
+      const double offset[3] = { ray % 2 == 0 ? 0.1 : -0.1, 0.0, 0.0 };
+      InsertRay(origins.GetPointer(), directions.GetPointer(), point, rayDirections[ray], offset);
+    }
+    const double outlierDirection[3] = { 0.0, 0.0, 1.0 };
+    const double outlierOffset[3] = { 20.0, 0.0, 0.0 };
+    InsertRay(origins.GetPointer(), directions.GetPointer(), point, outlierDirection, outlierOffset);
+    origins->InsertNextTuple3(point[0], point[1], point[2]);
+    directions->InsertNextTuple3(0.0, 0.0, 0.0);
+
+    // The outlier would move the least-squares intersection by several mm
+    for (vtkIdType id = 0; id < 7; ++id)
+    {
+      double origin[3];
+      double direction[3];
+      origins->GetTypedTuple(id, origin);
+      directions->GetTypedTuple(id, direction);
+      CHECK_BOOL(intersection->AddRay(origin, direction), true);
+    }
+    CHECK_BOOL(intersection->Update(), true);
+    CHECK_BOOL(std::sqrt(vtkMath::Distance2BetweenPoints(intersection->GetIntersection(), point)) > 1.0, true);
+
+    CHECK_BOOL(intersection->UpdateRobust(origins.GetPointer(), directions.GetPointer(), inliers.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPoint(intersection->GetIntersection(), point, 0.2));
+    CHECK_INT(intersection->GetNumberOfRays(), 6);
+    for (vtkIdType id = 0; id < 6; ++id)
+    {
+      CHECK_INT(inliers->GetValue(id), 1);
+    }
+    CHECK_INT(inliers->GetValue(6), 0);
+    CHECK_INT(inliers->GetValue(7), 0);
+    CHECK_EXIT_SUCCESS(CheckInliers(intersection.GetPointer(), origins.GetPointer(), directions.GetPointer(), inliers.GetPointer()));
+    CHECK_BOOL(intersection->GetError() < 0.1, true);
+
+    // With more pairs than iterations, random pairs are drawn
+    for (int ray = 0; ray < 6; ++ray)
+    {
+      const double offset[3] = { 0.0, ray % 2 == 0 ? 0.05 : -0.05, 0.0 };
+      InsertRay(origins.GetPointer(), directions.GetPointer(), point, rayDirections[ray], offset);
+    }
+    const double secondOutlierOffset[3] = { 0.0, -15.0, 0.0 };
+    InsertRay(origins.GetPointer(), directions.GetPointer(), point, rayDirections[4], secondOutlierOffset);
+    intersection->SetRobustNumberOfIterations(20);
+    CHECK_BOOL(intersection->UpdateRobust(origins.GetPointer(), directions.GetPointer(), inliers.GetPointer()), true);
+    CHECK_EXIT_SUCCESS(CheckPoint(intersection->GetIntersection(), point, 0.2));
+    CHECK_INT(intersection->GetNumberOfRays(), 12);
+    CHECK_INT(inliers->GetValue(6), 0);
+    CHECK_INT(inliers->GetValue(7), 0);
+    CHECK_INT(inliers->GetValue(14), 0);
+    CHECK_EXIT_SUCCESS(CheckInliers(intersection.GetPointer(), origins.GetPointer(), directions.GetPointer(), inliers.GetPointer()));
+
+    // Arrays that do not hold one 3 component tuple per ray, and a threshold that is not positive, are rejected
+    vtkNew<vtkDoubleArray> shortDirections;
+    shortDirections->SetNumberOfComponents(3);
+    shortDirections->InsertNextTuple3(1.0, 0.0, 0.0);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(intersection->UpdateRobust(origins.GetPointer(), shortDirections.GetPointer(), inliers.GetPointer()), false);
+    CHECK_BOOL(intersection->UpdateRobust(nullptr, directions.GetPointer()), false);
+    intersection->SetRobustThreshold(0.0);
+    CHECK_BOOL(intersection->UpdateRobust(origins.GetPointer(), directions.GetPointer()), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraRayIntersectionTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestExactIntersection());
+  CHECK_EXIT_SUCCESS(TestCovariance());
+  CHECK_EXIT_SUCCESS(TestParallelRays());
+  CHECK_EXIT_SUCCESS(TestRobust());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraResidualAnalysisTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraResidualAnalysis.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkIntArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkTable.h>
+
+// STL includes
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  // Pattern points on a 3x3 grid of 100 mm, 500 mm in front of a camera with a 500 pixel focal length:
+  // without distortion the pattern projects 1 pixel per mm around the principal point (320, 240)
+  const double INTRINSICS[9] = { 500.0, 0.0, 320.0, 0.0, 500.0, 240.0, 0.0, 0.0, 1.0 };
+  const int NUMBER_OF_POINTS = 9;
+
+  //----------------------------------------------------------------------------
+  void GetPatternPoint(int i, double point[3])
+  {
+    point[0] = 100.0 * (i % 3 - 1);
+    point[1] = 100.0 * (i / 3 - 1);
+    point[2] = 0.0;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestInvalidInputs()
+  {
+    vtkNew<vtkPinholeCameraResidualAnalysis> analysis;
+
+    // A camera and a view are needed
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(analysis->Update(), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+
+    const double badIntrinsics[9] = { 0.0, 0.0, 320.0, 0.0, 500.0, 240.0, 0.0, 0.0, 1.0 };
+    const double coefficients[15] = { 0.0 };
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_BOOL(analysis->SetCamera(badIntrinsics, coefficients, 5), false);
+    CHECK_BOOL(analysis->SetCamera(INTRINSICS, coefficients, 15), false);
+    CHECK_BOOL(analysis->SetCamera(static_cast<vtkMRMLPinholeCameraNode*>(nullptr)), false);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+
+    // Mismatched arrays and missing poses or points are rejected by both overloads
+    vtkNew<vtkPoints> objectPoints;
+    objectPoints->InsertNextPoint(0.0, 0.0, 0.0);
+    vtkNew<vtkDoubleArray> imagePoints;
+    imagePoints->SetNumberOfComponents(2);
+    vtkNew<vtkMatrix4x4> pose;
+    const float floatObjectPoints[3] = { 0.f, 0.f, 0.f };
+    const float floatImagePoints[2] = { 320.f, 240.f };
+    double floatPose[16];
+    vtkMatrix4x4::Identity(floatPose);
+    TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+    CHECK_INT(analysis->AddView(objectPoints.GetPointer(), imagePoints.GetPointer(), pose.GetPointer()), -1);
+    CHECK_INT(analysis->AddView(objectPoints.GetPointer(), nullptr, pose.GetPointer()), -1);
+    CHECK_INT(analysis->AddView(floatObjectPoints, floatImagePoints, -1, floatPose), -1);
+    CHECK_INT(analysis->AddView(nullptr, floatImagePoints, 1, floatPose), -1);
+    CHECK_INT(analysis->AddView(floatObjectPoints, nullptr, 1, floatPose), -1);
+    CHECK_INT(analysis->AddView(floatObjectPoints, floatImagePoints, 1, nullptr), -1);
+    TESTING_OUTPUT_ASSERT_ERRORS_END();
+    CHECK_INT(analysis->GetNumberOfViews(), 0);
+    CHECK_INT(static_cast<int>(analysis->GetNumberOfCorners()), 0);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestResiduals()
+  {
+    vtkNew<vtkPinholeCameraResidualAnalysis> analysis;
+    const double coefficients[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    CHECK_BOOL(analysis->SetCamera(INTRINSICS, coefficients, 5), true);
+    analysis->SetImageSize(640, 480);
+    analysis->SetHeatmapCellSize(32);
+    // Bins of 1.6 pixels for errors and 3.2 pixels for residual components, no value falls on a bin edge
+    analysis->SetNumberOfHistogramBins(5);
+    analysis->SetHistogramRange(8.0);
+
+    // View 0 is detected exactly where it projects
+    vtkNew<vtkPoints> objectPoints;
+    vtkNew<vtkDoubleArray> imagePoints;
+    imagePoints->SetNumberOfComponents(2);
+    for (int i = 0; i < NUMBER_OF_POINTS; ++i)
+    {
+      double point[3];
+      GetPatternPoint(i, point);
+      objectPoints->InsertNextPoint(point[0], point[1], point[2]);
+      imagePoints->InsertNextTuple2(320.0 + point[0], 240.0 + point[1]);
+    }
+    vtkNew<vtkMatrix4x4> pose;
+    pose->SetElement(2, 3, 500.0);
+    CHECK_INT(analysis->AddView(objectPoints.GetPointer(), imagePoints.GetPointer(), pose.GetPointer()), 0);
+
+    // View 1 is detected 3 pixels left and 4 pixels down of its projection, a residual of (3, -4) and an error of 5
+    std::vector<float> floatObjectPoints;
+    std::vector<float> floatImagePoints;
+    for (int i = 0; i < NUMBER_OF_POINTS; ++i)
+    {
+      double point[3];
+      GetPatternPoint(i, point);
+      floatObjectPoints.insert(floatObjectPoints.end(), point, point + 3);
+      floatImagePoints.push_back(static_cast<float>(320.0 + point[0] - 3.0));
+      floatImagePoints.push_back(static_cast<float>(240.0 + point[1] + 4.0));
+    }
+    double floatPose[16];
+    vtkMatrix4x4::Identity(floatPose);
+    floatPose[11] = 500.0;
+    CHECK_INT(analysis->AddView(&floatObjectPoints[0], &floatImagePoints[0], NUMBER_OF_POINTS, floatPose), 1);
+
+    // View 2 has the pattern behind the camera, none of its points count
+    floatPose[11] = -500.0;
+    CHECK_INT(analysis->AddView(&floatObjectPoints[0], &floatImagePoints[0], NUMBER_OF_POINTS, floatPose), 2);
+    CHECK_INT(analysis->GetNumberOfViews(), 3);
+    CHECK_INT(static_cast<int>(analysis->GetNumberOfCorners()), 3 * NUMBER_OF_POINTS);
+
+    CHECK_BOOL(analysis->Update(), true);
+    CHECK_DOUBLE_TOLERANCE(analysis->GetRMSError(), std::sqrt(12.5), 1e-6);
+    CHECK_DOUBLE_TOLERANCE(analysis->GetMaximumError(), 5.0, 1e-6);
+
+    // Per view statistics, the view behind the camera is the first to inspect
+    vtkTable* viewTable = analysis->GetViewTable();
+    vtkIntArray* viewCornerCounts = vtkIntArray::SafeDownCast(viewTable->GetColumnByName("NumberOfCorners"));
+    vtkDoubleArray* viewErrors = vtkDoubleArray::SafeDownCast(viewTable->GetColumnByName("RMSError"));
+    CHECK_NOT_NULL(viewCornerCounts);
+    CHECK_NOT_NULL(viewErrors);
+    CHECK_INT(viewCornerCounts->GetValue(0), NUMBER_OF_POINTS);
+    CHECK_INT(viewCornerCounts->GetValue(1), NUMBER_OF_POINTS);
+    CHECK_INT(viewCornerCounts->GetValue(2), 0);
+    CHECK_DOUBLE_TOLERANCE(viewErrors->GetValue(0), 0.0, 1e-6);
+    CHECK_DOUBLE_TOLERANCE(viewErrors->GetValue(1), 5.0, 1e-6);
+    CHECK_BOOL(std::isnan(viewErrors->GetValue(2)), true);
+    vtkNew<vtkIntArray> sortedViews;
+    analysis->GetViewsSortedByError(sortedViews.GetPointer());
+    CHECK_INT(static_cast<int>(sortedViews->GetNumberOfValues()), 3);
+    CHECK_INT(sortedViews->GetValue(0), 2);
+    CHECK_INT(sortedViews->GetValue(1), 1);
+    CHECK_INT(sortedViews->GetValue(2), 0);
+
+    // Residuals are projected minus detected pixels
+    vtkTable* cornerTable = analysis->GetCornerTable();
+    vtkDoubleArray* residualX = vtkDoubleArray::SafeDownCast(cornerTable->GetColumnByName("ResidualX"));
+    vtkDoubleArray* residualY = vtkDoubleArray::SafeDownCast(cornerTable->GetColumnByName("ResidualY"));
+    CHECK_NOT_NULL(residualX);
+    CHECK_NOT_NULL(residualY);
+    CHECK_DOUBLE_TOLERANCE(residualX->GetValue(NUMBER_OF_POINTS), 3.0, 1e-4);
+    CHECK_DOUBLE_TOLERANCE(residualY->GetValue(NUMBER_OF_POINTS), -4.0, 1e-4);
+
+    // Errors of 0 and 5 fall in bins 0 and 3, residual components of 0, 3 and -4 in bins 2, 3 and 1
+    vtkTable* histogramTable = analysis->GetHistogramTable();
+    vtkDoubleArray* errorCounts = vtkDoubleArray::SafeDownCast(histogramTable->GetColumnByName("ErrorCount"));
+    vtkDoubleArray* residualXCounts = vtkDoubleArray::SafeDownCast(histogramTable->GetColumnByName("ResidualXCount"));
+    vtkDoubleArray* residualYCounts = vtkDoubleArray::SafeDownCast(histogramTable->GetColumnByName("ResidualYCount"));
+    CHECK_NOT_NULL(errorCounts);
+    CHECK_NOT_NULL(residualXCounts);
+    CHECK_NOT_NULL(residualYCounts);
+    const double expectedErrorCounts[5] = { 9.0, 0.0, 0.0, 9.0, 0.0 };
+    const double expectedResidualXCounts[5] = { 0.0, 0.0, 9.0, 9.0, 0.0 };
+    const double expectedResidualYCounts[5] = { 0.0, 9.0, 9.0, 0.0, 0.0 };
+    for (int bin = 0; bin < 5; ++bin)
+    {
+      CHECK_DOUBLE(errorCounts->GetValue(bin), expectedErrorCounts[bin]);
+      CHECK_DOUBLE(residualXCounts->GetValue(bin), expectedResidualXCounts[bin]);
+      CHECK_DOUBLE(residualYCounts->GetValue(bin), expectedResidualYCounts[bin]);
+    }
+
+    // Heatmap of 20x15 cells: the center corner of view 1, detected at (317, 244), is alone in cell (9, 7)
+    vtkImageData* heatmap = analysis->GetHeatmap();
+    int dimensions[3] = { 0, 0, 0 };
+    heatmap->GetDimensions(dimensions);
+    CHECK_INT(dimensions[0], 20);
+    CHECK_INT(dimensions[1], 15);
+    vtkIntArray* cellCounts = vtkIntArray::SafeDownCast(heatmap->GetPointData()->GetArray("NumberOfCorners"));
+    vtkDoubleArray* cellErrors = vtkDoubleArray::SafeDownCast(heatmap->GetPointData()->GetScalars());
+    vtkDoubleArray* cellResiduals = vtkDoubleArray::SafeDownCast(heatmap->GetPointData()->GetArray("MeanResidual"));
+    CHECK_NOT_NULL(cellCounts);
+    CHECK_NOT_NULL(cellErrors);
+    CHECK_NOT_NULL(cellResiduals);
+    int totalCount = 0;
+    for (vtkIdType cell = 0; cell < cellCounts->GetNumberOfValues(); ++cell)
+    {
+      totalCount += cellCounts->GetValue(cell);
+    }
+    CHECK_INT(totalCount, 2 * NUMBER_OF_POINTS);
+    const vtkIdType cell = 7 * 20 + 9;
+    CHECK_INT(cellCounts->GetValue(cell), 1);
+    CHECK_DOUBLE_TOLERANCE(cellErrors->GetValue(cell), 5.0, 1e-4);
+    CHECK_DOUBLE_TOLERANCE(cellResiduals->GetComponent(cell, 0), 3.0, 1e-4);
+    CHECK_DOUBLE_TOLERANCE(cellResiduals->GetComponent(cell, 1), -4.0, 1e-4);
+
+    // Removing the views clears the results
+    analysis->RemoveAllViews();
+    CHECK_INT(analysis->GetNumberOfViews(), 0);
+    CHECK_DOUBLE(analysis->GetRMSError(), -1.0);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraResidualAnalysisTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestInvalidInputs());
+  CHECK_EXIT_SUCCESS(TestResiduals());
+  return EXIT_SUCCESS;
+}
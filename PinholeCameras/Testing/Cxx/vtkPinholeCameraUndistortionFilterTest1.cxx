@@ -0,0 +1,184 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraUndistortionFilterTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraUndistortionFilter.h"
+
+// PinholeCameras MRML includes
+#include "vtkMRMLPinholeCameraNode.h"
+
+// MRML includes
+#include <vtkMRMLCoreTestingMacros.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  const int WIDTH = 64;
+  const int HEIGHT = 48;
+
+  //----------------------------------------------------------------------------
+  // Smooth pattern, so that bilinear samples of the input stay close to the rounded expected values
+  void FillImage(vtkImageData* image, int components)
+  {
+    image->SetDimensions(WIDTH, HEIGHT, 1);
+    image->AllocateScalars(VTK_UNSIGNED_CHAR, components);
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+      for (int x = 0; x < WIDTH; ++x)
+      {
+        for (int c = 0; c < components; ++c)
+        {
+          const double value = 128.0 + 100.0 * std::sin(0.2 * x + c) * std::cos(0.15 * y);
+          image->SetScalarComponentFromDouble(x, y, 0, c, std::floor(value + 0.5));
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Check every output pixel against a bilinear sample of the input at the location given by the float map
+  int CheckOutput(vtkImageData* input, vtkImageData* output, vtkImageData* map, double tolerance)
+  {
+    const int components = input->GetNumberOfScalarComponents();
+    CHECK_INT(output->GetNumberOfScalarComponents(), components);
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+      for (int x = 0; x < WIDTH; ++x)
+      {
+        const double mapX = map->GetScalarComponentAsDouble(x, y, 0, 0);
+        const double mapY = map->GetScalarComponentAsDouble(x, y, 0, 1);
+        for (int c = 0; c < components; ++c)
+        {
+          double expected = 0.0;
+          if (mapX >= 0.0 && mapY >= 0.0 && mapX <= WIDTH - 1 && mapY <= HEIGHT - 1)
+          {
+            const int x0 = static_cast<int>(mapX);
+            const int y0 = static_cast<int>(mapY);
+            const int x1 = std::min(x0 + 1, WIDTH - 1);
+            const int y1 = std::min(y0 + 1, HEIGHT - 1);
+            const double fx = mapX - x0;
+            const double fy = mapY - y0;
+            expected = (1.0 - fx) * (1.0 - fy) * input->GetScalarComponentAsDouble(x0, y0, 0, c)
+              + fx * (1.0 - fy) * input->GetScalarComponentAsDouble(x1, y0, 0, c)
+              + (1.0 - fx) * fy * input->GetScalarComponentAsDouble(x0, y1, 0, c)
+              + fx * fy * input->GetScalarComponentAsDouble(x1, y1, 0, c);
+          }
+          const double actual = output->GetScalarComponentAsDouble(x, y, 0, c);
+          if (std::abs(actual - expected) > tolerance)
+          {
+            std::cerr << "Pixel (" << x << ", " << y << ") component " << c << " is " << actual << ", expected " << expected << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int CountChangedPixels(vtkImageData* before, vtkImageData* after)
+  {
+    int changed = 0;
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+      for (int x = 0; x < WIDTH; ++x)
+      {
+        if (std::abs(before->GetScalarComponentAsDouble(x, y, 0, 0) - after->GetScalarComponentAsDouble(x, y, 0, 0)) > 2.0)
+        {
+          ++changed;
+        }
+      }
+    }
+    return changed;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraUndistortionFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkMRMLPinholeCameraNode> cameraNode;
+  vtkMatrix3x3* intrinsics = cameraNode->GetIntrinsicMatrix();
+  intrinsics->Identity();
+  intrinsics->SetElement(0, 0, 60.0);
+  intrinsics->SetElement(1, 1, 58.0);
+  intrinsics->SetElement(0, 2, 31.5);
+  intrinsics->SetElement(1, 2, 24.0);
+
+  vtkNew<vtkImageData> input;
+  FillImage(input.GetPointer(), 1);
+  vtkNew<vtkPinholeCameraUndistortionFilter> filter;
+  filter->SetInputData(input.GetPointer());
+
+  // Without a camera there is nothing to undistort with
+  TESTING_OUTPUT_ASSERT_ERRORS_BEGIN();
+  filter->Update();
+  TESTING_OUTPUT_ASSERT_ERRORS_END();
+
+  // Without distortion the output is the input, up to the border where samples may fall just outside
+  filter->SetCameraNode(cameraNode.GetPointer());
+  filter->Update();
+  vtkNew<vtkImageData> undistorted;
+  undistorted->DeepCopy(filter->GetOutput());
+  CHECK_EXIT_SUCCESS(CheckOutput(input.GetPointer(), undistorted.GetPointer(), cameraNode->GetUndistortionMap(WIDTH, HEIGHT), 1.0));
+  CHECK_BOOL(CountChangedPixels(input.GetPointer(), undistorted.GetPointer()) < WIDTH + HEIGHT, true);
+
+  // Nothing changed, nothing to execute
+  const vtkMTimeType outputTime = filter->GetOutput()->GetMTime();
+  filter->Update();
+  CHECK_BOOL(filter->GetOutput()->GetMTime() == outputTime, true);
+
+  // Changing only a distortion coefficient does not modify the node, the filter still has to execute again
+  const vtkMTimeType nodeTime = cameraNode->GetMTime();
+  cameraNode->SetDistortionCoefficientValue(0, -0.3);
+  CHECK_BOOL(cameraNode->GetMTime() == nodeTime, true);
+  filter->Update();
+  CHECK_BOOL(filter->GetOutput()->GetMTime() > outputTime, true);
+  vtkNew<vtkImageData> distorted;
+  distorted->DeepCopy(filter->GetOutput());
+  CHECK_BOOL(CountChangedPixels(undistorted.GetPointer(), distorted.GetPointer()) > WIDTH * HEIGHT / 4, true);
+  vtkSmartPointer<vtkImageData> map = cameraNode->GetUndistortionMap(WIDTH, HEIGHT);
+  CHECK_EXIT_SUCCESS(CheckOutput(input.GetPointer(), distorted.GetPointer(), map, 1.0));
+
+  // Compact maps sample within their error bound, RGB images are remapped per component
+  cameraNode->SetUndistortionMapFormat(vtkMRMLPinholeCameraNode::UndistortionMapFixedPoint);
+  vtkNew<vtkImageData> rgbInput;
+  FillImage(rgbInput.GetPointer(), 3);
+  filter->SetInputData(rgbInput.GetPointer());
+  filter->Update();
+  const double bound = vtkMRMLPinholeCameraNode::GetCompactUndistortionMapErrorBound(WIDTH, HEIGHT);
+  // A sampling error changes a sample by at most the largest gradient of the pattern (25 per pixel) times the bound
+  CHECK_EXIT_SUCCESS(CheckOutput(rgbInput.GetPointer(), filter->GetOutput(), map, 1.0 + 25.0 * bound));
+
+  // Output intrinsics select another map
+  vtkNew<vtkMatrix3x3> outputIntrinsics;
+  outputIntrinsics->DeepCopy(intrinsics);
+  outputIntrinsics->SetElement(0, 0, 40.0);
+  outputIntrinsics->SetElement(1, 1, 40.0);
+  cameraNode->SetUndistortionMapFormat(vtkMRMLPinholeCameraNode::UndistortionMapFloat);
+  filter->SetOutputIntrinsics(outputIntrinsics.GetPointer());
+  filter->Update();
+  CHECK_EXIT_SUCCESS(CheckOutput(rgbInput.GetPointer(), filter->GetOutput(),
+                                 cameraNode->GetUndistortionMap(WIDTH, HEIGHT, outputIntrinsics.GetPointer()), 1.0));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/*=auto=========================================================================
+
+Portions (c) Copyright 2018 Robarts Research Institute. All Rights Reserved.
+
+See COPYRIGHT.txt
+or http://www.slicer.org/copyright/copyright.txt for details.
+
+Program:   3D Slicer
+Module:    $RCSfile: vtkPinholeCameraViewSynchronizerTest1.cxx,v $
+Date:      $Date: 2018/6/16 10:54:09 $
+Version:   $Revision: 1.0 $
+
+=========================================================================auto=*/
+
+// PinholeCameras MRML includes
+#include "vtkMRMLPinholeCameraNode.h"
+
+// PinholeCameras Logic includes
+#include "vtkPinholeCameraViewSynchronizer.h"
+
+// MRML includes
+#include <vtkMRMLCameraNode.h>
+#include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLLinearTransformNode.h>
+
+// VTK includes
+#include <vtkCamera.h>
+#include <vtkMath.h>
+#include <vtkMatrix3x3.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// STL includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  const int WIDTH = 640;
+  const int HEIGHT = 480;
+
+  //----------------------------------------------------------------------------
+  // A point of the marker coordinates must be rendered where the pinhole model images it. Pixel centers are at
+  // integer coordinates and rows go down, normalized device coordinates span [-1, 1] over the image with y up.
+  int CheckProjection(vtkCamera* camera, vtkMatrix4x4* markerToWorld, const double markerPoint[3], double fx, double fy, double cx, double cy)
+  {
+    const double u = fx * markerPoint[0] / markerPoint[2] + cx;
+    const double v = fy * markerPoint[1] / markerPoint[2] + cy;
+    const double expected[2] = { 2.0 * (u + 0.5) / WIDTH - 1.0, 1.0 - 2.0 * (v + 0.5) / HEIGHT };
+
+    double marker[4] = { markerPoint[0], markerPoint[1], markerPoint[2], 1.0 };
+    double world[4];
+    markerToWorld->MultiplyPoint(marker, world);
+    double device[4];
+    camera->GetCompositeProjectionTransformMatrix(static_cast<double>(WIDTH) / HEIGHT, -1.0, 1.0)->MultiplyPoint(world, device);
+    for (int i = 0; i < 2; ++i)
+    {
+      if (std::abs(device[i] / device[3] - expected[i]) > 1e-9)
+      {
+        std::cerr << "Point (" << markerPoint[0] << ", " << markerPoint[1] << ", " << markerPoint[2] << ") is rendered at ("
+                  << device[0] / device[3] << ", " << device[1] / device[3] << "), expected (" << expected[0] << ", "
+                  << expected[1] << ")" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  int TestOffAxisProjection()
+  {
+    // Square pixels, principal point 20 pixels left of and 20 pixels below the image center
+    const double fx = 800.0;
+    const double fy = 800.0;
+    const double cx = 299.5;
+    const double cy = 259.5;
+    vtkNew<vtkMRMLPinholeCameraNode> pinholeCameraNode;
+    pinholeCameraNode->GetIntrinsicMatrix()->Identity();
+    pinholeCameraNode->GetIntrinsicMatrix()->SetElement(0, 0, fx);
+    pinholeCameraNode->GetIntrinsicMatrix()->SetElement(1, 1, fy);
+    pinholeCameraNode->GetIntrinsicMatrix()->SetElement(0, 2, cx);
+    pinholeCameraNode->GetIntrinsicMatrix()->SetElement(1, 2, cy);
+
+    vtkNew<vtkMRMLCameraNode> viewCameraNode;
+    vtkCamera* camera = viewCameraNode->GetCamera();
+    camera->SetViewAngle(30.0);
+    camera->SetWindowCenter(0.0, 0.0);
+
+    vtkNew<vtkPinholeCameraViewSynchronizer> synchronizer;
+    synchronizer->SetViewCameraNode(viewCameraNode.GetPointer());
+    synchronizer->SetPinholeCameraNode(pinholeCameraNode.GetPointer());
+
+    // Nothing is driven until the image size is known
+    CHECK_BOOL(synchronizer->Update(), false);
+    synchronizer->SetImageSize(WIDTH, HEIGHT);
+    CHECK_BOOL(synchronizer->Update(), true);
+    CHECK_BOOL(synchronizer->Update(), false);
+    CHECK_INT(synchronizer->GetNumberOfViewCameraUpdates(), 1);
+
+    // The vertical view angle spans the image height, the window center moves the optical axis to the principal point
+    CHECK_DOUBLE_TOLERANCE(camera->GetViewAngle(), vtkMath::DegreesFromRadians(2.0 * std::atan(0.5 * HEIGHT / fy)), 1e-9);
+    double windowCenter[2];
+    camera->GetWindowCenter(windowCenter);
+    CHECK_DOUBLE_TOLERANCE(windowCenter[0], 0.0625, 1e-12);
+    CHECK_DOUBLE_TOLERANCE(windowCenter[1], 1.0 / 12.0, 1e-12);
+
+    vtkNew<vtkMatrix4x4> markerToWorld;
+    const double points[4][3] = { { 0.0, 0.0, 200.0 }, { 50.0, -30.0, 500.0 }, { -120.0, 90.0, 400.0 }, { 10.0, 75.0, 150.0 } };
+    for (int i = 0; i < 4; ++i)
+    {
+      CHECK_EXIT_SUCCESS(CheckProjection(camera, markerToWorld.GetPointer(), points[i], fx, fy, cx, cy));
+    }
+
+    // The tracked marker moves the view camera, an unchanged pose does not modify it
+    vtkNew<vtkMRMLLinearTransformNode> transformNode;
+    synchronizer->SetTransformNode(transformNode.GetPointer());
+    markerToWorld->SetElement(0, 0, 0.0);
+    markerToWorld->SetElement(0, 1, -1.0);
+    markerToWorld->SetElement(1, 0, 1.0);
+    markerToWorld->SetElement(1, 1, 0.0);
+    markerToWorld->SetElement(0, 3, 15.0);
+    markerToWorld->SetElement(1, 3, -40.0);
+    markerToWorld->SetElement(2, 3, 100.0);
+    transformNode->SetMatrixTransformToParent(markerToWorld.GetPointer());
+    CHECK_INT(synchronizer->GetNumberOfViewCameraUpdates(), 2);
+    transformNode->SetMatrixTransformToParent(markerToWorld.GetPointer());
+    CHECK_INT(synchronizer->GetNumberOfViewCameraUpdates(), 2);
+    for (int i = 0; i < 4; ++i)
+    {
+      CHECK_EXIT_SUCCESS(CheckProjection(camera, markerToWorld.GetPointer(), points[i], fx, fy, cx, cy));
+    }
+
+    // Non-square pixels only change the vertical scale, the view aspect ratio accounts for the horizontal one
+    pinholeCameraNode->GetIntrinsicMatrix()->SetElement(1, 1, 0.75 * fy);
+    CHECK_INT(synchronizer->GetNumberOfViewCameraUpdates(), 3);
+    CHECK_DOUBLE_TOLERANCE(camera->GetViewAngle(), vtkMath::DegreesFromRadians(2.0 * std::atan(0.5 * HEIGHT / (0.75 * fy))), 1e-9);
+    camera->GetWindowCenter(windowCenter);
+    CHECK_DOUBLE_TOLERANCE(windowCenter[0], 0.0625, 1e-12);
+    CHECK_DOUBLE_TOLERANCE(windowCenter[1], 1.0 / 12.0, 1e-12);
+
+    // Releasing the view gives back its view angle and window center
+    synchronizer->SetViewCameraNode(nullptr);
+    CHECK_DOUBLE(camera->GetViewAngle(), 30.0);
+    camera->GetWindowCenter(windowCenter);
+    CHECK_DOUBLE(windowCenter[0], 0.0);
+    CHECK_DOUBLE(windowCenter[1], 0.0);
+    return EXIT_SUCCESS;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkPinholeCameraViewSynchronizerTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  CHECK_EXIT_SUCCESS(TestOffAxisProjection());
+  return EXIT_SUCCESS;
+}
@@ -30,6 +30,9 @@ Version:   $Revision: 1.0 $
 // VTK includes
 #include <vtksys/RegularExpression.hxx>
 
+// STD includes
+#include <vector>
+
 namespace
 {
   //----------------------------------------------------------------------------
@@ -399,6 +402,7 @@ void qMRMLPinholeCameraIntrinsicsWidget::onIntrinsicMatrixChanged()
   }
 
   this->CurrentNode->RemoveObserver(this->IntrinsicObserverTag);
+  int wasModifying = this->CurrentNode->StartModify();
   QVector<double> vals = d->MatrixWidget_CameraMatrix->values();
   for (int i = 0; i < d->MatrixWidget_CameraMatrix->rowCount(); i++)
   {
@@ -407,6 +411,7 @@ void qMRMLPinholeCameraIntrinsicsWidget::onIntrinsicMatrixChanged()
       this->CurrentNode->GetIntrinsicMatrix()->SetElement(i, j, d->MatrixWidget_CameraMatrix->value(i, j));
     }
   }
+  this->CurrentNode->EndModify(wasModifying);
   this->IntrinsicObserverTag = this->CurrentNode->AddObserver(vtkMRMLPinholeCameraNode::IntrinsicsModifiedEvent, this, &qMRMLPinholeCameraIntrinsicsWidget::OnNodeIntrinsicsModified);
 }
 
@@ -415,16 +420,13 @@ void qMRMLPinholeCameraIntrinsicsWidget::onDistortionMatrixChanged()
 {
   Q_D(qMRMLPinholeCameraIntrinsicsWidget);
 
-  if (this->CurrentNode->GetNumberOfDistortionCoefficients() != d->MatrixWidget_DistCoeffs->columnCount())
-  {
-    this->CurrentNode->SetNumberOfDistortionCoefficients(d->MatrixWidget_DistCoeffs->columnCount());
-  }
-
   this->CurrentNode->RemoveObserver(this->DistortionObserverTag);
+  std::vector<double> values(d->MatrixWidget_DistCoeffs->columnCount());
   for (int i = 0; i < d->MatrixWidget_DistCoeffs->columnCount(); ++i)
   {
-    this->CurrentNode->SetDistortionCoefficientValue(i, d->MatrixWidget_DistCoeffs->value(0, i));
+    values[i] = d->MatrixWidget_DistCoeffs->value(0, i);
   }
+  this->CurrentNode->SetDistortionCoefficientValues(values.data(), static_cast<vtkIdType>(values.size()));
   this->DistortionObserverTag = this->CurrentNode->AddObserver(vtkMRMLPinholeCameraNode::DistortionCoefficientsModifiedEvent, this, &qMRMLPinholeCameraIntrinsicsWidget::OnNodeDistortionCoefficientsModified);
 }
 
@@ -441,6 +443,7 @@ void qMRMLPinholeCameraIntrinsicsWidget::onMarkerTransformMatrixChanged()
   }
 
   this->CurrentNode->RemoveObserver(this->MarkerTransformObserverTag);
+  int wasModifying = this->CurrentNode->StartModify();
   QVector<double> vals = d->MatrixWidget_MarkerToImageSensor->values();
   qWarning() << d->MatrixWidget_MarkerToImageSensor->rowCount();
   qWarning() << d->MatrixWidget_MarkerToImageSensor->columnCount();
@@ -451,6 +454,7 @@ void qMRMLPinholeCameraIntrinsicsWidget::onMarkerTransformMatrixChanged()
       this->CurrentNode->GetMarkerToImageSensorTransform()->SetElement(i, j, d->MatrixWidget_MarkerToImageSensor->value(i, j));
     }
   }
+  this->CurrentNode->EndModify(wasModifying);
   this->MarkerTransformObserverTag = this->CurrentNode->AddObserver(vtkMRMLPinholeCameraNode::MarkerToSensorTransformModifiedEvent, this, &qMRMLPinholeCameraIntrinsicsWidget::OnNodeMarkerTransformModified);
 }
 
@@ -460,10 +464,12 @@ void qMRMLPinholeCameraIntrinsicsWidget::onCameraPlaneOffsetMatrixChanged()
   Q_D(qMRMLPinholeCameraIntrinsicsWidget);
 
   this->CurrentNode->RemoveObserver(this->CameraPlaneOffsetObserverTag);
+  double offset[3];
   for (int i = 0; i < 3; ++i)
   {
-    this->CurrentNode->SetCameraPlaneOffsetValue(i, d->MatrixWidget_CameraPlaneOffset->value(0, i));
+    offset[i] = d->MatrixWidget_CameraPlaneOffset->value(0, i);
   }
+  this->CurrentNode->SetCameraPlaneOffsetValues(offset);
   this->CameraPlaneOffsetObserverTag = this->CurrentNode->AddObserver(vtkMRMLPinholeCameraNode::CameraPlaneOffsetModifiedEvent, this, &qMRMLPinholeCameraIntrinsicsWidget::OnCameraPlaneOffsetModified);
 }
 
@@ -576,10 +582,8 @@ void qMRMLPinholeCameraIntrinsicsWidget::pasteData()
     qWarning() << "Cannot convert values to camera plane offset.";
     return;
   }
-  for (int i = 0; i < 3; ++i)
-  {
-    this->CurrentNode->SetCameraPlaneOffsetValue(i, tempArray->GetValue(i));
-  }
+  double offset[3] = { tempArray->GetValue(0), tempArray->GetValue(1), tempArray->GetValue(2) };
+  this->CurrentNode->SetCameraPlaneOffsetValues(offset);
 
 
   // Distortion Coefficients
@@ -590,11 +594,7 @@ void qMRMLPinholeCameraIntrinsicsWidget::pasteData()
     qWarning() << "Cannot convert remaining values to distortion coefficients.";
     return;
   }
-  this->CurrentNode->SetNumberOfDistortionCoefficients(tempArray->GetNumberOfValues());
-  for (vtkIdType i = 0; i < tempArray->GetNumberOfValues(); ++i)
-  {
-    this->CurrentNode->SetDistortionCoefficientValue(i, tempArray->GetValue(i));
-  }
+  this->CurrentNode->SetDistortionCoefficientValues(tempArray.GetPointer());
 }
 
 //----------------------------------------------------------------------------
@@ -119,7 +119,7 @@ void qSlicerPinholeCamerasModule::setup()
     // Register IOs
     qSlicerIOManager* ioManager = qSlicerApplication::application()->ioManager();
     ioManager->registerIO(new qSlicerPinholeCamerasReaderPlugin(videoCamerasLogic, this));
-    ioManager->registerIO(new qSlicerNodeWriter("PinholeCameras", QString("PinholeCameraFile"), QStringList() << "vtkMRMLPinholeCameraNode", false, this));
+    ioManager->registerIO(new qSlicerNodeWriter("PinholeCameras", QString("PinholeCameraFile"), QStringList() << "vtkMRMLPinholeCameraNode" << "vtkMRMLPinholeCameraRigNode", false, this));
   }
 }
 
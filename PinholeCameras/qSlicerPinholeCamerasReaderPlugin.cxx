@@ -19,6 +19,7 @@
 
 // Qt includes
 #include <QFileInfo>
+#include <QStringList>
 
 // SlicerQt includes
 #include "qSlicerPinholeCamerasReaderPlugin.h"
@@ -28,10 +29,14 @@
 
 // MRML includes
 #include "vtkMRMLPinholeCameraNode.h"
+#include "vtkMRMLPinholeCameraRigNode.h"
 #include <vtkMRMLScene.h>
 
 // VTK includes
+#include <vtkCollection.h>
+#include <vtkNew.h>
 #include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
 
 //-----------------------------------------------------------------------------
 class qSlicerPinholeCamerasReaderPluginPrivate
@@ -84,14 +89,15 @@ qSlicerIO::IOFileType qSlicerPinholeCamerasReaderPlugin::fileType()const
 QStringList qSlicerPinholeCamerasReaderPlugin::extensions()const
 {
   return QStringList()
-         << "PinholeCamera (*.xml)";
+         << "PinholeCamera (*.xml *.pcb)"
+         << "PinholeCameraRig (*.rig.xml *.rig.pcb)";
 }
 
 //-----------------------------------------------------------------------------
 bool qSlicerPinholeCamerasReaderPlugin::load(const IOProperties& properties)
 {
   Q_D(qSlicerPinholeCamerasReaderPlugin);
-  Q_ASSERT(properties.contains("fileName"));
+  Q_ASSERT(properties.contains("fileName") || properties.contains("fileNames"));
   QString fileName = properties["fileName"].toString();
 
   this->setLoadedNodes(QStringList());
@@ -99,7 +105,44 @@ bool qSlicerPinholeCamerasReaderPlugin::load(const IOProperties& properties)
   {
     return false;
   }
-  vtkMRMLPinholeCameraNode* node = d->PinholeCamerasLogic->AddPinholeCamera(fileName.toLatin1());
+
+  // A list of files or a whole directory of calibrations, as given by scripted loads, is read in parallel and added
+  // in one batch. The Add Data dialog and drag-and-drop load files one by one and never get here.
+  if (properties.contains("fileNames") || QFileInfo(fileName).isDir())
+  {
+    vtkNew<vtkCollection> loadedNodes;
+    if (properties.contains("fileNames"))
+    {
+      vtkNew<vtkStringArray> fileNames;
+      foreach (const QString& name, properties["fileNames"].toStringList())
+      {
+        fileNames->InsertNextValue(name.toLatin1().constData());
+      }
+      d->PinholeCamerasLogic->AddPinholeCameras(fileNames, loadedNodes);
+    }
+    else
+    {
+      d->PinholeCamerasLogic->AddPinholeCamerasFromDirectory(fileName.toLatin1(), loadedNodes);
+    }
+
+    QStringList loadedNodeIDs;
+    for (int i = 0; i < loadedNodes->GetNumberOfItems(); ++i)
+    {
+      loadedNodeIDs << QString(vtkMRMLNode::SafeDownCast(loadedNodes->GetItemAsObject(i))->GetID());
+    }
+    this->setLoadedNodes(loadedNodeIDs);
+    return !loadedNodeIDs.isEmpty();
+  }
+
+  vtkMRMLStorableNode* node = NULL;
+  if (fileName.endsWith(".rig.xml", Qt::CaseInsensitive) || fileName.endsWith(".rig.pcb", Qt::CaseInsensitive))
+  {
+    node = d->PinholeCamerasLogic->AddPinholeCameraRig(fileName.toLatin1());
+  }
+  else
+  {
+    node = d->PinholeCamerasLogic->AddPinholeCamera(fileName.toLatin1());
+  }
   if (!node)
   {
     return false;
@@ -45,6 +45,10 @@ public:
   virtual IOFileType fileType()const;
   virtual QStringList extensions()const;
 
+  /// Load a camera or camera rig file given by the "fileName" property.
+  /// The bulk loader of vtkSlicerPinholeCamerasLogic (parallel parsing, a single undo state) is used only when
+  /// "fileName" is a directory or a "fileNames" list is given, which scripted loads through the IO manager can do.
+  /// Drag-and-drop and the Add Data dialog call load() once per file and take the single file path.
   virtual bool load(const IOProperties& properties);
 
 protected: